@@ -124,6 +124,40 @@ function(PROTOBUF_GENERATE_CPP_INTERNAL USE_DCCL SRCS HDRS)
 endfunction()
 
 
+# PROTOBUF_GENERATE_DCCL_C (public function)
+#   Runs protoc-gen-dccl_c, which writes dependency-free C99 code
+#   (foo.dccl.h, foo.dccl.c) for the DCCL messages in foo.proto
+#   SRCS = Variable to define with the generated C sources
+#   HDRS = Variable to define with the generated C headers
+#   ARGN = proto files
+function(PROTOBUF_GENERATE_DCCL_C SRCS HDRS)
+  set(${SRCS})
+  set(${HDRS})
+  foreach(FIL ${ARGN})
+    get_filename_component(ABS_FIL ${FIL} ABSOLUTE)
+    get_filename_component(FIL_WE ${FIL} NAME_WE)
+    file(RELATIVE_PATH REL_FIL ${dccl_SRC_DIR} ${ABS_FIL})
+    set(ABS_BUILT_FIL "${dccl_INC_DIR}/dccl/${REL_FIL}")
+    get_filename_component(FIL_PATH ${ABS_BUILT_FIL} PATH)
+
+    list(APPEND ${SRCS} "${FIL_PATH}/${FIL_WE}.dccl.c")
+    list(APPEND ${HDRS} "${FIL_PATH}/${FIL_WE}.dccl.h")
+
+    add_custom_command(
+      OUTPUT "${FIL_PATH}/${FIL_WE}.dccl.c"
+             "${FIL_PATH}/${FIL_WE}.dccl.h"
+      COMMAND  ${PROTOBUF_PROTOC_EXECUTABLE}
+      ARGS --dccl_c_out ${dccl_INC_DIR} --plugin protoc-gen-dccl_c=${dccl_EXEC_DIR}/protoc-gen-dccl_c --proto_path ${dccl_INC_DIR} ${dccl_INC_DIR}/dccl/${REL_FIL} -I ${PROTOBUF_INCLUDE_DIRS} -I ${dccl_INC_DIR}
+      DEPENDS ${ABS_FIL} protoc-gen-dccl_c
+      COMMENT "Running DCCL C generator on ${FIL}"
+      VERBATIM )
+  endforeach()
+
+  set_source_files_properties(${${SRCS}} ${${HDRS}} PROPERTIES GENERATED TRUE)
+  set(${SRCS} ${${SRCS}} PARENT_SCOPE)
+  set(${HDRS} ${${HDRS}} PARENT_SCOPE)
+endfunction()
+
 find_path(PROTOBUF_INCLUDE_DIR google/protobuf/service.h)
 
 # Support preference of static libs by adjusting CMAKE_FIND_LIBRARY_SUFFIXES
@@ -0,0 +1,277 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+#include <time.h>
+
+#include "dccl/message_generator.h"
+
+#include "benchmark.h"
+
+using google::protobuf::Descriptor;
+using google::protobuf::Message;
+
+namespace
+{
+    // only counted while measuring, as the tool's other modes may allocate from several threads
+    bool count_allocations = false;
+    unsigned long allocations = 0;
+}
+
+// counts heap allocations for benchmark()
+#if __cplusplus >= 201103L
+void* operator new(std::size_t size)
+#else
+void* operator new(std::size_t size) throw(std::bad_alloc)
+#endif
+{
+    if(count_allocations)
+        ++allocations;
+    void* p = std::malloc(size ? size : 1);
+    if(!p)
+        throw(std::bad_alloc());
+    return p;
+}
+
+#if __cplusplus >= 201103L
+void operator delete(void* p) noexcept
+#else
+void operator delete(void* p) throw()
+#endif
+{
+    std::free(p);
+}
+
+namespace
+{
+    typedef std::vector<boost::shared_ptr<Message> > Messages;
+    
+    // throughput is measured over at least this long for each operation
+    const double MIN_SECONDS = 0.5;
+    const std::size_t MIN_LATENCY_SAMPLES = 10000;
+
+    double now()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+    
+    // one of the Codec calls, on the i-th message
+    class Operation
+    {
+      public:
+        Operation(dccl::Codec& codec, const Messages& msgs, const std::vector<std::string>& encoded)
+            : codec_(codec), msgs_(msgs), encoded_(encoded)
+            { }
+        virtual ~Operation() { }
+        
+        virtual void run(std::size_t i) = 0;
+        
+      protected:
+        dccl::Codec& codec_;
+        const Messages& msgs_;
+        const std::vector<std::string>& encoded_;
+    };
+
+    class Encode : public Operation
+    {
+      public:
+        Encode(dccl::Codec& codec, const Messages& msgs, const std::vector<std::string>& encoded)
+            : Operation(codec, msgs, encoded)
+            { }
+        void run(std::size_t i)
+        {
+            bytes_.clear();
+            codec_.encode(&bytes_, *msgs_[i]);
+        }
+      private:
+        std::string bytes_;
+    };
+
+    class Decode : public Operation
+    {
+      public:
+        Decode(dccl::Codec& codec, const Messages& msgs, const std::vector<std::string>& encoded)
+            : Operation(codec, msgs, encoded),
+              msg_(msgs[0]->New())
+            { }
+        void run(std::size_t i)
+        {
+            msg_->Clear();
+            codec_.decode(encoded_[i], msg_.get());
+        }
+      private:
+        boost::shared_ptr<Message> msg_;
+    };
+
+    class Size : public Operation
+    {
+      public:
+        Size(dccl::Codec& codec, const Messages& msgs, const std::vector<std::string>& encoded)
+            : Operation(codec, msgs, encoded)
+            { }
+        void run(std::size_t i)
+        { codec_.size(*msgs_[i]); }
+    };
+
+    class Id : public Operation
+    {
+      public:
+        Id(dccl::Codec& codec, const Messages& msgs, const std::vector<std::string>& encoded)
+            : Operation(codec, msgs, encoded)
+            { }
+        void run(std::size_t i)
+        { codec_.id(encoded_[i]); }
+    };
+
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        return sorted[std::min<std::size_t>(sorted.size() - 1, p * sorted.size())];
+    }
+    
+    void measure(const std::string& name, Operation* op, std::size_t n, std::ostream* os)
+    {
+        // throughput and allocations, over as many passes through the messages as fit in MIN_SECONDS
+        std::size_t ops = 0;
+        const unsigned long start_allocations = allocations;
+        count_allocations = true;
+        const double start = now();
+        double elapsed = 0;
+        do
+        {
+            for(std::size_t i = 0; i < n; ++i)
+                op->run(i);
+            ops += n;
+            elapsed = now() - start;
+        }
+        while(elapsed < MIN_SECONDS);
+        count_allocations = false;
+        const double allocations_per_op = double(allocations - start_allocations) / ops;
+
+        // latency of each call
+        std::vector<double> latency(std::max(n, MIN_LATENCY_SAMPLES));
+        for(std::size_t i = 0, m = latency.size(); i < m; ++i)
+        {
+            const double op_start = now();
+            op->run(i % n);
+            latency[i] = (now() - op_start) * 1e9;
+        }
+        std::sort(latency.begin(), latency.end());
+
+        *os << "  " << std::left << std::setw(10) << name << std::right << std::fixed
+            << std::setprecision(0)
+            << std::setw(12) << ops / elapsed
+            << std::setw(10) << elapsed * 1e9 / ops
+            << std::setw(10) << percentile(latency, 0.5)
+            << std::setw(10) << percentile(latency, 0.9)
+            << std::setw(10) << percentile(latency, 0.99)
+            << std::setw(10) << percentile(latency, 0.999)
+            << std::setprecision(1)
+            << std::setw(11) << allocations_per_op << std::endl;
+        os->unsetf(std::ios::floatfield);
+        *os << std::setprecision(6);
+    }
+}
+
+void dccl::tool::random_messages(Codec& codec, const Descriptor* desc, std::size_t count, Messages* msgs)
+{
+    // default seed, so the messages are the same on every run
+    MessageGenerator generator;
+    std::string encoded;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        boost::shared_ptr<Message> msg = generator.generate(desc);
+        try
+        {
+            encoded.clear();
+            codec.encode(&encoded, *msg);
+            msgs->push_back(msg);
+        }
+        catch(std::exception&)
+        {
+        }
+    }
+}
+
+void dccl::tool::benchmark(Codec& codec, const Messages& all_msgs, std::ostream* os)
+{
+    // decode and id are measured on the encoded messages
+    Messages msgs;
+    std::vector<std::string> encoded;
+    std::size_t total_bytes = 0, max_bytes = 0;
+    for(std::size_t i = 0, n = all_msgs.size(); i < n; ++i)
+    {
+        std::string bytes;
+        try
+        {
+            codec.encode(&bytes, *all_msgs[i]);
+        }
+        catch(std::exception&)
+        {
+            continue;
+        }
+        msgs.push_back(all_msgs[i]);
+        encoded.push_back(bytes);
+        total_bytes += bytes.size();
+        max_bytes = std::max(max_bytes, bytes.size());
+    }
+    
+    if(all_msgs.empty())
+        return;
+    
+    const Descriptor* desc = all_msgs[0]->GetDescriptor();
+    *os << desc->full_name() << ": " << msgs.size() << " messages";
+    if(msgs.size() < all_msgs.size())
+        *os << " (" << all_msgs.size() - msgs.size() << " skipped as they failed to encode)";
+    if(msgs.empty())
+    {
+        *os << std::endl;
+        return;
+    }
+    
+    *os << ", " << std::fixed << std::setprecision(1) << double(total_bytes) / msgs.size() << " bytes mean encoded size ("
+        << max_bytes << " max, " << codec.max_size(desc) << " max_size())" << std::endl;
+    os->unsetf(std::ios::floatfield);
+    *os << std::setprecision(6);
+    
+    *os << "  " << std::left << std::setw(10) << "operation" << std::right
+        << std::setw(12) << "ops/s"
+        << std::setw(10) << "mean ns"
+        << std::setw(10) << "p50 ns"
+        << std::setw(10) << "p90 ns"
+        << std::setw(10) << "p99 ns"
+        << std::setw(10) << "p99.9 ns"
+        << std::setw(11) << "allocs/op" << std::endl;
+
+    Encode encode(codec, msgs, encoded);
+    measure("encode", &encode, msgs.size(), os);
+    Decode decode(codec, msgs, encoded);
+    measure("decode", &decode, msgs.size(), os);
+    Size size(codec, msgs, encoded);
+    measure("size", &size, msgs.size(), os);
+    Id id(codec, msgs, encoded);
+    measure("id", &id, msgs.size(), os);
+}
@@ -0,0 +1,55 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLTOOLBENCHMARK20261019H
+#define DCCLTOOLBENCHMARK20261019H
+
+#include <ostream>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "dccl/codec.h"
+
+namespace dccl
+{
+    namespace tool
+    {
+        /// \brief Generate random instances of a message loaded into `codec` (see MessageGenerator)
+        ///
+        /// Instances that `codec` fails to encode (e.g. because a custom field codec has constraints that are not known to MessageGenerator) are skipped.
+        /// \param codec Codec the message is loaded into
+        /// \param desc Message type
+        /// \param count Number of instances to try to generate
+        /// \param msgs Instances that encode successfully are appended to this
+        void random_messages(Codec& codec, const google::protobuf::Descriptor* desc, std::size_t count,
+                             std::vector<boost::shared_ptr<google::protobuf::Message> >* msgs);
+
+        /// \brief Measure the throughput, latency and heap allocations of Codec::encode(), decode(), size() and id() for a set of messages
+        ///
+        /// \param codec Codec the message type is loaded into
+        /// \param msgs Messages to measure, all of the same type. Any that fail to encode are skipped.
+        /// \param os Stream to write the results to
+        void benchmark(Codec& codec, const std::vector<boost::shared_ptr<google::protobuf::Message> >& msgs, std::ostream* os);
+    }
+}
+
+#endif
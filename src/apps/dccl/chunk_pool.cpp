@@ -0,0 +1,159 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <stdexcept>
+
+#include "chunk_pool.h"
+
+dccl::tool::ChunkPool::ChunkPool(ChunkProcessor& processor, OutputStream& out, unsigned threads)
+    : processor_(processor),
+      out_(out),
+      max_chunks_(threads ? 2 * threads : 1),
+      workers_(threads),
+      threads_(threads),
+      stop_(false)
+{
+    pthread_mutex_init(&mutex_, 0);
+    pthread_cond_init(&cond_, 0);
+
+    for(unsigned i = 0; i < threads; ++i)
+    {
+        workers_[i].pool = this;
+        workers_[i].index = i;
+        pthread_create(&threads_[i], 0, run_worker, &workers_[i]);
+    }
+}
+
+dccl::tool::ChunkPool::~ChunkPool()
+{
+    pthread_mutex_lock(&mutex_);
+    stop_ = true;
+    pending_.clear();
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&mutex_);
+
+    for(std::size_t i = 0, n = threads_.size(); i < n; ++i)
+        pthread_join(threads_[i], 0);
+
+    for(std::deque<Chunk*>::iterator it = chunks_.begin(), end = chunks_.end(); it != end; ++it)
+        delete *it;
+    
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+void dccl::tool::ChunkPool::submit(std::string* input)
+{
+    while(chunks_.size() >= max_chunks_)
+        write_front();
+
+    Chunk* chunk = new Chunk;
+    chunk->input.swap(*input);
+    chunks_.push_back(chunk);
+
+    if(threads_.empty())
+    {
+        process(0, chunk);
+        chunk->done = true;
+        write_front();
+    }
+    else
+    {
+        pthread_mutex_lock(&mutex_);
+        pending_.push_back(chunk);
+        pthread_cond_signal(&cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+}
+
+void dccl::tool::ChunkPool::finish()
+{
+    while(!chunks_.empty())
+        write_front();
+}
+
+void* dccl::tool::ChunkPool::run_worker(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    ChunkPool* pool = worker->pool;
+    pthread_mutex_lock(&pool->mutex_);
+    while(true)
+    {
+        while(pool->pending_.empty() && !pool->stop_)
+            pthread_cond_wait(&pool->cond_, &pool->mutex_);
+        if(pool->stop_)
+            break;
+
+        Chunk* chunk = pool->pending_.front();
+        pool->pending_.pop_front();
+        pthread_mutex_unlock(&pool->mutex_);
+
+        pool->process(worker->index, chunk);
+
+        pthread_mutex_lock(&pool->mutex_);
+        chunk->done = true;
+        pthread_cond_broadcast(&pool->cond_);
+    }
+    pthread_mutex_unlock(&pool->mutex_);
+    return 0;
+}
+
+void dccl::tool::ChunkPool::process(int worker, Chunk* chunk)
+{
+    try
+    {
+        processor_.process(worker, chunk->input, &chunk->output);
+    }
+    catch(std::exception& e)
+    {
+        chunk->failed = true;
+        chunk->error = e.what();
+    }
+    // no longer needed
+    std::string().swap(chunk->input);
+}
+
+void dccl::tool::ChunkPool::write_front()
+{
+    Chunk* chunk = chunks_.front();
+    pthread_mutex_lock(&mutex_);
+    while(!chunk->done)
+        pthread_cond_wait(&cond_, &mutex_);
+    pthread_mutex_unlock(&mutex_);
+    chunks_.pop_front();
+
+    const bool failed = chunk->failed;
+    std::string error;
+    error.swap(chunk->error);
+    try
+    {
+        out_.write(chunk->output);
+    }
+    catch(...)
+    {
+        delete chunk;
+        throw;
+    }
+    delete chunk;
+    
+    if(failed)
+        throw(std::runtime_error(error));
+}
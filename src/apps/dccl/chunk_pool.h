@@ -0,0 +1,116 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLTOOLCHUNKPOOL20261019H
+#define DCCLTOOLCHUNKPOOL20261019H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include "stream_io.h"
+
+namespace dccl
+{
+    namespace tool
+    {
+        /// \brief Turns one chunk of input into the corresponding output (e.g. lines of TextFormat into encoded messages)
+        class ChunkProcessor
+        {
+          public:
+            virtual ~ChunkProcessor() { }
+
+            /// \brief Called concurrently from the worker threads of a ChunkPool
+            ///
+            /// \param worker Index of the calling worker (0 to threads-1), for keeping per-thread state such as a Codec
+            /// \param input Chunk of input, as given to ChunkPool::submit()
+            /// \param output Output to append to
+            virtual void process(int worker, const std::string& input, std::string* output) = 0;
+        };
+
+        /// \brief Processes chunks of input on a pool of worker threads, writing their output in the order the chunks were submitted
+        ///
+        /// An exception thrown by ChunkProcessor::process() is rethrown (as std::runtime_error) by the submit() or finish() call that writes that chunk, after the output the chunk produced before the exception has been written.
+        class ChunkPool
+        {
+          public:
+            /// \param threads Number of worker threads. With 0, each chunk is processed (as worker 0) and written by submit() on the calling thread.
+            ChunkPool(ChunkProcessor& processor, OutputStream& out, unsigned threads);
+            /// \brief Stops the workers, discarding the output of any chunks not yet written
+            ~ChunkPool();
+            
+            /// \brief Queue a chunk of input for processing
+            ///
+            /// Blocks while too many chunks are in progress, writing the oldest as they finish.
+            /// \param input Chunk of input, which is swapped out (leaving input empty)
+            void submit(std::string* input);
+
+            /// \brief Wait for all the submitted chunks and write their output
+            void finish();
+            
+          private:
+            ChunkPool(const ChunkPool&);
+            ChunkPool& operator=(const ChunkPool&);
+            
+            struct Chunk
+            {
+                Chunk() : failed(false), done(false) { }
+                std::string input;
+                std::string output;
+                // set if processing threw, with its what()
+                bool failed;
+                std::string error;
+                bool done;
+            };
+
+            struct Worker
+            {
+                ChunkPool* pool;
+                int index;
+            };
+            
+            static void* run_worker(void* arg);
+            void process(int worker, Chunk* chunk);
+            // waits for the oldest chunk and writes it
+            void write_front();
+            
+          private:
+            ChunkProcessor& processor_;
+            OutputStream& out_;
+            std::size_t max_chunks_;
+
+            pthread_mutex_t mutex_;
+            pthread_cond_t cond_;
+            std::vector<Worker> workers_;
+            std::vector<pthread_t> threads_;
+
+            // in the order submitted (owned)
+            std::deque<Chunk*> chunks_;
+            // submitted but not yet picked up by a worker
+            std::deque<Chunk*> pending_;
+            bool stop_;
+        };
+    }
+}
+
+#endif
@@ -28,6 +28,7 @@
 
 #include <sstream>
 #include <fstream>
+#include <algorithm>
 
 
 #include <google/protobuf/descriptor.h>
@@ -35,20 +36,27 @@
 #include <google/protobuf/descriptor.pb.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include "dccl/codec.h"
 #include "dccl/cli_option.h"
 #include "dccl/binary.h"
+#include "dccl/message_generator.h"
 
 #include "dccl_tool.pb.h"
 #include "dccl/version.h"
+#include "stream_io.h"
+#include "chunk_pool.h"
+#include "benchmark.h"
 
 // for realpath
 #include <limits.h>
 #include <stdlib.h>
+// for STDIN_FILENO, STDOUT_FILENO
+#include <unistd.h>
 
 
-enum Action { NO_ACTION, ENCODE, DECODE, ANALYZE, DISP_PROTO };
+enum Action { NO_ACTION, ENCODE, DECODE, ANALYZE, DISP_PROTO, BENCHMARK, GENERATE };
 enum Format { BINARY, TEXTFORMAT, HEX, BASE64 };
 
 namespace dccl
@@ -63,7 +71,13 @@ namespace dccl
                   format(BINARY),
                   id_codec(dccl::Codec::default_id_codec_name()),
                   verbose(false),
-                  omit_prefix(false)
+                  omit_prefix(false),
+                  threads(1),
+                  count(1),
+                  max_size(false),
+                  presence(0.5),
+                  seed(dccl::MessageGenerator::DEFAULT_SEED),
+                  time_base(-1)
                 { }
     
             Action action;
@@ -75,6 +89,14 @@ namespace dccl
             std::string id_codec;
             bool verbose;
             bool omit_prefix;
+            unsigned threads;
+            std::string corpus;
+            unsigned long count;
+            bool max_size;
+            double presence;
+            unsigned seed;
+            // seconds since the UNIX epoch, or negative for now
+            double time_base;
         };
     }
 }
@@ -84,9 +106,13 @@ void analyze(dccl::Codec& dccl, const dccl::tool::Config& cfg);
 void encode(dccl::Codec& dccl, dccl::tool::Config& cfg);
 void decode(dccl::Codec& dccl, const dccl::tool::Config& cfg);
 void disp_proto(dccl::Codec& dccl, const dccl::tool::Config& cfg);
+void benchmark(dccl::Codec& dccl, dccl::tool::Config& cfg);
+void generate(dccl::Codec& dccl, const dccl::tool::Config& cfg);
 
         
 void load_desc(dccl::Codec* dccl,  const google::protobuf::Descriptor* desc, const std::string& name);
+std::string find_adaptive(const dccl::Codec& dccl);
+bool has_fixed_size(const dccl::Codec& dccl);
 void parse_options(int argc, char* argv[], dccl::tool::Config* cfg);
 
 
@@ -158,12 +184,29 @@ int main(int argc, char* argv[])
             load_desc(&dccl, desc, *it);
         }
 
+        // the models change with every message coded, so the messages cannot be split between threads
+        const std::string adaptive = (cfg.threads > 1) ? find_adaptive(dccl) : std::string();
+        if(!adaptive.empty())
+        {
+            std::cerr << "Using one thread, as " << adaptive << " is coded with adaptive models, which must see the messages one at a time, in order." << std::endl;
+            cfg.threads = 1;
+        }
+
+        // the reading thread has to decode each variable length message to find its end, so the workers would only repeat that work
+        if(cfg.action == DECODE && cfg.threads > 1 && !has_fixed_size(dccl))
+        {
+            std::cerr << "Using one thread, as none of the messages loaded has a fixed size, so each must be decoded to find where the next begins." << std::endl;
+            cfg.threads = 1;
+        }
+
         switch(cfg.action)
         {
             case ENCODE: encode(dccl, cfg); break;
             case DECODE: decode(dccl, cfg); break;
             case ANALYZE: analyze(dccl, cfg); break;
             case DISP_PROTO: disp_proto(dccl, cfg); break;
+            case BENCHMARK: benchmark(dccl, cfg); break;
+            case GENERATE: generate(dccl, cfg); break;
             default:
                 std::cerr << "No action specified (e.g. analyze, decode, encode). Try --help." << std::endl;
                 exit(EXIT_SUCCESS);
@@ -179,186 +222,630 @@ void analyze(dccl::Codec& dccl, const dccl::tool::Config& cfg)
     dccl.info_all(&std::cout);
 }
 
-void encode(dccl::Codec& dccl, dccl::tool::Config& cfg)
+namespace
 {
-    if(cfg.message.size() > 1)
+    // input is handed to the workers in chunks of about this many bytes
+    const std::size_t CHUNK_BYTES = 1 << 18;
+    
+    typedef std::map<std::string, boost::shared_ptr<google::protobuf::Message> > MessageCache;
+
+    unsigned pool_threads(const dccl::tool::Config& cfg)
+    { return cfg.threads > 1 ? cfg.threads : 0; }
+    
+    // A Codec for each worker of a ChunkPool (which cannot share a Codec), with the same messages loaded as the main Codec
+    class WorkerCodecs
     {
-        std::cerr << "No more than one DCCL message can be specified with -m or --message for encoding." << std::endl;
+      public:
+        WorkerCodecs(dccl::Codec& dccl, const dccl::tool::Config& cfg)
+            : main_(dccl)
+        {
+            for(unsigned i = 0, n = pool_threads(cfg); i < n; ++i)
+                codecs_.push_back(boost::shared_ptr<dccl::Codec>(new dccl::Codec(cfg.id_codec)));
+            for(std::map<dccl::int32, const google::protobuf::Descriptor*>::const_iterator it = dccl.loaded().begin(), end = dccl.loaded().end(); it != end; ++it)
+                load(it->second);
+        }
+
+        // with no worker threads, the one worker runs on the main thread and uses the main Codec
+        std::size_t size() const { return codecs_.empty() ? 1 : codecs_.size(); }
+        dccl::Codec& operator[](int worker) { return codecs_.empty() ? main_ : *codecs_[worker]; }
+        
+        // loads a message that has been loaded into the main Codec
+        void load(const google::protobuf::Descriptor* desc)
+        {
+            if(codecs_.empty())
+                return;
+
+            // the main Codec has already given any warnings about this message (and --verbose is not used with worker threads)
+            dccl::dlog.disconnect(dccl::logger::WARN_PLUS);
+            for(std::vector<boost::shared_ptr<dccl::Codec> >::iterator it = codecs_.begin(), end = codecs_.end(); it != end; ++it)
+            {
+                // any error was reported when loading into the main Codec
+                try { (*it)->load(desc); }
+                catch(std::exception&) { }
+            }
+            dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+        }
+        
+      private:
+        dccl::Codec& main_;
+        std::vector<boost::shared_ptr<dccl::Codec> > codecs_;
+    };
+
+    // writes everything encoded or decoded so far (including the chunk being filled) before exiting
+    void exit_failure(dccl::tool::ChunkPool* pool, std::string* chunk, dccl::tool::OutputStream* out, const std::string& message)
+    {
+        if(!chunk->empty())
+            pool->submit(chunk);
+        pool->finish();
+        out->flush();
+        std::cerr << message << std::endl;
         exit(EXIT_FAILURE);
     }
-    else if(cfg.message.size() == 0)
+    
+    void append_encoded(const std::string& encoded, Format format, std::string* output)
     {
-        std::cerr << "You must specify a DCCL message to encode with -m" << std::endl;
-        exit(EXIT_FAILURE);
+        switch(format)
+        {
+            default:
+            case BINARY:                    
+                *output += encoded;
+                break;
+                
+            case TEXTFORMAT:
+            {
+                dccl::tool::protobuf::ByteString s;
+                s.set_b(encoded);
+                std::string text;
+                google::protobuf::TextFormat::PrintFieldValueToString(s, s.GetDescriptor()->FindFieldByNumber(1), -1, &text);
+                *output += text + "\n";
+                break;
+            }
+                
+            case HEX:
+                *output += dccl::hex_encode(encoded) + "\n";
+                break;
+                
+            case BASE64:
+            {
+#if DCCL_HAS_B64
+                std::stringstream instream(encoded);
+                std::stringstream outstream;
+                ::base64::encoder D;
+                D.encode(instream, outstream);
+                *output += outstream.str();
+#endif
+                break;
+            }
+        }
     }
+
+    // encodes lines of "|Name|TextFormat"
+    class Encoder : public dccl::tool::ChunkProcessor
+    {
+      public:
+        Encoder(WorkerCodecs& codecs, Format format)
+            : codecs_(codecs),
+              format_(format),
+              msgs_(codecs.size())
+            { }
+        
+        void process(int worker, const std::string& input, std::string* output)
+        {
+            dccl::Codec& dccl = codecs_[worker];
+            MessageCache& msgs = msgs_[worker];
+            std::string encoded;
+            for(std::string::size_type pos = 0, n = input.size(); pos < n;)
+            {
+                std::string::size_type name_end = input.find('|', pos + 1);
+                std::string::size_type line_end = input.find('\n', name_end);
+                
+                boost::shared_ptr<google::protobuf::Message>& msg = msgs[input.substr(pos + 1, name_end - pos - 1)];
+                if(!msg)
+                    msg = dccl::DynamicProtobufManager::new_protobuf_message(input.substr(pos + 1, name_end - pos - 1));
+                google::protobuf::TextFormat::ParseFromString(input.substr(name_end + 1, line_end - name_end - 1), msg.get());
+                pos = line_end + 1;
+                
+                if(msg->IsInitialized())
+                {
+                    encoded.clear();
+                    dccl.encode(&encoded, *msg);
+                    append_encoded(encoded, format_, output);
+                }
+            }
+        }
+        
+      private:
+        WorkerCodecs& codecs_;
+        Format format_;
+        // for each worker, one message of each type reused for every line
+        std::vector<MessageCache> msgs_;
+    };
+
+    // decodes the message at begin (which must be followed by the whole message, or the end of the input) and appends it to output, returning the end of the message
+    const char* decode_message(dccl::Codec& dccl, const char* begin, const char* end, bool omit_prefix,
+                               MessageCache* msgs, std::string* output)
+    {
+        unsigned id = dccl.id(begin, end);
+        std::map<dccl::int32, const google::protobuf::Descriptor*>::const_iterator it = dccl.loaded().find(id);
+        if(it == dccl.loaded().end())
+            throw(dccl::Exception("Message id " + boost::lexical_cast<std::string>(id) + " has not been loaded. Call load() before decoding this type."));
+
+        boost::shared_ptr<google::protobuf::Message>& msg = (*msgs)[it->second->full_name()];
+        if(!msg)
+            msg = dccl::DynamicProtobufManager::new_protobuf_message(it->second);
+        else
+            msg->Clear();
     
-    std::string command_line_name = *cfg.message.begin();
+        const char* next = dccl.decode(begin, end, msg.get());
+        if(!omit_prefix)
+            *output += "|" + msg->GetDescriptor()->full_name() + "| ";
+        *output += msg->ShortDebugString() + "\n";
+        return next;
+    }
     
-    while(!std::cin.eof())
+    // decodes whole encoded messages
+    class Decoder : public dccl::tool::ChunkProcessor
     {
-        std::string input;
-        std::getline (std::cin, input);
-
-        boost::trim(input);
-        if(input.empty())
-            continue;
+      public:
+        Decoder(WorkerCodecs& codecs, bool omit_prefix)
+            : codecs_(codecs),
+              omit_prefix_(omit_prefix),
+              msgs_(codecs.size())
+            { }
+        
+        void process(int worker, const std::string& input, std::string* output)
+        {
+            const char* begin = input.data();
+            const char* end = begin + input.size();
+            while(begin != end)
+                begin = decode_message(codecs_[worker], begin, end, omit_prefix_, &msgs_[worker], output);
+        }
+        
+      private:
+        WorkerCodecs& codecs_;
+        bool omit_prefix_;
+        std::vector<MessageCache> msgs_;
+    };
 
-        std::string name;
-        if(input[0] == '|')
+    // Splits a stream of encoded messages into chunks of whole messages for the workers.
+    //
+    // With no worker threads, each message is decoded and written as it is split off instead, as finding the end of a variable length message means decoding it anyway.
+    class Splitter
+    {
+      public:
+        Splitter(dccl::Codec& dccl, const dccl::tool::Config& cfg,
+                 dccl::tool::ChunkPool& pool, dccl::tool::OutputStream& out)
+            : dccl_(dccl),
+              omit_prefix_(cfg.omit_prefix),
+              threaded_(pool_threads(cfg) > 0),
+              pool_(pool),
+              out_(out),
+              max_bytes_(1)
         {
-            std::string::size_type close_bracket_pos = input.find('|', 1);
-            if(close_bracket_pos == std::string::npos)
+            for(std::map<dccl::int32, const google::protobuf::Descriptor*>::const_iterator it = dccl.loaded().begin(), end = dccl.loaded().end(); it != end; ++it)
             {
-                std::cerr << "Incorrectly formatted input: expected '|'" << std::endl;
-                exit(EXIT_FAILURE);
+                max_bytes_ = std::max<std::size_t>(max_bytes_, dccl.max_size(it->second));
+
+                // min_size() and max_size() allow for any identifier, so check the head and body alone and size them with this type's identifier
+                boost::shared_ptr<dccl::FieldCodecBase> codec = dccl::FieldCodecManager::find(it->second);
+                unsigned head_min = 0, head_max = 0, body_min = 0, body_max = 0;
+                codec->base_min_size(&head_min, it->second, dccl::HEAD);
+                codec->base_max_size(&head_max, it->second, dccl::HEAD);
+                codec->base_min_size(&body_min, it->second, dccl::BODY);
+                codec->base_max_size(&body_max, it->second, dccl::BODY);
+                if(head_min == head_max && body_min == body_max)
+                {
+                    const dccl::MessageLayout& layout = dccl.layout(it->second);
+                    fixed_size_[it->first] = layout.body_byte_offset() + dccl::ceil_bits2bytes(layout.body_bits());
+                }
             }
+        }
 
-            name = input.substr(1, close_bracket_pos-1);
-            if(cfg.message.find(name) == cfg.message.end())
+        // no message is longer than this, so this many bytes always hold the whole of the next message
+        std::size_t max_bytes() const { return max_bytes_; }
+
+        // true if [begin, end) is known to hold the whole of the message at begin, so that it can be split off without waiting for more input
+        bool complete(const char* begin, const char* end)
+        {
+            const std::size_t size = end - begin;
+            if(size >= max_bytes_)
+                return true;
+            try
             {
-                const google::protobuf::Descriptor* desc = 
-                    dccl::DynamicProtobufManager::find_descriptor(name);
-                load_desc(&dccl, desc, name);
-                cfg.message.insert(name);
+                // Codec::id() may read past end, so decode it from a zero padded copy. If this cuts the ID short, the message it gives is longer than the bytes we have.
+                head_.assign(begin, end);
+                head_.resize(max_bytes_, 0);
+                std::map<unsigned, std::size_t>::const_iterator it = fixed_size_.find(dccl_.id(head_));
+                return it != fixed_size_.end() && size >= it->second;
+            }
+            catch(std::exception&)
+            {
+                return false;
             }
-            
-            
-            if(input.size() > close_bracket_pos+1)
-                input = input.substr(close_bracket_pos+1);
-            else
-                input.clear();
         }
-        else
+
+        // splits off the message at begin (which must be followed by the whole message, or the end of the input), returning its end
+        const char* split(const char* begin, const char* end)
         {
-            if(cfg.message.size() == 0)
+            if(!threaded_)
             {
-                std::cerr << "Message name not given with -m or in the input (i.e. '[Name] field1: value field2: value')." << std::endl;
-                exit(EXIT_FAILURE);
+                output_.clear();
+                const char* next = decode_message(dccl_, begin, end, omit_prefix_, &msgs_, &output_);
+                out_.write(output_);
+                return next;
             }
-                
-            name = command_line_name;
+
+            const char* next = message_end(begin, end);
+            chunk_.append(begin, next);
+            if(chunk_.size() >= CHUNK_BYTES)
+                pool_.submit(&chunk_);
+            return next;
+        }
+
+        // submits the last chunk
+        void flush()
+        {
+            if(!chunk_.empty())
+                pool_.submit(&chunk_);
         }
         
-        const google::protobuf::Descriptor* desc = dccl::DynamicProtobufManager::find_descriptor(name);
-        if(desc == 0)
+      private:
+        // If the message cannot be decoded, this returns end, leaving the worker decoding it to report the error in order with the output.
+        const char* message_end(const char* begin, const char* end)
         {
-            std::cerr << "No descriptor with name " << name << " found! Make sure you have loaded all the necessary .proto files and/or shared libraries. Also make sure you specified the fully qualified name including the package, if any (e.g. 'goby.acomms.protobuf.NetworkAck', not just 'NetworkAck')." << std::endl;
-            exit(EXIT_FAILURE);
+            try
+            {
+                unsigned id = dccl_.id(begin, end);
+                std::map<unsigned, std::size_t>::const_iterator it = fixed_size_.find(id);
+                if(it != fixed_size_.end())
+                    return begin + std::min<std::size_t>(it->second, end - begin);
+
+                // variable length, so it has to be decoded to find the end (the worker formats it)
+                std::map<dccl::int32, const google::protobuf::Descriptor*>::const_iterator desc_it = dccl_.loaded().find(id);
+                if(desc_it == dccl_.loaded().end())
+                    return end;
+                boost::shared_ptr<google::protobuf::Message>& msg = msgs_[desc_it->second->full_name()];
+                if(!msg)
+                    msg = dccl::DynamicProtobufManager::new_protobuf_message(desc_it->second);
+                else
+                    msg->Clear();
+                return dccl_.decode(begin, end, msg.get());
+            }
+            catch(std::exception&)
+            {
+                return end;
+            }
         }
         
+      private:
+        dccl::Codec& dccl_;
+        bool omit_prefix_;
+        bool threaded_;
+        dccl::tool::ChunkPool& pool_;
+        dccl::tool::OutputStream& out_;
         
-        boost::shared_ptr<google::protobuf::Message> msg = dccl::DynamicProtobufManager::new_protobuf_message(desc);
-        google::protobuf::TextFormat::ParseFromString(input, msg.get());
+        std::size_t max_bytes_;
+        std::map<unsigned, std::size_t> fixed_size_;
+        
+        MessageCache msgs_;
+        std::string output_;
+        std::string chunk_;
+        std::string head_;
+    };
+}
 
-        if(msg->IsInitialized())
+void encode(dccl::Codec& dccl, dccl::tool::Config& cfg)
+{
+    if(cfg.message.size() > 1)
+    {
+        std::cerr << "No more than one DCCL message can be specified with -m or --message for encoding." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    else if(cfg.message.size() == 0)
+    {
+        std::cerr << "You must specify a DCCL message to encode with -m" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+#if !DCCL_HAS_B64
+    if(cfg.format == BASE64)
+    {
+        std::cerr << "dccl was not compiled with libb64-dev, so no Base64 functionality is available." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+#endif
+    
+    std::string command_line_name = *cfg.message.begin();
+
+    WorkerCodecs codecs(dccl, cfg);
+    Encoder encoder(codecs, cfg.format);
+    
+    dccl::tool::OutputStream out(STDOUT_FILENO);
+    dccl::tool::InputStream in(STDIN_FILENO, &out);
+    boost::scoped_ptr<dccl::tool::ChunkPool> pool(new dccl::tool::ChunkPool(encoder, out, pool_threads(cfg)));
+
+    // lines for the next chunk, as "|Name|TextFormat"
+    std::string chunk;
+    std::string input;
+    try
+    {
+        while(in.getline(&input))
         {
-            std::string encoded;
-            dccl.encode(&encoded, *msg);
-            switch(cfg.format)
+            boost::trim(input);
+            if(input.empty())
+                continue;
+
+            std::string name;
+            if(input[0] == '|')
             {
-                default:
-                case BINARY:                    
-                {    
-                    std::ofstream fout("/dev/stdout", std::ios::binary | std::ios::app);
-                    fout.write(encoded.data(), encoded.size()); 
-                    break;
-                }
-                
-                case TEXTFORMAT:
+                std::string::size_type close_bracket_pos = input.find('|', 1);
+                if(close_bracket_pos == std::string::npos)
+                    exit_failure(pool.get(), &chunk, &out, "Incorrectly formatted input: expected '|'");
+
+                name = input.substr(1, close_bracket_pos-1);
+                if(cfg.message.find(name) == cfg.message.end())
                 {
+                    // the workers' Codecs cannot be changed while they are in use
+                    pool->finish();
+                    out.flush();
                     
-                    dccl::tool::protobuf::ByteString s;
-                    s.set_b(encoded);
-                    std::string output;
-                    google::protobuf::TextFormat::PrintFieldValueToString(s, s.GetDescriptor()->FindFieldByNumber(1), -1, &output);
+                    const google::protobuf::Descriptor* desc = 
+                        dccl::DynamicProtobufManager::find_descriptor(name);
+                    load_desc(&dccl, desc, name);
+                    codecs.load(desc);
+                    cfg.message.insert(name);
 
-                    std::cout << output << std::endl;
-                    break;
+                    const std::string adaptive = (pool_threads(cfg) > 0) ? find_adaptive(dccl) : std::string();
+                    if(!adaptive.empty())
+                    {
+                        std::cerr << "Using one thread from here on, as " << adaptive << " is coded with adaptive models, which must see the messages one at a time, in order." << std::endl;
+                        cfg.threads = 1;
+                        pool.reset(new dccl::tool::ChunkPool(encoder, out, 0));
+                    }
                 }
-                
-                case HEX:
-                    std::cout << dccl::hex_encode(encoded) << std::endl;
-                    break;
-                case BASE64:
-#if DCCL_HAS_B64
-                    std::stringstream instream(encoded);
-                    std::stringstream outstream;
-                    ::base64::encoder D;
-                    D.encode(instream, outstream);
-                    std::cout << outstream.str();
-#else
-                    std::cerr << "dccl was not compiled with libb64-dev, so no Base64 functionality is available." << std::endl;
-                    exit(EXIT_FAILURE);
-#endif
-                    break;
+            
+                chunk += input.substr(0, close_bracket_pos+1);
+                if(input.size() > close_bracket_pos+1)
+                    chunk.append(input, close_bracket_pos+1, std::string::npos);
             }
-        
+            else
+            {
+                if(cfg.message.size() == 0)
+                    exit_failure(pool.get(), &chunk, &out, "Message name not given with -m or in the input (i.e. '[Name] field1: value field2: value').");
+
+                chunk += "|" + command_line_name + "|" + input;
+            }
+            chunk += "\n";
+            
+            // with no worker threads, each line is encoded as it is read, so that the output keeps up with a slow producer
+            if(pool_threads(cfg) == 0 || chunk.size() >= CHUNK_BYTES)
+                pool->submit(&chunk);
         }
-    }    
+
+        if(!chunk.empty())
+            pool->submit(&chunk);
+        pool->finish();
+    }
+    catch(...)
+    {
+        out.flush();
+        throw;
+    }
+    out.flush();
 }
 
 void decode(dccl::Codec& dccl, const dccl::tool::Config& cfg)
 {
-    std::string input;
-    if(cfg.format == BINARY)
+#if !DCCL_HAS_B64
+    if(cfg.format == BASE64)
     {
-        std::ifstream fin("/dev/stdin", std::ios::binary);
-        std::ostringstream ostrm;
-        ostrm << fin.rdbuf();
-        input = ostrm.str();
+        std::cerr << "dccl was not compiled with libb64-dev, so no Base64 functionality is available." << std::endl;
+        exit(EXIT_FAILURE);
     }
-    else
+#endif
+
+    WorkerCodecs codecs(dccl, cfg);
+    Decoder decoder(codecs, cfg.omit_prefix);
+
+    dccl::tool::OutputStream out(STDOUT_FILENO);
+    dccl::tool::InputStream in(STDIN_FILENO, &out);
+    dccl::tool::ChunkPool pool(decoder, out, pool_threads(cfg));
+    Splitter splitter(dccl, cfg, pool, out);
+    const std::size_t max_bytes = splitter.max_bytes();
+
+    try
     {
-        while(!std::cin.eof())
+        if(cfg.format == BINARY)
+        {
+            while(in.fill(max_bytes))
+            {
+                const char* begin = in.data();
+                in.consume(splitter.split(begin, begin + std::min(in.size(), max_bytes)) - begin);
+            }
+        }
+        else
         {
+            // bytes from the lines read so far that have not been split off yet
+            std::string input;
             std::string line;
-            std::getline (std::cin, line);
-            
-            if(boost::trim_copy(line).empty())
-                continue;
-            
-            switch(cfg.format)
+            while(in.getline(&line))
             {
-                default:
-                case BINARY:
-                    break;
-                    
-                case TEXTFORMAT:
+                if(boost::trim_copy(line).empty())
+                    continue;
+            
+                switch(cfg.format)
                 {
-                    boost::trim_if(line, boost::is_any_of("\""));
+                    default:
+                    case BINARY:
+                        break;
                     
+                    case TEXTFORMAT:
+                    {
+                        boost::trim_if(line, boost::is_any_of("\""));
                     
-                    dccl::tool::protobuf::ByteString s;
-                    google::protobuf::TextFormat::ParseFieldValueFromString("\"" + line + "\"", s.GetDescriptor()->FindFieldByNumber(1), &s);
-                    input += s.b();
-                    break;
-                }
-                case HEX:
-                    input += dccl::hex_decode(line);
-                    break;
-                case BASE64:
+                    
+                        dccl::tool::protobuf::ByteString s;
+                        google::protobuf::TextFormat::ParseFieldValueFromString("\"" + line + "\"", s.GetDescriptor()->FindFieldByNumber(1), &s);
+                        input += s.b();
+                        break;
+                    }
+                    case HEX:
+                        input += dccl::hex_decode(line);
+                        break;
+                    case BASE64:
+                    {
 #if DCCL_HAS_B64
-                    std::stringstream instream(line);
-                    std::stringstream outstream;
-                    ::base64::decoder D;
-                    D.decode(instream, outstream);
-                    input += outstream.str();
-                    break;
-#else
-                    std::cerr << "dccl was not compiled with libb64-dev, so no Base64 functionality is available." << std::endl;
-                    exit(EXIT_FAILURE);
+                        std::stringstream instream(line);
+                        std::stringstream outstream;
+                        ::base64::decoder D;
+                        D.decode(instream, outstream);
+                        input += outstream.str();
 #endif
+                        break;
+                    }
+                }
+
+                // a message may continue on the next line, so only split it off once we are sure to have all of it
+                const char* begin = input.data();
+                const char* end = input.data() + input.size();
+                while(begin != end && splitter.complete(begin, end))
+                    begin = splitter.split(begin, std::min(end, begin + max_bytes));
+                input.erase(0, begin - input.data());
+            }
+            
+            const char* begin = input.data();
+            while(begin != input.data() + input.size())
+                begin = splitter.split(begin, input.data() + input.size());
+        }
+
+        splitter.flush();
+        pool.finish();
+    }
+    catch(...)
+    {
+        out.flush();
+        throw;
+    }
+    out.flush();
+}
+
+void benchmark(dccl::Codec& dccl, dccl::tool::Config& cfg)
+{
+    // instances of each message to benchmark, by name
+    std::map<std::string, std::vector<boost::shared_ptr<google::protobuf::Message> > > corpus;
+    
+    if(cfg.corpus.empty())
+    {
+        const std::size_t random_messages = 1000;
+        for(std::map<dccl::int32, const google::protobuf::Descriptor*>::const_iterator it = dccl.loaded().begin(), end = dccl.loaded().end(); it != end; ++it)
+        {
+            std::vector<boost::shared_ptr<google::protobuf::Message> >& msgs = corpus[it->second->full_name()];
+            dccl::tool::random_messages(dccl, it->second, random_messages, &msgs);
+            if(msgs.size() < random_messages)
+                std::cerr << "Skipped " << random_messages - msgs.size() << " random instances of " << it->second->full_name() << " that failed to encode" << std::endl;
+        }
+    }
+    else
+    {
+        std::ifstream in(cfg.corpus.c_str());
+        if(!in.is_open())
+        {
+            std::cerr << "Could not open corpus: " << cfg.corpus << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        std::size_t skipped = 0;
+        std::string input;
+        while(std::getline(in, input))
+        {
+            boost::trim(input);
+            if(input.empty())
+                continue;
+
+            // as for encode()
+            std::string name;
+            if(input[0] == '|')
+            {
+                std::string::size_type close_bracket_pos = input.find('|', 1);
+                if(close_bracket_pos == std::string::npos)
+                {
+                    std::cerr << "Incorrectly formatted corpus: expected '|'" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                name = input.substr(1, close_bracket_pos-1);
+                if(cfg.message.find(name) == cfg.message.end())
+                {
+                    load_desc(&dccl, dccl::DynamicProtobufManager::find_descriptor(name), name);
+                    cfg.message.insert(name);
+                }
+                input.erase(0, close_bracket_pos+1);
+            }
+            else if(cfg.message.size() == 1)
+            {
+                name = *cfg.message.begin();
+            }
+            else
+            {
+                std::cerr << "Message name not given in the corpus (i.e. '|Name| field1: value field2: value') and there is not exactly one message given with -m" << std::endl;
+                exit(EXIT_FAILURE);
             }
+            
+            boost::shared_ptr<google::protobuf::Message> msg = dccl::DynamicProtobufManager::new_protobuf_message(name);
+            if(google::protobuf::TextFormat::ParseFromString(input, msg.get()) && msg->IsInitialized())
+                corpus[msg->GetDescriptor()->full_name()].push_back(msg);
+            else
+                ++skipped;
         }
+        
+        if(skipped)
+            std::cerr << "Skipped " << skipped << " messages in the corpus that could not be parsed" << std::endl;
+    }
+
+    for(std::map<std::string, std::vector<boost::shared_ptr<google::protobuf::Message> > >::const_iterator it = corpus.begin(), end = corpus.end(); it != end; ++it)
+    {
+        if(it->second.empty())
+            std::cerr << "No messages to benchmark " << it->first << " with" << std::endl;
+        else
+            dccl::tool::benchmark(dccl, it->second, &std::cout);
     }
+}
 
-    while(!input.empty())
+void generate(dccl::Codec& dccl, const dccl::tool::Config& cfg)
+{
+    if(cfg.message.empty())
     {
-        boost::shared_ptr<google::protobuf::Message> msg = dccl.decode<boost::shared_ptr<google::protobuf::Message> >(&input);
+        std::cerr << "You must specify a DCCL message to generate with -m or -f" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    dccl::MessageGenerator generator(cfg.seed);
+    generator.set_presence_probability(cfg.presence);
+    if(cfg.time_base >= 0)
+        generator.set_time_base(cfg.time_base);
+    const dccl::MessageGenerator::Mode mode = cfg.max_size ? dccl::MessageGenerator::MAX_SIZE : dccl::MessageGenerator::RANDOM;
+
+    // one instance of each type, reused for every message generated
+    std::vector<boost::shared_ptr<google::protobuf::Message> > msgs;
+    for(std::set<std::string>::const_iterator it = cfg.message.begin(),
+            end = cfg.message.end(); it != end; ++it)
+        msgs.push_back(dccl::DynamicProtobufManager::new_protobuf_message(*it));
+
+    // in the same format as the output of decode, so it can be used as the input to encode
+    dccl::tool::OutputStream out(STDOUT_FILENO);
+    std::string line;
+    for(unsigned long i = 0; i < cfg.count; ++i)
+    {
+        google::protobuf::Message& msg = *msgs[i % msgs.size()];
+        generator.generate(&msg, mode);
+
+        line.clear();
         if(!cfg.omit_prefix)
-            std::cout << "|" << msg->GetDescriptor()->full_name() << "| ";
-        std::cout << msg->ShortDebugString() << std::endl;
+            line += "|" + msg.GetDescriptor()->full_name() + "| ";
+        line += msg.ShortDebugString() + "\n";
+        out.write(line);
     }
+    out.flush();
 }
 
 void disp_proto(dccl::Codec& dccl, const dccl::tool::Config& cfg)
@@ -393,6 +880,26 @@ void load_desc(dccl::Codec* dccl,  const google::protobuf::Descriptor* desc, con
     }
 }
 
+std::string find_adaptive(const dccl::Codec& dccl)
+{
+    for(std::map<dccl::int32, const google::protobuf::Descriptor*>::const_iterator it = dccl.loaded().begin(), end = dccl.loaded().end(); it != end; ++it)
+    {
+        if(dccl.layout(it->second).adaptive())
+            return it->second->full_name();
+    }
+    return std::string();
+}
+
+bool has_fixed_size(const dccl::Codec& dccl)
+{
+    for(std::map<dccl::int32, const google::protobuf::Descriptor*>::const_iterator it = dccl.loaded().begin(), end = dccl.loaded().end(); it != end; ++it)
+    {
+        if(dccl.min_size(it->second) == dccl.max_size(it->second))
+            return true;
+    }
+    return false;
+}
+
 void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
 {
     std::vector<dccl::Option> options;
@@ -400,15 +907,24 @@ void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
     options.push_back(dccl::Option('d', "decode", no_argument, "Decode a DCCL message to STDOUT from STDIN"));
     options.push_back(dccl::Option('a', "analyze", no_argument, "Provides information on a given DCCL message definition (e.g. field sizes)"));
     options.push_back(dccl::Option('p', "display_proto", no_argument, "Display the .proto definition of this message."));
+    options.push_back(dccl::Option('b', "benchmark", no_argument, "Measure the encode, decode, size and id performance of the given DCCL messages, using random instances or those in --corpus"));
+    options.push_back(dccl::Option('g', "generate", no_argument, "Write random instances of the given DCCL messages to STDOUT, in the same format as the input to --encode. Values are within the bounds of the (dccl.field) options; messages using custom field codecs may not encode."));
     options.push_back(dccl::Option('h', "help", no_argument, "Gives help on the usage of 'dccl'"));
     options.push_back(dccl::Option('I', "proto_path", required_argument, "Add another search directory for .proto files"));
     options.push_back(dccl::Option('l', "dlopen", required_argument, "Open this shared library containing compiled DCCL messages."));
     options.push_back(dccl::Option('m', "message", required_argument, "Message name to encode, decode or analyze."));
     options.push_back(dccl::Option('f', "proto_file", required_argument, ".proto file to load."));
     options.push_back(dccl::Option(0, "format", required_argument, "Format for encode output or decode input: 'bin' (default) is raw binary, 'hex' is ascii-encoded hexadecimal, 'textformat' is a Google Protobuf TextFormat byte string, 'base64' is ascii-encoded base 64."));
+    options.push_back(dccl::Option(0, "corpus", required_argument, "File of messages for --benchmark, one per line in the same format as the input to --encode."));
+    options.push_back(dccl::Option('n', "count", required_argument, "Number of messages for --generate (default 1). With more than one message type, the types are taken in turn."));
+    options.push_back(dccl::Option(0, "max_size", no_argument, "With --generate, set every field to its maximum length and repeat count, so that (with the default field codecs) each message encodes to its maximum size."));
+    options.push_back(dccl::Option(0, "presence", required_argument, "With --generate, the probability (0 to 1) that each optional field is set (default 0.5)."));
+    options.push_back(dccl::Option(0, "seed", required_argument, "With --generate, the seed for the random number generator, to produce a different set of messages. The messages depend only on the seed and options, apart from time fields, unless --time is also given."));
+    options.push_back(dccl::Option(0, "time", required_argument, "With --generate, the time (seconds since the UNIX epoch) that time fields are generated within the hour before (default now). The time codecs decode to the time nearest to now, so times far from now do not decode to the same values."));
     options.push_back(dccl::Option('v', "verbose", no_argument, "Display extra debugging information."));
     options.push_back(dccl::Option('o', "omit_prefix", no_argument, "Omit the DCCL type name prefix from the output of decode."));
     options.push_back(dccl::Option('i', "id_codec", required_argument, "(Advanced) name for a nonstandard DCCL ID codec to use"));
+    options.push_back(dccl::Option('j', "threads", required_argument, "Number of threads to encode or decode with (default 1). The output is in the same order as the input. Messages coded with adaptive models are always coded on one thread, as are messages to decode when none of their types has a fixed size."));
     options.push_back(dccl::Option('V', "version", no_argument, "DCCL Version"));
     
     std::vector<option> long_options; 
@@ -445,6 +961,47 @@ void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
                         exit(EXIT_FAILURE);
                     }
                 }
+                else if(!strcmp(long_options[option_index].name, "corpus"))
+                {
+                    cfg->corpus = optarg;
+                }
+                else if(!strcmp(long_options[option_index].name, "max_size"))
+                {
+                    cfg->max_size = true;
+                }
+                else if(!strcmp(long_options[option_index].name, "presence"))
+                {
+                    char* end = 0;
+                    double presence = strtod(optarg, &end);
+                    if(*end || !(presence >= 0 && presence <= 1))
+                    {
+                        std::cerr << "Invalid presence probability: '" << optarg << "'" << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                    cfg->presence = presence;
+                }
+                else if(!strcmp(long_options[option_index].name, "seed"))
+                {
+                    char* end = 0;
+                    unsigned long seed = strtoul(optarg, &end, 10);
+                    if(*end || !*optarg)
+                    {
+                        std::cerr << "Invalid seed: '" << optarg << "'" << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                    cfg->seed = seed;
+                }
+                else if(!strcmp(long_options[option_index].name, "time"))
+                {
+                    char* end = 0;
+                    double time_base = strtod(optarg, &end);
+                    if(*end || !*optarg || !(time_base >= 0))
+                    {
+                        std::cerr << "Invalid time: '" << optarg << "'" << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                    cfg->time_base = time_base;
+                }
                 else
                 {
                     std::cerr << "Try --help for valid options." << std::endl;
@@ -457,6 +1014,8 @@ void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
             case 'd': cfg->action = DECODE; break;
             case 'a': cfg->action = ANALYZE; break;    
             case 'p': cfg->action = DISP_PROTO; break;    
+            case 'b': cfg->action = BENCHMARK; break;    
+            case 'g': cfg->action = GENERATE; break;
             case 'I': cfg->include.insert(optarg); break;
             case 'l': cfg->dlopen.push_back(optarg); break;
             case 'm': cfg->message.insert(optarg); break;
@@ -478,6 +1037,30 @@ void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
             case 'i': cfg->id_codec = optarg; break;                
             case 'v': cfg->verbose = true; break;                
             case 'o': cfg->omit_prefix = true; break;                
+            case 'n':
+            {
+                char* end = 0;
+                long count = strtol(optarg, &end, 10);
+                if(*end || count < 0)
+                {
+                    std::cerr << "Invalid count: '" << optarg << "'" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                cfg->count = count;
+                break;
+            }
+            case 'j':
+            {
+                char* end = 0;
+                long threads = strtol(optarg, &end, 10);
+                if(*end || threads < 1)
+                {
+                    std::cerr << "Invalid number of threads: '" << optarg << "'" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                cfg->threads = threads;
+                break;
+            }
                 
             case 'h':
                 std::cout << "Usage of the Dynamic Compact Control Language (DCCL) tool ('dccl'): " << std::endl;
@@ -509,5 +1092,12 @@ void parse_options(int argc, char* argv[], dccl::tool::Config* cfg)
         std::cerr << "Try --help for valid options." << std::endl;
         exit(EXIT_FAILURE);
     }
+
+    if(cfg->verbose && cfg->threads > 1)
+    {
+        // the debug log is shared by all Codecs
+        std::cerr << "Using one thread, as the --verbose output cannot be written from several threads." << std::endl;
+        cfg->threads = 1;
+    }
 }
 
@@ -0,0 +1,210 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stream_io.h"
+
+namespace
+{
+    // size of each read() and of the output buffer
+    const std::size_t BLOCK_SIZE = 1 << 20;
+    // consumed parts of a memory-mapped file are released in steps of this size, so that they do not stay resident
+    const std::size_t RELEASE_SIZE = 64 << 20;
+}
+
+dccl::tool::InputStream::InputStream(int fd, OutputStream* flush_when_waiting)
+    : fd_(fd),
+      eof_(false),
+      flush_when_waiting_(flush_when_waiting),
+      map_(0),
+      map_size_(0),
+      map_released_(0),
+      begin_(0),
+      end_(0)
+{
+    struct stat st;
+    if(fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if(map != MAP_FAILED)
+        {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            map_ = static_cast<char*>(map);
+            map_size_ = st.st_size;
+            map_released_ = map_;
+
+            // start wherever the descriptor was left (normally the beginning)
+            off_t offset = lseek(fd_, 0, SEEK_CUR);
+            if(offset < 0 || static_cast<std::size_t>(offset) > map_size_)
+                offset = 0;
+            begin_ = map_ + offset;
+            end_ = map_ + map_size_;
+            eof_ = true;
+        }
+    }
+    // otherwise (or if mmap() fails) fall back to read()
+}
+
+dccl::tool::InputStream::~InputStream()
+{
+    if(map_)
+        munmap(map_, map_size_);
+}
+
+std::size_t dccl::tool::InputStream::fill(std::size_t n)
+{
+    while(size() < n && read_block())
+    { }
+    return size();
+}
+
+void dccl::tool::InputStream::consume(std::size_t n)
+{
+    begin_ += n;
+    if(map_ && static_cast<std::size_t>(begin_ - map_released_) >= RELEASE_SIZE)
+    {
+        static const long page_size = sysconf(_SC_PAGESIZE);
+        char* release_end = map_ + ((begin_ - map_) / page_size) * page_size;
+        madvise(map_released_, release_end - map_released_, MADV_DONTNEED);
+        map_released_ = release_end;
+    }
+}
+
+bool dccl::tool::InputStream::getline(std::string* line)
+{
+    std::size_t searched = 0;
+    while(true)
+    {
+        const char* newline = static_cast<const char*>(std::memchr(begin_ + searched, '\n', size() - searched));
+        if(newline)
+        {
+            line->assign(begin_, newline);
+            consume(newline - begin_ + 1);
+            return true;
+        }
+        
+        searched = size();
+        if(fill(searched + 1) == searched)
+        {
+            // last line, without a newline
+            if(searched == 0)
+                return false;
+            line->assign(begin_, end_);
+            consume(searched);
+            return true;
+        }
+    }
+}
+
+bool dccl::tool::InputStream::read_block()
+{
+    if(eof_)
+        return false;
+    
+    // move the unconsumed bytes to the front of the buffer
+    const std::size_t available = size();
+    if(buffer_.size() < available + BLOCK_SIZE)
+    {
+        std::vector<char> larger(available + BLOCK_SIZE);
+        if(available)
+            std::memcpy(&larger[0], begin_, available);
+        buffer_.swap(larger);
+    }
+    else if(available)
+    {
+        std::memmove(&buffer_[0], begin_, available);
+    }
+    begin_ = &buffer_[0];
+    end_ = begin_ + available;
+
+    if(flush_when_waiting_)
+    {
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, 0) == 0)
+            flush_when_waiting_->flush();
+    }
+    
+    ssize_t bytes_read;
+    do
+    {
+        bytes_read = ::read(fd_, &buffer_[0] + available, BLOCK_SIZE);
+    } while(bytes_read < 0 && errno == EINTR);
+    
+    if(bytes_read < 0)
+        throw(std::runtime_error(std::string("Failed to read input: ") + std::strerror(errno)));
+
+    if(bytes_read == 0)
+        eof_ = true;
+    end_ += bytes_read;
+    return bytes_read > 0;
+}
+
+dccl::tool::OutputStream::OutputStream(int fd)
+    : fd_(fd)
+{
+    buffer_.reserve(BLOCK_SIZE);
+}
+
+dccl::tool::OutputStream::~OutputStream()
+{
+    try { flush(); }
+    catch(std::exception&) { }
+}
+
+void dccl::tool::OutputStream::write(const char* bytes, std::size_t size)
+{
+    if(buffer_.size() + size > BLOCK_SIZE)
+        flush();
+    buffer_.append(bytes, size);
+    if(buffer_.size() >= BLOCK_SIZE)
+        flush();
+}
+
+void dccl::tool::OutputStream::flush()
+{
+    const char* bytes = buffer_.data();
+    std::size_t remaining = buffer_.size();
+    while(remaining)
+    {
+        ssize_t bytes_written = ::write(fd_, bytes, remaining);
+        if(bytes_written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            buffer_.clear();
+            throw(std::runtime_error(std::string("Failed to write output: ") + std::strerror(errno)));
+        }
+        bytes += bytes_written;
+        remaining -= bytes_written;
+    }
+    buffer_.clear();
+}
@@ -0,0 +1,113 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLTOOLSTREAMIO20261019H
+#define DCCLTOOLSTREAMIO20261019H
+
+#include <string>
+#include <vector>
+
+namespace dccl
+{
+    namespace tool
+    {
+        class OutputStream;
+        
+        /// \brief Buffered reader for a file descriptor (e.g. STDIN). Regular files are memory-mapped, anything else (pipes, terminals) is read in large blocks.
+        ///
+        /// Only the unconsumed part of the input is kept (data() to data()+size()), so memory use is bounded by the largest fill() request (plus the block size), not by the size of the input.
+        class InputStream
+        {
+          public:
+            /// \param fd File descriptor to read
+            /// \param flush_when_waiting If given, this is flushed before a read that would wait for more input (e.g. from a pipe), so that the output for the input so far is not held back while the input is idle
+            explicit InputStream(int fd, OutputStream* flush_when_waiting = 0);
+            ~InputStream();
+
+            /// \brief Make at least `n` bytes available, unless the end of the input is reached first
+            ///
+            /// May move the data, so call data() again afterwards.
+            /// \return number of bytes available (size())
+            std::size_t fill(std::size_t n);
+
+            /// \brief Start of the unconsumed input
+            const char* data() const { return begin_; }
+            /// \brief Number of bytes available without reading more
+            std::size_t size() const { return end_ - begin_; }
+            /// \brief Discard the first `n` available bytes
+            void consume(std::size_t n);
+
+            /// \brief Read the next line (without the newline)
+            ///
+            /// \return false at the end of the input
+            bool getline(std::string* line);
+            
+          private:
+            InputStream(const InputStream&);
+            InputStream& operator=(const InputStream&);
+
+            // reads one more block into buffer_ (read() case only)
+            bool read_block();
+            
+          private:
+            int fd_;
+            bool eof_;
+            OutputStream* flush_when_waiting_;
+
+            // memory-mapped regular file
+            char* map_;
+            std::size_t map_size_;
+            // start of the part of map_ that has not been released yet
+            char* map_released_;
+
+            // everything else
+            std::vector<char> buffer_;
+
+            const char* begin_;
+            const char* end_;
+        };
+
+        /// \brief Buffered writer for a file descriptor (e.g. STDOUT)
+        class OutputStream
+        {
+          public:
+            explicit OutputStream(int fd);
+            /// \brief Flushes any buffered output
+            ~OutputStream();
+
+            void write(const char* bytes, std::size_t size);
+            void write(const std::string& bytes) { write(bytes.data(), bytes.size()); }
+
+            /// \brief Write all the buffered output to the file descriptor
+            void flush();
+            
+          private:
+            OutputStream(const OutputStream&);
+            OutputStream& operator=(const OutputStream&);
+            
+          private:
+            int fd_;
+            std::string buffer_;
+        };
+    }
+}
+
+#endif
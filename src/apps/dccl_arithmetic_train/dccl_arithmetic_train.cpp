@@ -0,0 +1,554 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+
+// Trains dccl.arithmetic models (dccl::arith::protobuf::ArithmeticModel) from a corpus of messages
+// given as TextFormat lines (the same input as 'dccl --encode').
+
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/text_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "dccl/cli_option.h"
+#include "dccl/dynamic_protobuf_manager.h"
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+
+namespace dccl
+{
+    namespace arith
+    {
+        /// 'dccl_arithmetic_train' command line tool namespace
+        namespace train
+        {
+            struct Config
+            {
+                Config()
+                    : threads(0),
+                      max_symbols(64),
+                      all_fields(false)
+                    { }
+
+                std::set<std::string> include;
+                std::vector<std::string> dlopen;
+                std::set<std::string> message;
+                std::set<std::string> proto_file;
+                unsigned threads;
+                unsigned max_symbols;
+                bool all_fields;
+            };
+
+            // counts of the values (and EOF symbols) that one model will encode
+            struct Histogram
+            {
+                Histogram() : eof(0), messages(0), needs_eof(false) { }
+
+                void merge(const Histogram& other)
+                {
+                    for(std::map<double, uint64>::const_iterator it = other.counts.begin(), end = other.counts.end(); it != end; ++it)
+                        counts[it->first] += it->second;
+                    eof += other.eof;
+                    messages += other.messages;
+                    needs_eof = needs_eof || other.needs_eof;
+                    fields.insert(other.fields.begin(), other.fields.end());
+                }
+
+                std::map<double, uint64> counts;
+                uint64 eof; // number of times the field has fewer than max_repeat values
+                uint64 messages; // number of times the field is encoded
+                bool needs_eof; // optional or repeated
+                std::set<std::string> fields;
+            };
+
+            // keyed on model name
+            typedef std::map<std::string, Histogram> Histograms;
+
+            struct Sample
+            {
+                const google::protobuf::Message* prototype; // created before starting the threads
+                std::string text;
+            };
+
+            struct Worker
+            {
+                const Config* cfg;
+                const std::vector<Sample>* samples;
+                std::size_t begin, end;
+                Histograms histograms;
+                std::string error;
+            };
+        }
+    }
+}
+
+using namespace dccl::arith::train;
+
+void parse_options(int argc, char* argv[], Config* cfg);
+void* count_samples(void* worker);
+void add_message(const google::protobuf::Message& msg, const Config& cfg, Histograms* histograms);
+dccl::arith::protobuf::ArithmeticModel fit_model(const std::string& name, const Histogram& histogram, const Config& cfg, double* expected_bits);
+
+int main(int argc, char* argv[])
+{
+    Config cfg;
+    parse_options(argc, argv, &cfg);
+
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+    
+    dccl::DynamicProtobufManager::enable_compilation();
+    for(std::set<std::string>::const_iterator it = cfg.include.begin(), end = cfg.include.end(); it != end; ++it)
+        dccl::DynamicProtobufManager::add_include_path(*it);
+
+    for(std::vector<std::string>::const_iterator it = cfg.dlopen.begin(), end = cfg.dlopen.end(); it != end; ++it)
+    {
+        if(!dlopen(it->c_str(), RTLD_LAZY | RTLD_GLOBAL))
+        {
+            std::cerr << "Failed to open shared library: " << *it << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    bool no_messages_specified = cfg.message.empty();
+    for(std::set<std::string>::const_iterator it = cfg.proto_file.begin(), end = cfg.proto_file.end(); it != end; ++it)
+    {
+        const google::protobuf::FileDescriptor* file_desc = dccl::DynamicProtobufManager::load_from_proto_file(*it);
+        if(!file_desc)
+        {
+            std::cerr << "failed to read in: " << *it << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // as for 'dccl --encode', unprefixed lines are the first message in the file
+        if(no_messages_specified && file_desc->message_type_count() > 0)
+            cfg.message.insert(file_desc->message_type(0)->full_name());
+    }
+
+    const google::protobuf::Descriptor* default_desc = 0;
+    if(cfg.message.size() == 1)
+    {
+        default_desc = dccl::DynamicProtobufManager::find_descriptor(*cfg.message.begin());
+        if(!default_desc)
+        {
+            std::cerr << "No descriptor with name " << *cfg.message.begin() << " found! Make sure you have loaded all the necessary .proto files and/or shared libraries." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // read the corpus: one message per line, optionally prefixed by |Name| (as written by 'dccl --decode')
+    std::vector<Sample> samples;
+    std::map<const google::protobuf::Descriptor*, boost::shared_ptr<google::protobuf::Message> > prototypes;
+    while(!std::cin.eof())
+    {
+        std::string input;
+        std::getline(std::cin, input);
+        boost::trim(input);
+        if(input.empty() || input[0] == '#')
+            continue;
+
+        const google::protobuf::Descriptor* desc = default_desc;
+        if(input[0] == '|')
+        {
+            std::string::size_type close_bracket_pos = input.find('|', 1);
+            if(close_bracket_pos == std::string::npos)
+            {
+                std::cerr << "Incorrectly formatted input: expected '|'" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            std::string name = input.substr(1, close_bracket_pos-1);
+            desc = dccl::DynamicProtobufManager::find_descriptor(name);
+            if(!desc)
+            {
+                std::cerr << "No descriptor with name " << name << " found!" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            input.erase(0, close_bracket_pos+1);
+        }
+        else if(!desc)
+        {
+            std::cerr << "Message name not given with -m or in the input (i.e. '|Name| field1: value field2: value')." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        boost::shared_ptr<google::protobuf::Message>& prototype = prototypes[desc];
+        if(!prototype)
+            prototype = dccl::DynamicProtobufManager::new_protobuf_message(desc);
+
+        Sample sample;
+        sample.prototype = prototype.get();
+        sample.text = input;
+        samples.push_back(sample);
+    }
+
+    if(samples.empty())
+    {
+        std::cerr << "No messages to train on: read no samples from STDIN (one TextFormat message per line)." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    
+    // build the histograms for a slice of the corpus on each thread
+    unsigned threads = cfg.threads;
+    if(threads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cores > 0) ? cores : 1;
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, samples.size()));
+    
+    std::vector<Worker> workers(threads);
+    std::vector<pthread_t> thread_ids(threads);
+    for(unsigned i = 0; i < threads; ++i)
+    {
+        workers[i].cfg = &cfg;
+        workers[i].samples = &samples;
+        workers[i].begin = samples.size() * i / threads;
+        workers[i].end = samples.size() * (i + 1) / threads;
+        if(pthread_create(&thread_ids[i], 0, count_samples, &workers[i]) != 0)
+        {
+            std::cerr << "Failed to start thread" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    Histograms histograms;
+    for(unsigned i = 0; i < threads; ++i)
+    {
+        pthread_join(thread_ids[i], 0);
+        if(!workers[i].error.empty())
+        {
+            std::cerr << workers[i].error << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for(Histograms::const_iterator it = workers[i].histograms.begin(), end = workers[i].histograms.end(); it != end; ++it)
+            histograms[it->first].merge(it->second);
+    }
+
+    if(histograms.empty())
+    {
+        std::cerr << "No fields to train. Set (dccl.field).arithmetic.model or (dccl.field).codec = \"dccl.arithmetic\" on the fields to train, or use --all_fields." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    
+    std::cout << "# trained on " << samples.size() << " messages" << std::endl;
+    for(Histograms::const_iterator it = histograms.begin(), end = histograms.end(); it != end; ++it)
+    {
+        double expected_bits = 0;
+        dccl::arith::protobuf::ArithmeticModel model = fit_model(it->first, it->second, cfg, &expected_bits);
+
+        std::string text;
+        google::protobuf::TextFormat::PrintToString(model, &text);
+
+        std::cout << "\n# field(s): " << boost::algorithm::join(it->second.fields, ", ") << "\n"
+                  << "# expected size: " << expected_bits << " bits per field (entropy of the training set, plus up to 2 bits to end the encoding)\n"
+                  << text;
+    }
+}
+
+void* count_samples(void* param)
+{
+    Worker& worker = *static_cast<Worker*>(param);
+    try
+    {
+        std::map<const google::protobuf::Message*, boost::shared_ptr<google::protobuf::Message> > msgs;
+        for(std::size_t i = worker.begin; i < worker.end; ++i)
+        {
+            const Sample& sample = (*worker.samples)[i];
+            boost::shared_ptr<google::protobuf::Message>& msg = msgs[sample.prototype];
+            if(!msg)
+                msg.reset(sample.prototype->New());
+            
+            msg->Clear();
+            if(!google::protobuf::TextFormat::ParseFromString(sample.text, msg.get()))
+                throw(dccl::Exception("Failed to parse message " + boost::lexical_cast<std::string>(i + 1) + ": " + sample.text));
+            add_message(*msg, *worker.cfg, &worker.histograms);
+        }
+    }
+    catch(std::exception& e)
+    {
+        worker.error = e.what();
+    }
+    return 0;
+}
+
+void add_message(const google::protobuf::Message& msg, const Config& cfg, Histograms* histograms)
+{
+    const google::protobuf::Descriptor* desc = msg.GetDescriptor();
+    const google::protobuf::Reflection* refl = msg.GetReflection();
+    
+    for(int i = 0, n = desc->field_count(); i < n; ++i)
+    {
+        const google::protobuf::FieldDescriptor* field = desc->field(i);
+        const dccl::DCCLFieldOptions& dccl_options = field->options().GetExtension(dccl::field);
+        
+        if(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+        {
+            if(field->is_repeated())
+            {
+                for(int j = 0, m = refl->FieldSize(msg, field); j < m; ++j)
+                    add_message(refl->GetRepeatedMessage(msg, field, j), cfg, histograms);
+            }
+            else if(refl->HasField(msg, field))
+            {
+                add_message(refl->GetMessage(msg, field), cfg, histograms);
+            }
+            continue;
+        }
+        if(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_STRING)
+            continue;
+
+        std::string model_name;
+        if(dccl_options.HasExtension(arithmetic))
+            model_name = dccl_options.GetExtension(arithmetic).model();
+        else if(cfg.all_fields || dccl_options.codec() == "dccl.arithmetic" || dccl_options.codec() == "_arithmetic")
+            model_name = field->full_name();
+        else
+            continue;
+
+        std::vector<double> values;
+        int size = field->is_repeated() ? refl->FieldSize(msg, field) : (refl->HasField(msg, field) ? 1 : 0);
+        for(int j = 0; j < size; ++j)
+        {
+            bool repeated = field->is_repeated();
+            switch(field->cpp_type())
+            {
+                case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+                    values.push_back(repeated ? refl->GetRepeatedInt32(msg, field, j) : refl->GetInt32(msg, field)); break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+                    values.push_back(repeated ? refl->GetRepeatedInt64(msg, field, j) : refl->GetInt64(msg, field)); break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+                    values.push_back(repeated ? refl->GetRepeatedUInt32(msg, field, j) : refl->GetUInt32(msg, field)); break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+                    values.push_back(repeated ? refl->GetRepeatedUInt64(msg, field, j) : refl->GetUInt64(msg, field)); break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+                    values.push_back(repeated ? refl->GetRepeatedDouble(msg, field, j) : refl->GetDouble(msg, field)); break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+                    values.push_back(repeated ? refl->GetRepeatedFloat(msg, field, j) : refl->GetFloat(msg, field)); break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_BOOL:
+                    values.push_back(repeated ? refl->GetRepeatedBool(msg, field, j) : refl->GetBool(msg, field)); break;
+                case google::protobuf::FieldDescriptor::CPPTYPE_ENUM:
+                    values.push_back((repeated ? refl->GetRepeatedEnum(msg, field, j) : refl->GetEnum(msg, field))->number()); break;
+                default: break;
+            }
+        }
+
+        Histogram& histogram = (*histograms)[model_name];
+        histogram.fields.insert(field->full_name());
+        histogram.messages += 1;
+        for(std::vector<double>::const_iterator it = values.begin(), end = values.end(); it != end; ++it)
+            histogram.counts[*it] += 1;
+        
+        // EOF is encoded after the last value unless the field is full (see ArithmeticFieldCodecBase::encode_repeated)
+        const unsigned max_repeat = field->is_repeated() ? dccl_options.max_repeat() : 1;
+        if(values.size() < max_repeat)
+            histogram.eof += 1;
+        if(field->is_repeated() || !field->is_required())
+            histogram.needs_eof = true;
+    }
+}
+
+dccl::arith::protobuf::ArithmeticModel fit_model(const std::string& name, const Histogram& histogram, const Config& cfg, double* expected_bits)
+{
+    using dccl::arith::Model;
+    using dccl::uint64;
+    
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name(name);
+    model.set_out_of_range_frequency(0);
+
+    // choose the symbol values (value_bound): every distinct value if there are few enough,
+    // otherwise the first value of each of `max_symbols` - 1 bins holding roughly equal numbers of samples, and the largest value.
+    // Model::value_to_symbol() maps a value to the nearest bound, so a binned value decodes to whichever of these is closest.
+    uint64 total_count = 0;
+    for(std::map<double, uint64>::const_iterator it = histogram.counts.begin(), end = histogram.counts.end(); it != end; ++it)
+        total_count += it->second;
+
+    double min_gap = 1;
+    for(std::map<double, uint64>::const_iterator it = histogram.counts.begin(), end = histogram.counts.end(); it != end; ++it)
+    {
+        std::map<double, uint64>::const_iterator next = it;
+        if(++next != end && (it == histogram.counts.begin() || next->first - it->first < min_gap))
+            min_gap = next->first - it->first;
+    }
+
+    if(histogram.counts.size() <= cfg.max_symbols)
+    {
+        for(std::map<double, uint64>::const_iterator it = histogram.counts.begin(), end = histogram.counts.end(); it != end; ++it)
+            model.add_value_bound(it->first);
+    }
+    else
+    {
+        uint64 in_bin = 0;
+        for(std::map<double, uint64>::const_iterator it = histogram.counts.begin(), end = histogram.counts.end(); it != end; ++it)
+        {
+            if(model.value_bound_size() == 0 || (in_bin * cfg.max_symbols >= total_count && model.value_bound_size() < static_cast<int>(cfg.max_symbols) - 1))
+            {
+                model.add_value_bound(it->first);
+                in_bin = 0;
+            }
+            in_bin += it->second;
+        }
+    }
+    // the largest value is a symbol of its own, so that no value is nearer the upper bound
+    double max_value = histogram.counts.empty() ? 0 : histogram.counts.rbegin()->first;
+    if(model.value_bound_size() == 0 || model.value_bound(model.value_bound_size() - 1) != max_value)
+        model.add_value_bound(max_value);
+    
+    // upper bound: values must be strictly less than this (and, as value_to_symbol() compares squares, not equally near max_value)
+    double upper_bound = max_value + min_gap;
+    if(upper_bound == -max_value)
+        upper_bound += min_gap;
+    model.add_value_bound(upper_bound);
+    
+    // count the samples that map to each symbol
+    std::vector<uint64> counts(model.value_bound_size() - 1, 0);
+    {
+        dccl::arith::protobuf::ArithmeticModel flat = model;
+        for(int i = 0, n = counts.size(); i < n; ++i)
+            flat.add_frequency(1);
+        Model flat_model(flat);
+        dccl::arith::ModelManager::create_and_validate_model(&flat_model);
+        for(std::map<double, uint64>::const_iterator it = histogram.counts.begin(), end = histogram.counts.end(); it != end; ++it)
+        {
+            Model::symbol_type symbol = flat_model.value_to_symbol(it->first);
+            assert(symbol >= 0 && symbol < static_cast<Model::symbol_type>(counts.size()));
+            counts[symbol] += it->second;
+        }
+    }
+
+    // scale the frequencies so that their sum (with EOF) fits in Model::MAX_FREQUENCY; all symbol frequencies must be nonzero
+    uint64 eof_count = histogram.needs_eof ? std::max<uint64>(histogram.eof, 1) : 0;
+    uint64 total = eof_count;
+    for(std::size_t i = 0, n = counts.size(); i < n; ++i)
+        total += std::max<uint64>(counts[i], 1);
+
+    const uint64 max_total = Model::MAX_FREQUENCY - counts.size() - 1;
+    double scale = (total > max_total) ? static_cast<double>(max_total) / total : 1;
+    
+    for(std::size_t i = 0, n = counts.size(); i < n; ++i)
+        model.add_frequency(std::max<uint64>(static_cast<uint64>(std::max<uint64>(counts[i], 1) * scale), 1));
+    model.set_eof_frequency(eof_count ? std::max<uint64>(static_cast<uint64>(eof_count * scale), 1) : 0);
+
+    Model trained(model);
+    dccl::arith::ModelManager::create_and_validate_model(&trained);
+
+    // entropy of the training set under the fitted model
+    double bits = 0;
+    const double total_freq = trained.total_freq(Model::ENCODER);
+    for(std::size_t i = 0, n = counts.size(); i < n; ++i)
+        bits -= counts[i] * std::log(model.frequency(i) / total_freq) / std::log(2.0);
+    if(histogram.eof)
+        bits -= histogram.eof * std::log(model.eof_frequency() / total_freq) / std::log(2.0);
+    *expected_bits = histogram.messages ? bits / histogram.messages : 0;
+    
+    return model;
+}
+
+void parse_options(int argc, char* argv[], Config* cfg)
+{
+    std::vector<dccl::Option> options;
+    options.push_back(dccl::Option('h', "help", no_argument, "Gives help on the usage of 'dccl_arithmetic_train'"));
+    options.push_back(dccl::Option('I', "proto_path", required_argument, "Add another search directory for .proto files"));
+    options.push_back(dccl::Option('l', "dlopen", required_argument, "Open this shared library containing compiled DCCL messages."));
+    options.push_back(dccl::Option('m', "message", required_argument, "Message name of input lines without a '|Name|' prefix."));
+    options.push_back(dccl::Option('f', "proto_file", required_argument, ".proto file to load."));
+    options.push_back(dccl::Option('j', "threads", required_argument, "Number of threads used to build the histograms (default: number of cores)."));
+    options.push_back(dccl::Option('n', "max_symbols", required_argument, "Maximum number of symbols in each model (default: 64). At least 2. Fields with more distinct values are binned: each value decodes to the nearest of the first value of each bin and the largest value."));
+    options.push_back(dccl::Option('a', "all_fields", no_argument, "Train a model for every numeric, enum and bool field, not just those using dccl.arithmetic."));
+    
+    std::vector<option> long_options; 
+    std::string opt_string;
+    dccl::Option::convert_vector(options, &long_options, &opt_string);
+    
+    while (1) {
+        int option_index = 0;
+
+        int c = getopt_long(argc, argv, opt_string.c_str(),
+                            &long_options[0], &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'I': cfg->include.insert(optarg); break;
+            case 'l': cfg->dlopen.push_back(optarg); break;
+            case 'm': cfg->message.insert(optarg); break;
+            case 'f':
+            {
+                char* proto_file_canonical_path = realpath(optarg, 0);
+                if(proto_file_canonical_path)
+                {
+                    cfg->proto_file.insert(proto_file_canonical_path);
+                    free(proto_file_canonical_path);
+                }
+                else
+                {
+                    std::cerr << "Invalid proto file path: '" << optarg << "'" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'j': cfg->threads = atoi(optarg); break;
+            case 'n':
+                cfg->max_symbols = atoi(optarg);
+                if(cfg->max_symbols < 2)
+                {
+                    std::cerr << "--max_symbols must be at least 2" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'a': cfg->all_fields = true; break;
+                
+            case 'h':
+                std::cout << "Usage of 'dccl_arithmetic_train': reads messages (one TextFormat message per line, as for 'dccl --encode') from STDIN and writes dccl.arith.protobuf.ArithmeticModel definitions to STDOUT." << std::endl;
+                for(int i = 0, n = options.size(); i < n; ++i)
+                    std::cout << "  " << options[i].usage() << std::endl;
+                exit(EXIT_SUCCESS);
+                break;
+                
+            case '?':
+                std::cerr << "Try --help for valid options." << std::endl;
+                exit(EXIT_FAILURE);
+            default: exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind < argc)
+    {
+        std::cerr << "Unknown arguments: \n";
+        while (optind < argc)
+            std::cerr << argv[optind++];
+        std::cerr << std::endl;
+        std::cerr << "Try --help for valid options." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
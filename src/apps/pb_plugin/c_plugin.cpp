@@ -0,0 +1,101 @@
+// Copyright 2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <google/protobuf/compiler/plugin.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/compiler/code_generator.h>
+#include <sstream>
+#include <set>
+#include <boost/algorithm/string.hpp>
+#include <boost/shared_ptr.hpp>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include "option_extensions.pb.h"
+#include "gen_c_plugin.h"
+
+// protoc plugin writing foo.dccl.h and foo.dccl.c (C99) for foo.proto
+//
+// Usage: protoc --plugin=protoc-gen-dccl_c=/path/to/protoc-gen-dccl_c --dccl_c_out=[messages=pkg.A,pkg.B:]out_dir foo.proto
+// (parameters are separated by ';').
+// Without "messages=", every DCCL message (top level message with a (dccl.msg).id) in foo.proto that can be generated is.
+class DCCLCGenerator : public google::protobuf::compiler::CodeGenerator {
+ public:
+    DCCLCGenerator() { }
+    ~DCCLCGenerator() { }
+
+  // implements CodeGenerator ----------------------------------------
+    bool Generate(const google::protobuf::FileDescriptor* file,
+                  const std::string& parameter,
+                  google::protobuf::compiler::GeneratorContext* generator_context,
+                  std::string* error) const;
+};
+
+bool DCCLCGenerator::Generate(const google::protobuf::FileDescriptor* file,
+                              const std::string& parameter,
+                              google::protobuf::compiler::GeneratorContext* generator_context,
+                              std::string* error) const
+{
+    std::set<std::string> selected;
+    std::vector<std::string> options;
+    if(!parameter.empty())
+        boost::split(options, parameter, boost::is_any_of(";"));
+    for(std::vector<std::string>::const_iterator it = options.begin(), end = options.end(); it != end; ++it)
+    {
+        const std::string messages_key = "messages=";
+        if(it->compare(0, messages_key.size(), messages_key) == 0)
+        {
+            std::vector<std::string> messages;
+            std::string list = it->substr(messages_key.size());
+            boost::split(messages, list, boost::is_any_of(","));
+            for(std::vector<std::string>::const_iterator m_it = messages.begin(), m_end = messages.end(); m_it != m_end; ++m_it)
+            {
+                if(!m_it->empty())
+                    selected.insert(*m_it);
+            }
+        }
+        else
+        {
+            *error = "Unknown parameter: " + *it;
+            return false;
+        }
+    }
+    
+    const std::string& filename = file->name();
+    const std::string base = filename.substr(0, filename.find(".proto"));
+    const std::string filename_h = base + ".dccl.h";
+    const std::string filename_c = base + ".dccl.c";
+
+    std::stringstream header, source;
+    dccl::gen::CGenerator c_generator(file);
+    if(!c_generator.generate(selected, filename_h, header, source, error))
+        return false;
+
+    boost::shared_ptr<google::protobuf::io::ZeroCopyOutputStream> header_output(generator_context->Open(filename_h));
+    google::protobuf::io::CodedOutputStream(header_output.get()).WriteString(header.str());
+    boost::shared_ptr<google::protobuf::io::ZeroCopyOutputStream> source_output(generator_context->Open(filename_c));
+    google::protobuf::io::CodedOutputStream(source_output.get()).WriteString(source.str());
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    DCCLCGenerator generator;
+    return google::protobuf::compiler::PluginMain(argc, argv, &generator);
+}
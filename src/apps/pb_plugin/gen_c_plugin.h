@@ -0,0 +1,876 @@
+// Copyright 2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef GenCPlugin20170601H
+#define GenCPlugin20170601H
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/descriptor.h>
+
+#include "gen_codec_plugin.h"
+
+///////////////////////////////////////////////////////////////////////////////////
+// Generation of dependency-free C99 structs and pack / unpack functions for
+// DCCL messages that only use the version 3 default codecs
+///////////////////////////////////////////////////////////////////////////////////
+
+namespace dccl
+{
+  namespace gen
+  {
+    // C identifier for a message or enumeration (e.g. dccl_test_Outer_Inner for dccl.test.Outer.Inner)
+    template<typename Descriptor>
+    inline std::string c_name(const Descriptor* desc)
+    {
+      std::string name = desc->full_name();
+      std::replace(name.begin(), name.end(), '.', '_');
+      return name;
+    }
+
+    // name used for the C runtime helpers of a numeric type (e.g. dccl_c_quantize_int32)
+    inline std::string c_numeric_name(google::protobuf::FieldDescriptor::CppType type)
+    {
+      switch(type)
+      {
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT32: return "int32";
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64: return "int64";
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT32: return "uint32";
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64: return "uint64";
+        case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: return "double";
+        case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: return "float";
+        default: throw(Unsupported("not a numeric type"));
+      }
+    }
+
+    inline std::string c_numeric_type(google::protobuf::FieldDescriptor::CppType type)
+    {
+      const std::string name = c_numeric_name(type);
+      return (name == "double" || name == "float") ? name : name + "_t";
+    }
+
+    // Emits a C99 header and source with a struct for each DCCL message (and the messages and enumerations it uses) and
+    // <message>_pack() / <message>_unpack() functions that read and write the same bytes as dccl::Codec, without protobuf, Boost or the C++ library.
+    //
+    // Messages must use codec_version = 3 and only the "dccl.default3" codecs (numeric, bool, enum, string, bytes, embedded messages and repeated fields of these),
+    // with the default identifier codec and no encryption.
+    class CGenerator
+    {
+    public:
+      CGenerator(const google::protobuf::FileDescriptor* file)
+        : file_(file),
+        root_(0),
+        depth_(0),
+        uses_string_(false),
+        uses_bytes_(false)
+      { }
+
+      // generates `selected` (full names) or, if empty, every DCCL message in the file that can be generated
+      bool generate(const std::set<std::string>& selected, const std::string& header_name,
+                    std::ostream& header, std::ostream& source, std::string* error)
+      {
+        std::vector<const google::protobuf::Descriptor*> messages;
+        std::stringstream skipped;
+        for(std::set<std::string>::const_iterator it = selected.begin(), end = selected.end(); it != end; ++it)
+        {
+          const google::protobuf::Descriptor* desc = file_->pool()->FindMessageTypeByName(*it);
+          if(!desc || desc->file() != file_)
+          {
+            *error = "No message " + *it + " in " + file_->name();
+            return false;
+          }
+          messages.push_back(desc);
+        }
+        if(selected.empty())
+        {
+          for(int i = 0, n = file_->message_type_count(); i < n; ++i)
+          {
+            if(file_->message_type(i)->options().GetExtension(dccl::msg).id() != 0)
+              messages.push_back(file_->message_type(i));
+          }
+        }
+
+        for(std::vector<const google::protobuf::Descriptor*>::const_iterator it = messages.begin(), end = messages.end(); it != end; ++it)
+        {
+          try
+          {
+            message(*it);
+          }
+          catch(Unsupported& e)
+          {
+            if(!selected.empty())
+            {
+              *error = "Cannot generate C code for " + (*it)->full_name() + ": " + e.what();
+              return false;
+            }
+            skipped << "/* " << (*it)->full_name() << " is not generated: " << e.what() << " */\n";
+          }
+        }
+
+        std::string guard = "DCCL_C_" + header_name;
+        for(std::string::iterator it = guard.begin(), end = guard.end(); it != end; ++it)
+        {
+          if(!std::isalnum(static_cast<unsigned char>(*it)))
+            *it = '_';
+        }
+
+        header << "/* Generated by protoc-gen-dccl_c from " << file_->name() << ". DO NOT EDIT! */\n"
+               << "#ifndef " << guard << "\n"
+               << "#define " << guard << "\n"
+               << "\n"
+               << "#include <stdbool.h>\n"
+               << "#include <stddef.h>\n"
+               << "#include <stdint.h>\n"
+               << "\n"
+               << "#ifdef __cplusplus\n"
+               << "extern \"C\" {\n"
+               << "#endif\n"
+               << "\n"
+               << "#ifndef DCCL_C_ID_DEFINED\n"
+               << "#define DCCL_C_ID_DEFINED\n"
+               << "/* DCCL id of an encoded message (as written by dccl::DefaultIdentifierCodec), or -1 if there are too few bytes */\n"
+               << "static inline int32_t dccl_c_id(const uint8_t* bytes, size_t size)\n"
+               << "{\n"
+               << "    if(size < 1)\n"
+               << "        return -1;\n"
+               << "    if(!(bytes[0] & 1))\n"
+               << "        return bytes[0] >> 1;\n"
+               << "    if(size < 2)\n"
+               << "        return -1;\n"
+               << "    return (int32_t)(((uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8)) >> 1);\n"
+               << "}\n"
+               << "#endif\n"
+               << "\n"
+               << skipped.str()
+               << types_.str()
+               << declarations_.str()
+               << "#ifdef __cplusplus\n"
+               << "}\n"
+               << "#endif\n"
+               << "\n"
+               << "#endif\n";
+
+        source << "/* Generated by protoc-gen-dccl_c from " << file_->name() << ". DO NOT EDIT! */\n"
+               << "#include \"" << header_name << "\"\n"
+               << "\n"
+               << "#include <math.h>\n"
+               << "#include <string.h>\n"
+               << "\n";
+        runtime(source);
+        for(std::map<std::string, const google::protobuf::EnumDescriptor*>::const_iterator it = enums_.begin(), end = enums_.end(); it != end; ++it)
+          enum_functions(it->second, source);
+        source << definitions_.str();
+        return true;
+      }
+
+    private:
+      // generates the types and functions of one DCCL message, or throws Unsupported (leaving the output untouched)
+      void message(const google::protobuf::Descriptor* desc)
+      {
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+        if(desc->file()->syntax() == google::protobuf::FileDescriptor::SYNTAX_PROTO3)
+          throw(Unsupported("proto3 syntax"));
+#endif
+        root_ = &desc->options().GetExtension(dccl::msg);
+        if(root_->codec_version() != 3)
+          throw(Unsupported("only codec_version = 3 is supported"));
+        if(root_->has_codec() && root_->codec() != "dccl.default3")
+          throw(Unsupported("message uses (dccl.msg).codec " + root_->codec()));
+
+        SizeGenerator sizes(desc);
+        std::string why;
+        if(!sizes.compute(&why))
+          throw(Unsupported(why));
+
+        std::stringstream types;
+        std::set<std::string> declared = declared_;
+        declare(desc, types, &declared);
+
+        const unsigned id = root_->id();
+        const std::string name = c_name(desc);
+        encode_.str("");
+        decode_.str("");
+        depth_ = 0;
+        const bool uses_string = uses_string_, uses_bytes = uses_bytes_;
+        const std::set<std::string> numeric_types = numeric_types_;
+        const std::map<std::string, const google::protobuf::EnumDescriptor*> enums = enums_;
+        try
+        {
+          walk(desc, HEAD, UNKNOWN, "msg->", "");
+          encode_ << "    dccl_c_writer_align(&w);\n";
+          decode_ << "    dccl_c_reader_align(&r);\n";
+          walk(desc, BODY, UNKNOWN, "msg->", "");
+        }
+        catch(Unsupported& e)
+        {
+          uses_string_ = uses_string;
+          uses_bytes_ = uses_bytes;
+          numeric_types_ = numeric_types;
+          enums_ = enums;
+          throw;
+        }
+
+        declared_ = declared;
+        types_ << types.str();
+
+        declarations_ << "#define " << name << "_DCCL_ID " << id << "\n"
+                      << "/* largest and smallest encoded size in bytes */\n"
+                      << "#define " << name << "_DCCL_MAX_BYTES " << sizes.encoded_max() << "\n"
+                      << "#define " << name << "_DCCL_MIN_BYTES " << sizes.encoded_min() << "\n"
+                      << "/* encodes `msg` into `bytes` (" << name << "_DCCL_MAX_BYTES is always enough); returns the encoded size, or 0 if max_len is too small */\n"
+                      << "size_t " << name << "_pack(const " << name << "* msg, uint8_t* bytes, size_t max_len);\n"
+                      << "/* decodes `msg` from `bytes`; returns the number of bytes used, or 0 if the bytes are not a valid " << desc->full_name() << " */\n"
+                      << "size_t " << name << "_unpack(const uint8_t* bytes, size_t size, " << name << "* msg);\n"
+                      << "\n";
+
+        definitions_ << "size_t " << name << "_pack(const " << name << "* msg, uint8_t* bytes, size_t max_len)\n"
+                     << "{\n"
+                     << "    dccl_c_writer w;\n"
+                     << "    dccl_c_writer_init(&w, bytes, max_len);\n"
+                     << "    dccl_c_write(&w, " << id_bit_width(id) << ", " << id_bits(id) << "u);\n"
+                     << encode_.str()
+                     << "    return dccl_c_writer_finish(&w);\n"
+                     << "}\n"
+                     << "\n"
+                     << "size_t " << name << "_unpack(const uint8_t* bytes, size_t size, " << name << "* msg)\n"
+                     << "{\n"
+                     << "    dccl_c_reader r;\n"
+                     << "    dccl_c_reader_init(&r, bytes, size);\n"
+                     << "    memset(msg, 0, sizeof(*msg));\n"
+                     << "    if(dccl_c_read(&r, " << id_bit_width(id) << ") != " << id_bits(id) << "u)\n"
+                     << "        return 0;\n"
+                     << decode_.str()
+                     << "    return dccl_c_reader_finish(&r);\n"
+                     << "}\n"
+                     << "\n";
+      }
+
+      // declares the struct of `desc` (after the structs and enumerations it uses)
+      void declare(const google::protobuf::Descriptor* desc, std::ostream& os, std::set<std::string>* declared)
+      {
+        typedef google::protobuf::FieldDescriptor FieldDescriptor;
+
+        const std::string name = c_name(desc);
+        if(!declared->insert(name).second)
+          return;
+
+        std::stringstream members;
+        for(int i = 0, n = desc->field_count(); i < n; ++i)
+        {
+          const FieldDescriptor* field = desc->field(i);
+          const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+          if(field_options.omit())
+            continue;
+
+          std::string type, extent;
+          switch(field->cpp_type())
+          {
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+              declare(field->message_type(), os, declared);
+              type = c_name(field->message_type());
+              break;
+            case FieldDescriptor::CPPTYPE_ENUM:
+              declare(field->enum_type(), os, declared);
+              type = c_name(field->enum_type());
+              break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+              type = "bool";
+              break;
+            case FieldDescriptor::CPPTYPE_STRING:
+            {
+              if(!field_options.has_max_length())
+                throw(Unsupported(field->full_name() + ": missing (dccl.field).max_length"));
+              std::stringstream ss;
+              if(field->type() == FieldDescriptor::TYPE_BYTES)
+              {
+                type = "uint8_t";
+                ss << "[" << field_options.max_length() << "]";
+              }
+              else
+              {
+                // nul terminated
+                type = "char";
+                ss << "[" << field_options.max_length() + 1 << "]";
+              }
+              extent = ss.str();
+              break;
+            }
+            default:
+              type = c_numeric_type(field->cpp_type());
+              break;
+          }
+
+          if(field->is_repeated())
+          {
+            std::stringstream ss;
+            ss << "[" << field_options.max_repeat() << "]";
+            members << "    " << type << " " << field->name() << ss.str() << extent << ";\n"
+                    << "    uint32_t " << field->name() << "_count;\n";
+          }
+          else
+          {
+            if(field->is_optional())
+              members << "    bool has_" << field->name() << ";\n";
+            members << "    " << type << " " << field->name() << extent << ";\n";
+          }
+        }
+
+        os << "#ifndef DCCL_C_TYPE_" << name << "\n"
+           << "#define DCCL_C_TYPE_" << name << "\n"
+           << "/* " << desc->full_name() << " */\n"
+           << "typedef struct " << name << "\n"
+           << "{\n";
+        if(members.str().empty())
+          os << "    char dccl_c_empty;\n";
+        os << members.str()
+           << "} " << name << ";\n"
+           << "#endif\n"
+           << "\n";
+      }
+
+      void declare(const google::protobuf::EnumDescriptor* e, std::ostream& os, std::set<std::string>* declared)
+      {
+        const std::string name = c_name(e);
+        if(!declared->insert(name).second)
+          return;
+
+        os << "#ifndef DCCL_C_TYPE_" << name << "\n"
+           << "#define DCCL_C_TYPE_" << name << "\n"
+           << "/* " << e->full_name() << " */\n"
+           << "typedef enum " << name << "\n"
+           << "{\n";
+        for(int i = 0, n = e->value_count(); i < n; ++i)
+          os << "    " << name << "_" << e->value(i)->name() << " = " << e->value(i)->number() << (i + 1 < n ? ",\n" : "\n");
+        os << "} " << name << ";\n"
+           << "#endif\n"
+           << "\n";
+      }
+
+      std::string indent() const
+      { return std::string(4 * (depth_ + 1), ' '); }
+
+      // emits the code for all the fields of `desc` in part `pass`, where `prefix` is the expression for the struct followed by "->" or "."
+      void walk(const google::protobuf::Descriptor* desc, Part pass, Part current, const std::string& prefix, const std::string& set_flag)
+      {
+        for(int i = 0, n = desc->field_count(); i < n; ++i)
+        {
+          const google::protobuf::FieldDescriptor* field = desc->field(i);
+          if(!in_part(field, pass, current))
+            continue;
+
+          try
+          {
+            const std::string codec = codec_name(field, *root_);
+            if(codec != "dccl.default3")
+              throw(Unsupported("uses codec " + codec));
+
+            const std::string member = prefix + field->name();
+            if(field->is_repeated())
+              repeated_field(field, pass, current, member, set_flag);
+            else
+              value(field, pass, current, member, field->is_optional() ? prefix + "has_" + field->name() : "", field->is_required(), set_flag);
+          }
+          catch(Unsupported& e)
+          {
+            throw(Unsupported(field->full_name() + ": " + e.what()));
+          }
+        }
+      }
+
+      void repeated_field(const google::protobuf::FieldDescriptor* field, Part pass, Part current, const std::string& member, const std::string& set_flag)
+      {
+        const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+        const unsigned max_repeat = field_options.max_repeat();
+        // FieldCodecBase::any_encode_repeated(): the number of values precedes them (version 3)
+        const unsigned count_width = ceil_log2(static_cast<google::protobuf::uint64>(max_repeat) + 1);
+        std::stringstream index;
+        index << "i" << depth_;
+        const std::string i = index.str();
+        const std::string in = indent();
+        const bool is_string = field->type() == google::protobuf::FieldDescriptor::TYPE_STRING;
+
+        encode_ << in << "{\n"
+                << in << "    uint32_t " << i << ", n = " << member << "_count < " << max_repeat << " ? " << member << "_count : " << max_repeat << ";\n"
+                << in << "    dccl_c_write(&w, " << count_width << ", n);\n"
+                << in << "    for(" << i << " = 0; " << i << " < n; ++" << i << ")\n"
+                << in << "    {\n";
+        decode_ << in << "{\n"
+                << in << "    uint32_t " << i << ", n = (uint32_t)dccl_c_read(&r, " << count_width << ");\n"
+                << in << "    if(n > " << max_repeat << ")\n"
+                << in << "        return 0;\n"
+                << in << "    " << member << "_count = " << (is_string ? "0" : "n") << ";\n";
+        if(!set_flag.empty() && !is_string)
+          decode_ << in << "    if(n)\n"
+                  << in << "        " << set_flag << " = 1;\n";
+        decode_ << in << "    for(" << i << " = 0; " << i << " < n; ++" << i << ")\n"
+                << in << "    {\n";
+
+        // FieldCodecBase::use_required() is true for repeated fields in version 3
+        depth_ += 2;
+        if(is_string)
+        {
+            // empty strings decode as unset, so they are dropped from the decoded array (TypeHelper add_value())
+            uses_string_ = true;
+            const unsigned max_length = field_options.max_length();
+            const unsigned length_width = ceil_log2(static_cast<google::protobuf::uint64>(max_length) + 1);
+            const std::string inner = indent();
+            encode_ << inner << "dccl_c_write_string(&w, " << length_width << ", " << member << "[" << i << "], " << max_length << ");\n";
+            decode_ << inner << "switch(dccl_c_read_string(&r, " << length_width << ", " << member << "[" << member << "_count], " << max_length << "))\n"
+                    << inner << "{\n"
+                    << inner << "    case -1: return 0;\n"
+                    << inner << "    case 0: break;\n"
+                    << inner << "    default: ++" << member << "_count; break;\n"
+                    << inner << "}\n";
+        }
+        else
+        {
+            value(field, pass, current, member + "[" + i + "]", "", true, "");
+        }
+        depth_ -= 2;
+
+        encode_ << in << "    }\n"
+                << in << "}\n";
+        decode_ << in << "    }\n";
+        if(!set_flag.empty() && is_string)
+          decode_ << in << "    if(" << member << "_count)\n"
+                  << in << "        " << set_flag << " = 1;\n";
+        decode_ << in << "}\n";
+      }
+
+      // emits the code for a single value of `field` (stored in `member`), where `has` is the expression for its presence (empty if always present)
+      void value(const google::protobuf::FieldDescriptor* field, Part pass, Part current,
+                 const std::string& member, const std::string& has, bool required, const std::string& set_flag)
+      {
+        typedef google::protobuf::FieldDescriptor FieldDescriptor;
+
+        const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+        const int null_value = required ? 0 : 1;
+        const std::string required_str = required ? "1" : "0";
+        const std::string in = indent();
+        const std::string now_set = set_flag.empty() ? "" : " " + set_flag + " = 1;";
+        const std::string now_has = has.empty() ? "" : " " + has + " = 1;";
+
+        switch(field->cpp_type())
+        {
+          case FieldDescriptor::CPPTYPE_MESSAGE:
+          {
+            std::stringstream flag;
+            flag << "set" << depth_;
+            const std::string sub_set = flag.str();
+            // v3::DefaultMessageCodec: optional messages are preceded by a presence bit
+            const bool presence = field->is_optional();
+
+            if(presence)
+            {
+              encode_ << in << "dccl_c_write(&w, 1, " << has << " ? 1 : 0);\n"
+                      << in << "if(" << has << ")\n";
+              decode_ << in << "if(dccl_c_read(&r, 1))\n";
+            }
+            encode_ << in << "{\n";
+            decode_ << in << "{\n"
+                    << in << "    int " << sub_set << " = 0;\n";
+
+            ++depth_;
+            walk(field->message_type(), pass, child_part(field, current), member + ".", sub_set);
+            --depth_;
+
+            encode_ << in << "}\n";
+            // v3::DefaultMessageCodec::any_decode(): a message with no fields set is cleared
+            decode_ << in << "    if(" << sub_set << ")\n"
+                    << in << "    {" << now_has << now_set << " }\n"
+                    << in << "}\n";
+            break;
+          }
+
+          case FieldDescriptor::CPPTYPE_BOOL:
+          {
+            // v2::DefaultBoolCodec
+            const unsigned width = ceil_log2(static_cast<google::protobuf::uint64>(2 + null_value));
+            if(required)
+              encode_ << in << "dccl_c_write(&w, " << width << ", " << member << " ? 1 : 0);\n";
+            else
+              encode_ << in << "dccl_c_write(&w, " << width << ", " << has << " ? (" << member << " ? 2 : 1) : 0);\n";
+            decode_ << in << "{\n"
+                    << in << "    uint64_t wire = dccl_c_read(&r, " << width << ");\n";
+            if(required)
+              decode_ << in << "    " << member << " = wire != 0;" << now_set << "\n";
+            else
+              decode_ << in << "    if(wire) { " << member << " = wire - 1 != 0;" << now_has << now_set << " }\n";
+            decode_ << in << "}\n";
+            break;
+          }
+
+          case FieldDescriptor::CPPTYPE_ENUM:
+          {
+            // v2::DefaultEnumCodec: the enumeration index is encoded with v2::DefaultNumericFieldCodec<int32>
+            const google::protobuf::EnumDescriptor* e = field->enum_type();
+            const int max = e->value_count() - 1;
+            const int precision = field_options.precision();
+            const unsigned width = value_bits(max * std::pow(10.0, precision) + 1 + null_value);
+            const std::string name = c_name(e);
+            enums_[name] = e;
+            numeric_types_.insert("int32");
+
+            encode_ << in << "dccl_c_write(&w, " << width << ", ";
+            if(!has.empty())
+              encode_ << has << " ? ";
+            encode_ << "dccl_c_quantize_int32(" << name << "_index(" << member << "), 0.0, " << max << ".0, " << precision << ", " << required_str << ")";
+            if(!has.empty())
+              encode_ << " : 0";
+            encode_ << ");\n";
+
+            decode_ << in << "{\n"
+                    << in << "    uint64_t wire = dccl_c_read(&r, " << width << ");\n"
+                    << in << "    if(" << (required ? "1" : "wire") << ")\n"
+                    << in << "    {\n"
+                    << in << "        if(" << name << "_value(dccl_c_unquantize_int32(wire, 0.0, " << precision << ", " << required_str << "), &" << member << "))\n"
+                    << in << "        {" << now_has << now_set << " }\n";
+            if(required)
+              decode_ << in << "        else\n"
+                      << in << "            return 0;\n";
+            decode_ << in << "    }\n"
+                    << in << "}\n";
+            break;
+          }
+
+          case FieldDescriptor::CPPTYPE_STRING:
+          {
+            const unsigned max_length = field_options.max_length();
+            if(field->type() == FieldDescriptor::TYPE_BYTES)
+            {
+              // v2::DefaultBytesCodec: always max_length bytes, preceded by a presence bit if optional
+              uses_bytes_ = true;
+              if(required)
+              {
+                encode_ << in << "dccl_c_write_bytes(&w, " << member << ", " << max_length << ");\n";
+                decode_ << in << "dccl_c_read_bytes(&r, " << member << ", " << max_length << ");" << now_set << "\n";
+              }
+              else
+              {
+                encode_ << in << "dccl_c_write(&w, 1, " << has << " ? 1 : 0);\n"
+                        << in << "if(" << has << ")\n"
+                        << in << "    dccl_c_write_bytes(&w, " << member << ", " << max_length << ");\n";
+                decode_ << in << "if(dccl_c_read(&r, 1))\n"
+                        << in << "{ dccl_c_read_bytes(&r, " << member << ", " << max_length << ");" << now_has << now_set << " }\n";
+              }
+            }
+            else
+            {
+              // v3::DefaultStringCodec: the length (in just enough bits for max_length) precedes the characters; an empty string is not set
+              uses_string_ = true;
+              const unsigned length_width = ceil_log2(static_cast<google::protobuf::uint64>(max_length) + 1);
+              encode_ << in << "dccl_c_write_string(&w, " << length_width << ", " << (has.empty() ? member : has + " ? " + member + " : \"\"") << ", " << max_length << ");\n";
+              decode_ << in << "switch(dccl_c_read_string(&r, " << length_width << ", " << member << ", " << max_length << "))\n"
+                      << in << "{\n"
+                      << in << "    case -1: return 0;\n"
+                      << in << "    case 0: break;\n"
+                      << in << "    default:" << now_has << now_set << " break;\n"
+                      << in << "}\n";
+            }
+            break;
+          }
+
+          default:
+          {
+            // v2::DefaultNumericFieldCodec
+            if(!field_options.has_min() || !field_options.has_max())
+              throw(Unsupported("missing (dccl.field).min or (dccl.field).max"));
+            const std::string type = c_numeric_name(field->cpp_type());
+            const double min = field_options.min();
+            const double max = field_options.max();
+            const int precision = field_options.precision();
+            const unsigned width = value_bits((max - min) * std::pow(10.0, precision) + 1 + null_value);
+            if(width > 64)
+              throw(Unsupported("wider than 64 bits"));
+            numeric_types_.insert(type);
+
+            encode_ << in << "dccl_c_write(&w, " << width << ", ";
+            if(!has.empty())
+              encode_ << has << " ? ";
+            encode_ << "dccl_c_quantize_" << type << "(" << member << ", " << literal(min) << ", " << literal(max) << ", " << precision << ", " << required_str << ")";
+            if(!has.empty())
+              encode_ << " : 0";
+            encode_ << ");\n";
+
+            decode_ << in << "{\n"
+                    << in << "    uint64_t wire = dccl_c_read(&r, " << width << ");\n"
+                    << in << "    if(" << (required ? "1" : "wire") << ")\n"
+                    << in << "    { " << member << " = dccl_c_unquantize_" << type << "(wire, " << literal(min) << ", " << precision << ", " << required_str << ");" << now_has << now_set << " }\n"
+                    << in << "}\n";
+            break;
+          }
+        }
+      }
+
+      // conversions between the values of an enumeration and their index (which is what DCCL encodes)
+      void enum_functions(const google::protobuf::EnumDescriptor* e, std::ostream& os)
+      {
+        const std::string name = c_name(e);
+        os << "static int32_t " << name << "_index(" << name << " value)\n"
+           << "{\n"
+           << "    switch(value)\n"
+           << "    {\n";
+        for(int i = 0, n = e->value_count(); i < n; ++i)
+        {
+          // aliases share the index of the first value with that number (as EnumDescriptor::FindValueByNumber)
+          if(e->FindValueByNumber(e->value(i)->number()) == e->value(i))
+            os << "        case " << name << "_" << e->value(i)->name() << ": return " << i << ";\n";
+        }
+        os << "        default: return -1;\n"
+           << "    }\n"
+           << "}\n"
+           << "\n"
+           << "static bool " << name << "_value(int32_t index, " << name << "* value)\n"
+           << "{\n"
+           << "    switch(index)\n"
+           << "    {\n";
+        for(int i = 0, n = e->value_count(); i < n; ++i)
+          os << "        case " << i << ": *value = " << name << "_" << e->value(i)->name() << "; return true;\n";
+        os << "        default: return false;\n"
+           << "    }\n"
+           << "}\n"
+           << "\n";
+      }
+
+      // bit reader / writer and the C equivalents of dccl::round(), dccl::internal::quantize() and dccl::internal::unquantize()
+      void runtime(std::ostream& os)
+      {
+        os << "/* bits are numbered as in dccl::Bitset::to_byte_string(): bit i is bit (i % 8) of byte (i / 8) */\n"
+           << "typedef struct\n"
+           << "{\n"
+           << "    uint8_t* bytes;\n"
+           << "    size_t size;\n"
+           << "    size_t offset;\n"
+           << "    int overflow;\n"
+           << "} dccl_c_writer;\n"
+           << "\n"
+           << "static void dccl_c_writer_init(dccl_c_writer* w, uint8_t* bytes, size_t size)\n"
+           << "{\n"
+           << "    w->bytes = bytes;\n"
+           << "    w->size = size;\n"
+           << "    w->offset = 0;\n"
+           << "    w->overflow = 0;\n"
+           << "}\n"
+           << "\n"
+           << "static void dccl_c_write(dccl_c_writer* w, unsigned width, uint64_t value)\n"
+           << "{\n"
+           << "    unsigned done = 0;\n"
+           << "    if(w->overflow || w->offset + width > w->size * 8)\n"
+           << "    {\n"
+           << "        w->overflow = 1;\n"
+           << "        return;\n"
+           << "    }\n"
+           << "    while(done < width)\n"
+           << "    {\n"
+           << "        uint8_t* byte = w->bytes + w->offset / 8;\n"
+           << "        unsigned shift = (unsigned)(w->offset % 8);\n"
+           << "        unsigned n = (8 - shift < width - done) ? 8 - shift : width - done;\n"
+           << "        if(!shift)\n"
+           << "            *byte = 0;\n"
+           << "        *byte |= (uint8_t)(((value >> done) & ((1u << n) - 1)) << shift);\n"
+           << "        done += n;\n"
+           << "        w->offset += n;\n"
+           << "    }\n"
+           << "}\n"
+           << "\n"
+           << "/* the head is padded to a whole byte */\n"
+           << "static void dccl_c_writer_align(dccl_c_writer* w)\n"
+           << "{\n"
+           << "    w->offset = (w->offset + 7) / 8 * 8;\n"
+           << "}\n"
+           << "\n"
+           << "static size_t dccl_c_writer_finish(dccl_c_writer* w)\n"
+           << "{\n"
+           << "    if(w->overflow || w->offset > w->size * 8)\n"
+           << "        return 0;\n"
+           << "    return (w->offset + 7) / 8;\n"
+           << "}\n"
+           << "\n"
+           << "typedef struct\n"
+           << "{\n"
+           << "    const uint8_t* bytes;\n"
+           << "    size_t size;\n"
+           << "    size_t offset;\n"
+           << "    int overflow;\n"
+           << "} dccl_c_reader;\n"
+           << "\n"
+           << "static void dccl_c_reader_init(dccl_c_reader* r, const uint8_t* bytes, size_t size)\n"
+           << "{\n"
+           << "    r->bytes = bytes;\n"
+           << "    r->size = size;\n"
+           << "    r->offset = 0;\n"
+           << "    r->overflow = 0;\n"
+           << "}\n"
+           << "\n"
+           << "static uint64_t dccl_c_read(dccl_c_reader* r, unsigned width)\n"
+           << "{\n"
+           << "    uint64_t value = 0;\n"
+           << "    unsigned done = 0;\n"
+           << "    if(r->overflow || r->offset + width > r->size * 8)\n"
+           << "    {\n"
+           << "        r->overflow = 1;\n"
+           << "        return 0;\n"
+           << "    }\n"
+           << "    while(done < width)\n"
+           << "    {\n"
+           << "        unsigned shift = (unsigned)(r->offset % 8);\n"
+           << "        unsigned n = (8 - shift < width - done) ? 8 - shift : width - done;\n"
+           << "        value |= (uint64_t)((r->bytes[r->offset / 8] >> shift) & ((1u << n) - 1)) << done;\n"
+           << "        done += n;\n"
+           << "        r->offset += n;\n"
+           << "    }\n"
+           << "    return value;\n"
+           << "}\n"
+           << "\n"
+           << "static void dccl_c_reader_align(dccl_c_reader* r)\n"
+           << "{\n"
+           << "    r->offset = (r->offset + 7) / 8 * 8;\n"
+           << "}\n"
+           << "\n"
+           << "static size_t dccl_c_reader_finish(dccl_c_reader* r)\n"
+           << "{\n"
+           << "    if(r->overflow || r->offset > r->size * 8)\n"
+           << "        return 0;\n"
+           << "    return (r->offset + 7) / 8;\n"
+           << "}\n"
+           << "\n";
+
+        if(uses_string_)
+          os << "static void dccl_c_write_string(dccl_c_writer* w, unsigned length_width, const char* s, size_t max_length)\n"
+             << "{\n"
+             << "    size_t i, length = 0;\n"
+             << "    while(length < max_length && s[length])\n"
+             << "        ++length;\n"
+             << "    dccl_c_write(w, length_width, length);\n"
+             << "    for(i = 0; i < length; ++i)\n"
+             << "        dccl_c_write(w, 8, (uint8_t)s[i]);\n"
+             << "}\n"
+             << "\n"
+             << "/* returns the length of the string read into s (nul terminated), or -1 if it is longer than max_length */\n"
+             << "static int dccl_c_read_string(dccl_c_reader* r, unsigned length_width, char* s, size_t max_length)\n"
+             << "{\n"
+             << "    size_t i, length = (size_t)dccl_c_read(r, length_width);\n"
+             << "    if(length > max_length)\n"
+             << "        return -1;\n"
+             << "    for(i = 0; i < length; ++i)\n"
+             << "        s[i] = (char)dccl_c_read(r, 8);\n"
+             << "    s[length] = 0;\n"
+             << "    return (int)length;\n"
+             << "}\n"
+             << "\n";
+
+        if(uses_bytes_)
+          os << "static void dccl_c_write_bytes(dccl_c_writer* w, const uint8_t* bytes, size_t size)\n"
+             << "{\n"
+             << "    size_t i;\n"
+             << "    for(i = 0; i < size; ++i)\n"
+             << "        dccl_c_write(w, 8, bytes[i]);\n"
+             << "}\n"
+             << "\n"
+             << "static void dccl_c_read_bytes(dccl_c_reader* r, uint8_t* bytes, size_t size)\n"
+             << "{\n"
+             << "    size_t i;\n"
+             << "    for(i = 0; i < size; ++i)\n"
+             << "        bytes[i] = (uint8_t)dccl_c_read(r, 8);\n"
+             << "}\n"
+             << "\n";
+
+        for(std::set<std::string>::const_iterator it = numeric_types_.begin(), end = numeric_types_.end(); it != end; ++it)
+        {
+          const std::string& name = *it;
+          const bool is_float = (name == "double" || name == "float");
+          const std::string type = is_float ? name : name + "_t";
+
+          // dccl::round()
+          os << "static " << type << " dccl_c_round_" << name << "(" << type << " value, int precision)\n"
+             << "{\n";
+          if(name == "double")
+            os << "    double scaling = pow(10.0, precision);\n"
+               << "    return floor(value * scaling + 0.5) / scaling;\n";
+          else if(name == "float")
+            os << "    float scaling = (float)pow(10.0, precision);\n"
+               << "    return (float)floor((double)(value * scaling) + 0.5) / scaling;\n";
+          else
+            os << "    " << type << " scaling, remainder;\n"
+               << "    if(precision >= 0)\n"
+               << "        return value;\n"
+               << "    scaling = (" << type << ")pow(10.0, -precision);\n"
+               << "    remainder = value % scaling;\n"
+               << "    value -= remainder;\n"
+               << "    if(remainder >= scaling / 2)\n"
+               << "        value += scaling;\n"
+               << "    return value;\n";
+          os << "}\n"
+             << "\n";
+
+          // dccl::internal::quantize(): out of bounds values are encoded as zero
+          os << "static uint64_t dccl_c_quantize_" << name << "(" << type << " value, double min, double max, int precision, int required)\n"
+             << "{\n"
+             << "    " << type << " wire_value = dccl_c_round_" << name << "(value, precision);\n"
+             << "    if(wire_value < min || wire_value > max)\n"
+             << "        return 0;\n"
+             << "    wire_value -= dccl_c_round_" << name << "((" << type << ")min, precision);\n"
+             << "    if(precision < 0)\n"
+             << "        wire_value /= (" << type << ")pow(10.0, -precision);\n"
+             << "    else if(precision > 0)\n"
+             << "        wire_value *= (" << type << ")pow(10.0, precision);\n"
+             << "    return (uint64_t)dccl_c_round_" << name << "(wire_value, 0) + (required ? 0 : 1);\n"
+             << "}\n"
+             << "\n";
+
+          // dccl::internal::unquantize() (the caller handles the "not set" value)
+          os << "static " << type << " dccl_c_unquantize_" << name << "(uint64_t wire, double min, int precision, int required)\n"
+             << "{\n"
+             << "    " << type << " wire_value = (" << type << ")(required ? wire : wire - 1);\n"
+             << "    if(precision < 0)\n"
+             << "        wire_value *= (" << type << ")pow(10.0, -precision);\n"
+             << "    else if(precision > 0)\n"
+             << "        wire_value /= (" << type << ")pow(10.0, precision);\n"
+             << "    return dccl_c_round_" << name << "(wire_value + dccl_c_round_" << name << "((" << type << ")min, precision), precision);\n"
+             << "}\n"
+             << "\n";
+        }
+      }
+
+    private:
+      const google::protobuf::FileDescriptor* file_;
+      const dccl::DCCLMessageOptions* root_;
+      int depth_;
+      bool uses_string_;
+      bool uses_bytes_;
+      std::set<std::string> numeric_types_;
+      std::map<std::string, const google::protobuf::EnumDescriptor*> enums_;
+      std::set<std::string> declared_;
+      std::stringstream encode_;
+      std::stringstream decode_;
+      std::stringstream types_;
+      std::stringstream declarations_;
+      std::stringstream definitions_;
+    };
+  }
+}
+
+#endif
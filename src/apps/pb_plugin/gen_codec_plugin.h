@@ -0,0 +1,721 @@
+// Copyright 2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef GenCodecPlugin20170601H
+#define GenCodecPlugin20170601H
+
+#include <cmath>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/replace.hpp>
+
+#include <google/protobuf/descriptor.h>
+
+#include "option_extensions.pb.h"
+
+///////////////////////////////////////////////////////////////////////////////////
+// Generation of reflection-free encode / decode / size functions for
+// DCCL messages that only use fixed size default codecs
+///////////////////////////////////////////////////////////////////////////////////
+
+namespace dccl
+{
+  namespace gen
+  {
+    // thrown for any field we cannot generate code for (the message is then left to dccl::Codec's field codecs)
+    class Unsupported : public std::runtime_error
+    {
+    public:
+      Unsupported(const std::string& what) : std::runtime_error(what) { }
+    };
+
+    // same as dccl::ceil_log2 (dccl/binary.h)
+    inline unsigned ceil_log2(google::protobuf::uint64 v)
+    {
+      unsigned r = ((v & (v - 1)) == 0) ? 0 : 1;
+      while (v >>= 1)
+        r++;
+      return r;
+    }
+
+    inline unsigned ceil_log2(double d)
+    { return ceil_log2(static_cast<google::protobuf::uint64>(std::ceil(d))); }
+
+    // double written with enough digits to read back the identical value
+    inline std::string literal(double d)
+    {
+      std::stringstream ss;
+      ss << std::setprecision(17) << d;
+      std::string s = ss.str();
+      if(s.find_first_of(".en") == std::string::npos)
+        s += ".0";
+      return s;
+    }
+
+    // C++ name of a generated class or enumeration (e.g. ::dccl::test::Outer_Inner)
+    template<typename Descriptor>
+    inline std::string cpp_name(const Descriptor* desc)
+    {
+      std::string name = desc->name();
+      for(const google::protobuf::Descriptor* parent = desc->containing_type(); parent; parent = parent->containing_type())
+        name = parent->name() + "_" + name;
+
+      std::string package = desc->file()->package();
+      boost::replace_all(package, ".", "::");
+      return (package.empty() ? "::" : "::" + package + "::") + name;
+    }
+
+    inline std::string cpp_type_name(google::protobuf::FieldDescriptor::CppType type)
+    {
+      switch(type)
+      {
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT32: return "dccl::int32";
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64: return "dccl::int64";
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT32: return "dccl::uint32";
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64: return "dccl::uint64";
+        case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: return "double";
+        case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: return "float";
+        default: throw(Unsupported("not a numeric type"));
+      }
+    }
+
+    // part of the message a field is encoded in (as dccl::MessagePart), where UNKNOWN means "decided by (dccl.field).in_head"
+    enum Part { HEAD, BODY, UNKNOWN };
+
+    inline bool is_default_codec(const std::string& codec)
+    { return codec == "dccl.default2" || codec == "dccl.default3"; }
+
+    // the codec dccl::FieldCodecManager::find() would choose for this field of the message with options `root`
+    inline std::string codec_name(const google::protobuf::FieldDescriptor* field, const dccl::DCCLMessageOptions& root)
+    {
+      const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+      if(field_options.has_codec())
+        return field_options.codec();
+      else if(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE &&
+              field->message_type()->options().GetExtension(dccl::msg).has_codec())
+        return field->message_type()->options().GetExtension(dccl::msg).codec();
+      else if(root.has_codec_group())
+        return root.codec_group();
+      else if(root.has_codec_version())
+      {
+        std::stringstream ss;
+        ss << "dccl.default" << root.codec_version();
+        return ss.str();
+      }
+      else
+        return field_options.codec();
+    }
+
+    // true if `field` is encoded in part `pass`, following the rules of DefaultMessageCodec::check_field()
+    inline bool in_part(const google::protobuf::FieldDescriptor* field, Part pass, Part current)
+    {
+      const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+      if(field_options.omit())
+        return false;
+      return current == UNKNOWN ? (field_options.in_head() == (pass == HEAD)) : (current == pass);
+    }
+
+    // part the fields of the embedded message `field` are encoded in (as internal::MessageStack::push())
+    inline Part child_part(const google::protobuf::FieldDescriptor* field, Part current)
+    {
+      const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+      if(field_options.has_in_head())
+        return field_options.in_head() ? HEAD : BODY;
+      return current;
+    }
+
+    // dccl::ceil_log2() of a size computed in floating point (e.g. the number of values of a numeric field)
+    inline unsigned value_bits(double values)
+    {
+      if(!(values < 18446744073709551616.0))
+        throw(Unsupported("more than 64 bits"));
+      return ceil_log2(values);
+    }
+
+    // dccl::v2::TimeCodecBase conversion factor: the number of field units in one second
+    inline int time_conversion(const google::protobuf::FieldDescriptor* field)
+    {
+      switch(field->cpp_type())
+      {
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64: return 1000000;
+        case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: return 1;
+        default: throw(Unsupported("no time codec for this type"));
+      }
+    }
+
+    // encoded identifier, as written by dccl::DefaultIdentifierCodec
+    inline unsigned id_bit_width(unsigned id)
+    {
+      const unsigned one_byte_max_id = (1 << 7) - 1;
+      return (id <= one_byte_max_id) ? 8 : 16;
+    }
+
+    inline unsigned id_bits(unsigned id)
+    {
+      const unsigned one_byte_max_id = (1 << 7) - 1;
+      return (id <= one_byte_max_id) ? (id << 1) : ((id << 1) | 1);
+    }
+
+    // Emits the maximum and minimum encoded sizes of a DCCL message as compile-time constants.
+    //
+    // These are the values dccl::Codec computes with FieldCodecBase::base_max_size() and base_min_size(), so every field must use one of the
+    // default (version 2 or 3), time or static codecs. Unlike Codec::max_size() and Codec::min_size() (which allow for any identifier the identifier codec
+    // can write), the sizes include the identifier of this type as written by dccl::DefaultIdentifierCodec.
+    class SizeGenerator
+    {
+    public:
+      SizeGenerator(const google::protobuf::Descriptor* desc)
+        : desc_(desc),
+        options_(desc->options().GetExtension(dccl::msg)),
+        version_(options_.codec_version()),
+        head_max_(0),
+        head_min_(0),
+        body_max_(0),
+        body_min_(0)
+      { }
+
+      // returns false (and sets why) if the sizes cannot be computed
+      bool compute(std::string* why)
+      {
+        try
+        {
+          if(options_.has_codec() && !is_default_codec(options_.codec()))
+            throw(Unsupported("message uses (dccl.msg).codec " + options_.codec()));
+
+          head_max_ = head_min_ = id_bit_width(options_.id());
+          walk(desc_, HEAD, UNKNOWN, &head_max_, &head_min_);
+          body_max_ = body_min_ = 0;
+          walk(desc_, BODY, UNKNOWN, &body_max_, &body_min_);
+          return true;
+        }
+        catch(Unsupported& e)
+        {
+          *why = e.what();
+          return false;
+        }
+      }
+
+      // returns false (and sets why) if the sizes cannot be computed
+      bool generate(std::ostream& os, std::string* why)
+      {
+        if(!compute(why))
+          return false;
+
+        const unsigned id = options_.id();
+        os << "// DCCL sizes computed by protoc-gen-dccl for the default identifier codec (bits exclude the padding of the head to a whole byte)\n"
+           << "enum DCCLSizeParameters { DCCL_ID_BITS = " << id_bits(id)
+           << ", DCCL_ID_BIT_WIDTH = " << id_bit_width(id)
+           << ", DCCL_HEAD_BITS = " << head_max_
+           << ", DCCL_HEAD_MIN_BITS = " << head_min_
+           << ", DCCL_BODY_BITS = " << body_max_
+           << ", DCCL_BODY_MIN_BITS = " << body_min_
+           << ", DCCL_ENCODED_MAX = " << encoded_max()
+           << ", DCCL_ENCODED_MIN = " << encoded_min() << " };\n";
+        return true;
+      }
+
+      // sizes (in bytes) found by compute()
+      unsigned encoded_max() const { return (head_max_ + 7) / 8 + (body_max_ + 7) / 8; }
+      unsigned encoded_min() const { return (head_min_ + 7) / 8 + (body_min_ + 7) / 8; }
+
+    private:
+      void walk(const google::protobuf::Descriptor* desc, Part pass, Part current, unsigned* max, unsigned* min)
+      {
+        for(int i = 0, n = desc->field_count(); i < n; ++i)
+        {
+          const google::protobuf::FieldDescriptor* field = desc->field(i);
+          if(!in_part(field, pass, current))
+            continue;
+
+          try
+          {
+            unsigned field_max = 0, field_min = 0;
+            // FieldCodecBase::use_required()
+            const bool required = field->is_required() || (version_ > 2 && field->is_repeated());
+            value_size(field, pass, current, required, &field_max, &field_min);
+
+            if(field->is_repeated())
+            {
+              // FieldCodecBase::max_size_repeated() and min_size_repeated()
+              const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+              if(!field_options.has_max_repeat())
+                throw(Unsupported("missing (dccl.field).max_repeat"));
+              const unsigned max_repeat = field_options.max_repeat();
+              if(version_ > 2)
+              {
+                const unsigned prefix = ceil_log2(static_cast<google::protobuf::uint64>(max_repeat) + 1);
+                field_max = prefix + max_repeat * field_max;
+                field_min = prefix;
+              }
+              else
+              {
+                field_max *= max_repeat;
+                field_min *= max_repeat;
+              }
+            }
+
+            *max += field_max;
+            *min += field_min;
+          }
+          catch(Unsupported& e)
+          {
+            throw(Unsupported(field->full_name() + ": " + e.what()));
+          }
+        }
+      }
+
+      // size of a single value of `field`
+      void value_size(const google::protobuf::FieldDescriptor* field, Part pass, Part current, bool required, unsigned* max, unsigned* min)
+      {
+        typedef google::protobuf::FieldDescriptor FieldDescriptor;
+
+        const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+        const std::string codec = codec_name(field, options_);
+        const int null_value = required ? 0 : 1;
+
+        if(codec == "_time" || codec == "dccl.time2")
+        {
+          // v2::TimeCodecBase
+          const int conversion = time_conversion(field);
+          const double precision = field_options.has_precision() ? field_options.precision() + std::log10((double)conversion) : 0;
+          *max = *min = value_bits(field_options.num_days() * 86400.0 * std::pow(10.0, precision) + 1 + null_value);
+          return;
+        }
+        else if(codec == "_static" || codec == "dccl.static2")
+        {
+          // v2::StaticCodec
+          *max = *min = 0;
+          return;
+        }
+        else if(!is_default_codec(codec))
+        {
+          throw(Unsupported("uses codec " + codec));
+        }
+
+        switch(field->cpp_type())
+        {
+          case FieldDescriptor::CPPTYPE_MESSAGE:
+          {
+            unsigned children_max = 0, children_min = 0;
+            walk(field->message_type(), pass, child_part(field, current), &children_max, &children_min);
+            if(codec == "dccl.default3" && field->is_optional())
+            {
+              // v3::DefaultMessageCodec presence bit
+              *max = children_max + 1;
+              *min = 1;
+            }
+            else
+            {
+              *max = children_max;
+              *min = children_min;
+            }
+            break;
+          }
+
+          case FieldDescriptor::CPPTYPE_BOOL:
+            // v2::DefaultBoolCodec
+            *max = *min = ceil_log2(static_cast<google::protobuf::uint64>(2 + null_value));
+            break;
+
+          case FieldDescriptor::CPPTYPE_ENUM:
+            // v2::DefaultEnumCodec
+            *max = *min = value_bits((field->enum_type()->value_count() - 1) * std::pow(10.0, field_options.precision()) + 1 + null_value);
+            break;
+
+          case FieldDescriptor::CPPTYPE_STRING:
+          {
+            if(!field_options.has_max_length())
+              throw(Unsupported("missing (dccl.field).max_length"));
+            const unsigned length_bits = field_options.max_length() * 8;
+
+            if(field->type() == FieldDescriptor::TYPE_BYTES)
+            {
+              // v2::DefaultBytesCodec
+              *max = length_bits + (required ? 0 : 1);
+              *min = required ? *max : 1;
+            }
+            else
+            {
+              // v2::DefaultStringCodec (one length byte) or v3::DefaultStringCodec (just enough bits for max_length)
+              const unsigned max_string_length = 255;
+              *min = ceil_log2(static_cast<google::protobuf::uint64>(codec == "dccl.default3" ? field_options.max_length() : max_string_length) + 1);
+              *max = *min + length_bits;
+            }
+            break;
+          }
+
+          default:
+            // v2::DefaultNumericFieldCodec
+            if(!field_options.has_min() || !field_options.has_max())
+              throw(Unsupported("missing (dccl.field).min or (dccl.field).max"));
+            *max = *min = value_bits((field_options.max() - field_options.min()) * std::pow(10.0, field_options.precision()) + 1 + null_value);
+            break;
+        }
+      }
+
+    private:
+      const google::protobuf::Descriptor* desc_;
+      const dccl::DCCLMessageOptions& options_;
+      int version_;
+      unsigned head_max_;
+      unsigned head_min_;
+      unsigned body_max_;
+      unsigned body_min_;
+    };
+
+    // Emits static dccl_encode(), dccl_decode() and dccl_size() functions (and the bit offset and width of each field) into the class of a DCCL message.
+    //
+    // Only messages whose encoded size is fixed are generated, i.e. every field must be non-repeated and use the default numeric, bool, enum,
+    // time or (required) embedded message codecs. The generated code must produce identical bytes to the field codecs: dccl::Codec verifies the sizes
+    // against the layout it computes and only then dispatches to these functions. The sizes themselves come from SizeGenerator, which must be emitted first.
+    class CodecGenerator
+    {
+    public:
+      CodecGenerator(const google::protobuf::Descriptor* desc)
+        : desc_(desc),
+        options_(desc->options().GetExtension(dccl::msg)),
+        version_(options_.codec_version()),
+        uses_time_(false),
+        cursor_(0),
+        depth_(0)
+      { }
+
+      // returns false (and sets why) if the message cannot be generated
+      bool generate(std::ostream& os, std::string* why)
+      {
+        try
+        {
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+          // generated accessors do not have has_*() for proto3 scalars
+          if(desc_->file()->syntax() == google::protobuf::FileDescriptor::SYNTAX_PROTO3)
+            throw(Unsupported("proto3 syntax"));
+#endif
+          if(options_.has_codec() && !is_default_codec(options_.codec()))
+            throw(Unsupported("message uses (dccl.msg).codec " + options_.codec()));
+
+          cursor_ = id_bit_width(options_.id());
+          walk(desc_, HEAD, UNKNOWN, "msg", "msg", "");
+          const unsigned head_bits = cursor_;
+          const unsigned head_bytes = (head_bits + 7) / 8;
+
+          cursor_ = head_bytes * 8;
+          walk(desc_, BODY, UNKNOWN, "msg", "msg", "");
+          const unsigned body_bits = cursor_ - head_bytes * 8;
+          const unsigned body_bytes = (body_bits + 7) / 8;
+
+          const std::string name = cpp_name(desc_);
+
+          os << "// DCCL codec generated by protoc-gen-dccl (used by dccl::Codec::encode() and dccl::Codec::decode() for types loaded with dccl::Codec::load<T>())\n"
+             << "enum DCCLGeneratedParameters { DCCL_SIZE = " << head_bytes + body_bytes << " };\n";
+
+          // field names may repeat once flattened (e.g. "a_b" and "a.b"), in which case there is no unambiguous constant to emit
+          std::set<std::string> names;
+          for(std::vector<Offset>::const_iterator it = offsets_.begin(), end = offsets_.end(); it != end; ++it)
+          {
+            if(!names.insert(it->name).second)
+            {
+              offsets_.clear();
+              break;
+            }
+          }
+          if(!offsets_.empty())
+          {
+            os << "// position of each field (in bits from the start of the encoded message) and its size in bits\n"
+               << "struct DCCLFieldBitOffsets { enum {";
+            for(std::vector<Offset>::const_iterator it = offsets_.begin(), end = offsets_.end(); it != end; ++it)
+              os << (it == offsets_.begin() ? " " : ", ") << it->name << " = " << it->offset;
+            os << " }; };\n"
+               << "struct DCCLFieldBitWidths { enum {";
+            for(std::vector<Offset>::const_iterator it = offsets_.begin(), end = offsets_.end(); it != end; ++it)
+              os << (it == offsets_.begin() ? " " : ", ") << it->name << " = " << it->width;
+            os << " }; };\n";
+          }
+
+          os << "static unsigned dccl_size(const " << name << "&) { return DCCL_SIZE; }\n"
+             << "static void dccl_encode(const " << name << "& msg, unsigned char* bytes)\n"
+             << "{\n"
+             << "    std::memset(bytes, 0, DCCL_SIZE);\n"
+             << "    dccl::internal::write_bits(bytes, 0, DCCL_ID_BIT_WIDTH, DCCL_ID_BITS);\n"
+             << encode_.str()
+             << "}\n"
+             << "static void dccl_decode(const unsigned char* bytes, " << name << "* msg)\n"
+             << "{\n";
+          if(uses_time_)
+            os << "    timeval now;\n"
+               << "    gettimeofday(&now, 0);\n";
+          os << decode_.str()
+             << "}\n";
+          return true;
+        }
+        catch(Unsupported& e)
+        {
+          *why = e.what();
+          return false;
+        }
+      }
+
+    private:
+      // a field at a fixed position, named by its path with '.' replaced by '_' (e.g. "header_time")
+      struct Offset
+      {
+        std::string name;
+        unsigned offset;
+        unsigned width;
+      };
+
+      std::string indent() const
+      { return std::string(4 * (depth_ + 1), ' '); }
+
+      // emits the code for all the fields of `desc` in part `pass`, following the rules of DefaultMessageCodec::check_field()
+      void walk(const google::protobuf::Descriptor* desc, Part pass, Part current,
+                const std::string& src, const std::string& dst, const std::string& set_flag)
+      {
+        for(int i = 0, n = desc->field_count(); i < n; ++i)
+        {
+          const google::protobuf::FieldDescriptor* field = desc->field(i);
+          if(!in_part(field, pass, current))
+            continue;
+
+          try
+          {
+            if(field->is_repeated())
+              throw(Unsupported("repeated fields are variable size"));
+
+            if(field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE)
+              message_field(field, pass, current, src, dst, set_flag);
+            else
+              primitive_field(field, src, dst, set_flag);
+          }
+          catch(Unsupported& e)
+          {
+            throw(Unsupported(field->full_name() + ": " + e.what()));
+          }
+        }
+      }
+
+      void message_field(const google::protobuf::FieldDescriptor* field, Part pass, Part current,
+                         const std::string& src, const std::string& dst, const std::string& set_flag)
+      {
+        const std::string codec = codec_name(field, options_);
+        if(codec == "dccl.default3" && !field->is_required())
+          throw(Unsupported("optional embedded messages have a presence bit in version 3"));
+        else if(!is_default_codec(codec))
+          throw(Unsupported("uses codec " + codec));
+
+        std::stringstream var;
+        var << "m" << depth_ + 1;
+        const std::string sub = var.str();
+        const std::string sub_set = "set" + sub;
+        const std::string name = field->lowercase_name();
+        const std::string type = cpp_name(field->message_type());
+        const std::string in = indent();
+
+        encode_ << in << "if(" << src << ".has_" << name << "())\n"
+                << in << "{\n"
+                << in << "    const " << type << "& " << sub << " = " << src << "." << name << "();\n";
+        decode_ << in << "{\n"
+                << in << "    " << type << "* " << sub << " = " << dst << "->mutable_" << name << "();\n"
+                << in << "    bool " << sub_set << " = false;\n";
+
+        const std::string prefix = prefix_;
+        prefix_ += name + "_";
+        ++depth_;
+        walk(field->message_type(), pass, child_part(field, current), sub, sub, sub_set);
+        --depth_;
+        prefix_ = prefix;
+
+        encode_ << in << "}\n";
+        decode_ << in << "    if(!" << sub_set << ")\n"
+                << in << "        " << dst << "->clear_" << name << "();\n";
+        if(!set_flag.empty())
+          decode_ << in << "    else\n"
+                  << in << "        " << set_flag << " = true;\n";
+        decode_ << in << "}\n";
+      }
+
+      void primitive_field(const google::protobuf::FieldDescriptor* field,
+                           const std::string& src, const std::string& dst, const std::string& set_flag)
+      {
+        typedef google::protobuf::FieldDescriptor FieldDescriptor;
+
+        const dccl::DCCLFieldOptions& field_options = field->options().GetExtension(dccl::field);
+        const std::string codec = codec_name(field, options_);
+        // v2::DefaultNumericFieldCodec::use_required() for non-repeated fields
+        const bool required = field->is_required();
+        const std::string required_str = required ? "true" : "false";
+        const int null_value = required ? 0 : 1;
+        const std::string name = field->lowercase_name();
+        const std::string in = indent();
+        const std::string now_set = set_flag.empty() ? "" : " " + set_flag + " = true;";
+
+        if(codec == "_time" || codec == "dccl.time2")
+        {
+          const int conversion = time_conversion(field);
+
+          // v2::TimeCodecBase
+          const double max = field_options.num_days() * 86400.0;
+          const double precision = field_options.has_precision() ? field_options.precision() + std::log10((double)conversion) : 0;
+          const unsigned width = ceil_log2(max * std::pow(10.0, precision) + 1 + null_value);
+          if(width > 64)
+            throw(Unsupported("wider than 64 bits"));
+          const std::string type = cpp_type_name(field->cpp_type());
+
+          encode_ << in << "if(" << src << ".has_" << name << "())\n"
+                  << in << "{\n"
+                  << in << "    dccl::uint64 wire = 0;\n"
+                  << in << "    dccl::internal::quantize(dccl::internal::time_of_day(" << src << "." << name << "(), " << conversion << ", " << literal(max) << "), 0.0, " << literal(max) << ", " << literal(precision) << ", " << required_str << ", &wire);\n"
+                  << in << "    dccl::internal::write_bits(bytes, " << cursor_ << ", " << width << ", wire);\n"
+                  << in << "}\n";
+          decode_ << in << "{\n"
+                  << in << "    double encoded_time;\n"
+                  << in << "    if(dccl::internal::unquantize(dccl::internal::read_bits(bytes, " << cursor_ << ", " << width << "), 0.0, " << literal(precision) << ", " << required_str << ", &encoded_time))\n"
+                  << in << "    { " << dst << "->set_" << name << "(dccl::internal::expand_time_of_day<" << type << ">(encoded_time, " << static_cast<google::protobuf::int64>(max) << ", " << conversion << ", " << literal(precision) << " - std::log10(" << conversion << ".0), now.tv_sec));" << now_set << " }\n"
+                  << in << "}\n";
+          uses_time_ = true;
+          advance(field, width);
+          return;
+        }
+        
+        if(!is_default_codec(codec))
+          throw(Unsupported("uses codec " + codec));
+
+        switch(field->cpp_type())
+        {
+          case FieldDescriptor::CPPTYPE_BOOL:
+          {
+            // v2::DefaultBoolCodec
+            const unsigned width = ceil_log2(static_cast<google::protobuf::uint64>(2 + null_value));
+            encode_ << in << "if(" << src << ".has_" << name << "())\n"
+                    << in << "    dccl::internal::write_bits(bytes, " << cursor_ << ", " << width << ", " << src << "." << name << "()" << (required ? "" : " + 1") << ");\n";
+            decode_ << in << "{\n"
+                    << in << "    dccl::uint64 wire = dccl::internal::read_bits(bytes, " << cursor_ << ", " << width << ");\n";
+            if(required)
+              decode_ << in << "    " << dst << "->set_" << name << "(wire != 0);" << now_set << "\n";
+            else
+              decode_ << in << "    if(wire) { " << dst << "->set_" << name << "(wire - 1 != 0);" << now_set << " }\n";
+            decode_ << in << "}\n";
+            advance(field, width);
+            break;
+          }
+          
+          case FieldDescriptor::CPPTYPE_ENUM:
+          {
+            // v2::DefaultEnumCodec: the enumeration index is encoded with v2::DefaultNumericFieldCodec<int32>
+            const google::protobuf::EnumDescriptor* e = field->enum_type();
+            const int max = e->value_count() - 1;
+            const double precision = field_options.precision();
+            const unsigned width = ceil_log2(max * std::pow(10.0, precision) + 1 + null_value);
+            const std::string type = cpp_name(e);
+
+            encode_ << in << "if(" << src << ".has_" << name << "())\n"
+                    << in << "{\n"
+                    << in << "    dccl::int32 index = 0;\n"
+                    << in << "    switch(" << src << "." << name << "())\n"
+                    << in << "    {\n";
+            for(int j = 0, m = e->value_count(); j < m; ++j)
+            {
+              // aliases share the index of the first value with that number (as EnumDescriptor::FindValueByNumber)
+              if(e->FindValueByNumber(e->value(j)->number()) == e->value(j))
+                encode_ << in << "        case " << e->value(j)->number() << ": index = " << j << "; break;\n";
+            }
+            encode_ << in << "    }\n"
+                    << in << "    dccl::uint64 wire = 0;\n"
+                    << in << "    dccl::internal::quantize(index, 0.0, " << max << ".0, " << literal(precision) << ", " << required_str << ", &wire);\n"
+                    << in << "    dccl::internal::write_bits(bytes, " << cursor_ << ", " << width << ", wire);\n"
+                    << in << "}\n";
+            decode_ << in << "{\n"
+                    << in << "    dccl::int32 index;\n"
+                    << in << "    if(dccl::internal::unquantize(dccl::internal::read_bits(bytes, " << cursor_ << ", " << width << "), 0.0, " << literal(precision) << ", " << required_str << ", &index))\n"
+                    << in << "    {\n"
+                    << in << "        switch(index)\n"
+                    << in << "        {\n";
+            for(int j = 0, m = e->value_count(); j < m; ++j)
+              decode_ << in << "            case " << j << ": " << dst << "->set_" << name << "(static_cast<" << type << ">(" << e->value(j)->number() << "));" << now_set << " break;\n";
+            decode_ << in << "            default: break;\n"
+                    << in << "        }\n"
+                    << in << "    }\n"
+                    << in << "}\n";
+            advance(field, width);
+            break;
+          }
+
+          default:
+          {
+            // v2::DefaultNumericFieldCodec
+            if(!field_options.has_min() || !field_options.has_max())
+              throw(Unsupported("missing (dccl.field).min or (dccl.field).max"));
+            const std::string type = cpp_type_name(field->cpp_type());
+            const double min = field_options.min();
+            const double max = field_options.max();
+            const double precision = field_options.precision();
+            const unsigned width = ceil_log2((max - min) * std::pow(10.0, precision) + 1 + null_value);
+            if(width > 64)
+              throw(Unsupported("wider than 64 bits"));
+
+            encode_ << in << "if(" << src << ".has_" << name << "())\n"
+                    << in << "{\n"
+                    << in << "    dccl::uint64 wire = 0;\n"
+                    << in << "    dccl::internal::quantize<" << type << ">(" << src << "." << name << "(), " << literal(min) << ", " << literal(max) << ", " << literal(precision) << ", " << required_str << ", &wire);\n"
+                    << in << "    dccl::internal::write_bits(bytes, " << cursor_ << ", " << width << ", wire);\n"
+                    << in << "}\n";
+            decode_ << in << "{\n"
+                    << in << "    " << type << " value;\n"
+                    << in << "    if(dccl::internal::unquantize(dccl::internal::read_bits(bytes, " << cursor_ << ", " << width << "), " << literal(min) << ", " << literal(precision) << ", " << required_str << ", &value))\n"
+                    << in << "    { " << dst << "->set_" << name << "(value);" << now_set << " }\n"
+                    << in << "}\n";
+            advance(field, width);
+            break;
+          }
+        }
+      }
+      
+      // records the position of a field and moves past it
+      void advance(const google::protobuf::FieldDescriptor* field, unsigned width)
+      {
+        Offset offset;
+        offset.name = prefix_ + field->lowercase_name();
+        offset.offset = cursor_;
+        offset.width = width;
+        offsets_.push_back(offset);
+        cursor_ += width;
+      }
+
+    private:
+      const google::protobuf::Descriptor* desc_;
+      const dccl::DCCLMessageOptions& options_;
+      int version_;
+      bool uses_time_;
+      unsigned cursor_;
+      int depth_;
+      std::stringstream encode_;
+      std::stringstream decode_;
+      std::string prefix_;
+      std::vector<Offset> offsets_;
+    };
+  }
+}
+
+#endif
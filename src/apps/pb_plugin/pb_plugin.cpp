@@ -30,10 +30,12 @@
 #include <google/protobuf/io/zero_copy_stream.h>
 #include "option_extensions.pb.h"
 #include "gen_units_class_plugin.h"
+#include "gen_codec_plugin.h"
 
 std::set<std::string> systems_to_include_;
 std::set<std::string> base_units_to_include_;
 std::string filename_h_;
+bool codecs_generated_ = false;
 
 
 class DCCLGenerator : public google::protobuf::compiler::CodeGenerator {
@@ -87,6 +89,7 @@ bool DCCLGenerator::Generate(const google::protobuf::FileDescriptor* file,
     {
         const std::string& filename = file->name();
         filename_h_ = filename.substr(0, filename.find(".proto")) + ".pb.h";
+        codecs_generated_ = false;
 //        std::string filename_cc = filename.substr(0, filename.find(".proto")) + ".pb.cc";
         
         for(int message_i = 0, message_n = file->message_type_count(); message_i < message_n; ++message_i)
@@ -106,6 +109,14 @@ bool DCCLGenerator::Generate(const google::protobuf::FileDescriptor* file,
         google::protobuf::io::Printer include_printer(include_output.get(), '$');
         std::stringstream includes_ss;
 
+        if(codecs_generated_)
+        {
+            includes_ss << "#include <cstring>" << std::endl;
+            includes_ss << "#include <sys/time.h>" << std::endl;
+            includes_ss << "#include \"dccl/internal/bit_ops.h\"" << std::endl;
+            includes_ss << "#include \"dccl/internal/quantize.h\"" << std::endl;
+        }
+        
         includes_ss << "#include <boost/units/quantity.hpp>" <<std::endl;
         includes_ss << "#include <boost/units/absolute.hpp>" <<std::endl;
         includes_ss << "#include <boost/units/dimensionless_type.hpp>" <<std::endl;
@@ -148,6 +159,24 @@ void DCCLGenerator::generate_message(const google::protobuf::Descriptor* desc, g
                 id_enum << "enum DCCLParameters { DCCL_ID = " << desc->options().GetExtension(dccl::msg).id() << ", " <<
                     " DCCL_MAX_BYTES = " << desc->options().GetExtension(dccl::msg).max_bytes() << " };\n";
                 printer.Print(id_enum.str().c_str());
+
+                // compile-time sizes, for messages that only use default codecs
+                std::stringstream size_ss;
+                std::string why;
+                dccl::gen::SizeGenerator size_generator(desc);
+                if(size_generator.generate(size_ss, &why))
+                {
+                    printer.Print(size_ss.str().c_str());
+
+                    // static encode / decode functions, for messages that only use fixed size default codecs
+                    std::stringstream codec_ss;
+                    dccl::gen::CodecGenerator codec_generator(desc);
+                    if(codec_generator.generate(codec_ss, &why))
+                    {
+                        printer.Print(codec_ss.str().c_str());
+                        codecs_generated_ = true;
+                    }
+                }
             }
             
 
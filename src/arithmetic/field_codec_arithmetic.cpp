@@ -26,13 +26,19 @@ using dccl::dlog;
 using namespace dccl::logger;
 
 std::map<std::string, dccl::arith::Model> dccl::arith::ModelManager::arithmetic_models_;
+std::vector<dccl::arith::Model*> dccl::arith::ModelManager::models_by_index_;
+std::vector<dccl::arith::Model> dccl::arith::ModelManager::initial_models_;
+std::map<std::string, int> dccl::arith::ModelManager::name_to_index_;
+std::map<const google::protobuf::FieldDescriptor*, int> dccl::arith::ModelManager::field_to_index_;
+std::map<std::string, std::map<std::string, dccl::Bitset> > dccl::arith::ModelManager::last_bits_map_;
+pthread_mutex_t dccl::arith::ModelManager::mutex_ = PTHREAD_MUTEX_INITIALIZER;
 const dccl::arith::Model::symbol_type dccl::arith::Model::OUT_OF_RANGE_SYMBOL;
 const dccl::arith::Model::symbol_type dccl::arith::Model::EOF_SYMBOL;
 const dccl::arith::Model::symbol_type dccl::arith::Model::MIN_SYMBOL;
 const int dccl::arith::Model::CODE_VALUE_BITS;
 const int dccl::arith::Model::FREQUENCY_BITS;
 const dccl::arith::Model::freq_type dccl::arith::Model::MAX_FREQUENCY;
-std::map<std::string, std::map<std::string, dccl::Bitset> > dccl::arith::Model::last_bits_map;
+const int dccl::arith::Model::SYMBOL_LOOKUP_BITS;
 
 // shared library load
 extern "C"
@@ -142,33 +148,73 @@ dccl::arith::Model::value_type dccl::arith::Model::symbol_to_value(symbol_type s
 }
               
 
-std::pair<dccl::arith::Model::freq_type, dccl::arith::Model::freq_type> dccl::arith::Model::symbol_to_cumulative_freq(symbol_type symbol, ModelState state) const
+void dccl::arith::CumulativeFrequencies::assign(const std::vector<freq_type>& freqs)
 {
-    const boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
-        encoder_cumulative_freqs_ :
-        decoder_cumulative_freqs_;
+    freqs_ = freqs;
+    tree_.assign(freqs.size() + 1, 0);
+    total_ = 0;
+    
+    // O(n) construction: each node passes its partial sum to its parent
+    for(std::size_t i = 1, n = tree_.size(); i < n; ++i)
+    {
+        tree_[i] += freqs[i-1];
+        total_ += freqs[i-1];
+        std::size_t parent = i + (i & (~i + 1));
+        if(parent < n)
+            tree_[parent] += tree_[i];
+    }
 
-    boost::bimap<symbol_type, freq_type>::left_map::const_iterator c_freq_it =
-        c_freqs.left.find(symbol);
-    std::pair<freq_type, freq_type> c_freq_range;
-    c_freq_range.second = c_freq_it->second;
-    if(c_freq_it == c_freqs.left.begin())
+    top_ = 1;
+    while(top_ * 2 <= freqs_.size())
+        top_ *= 2;
+}
+
+void dccl::arith::Model::build_symbol_lookup()
+{
+    const CumulativeFrequencies& c_freqs = encoder_cumulative_freqs_;
+    static_cumulative_freqs_.resize(c_freqs.size());
+    for(std::size_t i = 0, n = c_freqs.size(); i < n; ++i)
+        static_cumulative_freqs_[i] = c_freqs.cumulative(i);
+
+    // index the table by the top SYMBOL_LOOKUP_BITS of the largest possible cumulative frequency (total - 1)
+    const freq_type max_c_freq = c_freqs.total() - 1;
+    int c_freq_bits = 0;
+    while(c_freq_bits < FREQUENCY_BITS && (max_c_freq >> c_freq_bits))
+        ++c_freq_bits;
+    symbol_lookup_shift_ = std::max(c_freq_bits - SYMBOL_LOOKUP_BITS, 0);
+
+    // entry j is the first symbol index whose cumulative frequency is greater than (j << symbol_lookup_shift_)
+    symbol_lookup_.resize((max_c_freq >> symbol_lookup_shift_) + 1);
+    unsigned i = 0;
+    for(std::size_t j = 0, n = symbol_lookup_.size(); j < n; ++j)
     {
-        c_freq_range.first  = 0;
+        while(static_cumulative_freqs_[i] <= (static_cast<freq_type>(j) << symbol_lookup_shift_))
+            ++i;
+        symbol_lookup_[j] = i;
     }
-    else
+}
+
+std::pair<dccl::arith::Model::freq_type, dccl::arith::Model::freq_type> dccl::arith::Model::symbol_to_cumulative_freq(symbol_type symbol, ModelState state) const
+{
+    if(!static_cumulative_freqs_.empty())
     {
-        c_freq_it--;
-        c_freq_range.first = c_freq_it->second;
+        const std::size_t i = symbol - MIN_SYMBOL;
+        return std::make_pair(i ? static_cumulative_freqs_[i-1] : 0, static_cumulative_freqs_[i]);
     }
+    
+    const CumulativeFrequencies& c_freqs = (state == ENCODER) ?
+        encoder_cumulative_freqs_ :
+        decoder_cumulative_freqs_;
+
+    std::pair<freq_type, freq_type> c_freq_range;
+    c_freq_range.second = c_freqs.cumulative(symbol - MIN_SYMBOL);
+    c_freq_range.first = c_freq_range.second - c_freqs.frequency(symbol - MIN_SYMBOL);
     return c_freq_range;
-                          
 }
 
 std::pair<dccl::arith::Model::symbol_type, dccl::arith::Model::symbol_type> dccl::arith::Model::cumulative_freq_to_symbol(std::pair<freq_type, freq_type> c_freq_pair,  ModelState state) const
 {
-
-    const boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
+    const CumulativeFrequencies& c_freqs = (state == ENCODER) ?
         encoder_cumulative_freqs_ :
         decoder_cumulative_freqs_;
     
@@ -181,17 +227,28 @@ std::pair<dccl::arith::Model::symbol_type, dccl::arith::Model::symbol_type> dccl
     // symbol: 2   freq: 10   c_freq: 35 [25 ... 35)
     // searching for c_freq of 30 should return symbol 2     
     // searching for c_freq of 10 should return symbol 1
-    symbol_pair.first = c_freqs.right.upper_bound(c_freq_pair.first)->second;
-    
+    freq_type c_freq;
+    if(!symbol_lookup_.empty())
+    {
+        // static model: start from the table entry for the top bits of c_freq and scan the few symbols that share them
+        std::size_t i = symbol_lookup_[c_freq_pair.first >> symbol_lookup_shift_];
+        while(static_cumulative_freqs_[i] <= c_freq_pair.first)
+            ++i;
+        symbol_pair.first = i + MIN_SYMBOL;
+        c_freq = static_cumulative_freqs_[i];
+    }
+    else
+    {
+        symbol_pair.first = c_freqs.upper_bound(c_freq_pair.first) + MIN_SYMBOL;
+        c_freq = c_freqs.cumulative(symbol_pair.first - MIN_SYMBOL);
+    }
     
-    if(symbol_pair.first == c_freqs.left.rbegin()->first)
+    if(symbol_pair.first == max_symbol())
         symbol_pair.second = symbol_pair.first; // last symbol can't be ambiguous on the low end
-    else if(c_freqs.left.find(symbol_pair.first)->second > c_freq_pair.second)
+    else if(c_freq > c_freq_pair.second)
         symbol_pair.second = symbol_pair.first; // unambiguously this symbol
     else
         symbol_pair.second = symbol_pair.first + 1;
-
-
     
     return symbol_pair;
 }
@@ -202,7 +259,7 @@ void dccl::arith::Model::update_model(symbol_type symbol, ModelState state)
     if(!user_model_.is_adaptive())
         return;
 
-    boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
+    CumulativeFrequencies& c_freqs = (state == ENCODER) ?
         encoder_cumulative_freqs_ :
         decoder_cumulative_freqs_;
 
@@ -210,35 +267,362 @@ void dccl::arith::Model::update_model(symbol_type symbol, ModelState state)
     {
         dlog << "Model was: " << std::endl;
         for(symbol_type i = MIN_SYMBOL, n = max_symbol(); i <= n; ++i)
-        {
-            boost::bimap<symbol_type, freq_type>::left_iterator it =
-                c_freqs.left.find(i);
-            if(it != c_freqs.left.end())
-                dlog << "Symbol: " << it->first << ", c_freq: " << it->second << std::endl;
-        }
+            dlog << "Symbol: " << i << ", c_freq: " << c_freqs.cumulative(i - MIN_SYMBOL) << std::endl;
+    }
+
+    c_freqs.add(symbol - MIN_SYMBOL, 1);
+    if(scratch_)
+        scratch_->updates_.push_back(std::make_pair(symbol, state));
+
+    if(dlog.is(DEBUG3))
+    {
+        dlog << "Model is now: " << std::endl;
+        for(symbol_type i = MIN_SYMBOL, n = max_symbol(); i <= n; ++i)
+            dlog << "Symbol: " << i << ", c_freq: " << c_freqs.cumulative(i - MIN_SYMBOL) << std::endl;
     }
     
+    dlog.is(DEBUG3) && dlog << "total freq: " << total_freq(state) << std::endl;
                 
-    for(symbol_type i = max_symbol(), n = symbol; i >= n; --i)
+}
+
+dccl::arith::Model& dccl::arith::Model::operator=(const Model& other)
+{
+    // keep our own ScratchScope (if any)
+    user_model_ = other.user_model_;
+    encoder_cumulative_freqs_ = other.encoder_cumulative_freqs_;
+    decoder_cumulative_freqs_ = other.decoder_cumulative_freqs_;
+    static_cumulative_freqs_ = other.static_cumulative_freqs_;
+    symbol_lookup_ = other.symbol_lookup_;
+    symbol_lookup_shift_ = other.symbol_lookup_shift_;
+    return *this;
+}
+
+dccl::arith::Model::ScratchScope::ScratchScope(Model* model)
+    : model_(model),
+      previous_(model->scratch_)
+{
+    model_->scratch_ = this;
+}
+
+dccl::arith::Model::ScratchScope::~ScratchScope()
+{
+    for(std::vector<std::pair<symbol_type, ModelState> >::reverse_iterator it = updates_.rbegin(), end = updates_.rend(); it != end; ++it)
     {
-        boost::bimap<symbol_type, freq_type>::left_iterator it =
-            c_freqs.left.find(i);
-        if(it != c_freqs.left.end())
-            c_freqs.left.replace_data(it, it->second + 1);
+        CumulativeFrequencies& c_freqs = (it->second == ENCODER) ?
+            model_->encoder_cumulative_freqs_ :
+            model_->decoder_cumulative_freqs_;
+        c_freqs.subtract(it->first - MIN_SYMBOL, 1);
     }
+    model_->scratch_ = previous_;
+}
 
-    if(dlog.is(DEBUG3))
+namespace
+{
+    void init_recursive_mutex(pthread_mutex_t* mutex)
     {
-        dlog << "Model is now: " << std::endl;
-        for(symbol_type i = MIN_SYMBOL, n = max_symbol(); i <= n; ++i)
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    
+    pthread_once_t thread_setup_once = PTHREAD_ONCE_INIT;
+    // LinkModels* in scope on each thread
+    pthread_key_t current_link_key;
+    // see ModelManager::lock_default_models()
+    pthread_mutex_t default_models_mutex;
+
+    void thread_setup()
+    {
+        pthread_key_create(&current_link_key, 0);
+        init_recursive_mutex(&default_models_mutex);
+    }
+
+    class ScopedLock
+    {
+      public:
+      ScopedLock(pthread_mutex_t* mutex) : mutex_(mutex)
+        { pthread_mutex_lock(mutex_); }
+        ~ScopedLock()
+        { pthread_mutex_unlock(mutex_); }
+      private:
+        pthread_mutex_t* mutex_;
+    };
+}
+
+void dccl::arith::ModelManager::set_model(const protobuf::ArithmeticModel& model)
+{
+    Model new_model(model);
+    create_and_validate_model(&new_model);
+
+    lock_default_models();
+    ScopedLock lock(&mutex_);
+    // replace in place so that the pointers in models_by_index_ stay valid
+    std::map<std::string, Model>::iterator it = arithmetic_models_.find(model.name());
+    if(it != arithmetic_models_.end())
+    {
+        it->second = new_model;
+        initial_models_[name_to_index_[model.name()]] = new_model;
+    }
+    else
+    {
+        it = arithmetic_models_.insert(std::make_pair(model.name(), new_model)).first;
+        name_to_index_[model.name()] = models_by_index_.size();
+        models_by_index_.push_back(&it->second);
+        initial_models_.push_back(new_model);
+    }
+    unlock_default_models();
+}
+
+dccl::arith::Model& dccl::arith::ModelManager::find(const std::string& name)
+{
+    ScopedLock lock(&mutex_);
+    std::map<std::string, Model>::iterator it = arithmetic_models_.find(name);
+    if(it == arithmetic_models_.end())
+        throw(Exception("Cannot find model called: " + name));
+    else
+        return it->second;
+}
+
+int dccl::arith::ModelManager::find_index(const std::string& name)
+{
+    std::map<std::string, int>::const_iterator it = name_to_index_.find(name);
+    if(it == name_to_index_.end())
+        throw(Exception("Cannot find model called: " + name));
+    return it->second;
+}
+
+int dccl::arith::ModelManager::find_index(const google::protobuf::FieldDescriptor* field)
+{
+    ScopedLock lock(&mutex_);
+    // look up the model by name only once for each field
+    std::map<const google::protobuf::FieldDescriptor*, int>::const_iterator it = field_to_index_.find(field);
+    if(it != field_to_index_.end())
+        return it->second;
+
+    int index = find_index(field->options().GetExtension(dccl::field).GetExtension(arithmetic).model());
+    field_to_index_.insert(std::make_pair(field, index));
+    return index;
+}
+
+dccl::arith::Model& dccl::arith::ModelManager::find(int index)
+{
+    ScopedLock lock(&mutex_);
+    return *models_by_index_.at(index);
+}
+
+dccl::arith::Model dccl::arith::ModelManager::initial_model(int index)
+{
+    ScopedLock lock(&mutex_);
+    return initial_models_.at(index);
+}
+
+void dccl::arith::ModelManager::lock_default_models()
+{
+    pthread_once(&thread_setup_once, thread_setup);
+    pthread_mutex_lock(&default_models_mutex);
+}
+
+void dccl::arith::ModelManager::unlock_default_models()
+{
+    pthread_mutex_unlock(&default_models_mutex);
+}
+
+void dccl::arith::ModelManager::set_last_bits(const std::string& message, const std::string& field, const Bitset& bits)
+{
+    ScopedLock lock(&mutex_);
+    last_bits_map_[message][field] = bits;
+}
+
+dccl::Bitset dccl::arith::ModelManager::last_bits(const std::string& message, const std::string& field)
+{
+    ScopedLock lock(&mutex_);
+    return last_bits_map_[message][field];
+}
+
+// the link mutexes are recursive so that LinkScopes for the same link may be nested
+dccl::arith::LinkModels::LinkModels()
+{
+    init_recursive_mutex(&mutex_);
+}
+
+dccl::arith::LinkModels::LinkModels(const LinkModels& other)
+{
+    init_recursive_mutex(&mutex_);
+    ScopedLock lock(const_cast<pthread_mutex_t*>(&other.mutex_));
+    models_ = other.models_;
+}
+
+dccl::arith::LinkModels& dccl::arith::LinkModels::operator=(const LinkModels& other)
+{
+    if(this != &other)
+    {
+        // copy first, so that the two links are never locked at the same time
+        std::map<int, Model> models;
+        {
+            ScopedLock lock(const_cast<pthread_mutex_t*>(&other.mutex_));
+            models = other.models_;
+        }
+        ScopedLock lock(&mutex_);
+        models_.swap(models);
+    }
+    return *this;
+}
+
+dccl::arith::LinkModels::~LinkModels()
+{
+    pthread_mutex_destroy(&mutex_);
+}
+
+dccl::arith::Model& dccl::arith::LinkModels::find(const std::string& name)
+{
+    int index;
+    {
+        ScopedLock lock(&ModelManager::mutex_);
+        index = ModelManager::find_index(name);
+    }
+    return find(index);
+}
+
+dccl::arith::Model& dccl::arith::LinkModels::find(int index)
+{
+    ScopedLock lock(&mutex_);
+    std::map<int, Model>::iterator it = models_.find(index);
+    if(it == models_.end())
+        it = models_.insert(std::make_pair(index, ModelManager::initial_model(index))).first;
+    return it->second;
+}
+
+void dccl::arith::LinkModels::reset()
+{
+    ScopedLock lock(&mutex_);
+    models_.clear();
+}
+
+dccl::arith::LinkModels* dccl::arith::LinkModels::current()
+{
+    pthread_once(&thread_setup_once, thread_setup);
+    return static_cast<LinkModels*>(pthread_getspecific(current_link_key));
+}
+
+dccl::arith::Model& dccl::arith::LinkModels::find_current(const google::protobuf::FieldDescriptor* field)
+{
+    const int index = ModelManager::find_index(field);
+    LinkModels* link = current();
+    return link ? link->find(index) : ModelManager::find(index);
+}
+
+dccl::arith::Model& dccl::arith::LinkModels::find_current(const std::string& name)
+{
+    LinkModels* link = current();
+    return link ? link->find(name) : ModelManager::find(name);
+}
+
+dccl::arith::LinkScope::LinkScope(LinkModels* link)
+    : link_(link),
+      previous_(LinkModels::current())
+{
+    pthread_mutex_lock(&link_->mutex_);
+    pthread_setspecific(current_link_key, link_);
+}
+
+dccl::arith::LinkScope::~LinkScope()
+{
+    pthread_setspecific(current_link_key, previous_);
+    pthread_mutex_unlock(&link_->mutex_);
+}
+
+const int dccl::arith::ContextModels::NO_CONTEXT;
+
+dccl::arith::ContextModels::ContextModels(const google::protobuf::FieldDescriptor* field,
+                                          const google::protobuf::Message* root_message,
+                                          bool scratch)
+    : scratch_(scratch),
+      options_(field->options().GetExtension(dccl::field).GetExtension(arithmetic)),
+      model_(0),
+      field_context_(NO_CONTEXT)
+{
+    // (after scratch_scopes_ is constructed)
+    model_ = use(&LinkModels::find_current(field));
+    
+    if(!options_.context_model_size())
+        return;
+
+    // cache of the model for each context seen
+    context_models_.insert(std::make_pair(NO_CONTEXT, model_));
+    
+    if(options_.has_context_field())
+    {
+        if(!root_message || root_message->GetDescriptor() != field->containing_type())
+            throw(Exception("(dccl.field).arithmetic.context_field is only supported for fields of the root message"));
+
+        const google::protobuf::FieldDescriptor* context_field = field->containing_type()->FindFieldByName(options_.context_field());
+        const google::protobuf::Reflection* refl = root_message->GetReflection();
+        if(!refl->HasField(*root_message, context_field))
+            return;
+        
+        // as pre_encode() of ArithmeticFieldCodec
+        Model::value_type value = 0;
+        switch(context_field->cpp_type())
         {
-            boost::bimap<symbol_type, freq_type>::left_iterator it =
-                c_freqs.left.find(i);
-            if(it != c_freqs.left.end())
-                dlog << "Symbol: " << it->first << ", c_freq: " << it->second << std::endl;
+            case google::protobuf::FieldDescriptor::CPPTYPE_INT32: value = refl->GetInt32(*root_message, context_field); break;
+            case google::protobuf::FieldDescriptor::CPPTYPE_INT64: value = refl->GetInt64(*root_message, context_field); break;
+            case google::protobuf::FieldDescriptor::CPPTYPE_UINT32: value = refl->GetUInt32(*root_message, context_field); break;
+            case google::protobuf::FieldDescriptor::CPPTYPE_UINT64: value = refl->GetUInt64(*root_message, context_field); break;
+            case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: value = refl->GetDouble(*root_message, context_field); break;
+            case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: value = refl->GetFloat(*root_message, context_field); break;
+            case google::protobuf::FieldDescriptor::CPPTYPE_BOOL: value = refl->GetBool(*root_message, context_field); break;
+            case google::protobuf::FieldDescriptor::CPPTYPE_ENUM: value = refl->GetEnum(*root_message, context_field)->number(); break;
+            default:
+                throw(Exception("(dccl.field).arithmetic.context_field must be a scalar or enum field"));
         }
+
+        // the value bounds do not change, so any instance of the model will do
+        const Model& context_model = ModelManager::find(context_field->options().GetExtension(dccl::field).GetExtension(arithmetic).model());
+        field_context_ = context_model.value_to_symbol(value);
+        
+        dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec) context from " << context_field->name() << " (" << value << "): " << field_context_ << std::endl;
     }
+}
+
+dccl::arith::Model& dccl::arith::ContextModels::find_in_context(const std::vector<Model::value_type>& values, unsigned value_index)
+{
+    int context = field_context_;
+    if(options_.context_previous_element())
+        context = value_index ? model_->value_to_symbol(values[value_index - 1]) : NO_CONTEXT;
+    if(context < 0)
+        context = NO_CONTEXT;
     
-    dlog.is(DEBUG3) && dlog << "total freq: " << total_freq(state) << std::endl;
-                
+    std::map<int, Model*>::iterator it = context_models_.find(context);
+    if(it == context_models_.end())
+    {
+        Model* model = model_;
+        if(context < options_.context_model_size() && !options_.context_model(context).empty())
+            model = use(&LinkModels::find_current(options_.context_model(context)));
+        it = context_models_.insert(std::make_pair(context, model)).first;
+    }
+    return *it->second;
+}
+
+dccl::arith::Model* dccl::arith::ContextModels::use(Model* model)
+{
+    if(!scratch_ || !model->user_model().is_adaptive())
+        return model;
+
+    if(!scratch_scopes_.count(model))
+        scratch_scopes_.insert(std::make_pair(model, boost::shared_ptr<Model::ScratchScope>(new Model::ScratchScope(model))));
+    return model;
+}
+
+std::vector<const dccl::arith::Model*> dccl::arith::ContextModels::family(const google::protobuf::FieldDescriptor* field)
+{
+    const ::ArithmeticOptions options = field->options().GetExtension(dccl::field).GetExtension(arithmetic);
+    std::vector<const Model*> models(1, &LinkModels::find_current(field));
+    for(int i = 0, n = options.context_model_size(); i < n; ++i)
+    {
+        if(!options.context_model(i).empty())
+            models.push_back(&LinkModels::find_current(options.context_model(i)));
+    }
+    return models;
 }
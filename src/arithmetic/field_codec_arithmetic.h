@@ -27,9 +27,12 @@
 
 #include <limits>
 #include <algorithm>
+#include <vector>
+
+#include <pthread.h>
 
-#include <boost/bimap.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "dccl/field_codec_typed.h"
 
@@ -53,6 +56,74 @@ namespace dccl
     /// DCCL Arithmetic Encoder Library namespace 
     namespace arith
     {
+        /// \brief Cumulative frequencies of a set of symbols (indexed 0 ... size()-1), stored as a Fenwick (binary indexed) tree so that lookups and adaptive updates are O(log n).
+        class CumulativeFrequencies
+        {
+          public:
+            typedef uint32 freq_type;
+
+          CumulativeFrequencies() : total_(0), top_(0) { }
+
+            /// \brief Replace the contents with the given (non-cumulative) frequencies.
+            void assign(const std::vector<freq_type>& freqs);
+
+            /// \brief Sum of the frequencies of symbols [0, i].
+            freq_type cumulative(std::size_t i) const
+            {
+                freq_type sum = 0;
+                for(++i; i > 0; i -= i & (~i + 1))
+                    sum += tree_[i];
+                return sum;
+            }
+
+            /// \brief Frequency of symbol i.
+            freq_type frequency(std::size_t i) const { return freqs_[i]; }
+
+            /// \brief Sum of all frequencies.
+            freq_type total() const { return total_; }
+
+            std::size_t size() const { return freqs_.size(); }
+
+            /// \brief Add `delta` to the frequency of symbol i.
+            void add(std::size_t i, freq_type delta)
+            {
+                freqs_[i] += delta;
+                total_ += delta;
+                for(++i; i < tree_.size(); i += i & (~i + 1))
+                    tree_[i] += delta;
+            }
+
+            /// \brief Subtract `delta` from the frequency of symbol i (undoes add()).
+            void subtract(std::size_t i, freq_type delta)
+            {
+                freqs_[i] -= delta;
+                total_ -= delta;
+                for(++i; i < tree_.size(); i += i & (~i + 1))
+                    tree_[i] -= delta;
+            }
+
+            /// \brief The first symbol whose cumulative frequency is greater than `c_freq`, or size() if there is none.
+            std::size_t upper_bound(freq_type c_freq) const
+            {
+                std::size_t i = 0;
+                for(std::size_t step = top_; step > 0; step >>= 1)
+                {
+                    if(i + step < tree_.size() && tree_[i + step] <= c_freq)
+                    {
+                        i += step;
+                        c_freq -= tree_[i];
+                    }
+                }
+                return i;
+            }
+            
+          private:
+            std::vector<freq_type> freqs_;
+            std::vector<freq_type> tree_; // 1-based, tree_[0] unused
+            freq_type total_;
+            std::size_t top_; // largest power of two <= size()
+        };
+        
         class Model
         {
           public:
@@ -69,15 +140,28 @@ namespace dccl
             
             static const freq_type MAX_FREQUENCY = (1 << FREQUENCY_BITS) - 1;
 
-            
-            // maps message name -> map of field name -> last size (bits)
-            static std::map<std::string, std::map<std::string, Bitset> > last_bits_map;
+            // number of (most significant) bits of a cumulative frequency used to index the symbol lookup table of static models
+            static const int SYMBOL_LOOKUP_BITS = 10;
 
             
           Model(const protobuf::ArithmeticModel& user)
-              : user_model_(user)
+              : user_model_(user),
+                symbol_lookup_shift_(0),
+                scratch_(0)
             { }
 
+            // copies never share the ScratchScope of the original
+          Model(const Model& other)
+              : user_model_(other.user_model_),
+                encoder_cumulative_freqs_(other.encoder_cumulative_freqs_),
+                decoder_cumulative_freqs_(other.decoder_cumulative_freqs_),
+                static_cumulative_freqs_(other.static_cumulative_freqs_),
+                symbol_lookup_(other.symbol_lookup_),
+                symbol_lookup_shift_(other.symbol_lookup_shift_),
+                scratch_(0)
+            { }
+            Model& operator=(const Model& other);
+
             enum ModelState
             { ENCODER, DECODER };
             
@@ -94,12 +178,9 @@ namespace dccl
             
             freq_type total_freq(ModelState state) const
             {
-                
-                const boost::bimap<symbol_type, freq_type>& c_freqs = (state == ENCODER) ?
-                    encoder_cumulative_freqs_ :
-                    decoder_cumulative_freqs_;
-
-                return c_freqs.left.at(max_symbol());
+                return (state == ENCODER) ?
+                    encoder_cumulative_freqs_.total() :
+                    decoder_cumulative_freqs_.total();
             }
 
             void update_model(symbol_type symbol, ModelState state);
@@ -108,24 +189,49 @@ namespace dccl
             std::pair<freq_type, freq_type> symbol_to_cumulative_freq(symbol_type symbol, ModelState state) const;
             std::pair<symbol_type, symbol_type> cumulative_freq_to_symbol(std::pair<freq_type, freq_type> c_freq_pair,  ModelState state) const;
 
+            /// \brief While in scope, the updates made to `model` (update_model()) are recorded and undone at the end of the scope, so that sizes can be calculated with an adaptive model in place rather than with a copy of it. Use under a ModelLock.
+            class ScratchScope
+            {
+              public:
+                explicit ScratchScope(Model* model);
+                ~ScratchScope();
+
+              private:
+                ScratchScope(const ScratchScope&);
+                ScratchScope& operator=(const ScratchScope&);
+
+                friend class Model;
+                Model* model_;
+                ScratchScope* previous_;
+                std::vector<std::pair<symbol_type, ModelState> > updates_;
+            };
+
             friend class ModelManager;
           private:
+            void build_symbol_lookup();
+            
             protobuf::ArithmeticModel user_model_;
-            boost::bimap<symbol_type, freq_type> encoder_cumulative_freqs_;
-            boost::bimap<symbol_type, freq_type> decoder_cumulative_freqs_;
+            // indexed by symbol - MIN_SYMBOL
+            CumulativeFrequencies encoder_cumulative_freqs_;
+            CumulativeFrequencies decoder_cumulative_freqs_;
+
+            // static (non-adaptive) models only: flat cumulative frequencies (indexed by symbol - MIN_SYMBOL)
+            // and the first candidate symbol index for each value of (cumulative frequency >> symbol_lookup_shift_)
+            std::vector<freq_type> static_cumulative_freqs_;
+            std::vector<unsigned> symbol_lookup_;
+            int symbol_lookup_shift_;
+
+            // innermost ScratchScope on this model (null if none)
+            ScratchScope* scratch_;
         };
 
+        class LinkModels;
+        
         class ModelManager
         {
           public:
-            static void set_model(const protobuf::ArithmeticModel& model)
-            {
-                Model new_model(model);
-                create_and_validate_model(&new_model);
-                if(arithmetic_models_.count(model.name()))
-                    arithmetic_models_.erase(model.name());
-                arithmetic_models_.insert(std::make_pair(model.name(), new_model));
-            }
+            /// \brief Add a model (or replace the model with the same name). Links (LinkModels) that have already used the old model keep their copy until LinkModels::reset().
+            static void set_model(const protobuf::ArithmeticModel& model);
 
             static void create_and_validate_model(Model* model)
             {
@@ -136,7 +242,7 @@ namespace dccl
                                     "Missing fields: " + model->user_model_.InitializationErrorString()));
                 }
 
-                Model::freq_type cumulative_freq = 0;
+                std::vector<Model::freq_type> freqs;
                 for(Model::symbol_type symbol = Model::MIN_SYMBOL, n = model->user_model_.frequency_size(); symbol < n; ++symbol)
                 {
                     Model::freq_type freq;
@@ -153,13 +259,15 @@ namespace dccl
                                         model->user_model_.DebugString() +
                                         "All frequencies must be nonzero."));
                     }                      
-                    cumulative_freq += freq;
-                    model->encoder_cumulative_freqs_.left.insert(std::make_pair(symbol, cumulative_freq));
-                    
+                    freqs.push_back(freq);
                 }
+                model->encoder_cumulative_freqs_.assign(freqs);
 
                 // must have separate models for adaptive encoding.
                 model->decoder_cumulative_freqs_ = model->encoder_cumulative_freqs_;
+
+                model->static_cumulative_freqs_.clear();
+                model->symbol_lookup_.clear();
                 
                 if(model->total_freq(Model::ENCODER) > Model::MAX_FREQUENCY)
                 {
@@ -187,20 +295,150 @@ namespace dccl
                                     model->user_model_.DebugString() +
                                     "`value_bound` must be monotonically increasing."));
                 }
+
+                if(!model->user_model_.is_adaptive())
+                    model->build_symbol_lookup();
             }
             
 
-            static Model& find(const std::string& name)
-            {
-                std::map<std::string, Model>::iterator it = arithmetic_models_.find(name);
-                if(it == arithmetic_models_.end())
-                    throw(Exception("Cannot find model called: " + name));
-                else
-                    return it->second;
-            }
+            /// \brief The process-wide instance of a model (used when no LinkScope is active).
+            static Model& find(const std::string& name);
+
+            /// \brief Stable index of the model used by a field (given by (dccl.field).arithmetic.model), for use with find(int) and LinkModels::find(int).
+            static int find_index(const google::protobuf::FieldDescriptor* field);
+
+            /// \brief The process-wide instance of a model by index (see find_index()).
+            static Model& find(int index);
+
+            /// \brief Copy of a model by index as given to set_model(), with no adaptive updates.
+            static Model initial_model(int index);
+
+            // serializes coding with the process-wide models, whose adaptive state is shared by all threads (recursive)
+            static void lock_default_models();
+            static void unlock_default_models();
+
+            /// \brief Record the bits of the last encode of a (arithmetic).debug_assert field, for comparison by the next decode of that field (on any link or thread).
+            static void set_last_bits(const std::string& message, const std::string& field, const Bitset& bits);
+            /// \brief The bits recorded by set_last_bits() (empty if none).
+            static Bitset last_bits(const std::string& message, const std::string& field);
+            
+          private:
+            friend class LinkModels;
+            static int find_index(const std::string& name);
 
           private:
             static std::map<std::string, Model> arithmetic_models_;
+
+            // pointers into arithmetic_models_ (whose elements are never erased, see set_model())
+            static std::vector<Model*> models_by_index_;
+            // copies of the models as given to set_model()
+            static std::vector<Model> initial_models_;
+            static std::map<std::string, int> name_to_index_;
+            static std::map<const google::protobuf::FieldDescriptor*, int> field_to_index_;
+            // maps message name -> map of field name -> last bits encoded (for debug_assert)
+            static std::map<std::string, std::map<std::string, Bitset> > last_bits_map_;
+
+            // guards all of the above
+            static pthread_mutex_t mutex_;
+        };
+
+        /// \brief A set of arithmetic models with their own adaptive state, e.g. for one link to a remote node.
+        ///
+        /// Adaptive models (`is_adaptive`) change with every message coded, so the encoder and decoder must see the same sequence of messages. When talking to several nodes, keep one LinkModels per node and select it with LinkScope around each encode and decode for that node. Each model is copied from the one given to ModelManager::set_model() on its first use on the link.
+        ///
+        /// Copying a LinkModels takes a snapshot of its adaptive state, and assigning one restores it (neither may be done on a link that is in scope on the calling thread).
+        class LinkModels
+        {
+          public:
+            LinkModels();
+            LinkModels(const LinkModels& other);
+            LinkModels& operator=(const LinkModels& other);
+            ~LinkModels();
+
+            /// \brief The instance of model `name` used on this link.
+            Model& find(const std::string& name);
+
+            /// \brief The instance of a model used on this link, by index (see ModelManager::find_index()).
+            Model& find(int index);
+
+            /// \brief Discard all adaptive state, so that models restart from their ModelManager::set_model() frequencies.
+            void reset();
+
+            /// \brief The LinkModels in scope on the calling thread, or null if none.
+            static LinkModels* current();
+
+            /// \brief The instance of `field`'s model for the LinkModels in scope on the calling thread, or the process-wide instance if there is none.
+            static Model& find_current(const google::protobuf::FieldDescriptor* field);
+
+            /// \brief As find_current(const google::protobuf::FieldDescriptor*), for model `name`.
+            static Model& find_current(const std::string& name);
+            
+          private:
+            friend class LinkScope;
+            std::map<int, Model> models_;
+            pthread_mutex_t mutex_;
+        };
+
+        /// \brief For the lifetime of this object, arithmetic field codecs called from this thread use (and update) the models of `link`. The link is locked for the lifetime of the scope, so a link is used by one thread at a time, while different links may be used by different threads.
+        class LinkScope
+        {
+          public:
+            explicit LinkScope(LinkModels* link);
+            ~LinkScope();
+            
+          private:
+            LinkScope(const LinkScope&);
+            LinkScope& operator=(const LinkScope&);
+            
+            LinkModels* link_;
+            LinkModels* previous_;
+        };
+
+        /// \brief The models used for the elements of one field during one encode, decode or size: (dccl.field).arithmetic.model, or one of its context_model chosen by the context (see ArithmeticOptions). Use under a ModelLock.
+        class ContextModels
+        {
+          public:
+            /// \param field Field being coded
+            /// \param root_message Message being coded (for context_field)
+            /// \param scratch Undo the updates made to adaptive models when this goes out of scope, leaving them unchanged (for size calculations)
+            ContextModels(const google::protobuf::FieldDescriptor* field,
+                          const google::protobuf::Message* root_message,
+                          bool scratch);
+
+            /// \brief The model for element `value_index`, given the elements before it.
+            Model& find(const std::vector<Model::value_type>& values, unsigned value_index)
+            { return context_models_.empty() ? *model_ : find_in_context(values, value_index); }
+            
+            /// \brief (dccl.field).arithmetic.model and the models listed in context_model, for computing size bounds.
+            static std::vector<const Model*> family(const google::protobuf::FieldDescriptor* field);
+            
+          private:
+            Model& find_in_context(const std::vector<Model::value_type>& values, unsigned value_index);
+            Model* use(Model* model);
+            
+            static const int NO_CONTEXT = -1;
+            
+            bool scratch_;
+            ::ArithmeticOptions options_;
+            Model* model_;
+            int field_context_;
+            std::map<int, Model*> context_models_;
+            std::map<const Model*, boost::shared_ptr<Model::ScratchScope> > scratch_scopes_;
+        };
+        
+        /// \brief Held by field codecs while coding with the models returned by LinkModels::find_current(): serializes use of the process-wide models when no LinkScope is active (links are locked by LinkScope itself).
+        class ModelLock
+        {
+          public:
+          ModelLock() : locked_(!LinkModels::current())
+            { if(locked_) ModelManager::lock_default_models(); }
+            ~ModelLock()
+            { if(locked_) ModelManager::unlock_default_models(); }
+          private:
+            ModelLock(const ModelLock&);
+            ModelLock& operator=(const ModelLock&);
+            
+            bool locked_;
         };
         
         
@@ -221,20 +459,39 @@ namespace dccl
               
               Bitset encode_repeated(const std::vector<Model::value_type>& wire_value,
                                      bool update_model)
+              {
+                  ModelLock lock;
+                  Bitset bits;
+                  ContextModels models(FieldCodecBase::this_field(), FieldCodecBase::root_message(), false);
+                  encode_interval(models, wire_value, update_model, &bits);
+
+                  if(FieldCodecBase::dccl_field_options().GetExtension(arithmetic).debug_assert())
+                  {
+                      // bit of a hack so I can get at the exact bit field sizes
+                      ModelManager::set_last_bits(FieldCodecBase::this_descriptor()->full_name(), FieldCodecBase::this_field()->name(), bits);
+                  }
+                  
+                  return bits;
+              }
+
+              // runs the encoder over `wire_value`, appending the output to `bits` (if not null), and returns the number of bits output
+              unsigned encode_interval(ContextModels& models,
+                                       const std::vector<Model::value_type>& wire_value,
+                                       bool update_model,
+                                       Bitset* bits)
               {
                   using dccl::dlog;
                   using namespace dccl::logger;
                   
-                  Model& model = current_model();
-
                   uint64 low = 0; // lowest code value (0.0 in decimal version)
                   uint64 high = TOP_VALUE; // highest code value (1.0 in decimal version)
                   int bits_to_follow = 0; // bits to follow with after expanding around half
-                  Bitset bits;
+                  unsigned size = 0;
 
                   
                   for(unsigned value_index = 0, n = max_repeat(); value_index < n; ++value_index)
                   {
+                      Model& model = models.find(wire_value, value_index);
                       Model::symbol_type symbol = Model::EOF_SYMBOL;
 
                       if(wire_value.size() > value_index)
@@ -309,12 +566,12 @@ namespace dccl
                       {
                           if(high<HALF)
                           {
-                              bit_plus_follow(&bits, &bits_to_follow, 0);
+                              bit_plus_follow(bits, &bits_to_follow, 0, &size);
                               dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec): completely in [0, 0.5): EXPAND" << std::endl;
                           }
                           else if(low>=HALF)
                           {
-                              bit_plus_follow(&bits, &bits_to_follow, 1);
+                              bit_plus_follow(bits, &bits_to_follow, 1, &size);
                               low -= HALF;
                               high -= HALF;
                               dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec): completely in [0.5, 1): EXPAND" << std::endl;
@@ -354,13 +611,13 @@ namespace dccl
                   if(low == 0) // high must be greater than half
                   {
                       if(high != TOP_VALUE || bits_to_follow > 0)
-                          bit_plus_follow(&bits, &bits_to_follow, 0);
+                          bit_plus_follow(bits, &bits_to_follow, 0, &size);
                   }
                   // 0    .     .     .     1
                   //       |                | -- output a single 1
                   else if(high == TOP_VALUE) // 0 < low < half
                   {
-                      bit_plus_follow(&bits, &bits_to_follow, 1);
+                      bit_plus_follow(bits, &bits_to_follow, 1, &size);
                   }
                   // 0    .     .     .     1
                   //     |           |        -- output 01
@@ -368,22 +625,29 @@ namespace dccl
                   else 
                   {
                       bits_to_follow += 1;
-                      bit_plus_follow(&bits, &bits_to_follow, (low < FIRST_QTR) ? 0 : 1);
-                  }
-                  
-                  if(FieldCodecBase::dccl_field_options().GetExtension(arithmetic).debug_assert())
-                  {
-                      // bit of a hack so I can get at the exact bit field sizes
-                      Model::last_bits_map[FieldCodecBase::this_descriptor()->full_name()][FieldCodecBase::this_field()->name()] = bits;
+                      bit_plus_follow(bits, &bits_to_follow, (low < FIRST_QTR) ? 0 : 1, &size);
                   }
-
                   
-                  return bits;
+                  return size;
               }
 
               
               void bit_plus_follow(Bitset* bits, int* bits_to_follow, bool bit)
               {
+                  unsigned size = 0;
+                  bit_plus_follow(bits, bits_to_follow, bit, &size);
+              }
+
+              // as above, but `bits` may be null, in which case the bits are only counted (in `size`)
+              void bit_plus_follow(Bitset* bits, int* bits_to_follow, bool bit, unsigned* size)
+              {
+                  *size += 1 + *bits_to_follow;
+                  if(!bits)
+                  {
+                      *bits_to_follow = 0;
+                      return;
+                  }
+                  
                   bits->push_back(bit);
                   dccl::dlog.is(dccl::logger::DEBUG3) && dccl::dlog << "(ArithmeticFieldCodec): emitted bit: " << bit << std::endl;
                   
@@ -403,7 +667,8 @@ namespace dccl
                   
                   std::vector<Model::value_type> values;
 
-                  Model& model = current_model();
+                  ModelLock lock;
+                  ContextModels models(FieldCodecBase::this_field(), FieldCodecBase::root_message(), false);
                   
                   uint64 value = 0;
                   uint64 low = 0;
@@ -413,11 +678,10 @@ namespace dccl
                   // there are `bit_stream_offset` zeros in the lower bits of `value`
                   int bit_stream_offset = Model::CODE_VALUE_BITS - bits->size();
                   
-                  for(int i = 0, n = Model::CODE_VALUE_BITS; i < n; ++i)
-                  {
-                      if(i >= bit_stream_offset)
-                          value |= (static_cast<uint64>((*bits)[bits->size()-(i-bit_stream_offset)-1]) << i);
-                  }
+                  // the first bit of the stream is the most significant bit of `value`
+                  Bitset::const_iterator bit_it = bits->begin();
+                  for(int i = Model::CODE_VALUE_BITS - 1, n = std::max(bit_stream_offset, 0); i >= n; --i, ++bit_it)
+                      value |= static_cast<uint64>(*bit_it) << i;
 
                   dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec): starting value: " << Bitset(Model::CODE_VALUE_BITS, value).to_string() << std::endl;
                               
@@ -425,9 +689,10 @@ namespace dccl
                   
                   for(unsigned value_index = 0, n = max_repeat(); value_index < n; ++value_index)
                   {
+                      Model& model = models.find(values, value_index);
                       uint64 range = (high-low)+1;
 
-                      Model::symbol_type symbol = bits_to_symbol(bits, value, bit_stream_offset, low, range);
+                      Model::symbol_type symbol = bits_to_symbol(model, bits, value, bit_stream_offset, low, range);
                       
                       dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec) symbol is: " << symbol << std::endl;
                       
@@ -484,7 +749,7 @@ namespace dccl
                   if(FieldCodecBase::dccl_field_options().GetExtension(arithmetic).debug_assert())
                   {
                       // must consume same bits as encoded makes
-                      Bitset in = Model::last_bits_map[FieldCodecBase::this_descriptor()->full_name()][FieldCodecBase::this_field()->name()];
+                      Bitset in = ModelManager::last_bits(FieldCodecBase::this_descriptor()->full_name(), FieldCodecBase::this_field()->name());
                       
                       dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec) bits used is (" << bits->size() << "):     " << *bits << std::endl;
                       dlog.is(DEBUG3) && dlog << "(ArithmeticFieldCodec) bits original is (" << in.size() << "): " << in << std::endl;
@@ -499,37 +764,56 @@ namespace dccl
 
               unsigned size_repeated(const std::vector<Model::value_type>& wire_values)
               {
-                  // we should really cache this for efficiency
-                  return encode_repeated(wire_values, false).size();
+                  // only track the interval and count the bits it would output
+                  // (the interval depends on the updates made to adaptive models after each symbol, so undo them afterwards)
+                  ModelLock lock;
+                  ContextModels models(FieldCodecBase::this_field(), FieldCodecBase::root_message(), true);
+                  return encode_interval(models, wire_values, true, 0);
               }
             
 
               // this maximum size will be upper bounded by: ceil(log_2(1/P)) + 1 where P is the
               // probability of this least probable set of symbols
+              // (with context models, each element may use the least favorable model of the family)
               unsigned max_size_repeated()
               {
                   using dccl::log2;
                   
-                  Model& model = current_model();
-                  
-                  // if user doesn't provide out_of_range frequency, set it to max to force this
-                  // calculation to return the lowest probability symbol in use
-                  Model::freq_type out_of_range_freq = model.user_model().out_of_range_frequency();
-                  if(out_of_range_freq == 0)
-                      out_of_range_freq = Model::MAX_FREQUENCY;
-
-                  Model::value_type lowest_frequency = std::min(out_of_range_freq,
-                                                                *std::min_element(model.user_model().frequency().begin(), model.user_model().frequency().end()));
+                  ModelLock lock;
+                  std::vector<const Model*> models = ContextModels::family(FieldCodecBase::this_field());
+
+                  // bits for the least probable symbol, and for EOF
+                  double least_probable = 0, eof = 0;
+                  bool has_eof = false;
+                  for(std::vector<const Model*>::const_iterator it = models.begin(), end = models.end(); it != end; ++it)
+                  {
+                      const Model& model = **it;
+                      
+                      // if user doesn't provide out_of_range frequency, set it to max to force this
+                      // calculation to return the lowest probability symbol in use
+                      Model::freq_type out_of_range_freq = model.user_model().out_of_range_frequency();
+                      if(out_of_range_freq == 0)
+                          out_of_range_freq = Model::MAX_FREQUENCY;
+
+                      Model::value_type lowest_frequency = std::min(out_of_range_freq,
+                                                                    *std::min_element(model.user_model().frequency().begin(), model.user_model().frequency().end()));
+                      least_probable = std::max(least_probable, log2(model.total_freq(Model::ENCODER))-log2(lowest_frequency));
+
+                      Model::freq_type eof_freq = model.user_model().eof_frequency();
+                      if(eof_freq != 0)
+                      {
+                          has_eof = true;
+                          eof = std::max(eof, log2(model.total_freq(Model::ENCODER))-log2(eof_freq));
+                      }
+                  }
                   
                   // full of least probable symbols
-                  unsigned size_least_probable = (unsigned)(std::ceil(max_repeat()*(log2(model.total_freq(Model::ENCODER))-log2(lowest_frequency))));
+                  unsigned size_least_probable = (unsigned)(std::ceil(max_repeat()*least_probable));
                   
                   dccl::dlog.is(dccl::logger::DEBUG3) && dccl::dlog << "(ArithmeticFieldCodec) size_least_probable: " << size_least_probable << std::endl;
 
-                  
-                  Model::freq_type eof_freq = model.user_model().eof_frequency();                  
                   // almost full of least probable symbols plus EOF
-                  unsigned size_least_probable_plus_eof = (unsigned)((eof_freq != 0 ) ? std::ceil(max_repeat()*log2(model.total_freq(Model::ENCODER))-(max_repeat()-1)*log2(lowest_frequency)-log2(eof_freq)) : 0);
+                  unsigned size_least_probable_plus_eof = (unsigned)(has_eof ? std::ceil((max_repeat()-1)*least_probable + eof) : 0);
 
                   dccl::dlog.is(dccl::logger::DEBUG3) && dccl::dlog << "(ArithmeticFieldCodec) size_least_probable_plus_eof: " << size_least_probable_plus_eof << std::endl;
 
@@ -541,34 +825,68 @@ namespace dccl
               unsigned min_size_repeated()
               {
                   using dccl::log2;
-                  const Model& model = current_model();
+                  ModelLock lock;
+                  std::vector<const Model*> models = ContextModels::family(FieldCodecBase::this_field());
 
-                  if(model.user_model().is_adaptive())
-                      return 0; // force examining bits from the beginning on decode
+                  // bits for the most probable symbol, and for EOF
+                  double most_probable = std::numeric_limits<double>::max(), eof = std::numeric_limits<double>::max();
+                  for(std::vector<const Model*>::const_iterator it = models.begin(), end = models.end(); it != end; ++it)
+                  {
+                      const Model& model = **it;
+                      
+                      if(model.user_model().is_adaptive())
+                          return 0; // force examining bits from the beginning on decode
+                  
+                      // if user doesn't provide out_of_range frequency, set it to 1 (minimum) to force this
+                      // calculation to return the highest probability symbol in use
+                      Model::freq_type out_of_range_freq = model.user_model().out_of_range_frequency();
+                      if(out_of_range_freq == 0)
+                          out_of_range_freq = 1;
+
+                      Model::freq_type eof_freq = model.user_model().eof_frequency();
+                      if(eof_freq != 0)
+                          eof = std::min(eof, log2(model.total_freq(Model::ENCODER))-log2(eof_freq));
+
+                      Model::value_type highest_frequency = std::max(out_of_range_freq,
+                                                                     *std::max_element(model.user_model().frequency().begin(), model.user_model().frequency().end()));
+                      most_probable = std::min(most_probable, log2(model.total_freq(Model::ENCODER))-log2(highest_frequency));
+                  }
                   
-                  // if user doesn't provide out_of_range frequency, set it to 1 (minimum) to force this
-                  // calculation to return the highest probability symbol in use
-                  Model::freq_type out_of_range_freq = model.user_model().out_of_range_frequency();
-                  if(out_of_range_freq == 0)
-                      out_of_range_freq = 1;
-
-                  Model::freq_type eof_freq = model.user_model().eof_frequency();                  
                   // just EOF
-                  unsigned size_empty = (unsigned)((eof_freq != 0) ? std::ceil(log2(model.total_freq(Model::ENCODER))-log2(eof_freq)) : std::numeric_limits<unsigned>::max());
+                  unsigned size_empty = (eof != std::numeric_limits<double>::max()) ? (unsigned)std::ceil(eof) : std::numeric_limits<unsigned>::max();
                   
                   dccl::dlog.is(dccl::logger::DEBUG3) && dccl::dlog << "(ArithmeticFieldCodec) size_empty: " << size_empty << std::endl;
                   
                   // full with most probable symbol
-                  Model::value_type highest_frequency = std::max(out_of_range_freq,
-                                                                 *std::max_element(model.user_model().frequency().begin(), model.user_model().frequency().end()));
-                  
-                  unsigned size_most_probable = (unsigned)(std::ceil(max_repeat()*(log2(model.total_freq(Model::ENCODER))-log2(highest_frequency))));
+                  unsigned size_most_probable = (unsigned)(std::ceil(max_repeat()*most_probable));
 
                   dccl::dlog.is(dccl::logger::DEBUG3) && dccl::dlog << "(ArithmeticFieldCodec) size_most_probable: " << size_most_probable << std::endl;
                   
                   return std::min(size_empty, size_most_probable);
               }
           
+              bool adaptive()
+              {
+                  ModelLock lock;
+                  std::vector<const Model*> models = ContextModels::family(FieldCodecBase::this_field());
+                  for(std::vector<const Model*>::const_iterator it = models.begin(), end = models.end(); it != end; ++it)
+                  {
+                      if((*it)->user_model().is_adaptive())
+                          return true;
+                  }
+                  return false;
+              }
+
+              std::string validation_state()
+              {
+                  ModelLock lock;
+                  std::string state;
+                  std::vector<const Model*> models = ContextModels::family(FieldCodecBase::this_field());
+                  for(std::vector<const Model*>::const_iterator it = models.begin(), end = models.end(); it != end; ++it)
+                      state += (*it)->user_model().SerializeAsString();
+                  return state;
+              }
+
               void validate()
               {
                   FieldCodecBase::require(FieldCodecBase::dccl_field_options().HasExtension(arithmetic),
@@ -583,19 +901,73 @@ namespace dccl
                   {
                       FieldCodecBase::require(false, "no such (dccl.field).arithmetic.model called \"" + model_name + "\" loaded.");
                   }
+
+                  validate_context();
               }
 
 
               // end inherited methods
 
+              void validate_context()
+              {
+                  const ::ArithmeticOptions options = FieldCodecBase::dccl_field_options().GetExtension(arithmetic);
+                  const google::protobuf::FieldDescriptor* field = FieldCodecBase::this_field();
+
+                  for(int i = 0, n = options.context_model_size(); i < n; ++i)
+                  {
+                      try
+                      {
+                          if(!options.context_model(i).empty())
+                              ModelManager::find(options.context_model(i));
+                      }
+                      catch(Exception& e)
+                      {
+                          FieldCodecBase::require(false, "no such (dccl.field).arithmetic.context_model called \"" + options.context_model(i) + "\" loaded.");
+                      }
+                  }
+
+                  FieldCodecBase::require(!options.context_model_size() || options.has_context_field() || options.context_previous_element(),
+                                          "(dccl.field).arithmetic.context_model requires context_field or context_previous_element");
+                  FieldCodecBase::require(!(options.has_context_field() && options.context_previous_element()),
+                                          "(dccl.field).arithmetic.context_field and context_previous_element cannot both be used");
+                  FieldCodecBase::require(!options.context_previous_element() || field->is_repeated(),
+                                          "(dccl.field).arithmetic.context_previous_element requires a repeated field");
+                  
+                  if(options.has_context_field())
+                  {
+                      const google::protobuf::FieldDescriptor* context_field = field->containing_type()->FindFieldByName(options.context_field());
+                      FieldCodecBase::require(context_field, "no such (dccl.field).arithmetic.context_field \"" + options.context_field() + "\"");
+                      FieldCodecBase::require(!context_field->is_repeated() && context_field->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE,
+                                              "(dccl.field).arithmetic.context_field must be a non-repeated scalar or enum field");
+                      
+                      const DCCLFieldOptions context_options = context_field->options().GetExtension(dccl::field);
+                      FieldCodecBase::require(context_options.HasExtension(arithmetic),
+                                              "(dccl.field).arithmetic.context_field must have a model ((dccl.field).arithmetic.model)");
+
+                      // the decoder must already have the context
+                      const bool in_head = field->options().GetExtension(dccl::field).in_head();
+                      FieldCodecBase::require((context_options.in_head() && !in_head) ||
+                                              (context_options.in_head() == in_head && context_field->index() < field->index()),
+                                              "(dccl.field).arithmetic.context_field must be coded before this field");
+                  }
+              }
+
               Model::symbol_type bits_to_symbol(Bitset* bits,
                                                 uint64& value,
                                                 int& bit_stream_offset,
                                                 uint64 low,
                                                 uint64 range)
               {
-                  Model& model = current_model();
-                  
+                  return bits_to_symbol(current_model(), bits, value, bit_stream_offset, low, range);
+              }
+              
+              Model::symbol_type bits_to_symbol(const Model& model,
+                                                Bitset* bits,
+                                                uint64& value,
+                                                int& bit_stream_offset,
+                                                uint64 low,
+                                                uint64 range)
+              {
                   for(;;)
                   {
                       uint64 value_high = (bit_stream_offset > 0) ?
@@ -645,14 +1017,7 @@ namespace dccl
               }
 
               Model& current_model()
-              {
-                  std::string name = FieldCodecBase::dccl_field_options().GetExtension(arithmetic).model();
-                  return ModelManager::find(name);
-              }
-              
-              
-              
-              
+              { return LinkModels::find_current(FieldCodecBase::this_field()); }
             };
 
         // constant integer definitions
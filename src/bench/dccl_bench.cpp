@@ -0,0 +1,985 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// microbenchmarks for the DCCL library: run with --benchmark_format=console for
+// a human-readable table; JSON (--benchmark_format=json) is the default
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include "dccl/codec.h"
+#include "dccl/binary.h"
+#include "dccl/version.h"
+#include "dccl/field_codec_typed.h"
+#include "dccl/dynamic_protobuf_manager.h"
+#include "dccl/load_cache.h"
+#include "dccl/message_generator.h"
+
+#include "synthetic_schema.h"
+
+#include "dccl/bench/bench.pb.h"
+#include "dccl/test/dccl_all_fields/test.pb.h"
+#include "dccl/test/dccl_repeated/test.pb.h"
+#include "dccl/test/dccl_header/test.pb.h"
+#include "dccl/test/dccl_custom_message/test.pb.h"
+
+#ifdef DCCL_BENCH_ARITHMETIC
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+#include "dccl/range/field_codec_range.h"
+#include "dccl/bench/bench_arithmetic.pb.h"
+#endif
+
+#ifdef DCCL_CCL_COMPAT_NAME
+#include <boost/date_time.hpp>
+#include "dccl/ccl/ccl_compatibility.h"
+#include "dccl/ccl/ccl_transcoder.h"
+#endif
+
+using dccl::Bitset;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+namespace dccl
+{
+    namespace test
+    {
+        // equivalents of the codecs defined in the dccl_custom_message test, without the output
+        class CustomCodec : public dccl::TypedFixedFieldCodec<CustomMsg>
+        {
+        private:
+            unsigned size() { return (part() == dccl::HEAD) ? 0 : A_SIZE + B_SIZE; }
+            Bitset encode() { return Bitset(size()); }
+
+            Bitset encode(const CustomMsg& msg)
+                {
+                    if(part() == dccl::HEAD)
+                        return encode();
+
+                    Bitset a(A_SIZE, static_cast<unsigned long>(msg.a()));
+                    Bitset b(B_SIZE, static_cast<unsigned long>(msg.b()));
+                    a.append(b);
+                    return a;
+                }
+
+            CustomMsg decode(Bitset* bits)
+                {
+                    if(part() == dccl::HEAD)
+                        throw dccl::NullValueException();
+
+                    Bitset a = *bits;
+                    a.resize(A_SIZE);
+                    Bitset b = *bits;
+                    b >>= A_SIZE;
+                    b.resize(B_SIZE);
+
+                    CustomMsg msg;
+                    msg.set_a(a.to_ulong());
+                    msg.set_b(b.to_ulong());
+                    return msg;
+                }
+
+            void validate() { }
+
+            enum { A_SIZE = 32 };
+            enum { B_SIZE = 1 };
+        };
+
+        class Int32RepeatedCodec : public dccl::RepeatedTypedFieldCodec<dccl::int32>
+        {
+        private:
+            enum { REPEAT_STORAGE_BITS = 4 };
+
+            dccl::int32 max() { return FieldCodecBase::dccl_field_options().max(); }
+            dccl::int32 min() { return FieldCodecBase::dccl_field_options().min(); }
+            dccl::int32 max_repeat() { return FieldCodecBase::dccl_field_options().max_repeat(); }
+
+            Bitset encode_repeated(const std::vector<dccl::int32>& wire_values)
+                {
+                    int repeat_size = std::min<int>(wire_values.size(), max_repeat());
+                    Bitset out(REPEAT_STORAGE_BITS, repeat_size);
+                    for(int i = 0; i < repeat_size; ++i)
+                        out.append(Bitset(singular_size(), static_cast<unsigned long>(wire_values[i] - min())));
+                    return out;
+                }
+
+            std::vector<dccl::int32> decode_repeated(Bitset* bits)
+                {
+                    int repeat_size = bits->to_ulong();
+                    bits->get_more_bits(repeat_size*singular_size());
+
+                    Bitset value_bits = *bits;
+                    value_bits >>= REPEAT_STORAGE_BITS;
+
+                    std::vector<dccl::int32> out;
+                    for(int i = 0; i < repeat_size; ++i)
+                    {
+                        out.push_back((value_bits.to_ulong() & ((1 << singular_size()) - 1)) + min());
+                        value_bits >>= singular_size();
+                    }
+                    return out;
+                }
+
+            unsigned size_repeated(const std::vector<dccl::int32>& field_values)
+                { return REPEAT_STORAGE_BITS + field_values.size()*singular_size(); }
+
+            unsigned singular_size()
+                { return dccl::ceil_log2((max()-min())+1); }
+
+            unsigned max_size_repeated()
+                { return REPEAT_STORAGE_BITS + max_repeat()*singular_size(); }
+
+            unsigned min_size_repeated()
+                { return REPEAT_STORAGE_BITS; }
+
+            void validate() { }
+        };
+    }
+}
+
+namespace
+{
+    const int BITSET_MIN = 8;
+    const int BITSET_MAX = 1 << 12;
+
+    // Bitset primitives: the building blocks of every field codec
+    void BM_BitsetFromTo(benchmark::State& state)
+    {
+        unsigned long value = 0x5a5a5a5aUL;
+        Bitset bits;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            bits.from_ulong(value, state.range(0));
+            benchmark::DoNotOptimize(value = bits.to_ulong() + 1);
+        }
+    }
+    BENCHMARK(BM_BitsetFromTo)->ArgName("bits")->Arg(8)->Arg(32)->Arg(64);
+
+    void BM_BitsetAppend(benchmark::State& state)
+    {
+        Bitset chunk(8, 0xa5);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            Bitset bits;
+            for(int i = 0, n = state.range(0) / 8; i < n; ++i)
+                bits.append(chunk);
+            benchmark::DoNotOptimize(bits.size());
+        }
+        state.SetBytesProcessed(state.iterations() * state.range(0) / 8);
+    }
+    BENCHMARK(BM_BitsetAppend)->ArgName("bits")->Range(BITSET_MIN, BITSET_MAX);
+
+    void BM_BitsetPrepend(benchmark::State& state)
+    {
+        Bitset chunk(8, 0xa5);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            Bitset bits;
+            for(int i = 0, n = state.range(0) / 8; i < n; ++i)
+                bits.prepend(chunk);
+            benchmark::DoNotOptimize(bits.size());
+        }
+        state.SetBytesProcessed(state.iterations() * state.range(0) / 8);
+    }
+    BENCHMARK(BM_BitsetPrepend)->ArgName("bits")->Range(BITSET_MIN, BITSET_MAX);
+
+    void BM_BitsetShift(benchmark::State& state)
+    {
+        Bitset bits(state.range(0), 0x5a5a5a5aUL);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            bits <<= 8;
+            bits >>= 8;
+            benchmark::DoNotOptimize(bits.size());
+        }
+    }
+    BENCHMARK(BM_BitsetShift)->ArgName("bits")->Range(BITSET_MIN, BITSET_MAX);
+
+    void BM_BitsetToByteString(benchmark::State& state)
+    {
+        Bitset bits(state.range(0), 0x5a5a5a5aUL);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+            benchmark::DoNotOptimize(bits.to_byte_string());
+        state.SetBytesProcessed(state.iterations() * state.range(0) / 8);
+    }
+    BENCHMARK(BM_BitsetToByteString)->ArgName("bits")->Range(BITSET_MIN, BITSET_MAX);
+
+    void BM_BitsetFromByteString(benchmark::State& state)
+    {
+        std::string bytes(state.range(0) / 8, '\x5a');
+        Bitset bits;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            bits.from_byte_string(bytes);
+            benchmark::DoNotOptimize(bits.size());
+        }
+        state.SetBytesProcessed(state.iterations() * bytes.size());
+    }
+    BENCHMARK(BM_BitsetFromByteString)->ArgName("bits")->Range(BITSET_MIN, BITSET_MAX);
+
+    // fills every element of the repeated field "value" used by the messages in bench.proto
+    void fill_values(Message* msg)
+    {
+        const FieldDescriptor* field = msg->GetDescriptor()->FindFieldByName("value");
+        const Reflection* refl = msg->GetReflection();
+        int max_repeat = field->options().GetExtension(dccl::field).max_repeat();
+
+        for(int i = 0; i < max_repeat; ++i)
+        {
+            switch(field->cpp_type())
+            {
+                case FieldDescriptor::CPPTYPE_DOUBLE: refl->AddDouble(msg, field, i * 10 + 0.125); break;
+                case FieldDescriptor::CPPTYPE_FLOAT: refl->AddFloat(msg, field, i * 10 + 0.25); break;
+                case FieldDescriptor::CPPTYPE_BOOL: refl->AddBool(msg, field, i % 2); break;
+                case FieldDescriptor::CPPTYPE_INT32: refl->AddInt32(msg, field, i * 10 - 40); break;
+                case FieldDescriptor::CPPTYPE_INT64: refl->AddInt64(msg, field, i * 10 - 40); break;
+                case FieldDescriptor::CPPTYPE_UINT32: refl->AddUInt32(msg, field, i * 10); break;
+                case FieldDescriptor::CPPTYPE_UINT64: refl->AddUInt64(msg, field, i * 10); break;
+                case FieldDescriptor::CPPTYPE_STRING: refl->AddString(msg, field, std::string("dccl").substr(0, i % 5)); break;
+                case FieldDescriptor::CPPTYPE_ENUM:
+                    refl->AddEnum(msg, field, field->enum_type()->value(i % field->enum_type()->value_count()));
+                    break;
+                case FieldDescriptor::CPPTYPE_MESSAGE:
+                {
+                    Message* embedded = refl->AddMessage(msg, field);
+                    embedded->GetReflection()->SetInt32(embedded, embedded->GetDescriptor()->FindFieldByName("val"), i * 10);
+                    break;
+                }
+            }
+        }
+    }
+
+    // representative instance of each schema benchmarked
+    template<typename Msg> void fill(Msg* msg) { fill_values(msg); }
+
+    template<> void fill(dccl::test::TestMsg* msg)
+    {
+        using namespace dccl::test;
+        // values as used by the dccl_all_fields test
+        int i = 0;
+        msg->set_double_default_optional(++i + 0.1);
+        msg->set_float_default_optional(++i + 0.2);
+        msg->set_int32_default_optional(++i);
+        msg->set_int64_default_optional(-++i);
+        msg->set_uint32_default_optional(++i);
+        msg->set_uint64_default_optional(++i);
+        msg->set_sint32_default_optional(-++i);
+        msg->set_sint64_default_optional(++i);
+        msg->set_fixed32_default_optional(++i);
+        msg->set_fixed64_default_optional(++i);
+        msg->set_sfixed32_default_optional(++i);
+        msg->set_sfixed64_default_optional(-++i);
+        msg->set_bool_default_optional(true);
+        msg->set_string_default_optional("abc123");
+        msg->set_bytes_default_optional(dccl::hex_decode("00112233aabbcc1234"));
+        msg->set_enum_default_optional(ENUM_C);
+        msg->mutable_msg_default_optional()->set_val(++i + 0.3);
+        msg->mutable_msg_default_optional()->mutable_msg()->set_val(++i);
+
+        msg->set_double_default_required(++i + 0.1);
+        msg->set_float_default_required(++i + 0.2);
+        msg->set_int32_default_required(++i);
+        msg->set_int64_default_required(-++i);
+        msg->set_uint32_default_required(++i);
+        msg->set_uint64_default_required(++i);
+        msg->set_sint32_default_required(-++i);
+        msg->set_sint64_default_required(++i);
+        msg->set_fixed32_default_required(++i);
+        msg->set_fixed64_default_required(++i);
+        msg->set_sfixed32_default_required(++i);
+        msg->set_sfixed64_default_required(-++i);
+        msg->set_bool_default_required(true);
+        msg->set_string_default_required("abc123");
+        msg->set_bytes_default_required(dccl::hex_decode("00112233aabbcc1234"));
+        msg->set_enum_default_required(ENUM_C);
+        msg->mutable_msg_default_required()->set_val(++i + 0.3);
+        msg->mutable_msg_default_required()->mutable_msg()->set_val(++i);
+
+        for(int j = 0; j < 2; ++j)
+        {
+            msg->add_double_default_repeat(++i + 0.1);
+            msg->add_float_default_repeat(++i + 0.2);
+            msg->add_int32_default_repeat(++i);
+            msg->add_int64_default_repeat(-++i);
+            msg->add_uint32_default_repeat(++i);
+            msg->add_uint64_default_repeat(++i);
+            msg->add_sint32_default_repeat(-++i);
+            msg->add_sint64_default_repeat(++i);
+            msg->add_fixed32_default_repeat(++i);
+            msg->add_fixed64_default_repeat(++i);
+            msg->add_sfixed32_default_repeat(++i);
+            msg->add_sfixed64_default_repeat(-++i);
+            msg->add_bool_default_repeat(true);
+            msg->add_string_default_repeat("abc123");
+            msg->add_bytes_default_repeat(dccl::hex_decode(j ? "00aabbcc" : "ffeedd12"));
+            msg->add_enum_default_repeat(static_cast<Enum1>((++i % 3) + 1));
+            EmbeddedMsg1* em_msg = msg->add_msg_default_repeat();
+            em_msg->set_val(++i + 0.3);
+            em_msg->mutable_msg()->set_val(++i);
+        }
+    }
+
+    template<> void fill(dccl::test::GobyMessage3* msg)
+    { msg->set_string_val("string1"); }
+
+    template<> void fill(dccl::test::GobyMessage* msg)
+    {
+        msg->set_telegram("hello!");
+        dccl::test::Header* header = msg->mutable_header();
+        // fixed rather than the current time so that runs are comparable
+        const dccl::int64 now = 1500000000LL * 1000000;
+        header->set_time(now);
+        header->set_time_signed(now);
+        header->set_time_double(now / 1000000);
+        header->set_pasttime_double(now / 1000000 - 200000);
+        header->set_futuretime_double(now / 1000000 + 200000);
+        header->set_time_precision(now + 123000);
+        header->set_time_double_precision((now + 123456) / 1000000.0);
+        header->set_source_platform(1);
+        header->set_dest_platform(3);
+        header->set_dest_type(dccl::test::Header::PUBLISH_OTHER);
+        msg->set_const_int(3);
+    }
+
+    template<> void fill(dccl::test::CustomMsg2* msg)
+    {
+        msg->mutable_msg()->set_a(10);
+        msg->mutable_msg()->set_b(true);
+        msg->add_c(30);
+        msg->add_c(2);
+    }
+
+#ifdef DCCL_BENCH_ARITHMETIC
+    template<> void fill(dccl::bench::ArithmeticMsg* msg)
+    {
+        for(int i = 0; i < 8; ++i)
+            msg->add_value((i * 5) % 16);
+    }
+
+    const int LONG_MODEL_SYMBOLS = 256;
+    const int LONG_MSG_VALUES = 100;
+
+    // small linear congruential generator, so that the model and values do not depend on rand()
+    unsigned long_random(unsigned* seed)
+    {
+        *seed = *seed * 1103515245u + 12345u;
+        return (*seed >> 16) & 0x7fff;
+    }
+
+    // skewed (roughly one symbol in ten is 100 times more frequent), so there is something to compress
+    dccl::arith::protobuf::ArithmeticModel long_model()
+    {
+        unsigned seed = 1;
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("bench_long_model");
+        model.set_eof_frequency(long_random(&seed) % 100 + 1);
+        model.set_out_of_range_frequency(1);
+        for(int i = 0; i < LONG_MODEL_SYMBOLS; ++i)
+        {
+            model.add_value_bound(i);
+            model.add_frequency((long_random(&seed) % 1000 + 1) * (long_random(&seed) % 10 ? 1 : 100));
+        }
+        model.add_value_bound(LONG_MODEL_SYMBOLS);
+        return model;
+    }
+
+    // values drawn from the distribution of long_model()
+    std::vector<int> long_values()
+    {
+        const dccl::arith::protobuf::ArithmeticModel model = long_model();
+        unsigned total = 0;
+        for(int i = 0, n = model.frequency_size(); i < n; ++i)
+            total += model.frequency(i);
+
+        unsigned seed = 2;
+        std::vector<int> values;
+        for(int j = 0; j < LONG_MSG_VALUES; ++j)
+        {
+            unsigned r = (long_random(&seed) << 15 | long_random(&seed)) % total;
+            int i = 0;
+            while(r >= model.frequency(i))
+                r -= model.frequency(i++);
+            values.push_back(model.value_bound(i));
+        }
+        return values;
+    }
+
+    template<> void fill(dccl::bench::ArithmeticLongMsg* msg)
+    {
+        std::vector<int> values = long_values();
+        msg->mutable_value()->Add(values.begin(), values.end());
+    }
+
+    template<> void fill(dccl::bench::RangeLongMsg* msg)
+    {
+        std::vector<int> values = long_values();
+        msg->mutable_value()->Add(values.begin(), values.end());
+    }
+#endif
+
+    // one Codec per message type, as several of the test schemas share DCCL ids
+    template<typename Msg>
+        dccl::Codec& loaded_codec()
+    {
+        static dccl::Codec codec;
+        static bool loaded = false;
+        if(!loaded)
+        {
+            codec.load<Msg>();
+            loaded = true;
+        }
+        return codec;
+    }
+
+    template<typename Msg>
+        void BM_Encode(benchmark::State& state)
+    {
+        dccl::Codec& codec = loaded_codec<Msg>();
+        Msg msg;
+        fill(&msg);
+        std::string bytes;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            bytes.clear();
+            codec.encode(&bytes, msg);
+            benchmark::DoNotOptimize(bytes.data());
+        }
+        state.counters["bytes"] = bytes.size();
+    }
+
+    template<typename Msg>
+        void BM_Decode(benchmark::State& state)
+    {
+        dccl::Codec& codec = loaded_codec<Msg>();
+        Msg msg;
+        fill(&msg);
+        std::string bytes;
+        codec.encode(&bytes, msg);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            msg.Clear();
+            codec.decode(bytes, &msg);
+        }
+        state.counters["bytes"] = bytes.size();
+    }
+
+    template<typename Msg>
+        void BM_Size(benchmark::State& state)
+    {
+        dccl::Codec& codec = loaded_codec<Msg>();
+        Msg msg;
+        fill(&msg);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+            benchmark::DoNotOptimize(codec.size(msg));
+    }
+
+    template<typename Msg>
+        void BM_Id(benchmark::State& state)
+    {
+        dccl::Codec& codec = loaded_codec<Msg>();
+        Msg msg;
+        fill(&msg);
+        std::string bytes;
+        codec.encode(&bytes, msg);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+            benchmark::DoNotOptimize(codec.id(bytes));
+    }
+
+    // each default field codec, isolated in the messages of bench.proto
+#define DCCL_BENCH_FIELD_CODEC(Msg)                     \
+    BENCHMARK_TEMPLATE(BM_Encode, dccl::bench::Msg);    \
+    BENCHMARK_TEMPLATE(BM_Decode, dccl::bench::Msg)
+
+    DCCL_BENCH_FIELD_CODEC(V2Double);
+    DCCL_BENCH_FIELD_CODEC(V2Float);
+    DCCL_BENCH_FIELD_CODEC(V2Bool);
+    DCCL_BENCH_FIELD_CODEC(V2Int32);
+    DCCL_BENCH_FIELD_CODEC(V2Int64);
+    DCCL_BENCH_FIELD_CODEC(V2UInt32);
+    DCCL_BENCH_FIELD_CODEC(V2UInt64);
+    DCCL_BENCH_FIELD_CODEC(V2String);
+    DCCL_BENCH_FIELD_CODEC(V2Bytes);
+    DCCL_BENCH_FIELD_CODEC(V2Enum);
+    DCCL_BENCH_FIELD_CODEC(V2Message);
+    DCCL_BENCH_FIELD_CODEC(V3Double);
+    DCCL_BENCH_FIELD_CODEC(V3Float);
+    DCCL_BENCH_FIELD_CODEC(V3Bool);
+    DCCL_BENCH_FIELD_CODEC(V3Int32);
+    DCCL_BENCH_FIELD_CODEC(V3Int64);
+    DCCL_BENCH_FIELD_CODEC(V3UInt32);
+    DCCL_BENCH_FIELD_CODEC(V3UInt64);
+    DCCL_BENCH_FIELD_CODEC(V3String);
+    DCCL_BENCH_FIELD_CODEC(V3Bytes);
+    DCCL_BENCH_FIELD_CODEC(V3Enum);
+    DCCL_BENCH_FIELD_CODEC(V3Message);
+
+    // the public Codec API on the schemas of the unit tests
+#define DCCL_BENCH_SCHEMA(Msg)                          \
+    BENCHMARK_TEMPLATE(BM_Encode, dccl::test::Msg);     \
+    BENCHMARK_TEMPLATE(BM_Decode, dccl::test::Msg);     \
+    BENCHMARK_TEMPLATE(BM_Size, dccl::test::Msg);       \
+    BENCHMARK_TEMPLATE(BM_Id, dccl::test::Msg)
+
+    DCCL_BENCH_SCHEMA(TestMsg);
+    DCCL_BENCH_SCHEMA(GobyMessage3);
+    DCCL_BENCH_SCHEMA(GobyMessage);
+    DCCL_BENCH_SCHEMA(CustomMsg2);
+
+#ifdef DCCL_BENCH_ARITHMETIC
+    DCCL_BENCH_FIELD_CODEC(ArithmeticMsg);
+
+    // the arithmetic and range coders on the same values (the "bytes" counters give the compression)
+    DCCL_BENCH_FIELD_CODEC(ArithmeticLongMsg);
+    BENCHMARK_TEMPLATE(BM_Size, dccl::bench::ArithmeticLongMsg);
+    DCCL_BENCH_FIELD_CODEC(RangeLongMsg);
+    BENCHMARK_TEMPLATE(BM_Size, dccl::bench::RangeLongMsg);
+
+    // RangeCoder alone (the rest of the time above is spent in the message and field layers)
+    void BM_RangeCoder(benchmark::State& state)
+    {
+        dccl::arith::Model& model = dccl::arith::ModelManager::find("bench_long_model");
+        std::vector<int> ints = long_values();
+        std::vector<dccl::arith::Model::value_type> values(ints.begin(), ints.end());
+        std::vector<unsigned char> stream;
+        unsigned bits = dccl::range::RangeCoder::encode(model, values, LONG_MSG_VALUES, false, &stream);
+
+        const bool decode = state.range(0);
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            if(decode)
+                benchmark::DoNotOptimize(dccl::range::RangeCoder::decode(model, stream, LONG_MSG_VALUES).size());
+            else
+                benchmark::DoNotOptimize(dccl::range::RangeCoder::encode(model, values, LONG_MSG_VALUES, false, &stream));
+        }
+        state.counters["bits"] = bits;
+    }
+    BENCHMARK(BM_RangeCoder)->ArgName("decode")->Arg(0)->Arg(1);
+
+    // the "value" field codec of ArithmeticLongMsg or RangeLongMsg alone (without the header, identifier and message layer), so that the two coders can be compared directly
+    template<typename Msg>
+        void BM_FieldCoder(benchmark::State& state)
+    {
+        loaded_codec<Msg>(); // validates the field
+        const FieldDescriptor* field = Msg::descriptor()->FindFieldByName("value");
+        boost::shared_ptr<dccl::FieldCodecBase> codec = dccl::FieldCodecManager::find(field, false, "");
+
+        std::vector<int> ints = long_values();
+        std::vector<boost::any> values(ints.begin(), ints.end());
+        Bitset encoded;
+        codec->field_encode_repeated(&encoded, values, field);
+
+        const bool decode = state.range(0);
+        std::vector<boost::any> decoded;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            if(decode)
+            {
+                Bitset bits(encoded);
+                decoded.clear();
+                codec->field_decode_repeated(&bits, &decoded, field);
+                benchmark::DoNotOptimize(decoded.size());
+            }
+            else
+            {
+                Bitset bits;
+                codec->field_encode_repeated(&bits, values, field);
+                benchmark::DoNotOptimize(bits.size());
+            }
+        }
+        state.counters["bits"] = encoded.size();
+    }
+    BENCHMARK_TEMPLATE(BM_FieldCoder, dccl::bench::ArithmeticLongMsg)->ArgName("decode")->Arg(0)->Arg(1);
+    BENCHMARK_TEMPLATE(BM_FieldCoder, dccl::bench::RangeLongMsg)->ArgName("decode")->Arg(0)->Arg(1);
+#endif
+
+#ifdef DCCL_CCL_COMPAT_NAME
+    // a CCL message as sent by a REMUS vehicle (from the dccl_ccl test), through the legacy codecs
+    void BM_CCL(benchmark::State& state)
+    {
+        static dccl::Codec codec("dccl.ccl.id", DCCL_CCL_COMPAT_NAME);
+        dccl::legacyccl::protobuf::CCLMDATState msg;
+        const std::string bytes = dccl::hex_decode("0e86fa11ad20c9011b4432bf47d10000002401042f0e7d87fa111620c95a200a");
+        codec.decode(bytes, &msg);
+
+        std::string encoded;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            if(state.range(0))
+            {
+                msg.Clear();
+                codec.decode(bytes, &msg);
+            }
+            else
+            {
+                encoded.clear();
+                codec.encode(&encoded, msg);
+                benchmark::DoNotOptimize(encoded.data());
+            }
+        }
+    }
+    BENCHMARK(BM_CCL)->ArgName("decode")->Arg(0)->Arg(1);
+
+    // bulk transcoding of a log of random CCL frames to comma separated values (as in the dccl_ccl_transcoder test)
+    void BM_Transcode(benchmark::State& state)
+    {
+        static dccl::Codec codec("dccl.ccl.id", DCCL_CCL_COMPAT_NAME);
+        static dccl::legacyccl::Transcoder transcoder(codec);
+
+        const unsigned char ccl_ids[] = { 0x06, 0x07, 0x09, 0x0A, 0x0B, 0x0E, 0x0F };
+        unsigned seed = 1;
+        std::string frames(50000 * dccl::legacyccl::Transcoder::FRAME_BYTES, 0);
+        for(std::string::iterator it = frames.begin(), end = frames.end(); it != end; ++it)
+            *it = rand_r(&seed);
+        for(std::size_t i = 0, n = frames.size(); i < n; i += dccl::legacyccl::Transcoder::FRAME_BYTES)
+            frames[i] = ccl_ids[rand_r(&seed) % sizeof(ccl_ids)];
+
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            std::stringstream in(frames);
+            std::stringstream out;
+            dccl::legacyccl::CSVSink sink(out);
+            benchmark::DoNotOptimize(transcoder.transcode(in, sink, state.range(0)));
+        }
+        state.SetBytesProcessed(state.iterations() * frames.size());
+    }
+    BENCHMARK(BM_Transcode)->ArgName("threads")->Arg(0)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+#endif
+
+#if DCCL_HAS_CRYPTOPP
+    std::vector<std::string> crypto_arg_names()
+    {
+        std::vector<std::string> names;
+        names.push_back("encrypt");
+        names.push_back("decode");
+        return names;
+    }
+
+    std::vector<int64_t> crypto_args(int encrypt, int decode)
+    {
+        std::vector<int64_t> args;
+        args.push_back(encrypt);
+        args.push_back(decode);
+        return args;
+    }
+
+    // the all fields message with and without encryption of the body
+    void BM_Crypto(benchmark::State& state)
+    {
+        static dccl::Codec plain, encrypted;
+        static bool loaded = false;
+        if(!loaded)
+        {
+            encrypted.set_crypto_passphrase("dccl_bench passphrase");
+            plain.load<dccl::test::TestMsg>();
+            encrypted.load<dccl::test::TestMsg>();
+            loaded = true;
+        }
+        dccl::Codec& codec = state.range(0) ? encrypted : plain;
+
+        dccl::test::TestMsg msg;
+        fill(&msg);
+        std::string bytes;
+        codec.encode(&bytes, msg);
+
+        std::string encoded;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            if(state.range(1))
+            {
+                msg.Clear();
+                codec.decode(bytes, &msg);
+            }
+            else
+            {
+                encoded.clear();
+                codec.encode(&encoded, msg);
+                benchmark::DoNotOptimize(encoded.data());
+            }
+        }
+    }
+    BENCHMARK(BM_Crypto)->ArgNames(crypto_arg_names())->Args(crypto_args(0, 0))->Args(crypto_args(0, 1))
+        ->Args(crypto_args(1, 0))->Args(crypto_args(1, 1));
+#endif
+
+    // synthetic schemas of increasing size, to expose superlinear costs in loading (the recursion
+    // over the field codecs for the size bounds and validation) and in the registry lookups
+    std::string synthetic_dir;
+
+    // bytes currently allocated from the heap (0 where this is not available)
+    std::size_t allocated_bytes()
+    {
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+        struct mallinfo2 info = mallinfo2();
+#else
+        struct mallinfo info = mallinfo();
+#endif
+        return info.uordblks + info.hblkhd;
+#else
+        return 0;
+#endif
+    }
+
+    struct SyntheticSchema
+    {
+        std::vector<const google::protobuf::Descriptor*> messages;
+        std::size_t descriptor_bytes;
+        // all the messages loaded, with a random instance of each and its encoding
+        boost::shared_ptr<dccl::Codec> codec;
+        std::vector<boost::shared_ptr<Message> > instances;
+        std::vector<std::string> encoded;
+        std::size_t encoded_bytes;
+    };
+
+    // arguments are the dccl::bench::SchemaShape; each shape is loaded only once
+    SyntheticSchema& synthetic_schema(const benchmark::State& state)
+    {
+        static std::map<std::string, SyntheticSchema> schemas;
+        dccl::bench::SchemaShape shape(state.range(0), state.range(1), state.range(2), state.range(3));
+
+        std::map<std::string, SyntheticSchema>::iterator it = schemas.find(shape.name());
+        if(it != schemas.end())
+            return it->second;
+
+        SyntheticSchema& schema = schemas[shape.name()];
+        std::size_t before = allocated_bytes();
+        const google::protobuf::FileDescriptor* file = dccl::bench::load_synthetic_schema(shape, synthetic_dir);
+        for(int i = 0, n = file->message_type_count(); i < n; ++i)
+            schema.messages.push_back(file->message_type(i));
+        schema.descriptor_bytes = allocated_bytes() - before;
+
+        schema.codec.reset(new dccl::Codec);
+        dccl::MessageGenerator generator;
+        schema.encoded_bytes = 0;
+        for(std::vector<const google::protobuf::Descriptor*>::const_iterator it = schema.messages.begin(), end = schema.messages.end(); it != end; ++it)
+        {
+            schema.codec->load(*it);
+            schema.instances.push_back(generator.generate(*it));
+            schema.encoded.push_back(std::string());
+            schema.codec->encode(&schema.encoded.back(), *schema.instances.back());
+            schema.encoded_bytes += schema.encoded.back().size();
+        }
+        return schema;
+    }
+
+    std::vector<int64_t> synthetic_args(int messages, int fields, int depth, int max_repeat)
+    {
+        std::vector<int64_t> args;
+        args.push_back(messages);
+        args.push_back(fields);
+        args.push_back(depth);
+        args.push_back(max_repeat);
+        return args;
+    }
+
+    void synthetic_shapes(benchmark::internal::Benchmark* b)
+    {
+        std::vector<std::string> names;
+        names.push_back("messages");
+        names.push_back("fields");
+        names.push_back("depth");
+        names.push_back("max_repeat");
+        b->ArgNames(names);
+
+        // each parameter varied in turn from the baseline of 16 messages of 16 fields, 2 deep, repeats of 4
+        const int messages[] = { 1, 4, 16, 64, 256 };
+        const int fields[] = { 4, 16, 64, 128 };
+        const int depth[] = { 1, 2, 3, 5 };
+        const int max_repeat[] = { 0, 1, 4, 16 };
+        std::vector<std::vector<int64_t> > shapes;
+        for(unsigned i = 0; i < sizeof(messages) / sizeof(int); ++i)
+            shapes.push_back(synthetic_args(messages[i], 16, 2, 4));
+        for(unsigned i = 0; i < sizeof(fields) / sizeof(int); ++i)
+            shapes.push_back(synthetic_args(16, fields[i], 2, 4));
+        for(unsigned i = 0; i < sizeof(depth) / sizeof(int); ++i)
+            shapes.push_back(synthetic_args(16, 16, depth[i], 4));
+        for(unsigned i = 0; i < sizeof(max_repeat) / sizeof(int); ++i)
+            shapes.push_back(synthetic_args(16, 16, 2, max_repeat[i]));
+        // the largest of the fleet's messages
+        shapes.push_back(synthetic_args(16, 128, 5, 4));
+
+        std::sort(shapes.begin(), shapes.end());
+        shapes.erase(std::unique(shapes.begin(), shapes.end()), shapes.end());
+        for(std::vector<std::vector<int64_t> >::const_iterator it = shapes.begin(), end = shapes.end(); it != end; ++it)
+            b->Args(*it);
+    }
+
+    // Codec::load of every message of the schema into a new Codec
+    void BM_SchemaLoad(benchmark::State& state)
+    {
+        SyntheticSchema& schema = synthetic_schema(state);
+        std::size_t codec_bytes = 0;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            state.PauseTiming();
+            dccl::Codec* codec = new dccl::Codec;
+            std::size_t before = allocated_bytes();
+            state.ResumeTiming();
+
+            for(std::vector<const google::protobuf::Descriptor*>::const_iterator d = schema.messages.begin(), n = schema.messages.end(); d != n; ++d)
+                codec->load(*d);
+
+            state.PauseTiming();
+            codec_bytes = allocated_bytes() - before;
+            delete codec;
+            state.ResumeTiming();
+        }
+        const double types = schema.messages.size();
+        state.SetItemsProcessed(state.iterations() * schema.messages.size());
+        state.counters["descriptor_bytes_per_type"] = schema.descriptor_bytes / types;
+        state.counters["codec_bytes_per_type"] = codec_bytes / types;
+    }
+    BENCHMARK(BM_SchemaLoad)->Apply(synthetic_shapes)->Unit(benchmark::kMicrosecond);
+
+    // as BM_SchemaLoad, with the validation results of every message already in a LoadCache
+    void BM_SchemaLoadCached(benchmark::State& state)
+    {
+        SyntheticSchema& schema = synthetic_schema(state);
+        dccl::LoadCache cache(synthetic_dir + "/unused.cache");
+        {
+            dccl::Codec codec;
+            codec.set_load_cache(&cache);
+            for(std::vector<const google::protobuf::Descriptor*>::const_iterator d = schema.messages.begin(), n = schema.messages.end(); d != n; ++d)
+                codec.load(*d);
+        }
+
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            state.PauseTiming();
+            dccl::Codec* codec = new dccl::Codec;
+            codec->set_load_cache(&cache);
+            state.ResumeTiming();
+
+            for(std::vector<const google::protobuf::Descriptor*>::const_iterator d = schema.messages.begin(), n = schema.messages.end(); d != n; ++d)
+                codec->load(*d);
+
+            state.PauseTiming();
+            delete codec;
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * schema.messages.size());
+    }
+    BENCHMARK(BM_SchemaLoadCached)->Apply(synthetic_shapes)->Unit(benchmark::kMicrosecond);
+
+    // encoding each of the messages in turn
+    void BM_SchemaEncode(benchmark::State& state)
+    {
+        SyntheticSchema& schema = synthetic_schema(state);
+        std::string bytes;
+        std::size_t i = 0;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            bytes.clear();
+            schema.codec->encode(&bytes, *schema.instances[i]);
+            benchmark::DoNotOptimize(bytes.data());
+            if(++i == schema.instances.size())
+                i = 0;
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["bytes"] = static_cast<double>(schema.encoded_bytes) / schema.encoded.size();
+    }
+    BENCHMARK(BM_SchemaEncode)->Apply(synthetic_shapes);
+
+    // decoding each of the messages in turn, including the lookup of the type from the DCCL id
+    void BM_SchemaDecode(benchmark::State& state)
+    {
+        SyntheticSchema& schema = synthetic_schema(state);
+        std::size_t i = 0;
+        for(benchmark::State::StateIterator it = state.begin(), end = state.end(); it != end; ++it)
+        {
+            benchmark::DoNotOptimize(schema.codec->decode<boost::shared_ptr<Message> >(schema.encoded[i]));
+            if(++i == schema.encoded.size())
+                i = 0;
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["bytes"] = static_cast<double>(schema.encoded_bytes) / schema.encoded.size();
+    }
+    BENCHMARK(BM_SchemaDecode)->Apply(synthetic_shapes);
+}
+
+int main(int argc, char* argv[])
+{
+    // JSON unless the caller asks otherwise
+    std::vector<char*> args(argv, argv + argc);
+    bool has_format = false;
+    for(int i = 1; i < argc; ++i)
+        has_format |= (std::strncmp(argv[i], "--benchmark_format", 18) == 0);
+    char json_format[] = "--benchmark_format=json";
+    if(!has_format)
+        args.push_back(json_format);
+    int args_size = args.size();
+
+    benchmark::Initialize(&args_size, &args[0]);
+    if(benchmark::ReportUnrecognizedArguments(args_size, &args[0]))
+        return 1;
+
+#ifdef DCCL_BENCH_ARITHMETIC
+    // uniform model over the values 0-15
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name("bench_model");
+    model.set_eof_frequency(1);
+    for(int i = 0; i < 16; ++i)
+    {
+        model.add_value_bound(i);
+        model.add_frequency(10);
+    }
+    model.add_value_bound(16);
+    dccl::arith::ModelManager::set_model(model);
+    dccl::arith::ModelManager::set_model(long_model());
+
+    dccl::Codec arithmetic;
+    dccl_arithmetic_load(&arithmetic);
+    dccl_range_load(&arithmetic);
+#endif
+
+    dccl::FieldCodecManager::add<dccl::test::CustomCodec>("custom_codec");
+    dccl::FieldCodecManager::add<dccl::test::Int32RepeatedCodec>("int32_test_codec");
+
+    benchmark::AddCustomContext("dccl_version", dccl::VERSION_STRING);
+    benchmark::AddCustomContext("dccl_crypto", DCCL_HAS_CRYPTOPP ? "on" : "off");
+
+    // the synthetic schemas are written here and removed again as soon as they are loaded
+    char dir_template[] = "/tmp/dccl_bench.XXXXXX";
+    if(!mkdtemp(dir_template))
+    {
+        std::cerr << "Failed to create a directory for the synthetic schemas" << std::endl;
+        return 1;
+    }
+    synthetic_dir = dir_template;
+    dccl::DynamicProtobufManager::enable_compilation();
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    rmdir(dir_template);
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <boost/lexical_cast.hpp>
+
+#include "dccl/dynamic_protobuf_manager.h"
+#include "dccl/exception.h"
+
+#include "synthetic_schema.h"
+
+namespace
+{
+    // the field options for the j-th field of a level, cycling through the common field types
+    std::string field_definition(int j, const dccl::bench::SchemaShape& shape)
+    {
+        std::string type, options;
+        switch(j % 7)
+        {
+            case 0: type = "int32"; options = "(dccl.field).min = -1000, (dccl.field).max = 1000"; break;
+            case 1: type = "double"; options = "(dccl.field).min = -180, (dccl.field).max = 180, (dccl.field).precision = 6"; break;
+            case 2: type = "uint32"; options = "(dccl.field).min = 0, (dccl.field).max = 65535"; break;
+            case 3: type = "bool"; break;
+            case 4: type = "SyntheticEnum"; break;
+            case 5: type = "string"; options = "(dccl.field).max_length = 16"; break;
+            case 6: type = "int64"; options = "(dccl.field).min = -1000000000, (dccl.field).max = 1000000000"; break;
+        }
+
+        std::stringstream ss;
+        bool repeated = shape.max_repeat > 0 && j % 4 == 3;
+        if(repeated)
+            options += std::string(options.empty() ? "" : ", ") + "(dccl.field).max_repeat = " + boost::lexical_cast<std::string>(shape.max_repeat);
+
+        ss << (repeated ? "repeated " : "optional ") << type << " field" << j + 1 << " = " << j + 1;
+        if(!options.empty())
+            ss << " [" << options << "]";
+        ss << ";";
+        return ss.str();
+    }
+
+    // fields of the given level (1 is the top), followed by the next level as an embedded message
+    void write_level(std::ostream& out, int level, const std::string& indent, const dccl::bench::SchemaShape& shape)
+    {
+        for(int j = 0; j < shape.fields; ++j)
+            out << indent << field_definition(j, shape) << "\n";
+
+        if(level < shape.depth)
+        {
+            out << indent << "optional Level" << level + 1 << " level" << level + 1 << " = " << shape.fields + 1 << ";\n"
+                << indent << "message Level" << level + 1 << "\n"
+                << indent << "{\n";
+            write_level(out, level + 1, indent + "  ", shape);
+            out << indent << "}\n";
+        }
+    }
+}
+
+std::string dccl::bench::SchemaShape::name() const
+{
+    std::stringstream ss;
+    ss << "m" << messages << "_f" << fields << "_d" << depth << "_r" << max_repeat;
+    return ss.str();
+}
+
+std::string dccl::bench::synthetic_proto(const SchemaShape& shape)
+{
+    std::stringstream out;
+    out << "syntax = \"proto2\";\n"
+        << "import \"dccl/protobuf/option_extensions.proto\";\n"
+        << "package dccl.bench.synthetic." << shape.name() << ";\n\n"
+        << "enum SyntheticEnum { ENUM_A = 1; ENUM_B = 2; ENUM_C = 3; }\n";
+
+    for(int i = 0; i < shape.messages; ++i)
+    {
+        out << "\nmessage Msg" << i + 1 << "\n"
+            << "{\n"
+            << "  option (dccl.msg).id = " << i + 1 << ";\n"
+            << "  option (dccl.msg).max_bytes = 1000000;\n"
+            << "  option (dccl.msg).codec_version = 3;\n";
+        write_level(out, 1, "  ", shape);
+        out << "}\n";
+    }
+    return out.str();
+}
+
+const google::protobuf::FileDescriptor* dccl::bench::load_synthetic_schema(const SchemaShape& shape, const std::string& dir)
+{
+    std::string path = dir + "/" + shape.name() + ".proto";
+    {
+        std::ofstream out(path.c_str());
+        out << synthetic_proto(shape);
+        if(!out)
+            throw(Exception("Failed to write synthetic schema: " + path));
+    }
+
+    const google::protobuf::FileDescriptor* file = DynamicProtobufManager::load_from_proto_file(path);
+    std::remove(path.c_str());
+    if(!file)
+        throw(Exception("Failed to load synthetic schema: " + path));
+    return file;
+}
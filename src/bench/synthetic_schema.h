@@ -0,0 +1,65 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLBENCHSYNTHETICSCHEMA20261019H
+#define DCCLBENCHSYNTHETICSCHEMA20261019H
+
+#include <string>
+
+#include <google/protobuf/descriptor.h>
+
+namespace dccl
+{
+    namespace bench
+    {
+        /// \brief Parameters of a synthetic DCCL schema, used to measure how the library scales with the size of the schema
+        ///
+        /// The schema has `messages` top-level DCCL messages (ids 1 to `messages`). Each is `depth` levels deep: every level has `fields` fields of assorted types and, except the deepest, an optional embedded message holding the next level. Every fourth field is repeated with `max_repeat` values (none are if `max_repeat` is 0).
+        struct SchemaShape
+        {
+            SchemaShape(int messages, int fields, int depth, int max_repeat)
+                : messages(messages), fields(fields), depth(depth), max_repeat(max_repeat)
+            { }
+
+            /// \brief Unique name of the schema, used for its package and file name
+            std::string name() const;
+
+            int messages;
+            int fields;
+            int depth;
+            int max_repeat;
+        };
+
+        /// \brief Returns the text of the .proto file for a synthetic schema
+        std::string synthetic_proto(const SchemaShape& shape);
+
+        /// \brief Writes the .proto file for a synthetic schema into `dir`, loads it using DynamicProtobufManager::load_from_proto_file() and removes the file again
+        ///
+        /// DynamicProtobufManager::enable_compilation() must have been called. As the DescriptorPool cannot unload files, each shape should be loaded only once.
+        /// \param shape Parameters of the schema
+        /// \param dir Absolute path of an existing directory to write the file into
+        /// \return Descriptor of the loaded file, whose message_type(i) are the top-level DCCL messages
+        /// \throw Exception If the file cannot be written or loaded
+        const google::protobuf::FileDescriptor* load_synthetic_schema(const SchemaShape& shape, const std::string& dir);
+    }
+}
+
+#endif
@@ -0,0 +1,230 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLBITSTREAM20170615H
+#define DCCLBITSTREAM20170615H
+
+#include <cstring>
+#include <string>
+
+#include <boost/lexical_cast.hpp>
+
+#include "dccl/common.h"
+#include "dccl/exception.h"
+#include "dccl/internal/bit_ops.h"
+
+namespace dccl
+{
+    /// \brief Appends values to a caller supplied byte buffer, least significant bit first, using the same bit numbering as Bitset::to_byte_string().
+    ///
+    /// Unlike Bitset, no memory is allocated; this is the output stream used by StructCodec.
+    class BitWriter
+    {
+      public:
+        /// \brief Write into `bytes`, which holds `size` bytes. Bytes are zeroed as they are first written to.
+      BitWriter(unsigned char* bytes, std::size_t size)
+          : bytes_(bytes),
+            size_(size),
+            position_(0)
+        { }
+
+        /// \brief Writes the `width` (<= 64) least significant bits of `value`
+        void write(uint64 value, unsigned width)
+        {
+            if(position_ + width > size_ * BITS_IN_BYTE)
+                throw(Exception("BitWriter: encoded message does not fit in the " + boost::lexical_cast<std::string>(size_) + " byte buffer"));
+
+            if(width < 64)
+                value &= (static_cast<uint64>(1) << width) - 1;
+
+            while(width)
+            {
+                unsigned char* byte = bytes_ + position_ / BITS_IN_BYTE;
+                unsigned shift = position_ % BITS_IN_BYTE;
+                if(!shift)
+                    *byte = 0;
+
+                unsigned n = std::min(BITS_IN_BYTE - shift, width);
+                *byte |= static_cast<unsigned char>((value & ((1u << n) - 1)) << shift);
+                value >>= n;
+                width -= n;
+                position_ += n;
+            }
+        }
+
+        /// \brief Writes the bytes of `s`
+        void write_bytes(const char* s, std::size_t length)
+        {
+            if(position_ % BITS_IN_BYTE == 0 && position_ + length * BITS_IN_BYTE <= size_ * BITS_IN_BYTE)
+            {
+                std::memcpy(bytes_ + position_ / BITS_IN_BYTE, s, length);
+                position_ += length * BITS_IN_BYTE;
+            }
+            else
+            {
+                for(std::size_t i = 0; i < length; ++i)
+                    write(static_cast<unsigned char>(s[i]), BITS_IN_BYTE);
+            }
+        }
+
+        /// \brief Pads with zeros to the next whole byte
+        void align()
+        {
+            if(position_ % BITS_IN_BYTE)
+                write(0, BITS_IN_BYTE - position_ % BITS_IN_BYTE);
+        }
+        
+        /// \brief Number of bits written so far
+        unsigned bits() const { return position_; }
+        /// \brief Number of bytes (including a partially filled last byte) written so far
+        std::size_t bytes() const { return ceil_bits2bytes(position_); }
+        
+      private:
+        unsigned char* bytes_;
+        std::size_t size_;
+        unsigned position_;
+    };
+
+    /// \brief Reads values written by BitWriter (or Bitset::to_byte_string()) from a byte buffer.
+    class BitReader
+    {
+      public:
+      BitReader(const unsigned char* bytes, std::size_t size)
+          : bytes_(bytes),
+            size_(size),
+            position_(0)
+        { }
+
+        /// \brief Reads `width` (<= 64) bits. Throws Exception if there are not enough bytes left.
+        uint64 read(unsigned width)
+        {
+            require(width);
+            uint64 value = internal::read_bits(bytes_, position_, width);
+            position_ += width;
+            return value;
+        }
+
+        /// \brief Reads `length` bytes into `s`
+        void read_bytes(char* s, std::size_t length)
+        {
+            require(length * BITS_IN_BYTE);
+            if(position_ % BITS_IN_BYTE == 0)
+            {
+                std::memcpy(s, bytes_ + position_ / BITS_IN_BYTE, length);
+                position_ += length * BITS_IN_BYTE;
+            }
+            else
+            {
+                for(std::size_t i = 0; i < length; ++i)
+                    s[i] = static_cast<char>(read(BITS_IN_BYTE));
+            }
+        }
+        
+        /// \brief Skips to the start of the next whole byte
+        void align()
+        {
+            if(position_ % BITS_IN_BYTE)
+                position_ += BITS_IN_BYTE - position_ % BITS_IN_BYTE;
+        }
+        
+        /// \brief Number of bits read so far
+        unsigned bits() const { return position_; }
+        /// \brief Number of bytes (including a partially read last byte) read so far
+        std::size_t bytes() const { return ceil_bits2bytes(position_); }
+
+      private:
+        void require(std::size_t width) const
+        {
+            if(position_ + width > size_ * BITS_IN_BYTE)
+                throw(Exception("BitReader: message is truncated (needed " + boost::lexical_cast<std::string>(ceil_bits2bytes(position_ + width)) + " bytes, have " + boost::lexical_cast<std::string>(size_) + ")"));
+        }
+        
+      private:
+        const unsigned char* bytes_;
+        std::size_t size_;
+        unsigned position_;
+    };
+
+    /// \brief Appends to a Bitset with the same interface as BitWriter, so that StaticFieldCodec children can be used by the Codec (through FieldCodecBase) and by StructCodec alike.
+    class BitsetWriter
+    {
+      public:
+      BitsetWriter(Bitset* bits)
+          : bits_(bits)
+        { }
+
+        void write(uint64 value, unsigned width)
+        {
+            for(unsigned i = 0; i < width; ++i)
+                bits_->push_back((value >> i) & 1);
+        }
+
+        void write_bytes(const char* s, std::size_t length)
+        {
+            for(std::size_t i = 0; i < length; ++i)
+                write(static_cast<unsigned char>(s[i]), BITS_IN_BYTE);
+        }
+        
+        unsigned bits() const { return bits_->size(); }
+
+      private:
+        Bitset* bits_;
+    };
+
+    /// \brief Reads from a Bitset with the same interface as BitReader. Bits beyond the end of the Bitset are requested from its parent (Bitset::get_more_bits()).
+    class BitsetReader
+    {
+      public:
+      BitsetReader(Bitset* bits)
+          : bits_(bits),
+            position_(0)
+        { }
+
+        uint64 read(unsigned width)
+        {
+            if(position_ + width > bits_->size())
+                bits_->get_more_bits(position_ + width - bits_->size());
+
+            uint64 value = 0;
+            for(unsigned i = 0; i < width; ++i)
+            {
+                if((*bits_)[position_ + i])
+                    value |= static_cast<uint64>(1) << i;
+            }
+            position_ += width;
+            return value;
+        }
+
+        void read_bytes(char* s, std::size_t length)
+        {
+            for(std::size_t i = 0; i < length; ++i)
+                s[i] = static_cast<char>(read(BITS_IN_BYTE));
+        }
+
+        unsigned bits() const { return position_; }
+        
+      private:
+        Bitset* bits_;
+        unsigned position_;
+    };
+}
+
+#endif
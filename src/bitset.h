@@ -311,10 +311,7 @@ namespace dccl
         {
             // number of bytes needed is ceil(size() / 8)
             std::string s(this->size()/8 + (this->size()%8 ? 1 : 0), 0);
-                
-            for(size_type i = 0, n = this->size(); i < n; ++i)
-                s[i/8] |= static_cast<char>((*this)[i] << (i%8));
-                
+            to_bytes(s.begin());
             return s;
         }
 
@@ -333,12 +330,7 @@ namespace dccl
                 throw std::length_error("max_len must be >= len");
             }
 
-            // initialize buffer to all zeroes
-            std::fill_n(buf, len, 0);
-
-            for(size_type i = 0, n = this->size(); i < n; ++i)
-                buf[i/8] |= static_cast<char>((*this)[i] << (i%8));
-
+            to_bytes(buf);
             return len;
         }
 
@@ -358,12 +350,13 @@ namespace dccl
         void from_byte_stream(CharIterator begin, CharIterator end)
         {
             this->resize(std::distance(begin, end) * 8);
-            int i = 0;
+            // a whole byte at a time, walking the bits with an iterator rather than indexing each one
+            iterator bit_it = this->begin();
             for(CharIterator it = begin; it != end; ++it)
             {
-                for(size_type j = 0; j < 8; ++j)
-                    (*this)[i*8+j] = (*it) & (1 << j);
-                ++i;
+                const unsigned char byte = *it;
+                for(size_type j = 0; j < 8; ++j, ++bit_it)
+                    *bit_it = byte & (1 << j);
             }
         }
 
@@ -390,6 +383,20 @@ namespace dccl
             
       private:            
         Bitset relinquish_bits(size_type num_bits, bool final_child);
+
+        // writes ceil(size() / 8) bytes (see to_byte_string()), a whole byte at a time
+        template<typename CharIterator>
+            void to_bytes(CharIterator out) const
+        {
+            const_iterator bit_it = this->begin(), bit_end = this->end();
+            while(bit_it != bit_end)
+            {
+                unsigned char byte = 0;
+                for(size_type j = 0; j < 8 && bit_it != bit_end; ++j, ++bit_it)
+                    byte |= static_cast<unsigned char>(*bit_it << j);
+                *out++ = static_cast<char>(byte);
+            }
+        }
             
       private:            
         Bitset* parent_;
@@ -0,0 +1,746 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <limits>
+
+#include <pthread.h>
+
+#include <boost/date_time.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "ccl_transcoder.h"
+#include "ccl_compatibility.h"
+#include "WhoiUtil.h"
+#include "dccl/codec.h"
+#include "dccl/binary.h"
+#include "dccl/internal/bit_ops.h"
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using namespace dccl::logger;
+
+namespace
+{
+    struct TranscodeJob
+    {
+        TranscodeJob() : frames(0), failed(false), done(false) { }
+        std::string bytes;
+        std::size_t frames;
+        dccl::legacyccl::Batch batch;
+        // from Sink::format()
+        std::string output;
+        // set if decoding or formatting threw on a worker, with its what()
+        bool failed;
+        std::string error;
+        bool done;
+    };
+
+    // shared between the thread calling Transcoder::transcode() and the workers
+    struct TranscodePipeline
+    {
+        const dccl::legacyccl::Transcoder* transcoder;
+        const dccl::legacyccl::Sink* sink;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        // jobs read but not yet picked up by a worker
+        std::deque<TranscodeJob*> pending;
+        bool stop;
+    };
+
+    void* transcode_worker(void* arg)
+    {
+        TranscodePipeline* pipeline = static_cast<TranscodePipeline*>(arg);
+        pthread_mutex_lock(&pipeline->mutex);
+        while(true)
+        {
+            while(pipeline->pending.empty() && !pipeline->stop)
+                pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+            if(pipeline->stop)
+                break;
+
+            TranscodeJob* job = pipeline->pending.front();
+            pipeline->pending.pop_front();
+            pthread_mutex_unlock(&pipeline->mutex);
+
+            // Sink::format() may be user code: the exception is rethrown by transcode() when this job is written
+            try
+            {
+                pipeline->transcoder->decode(job->bytes.data(), job->frames, &job->batch);
+                pipeline->sink->format(job->batch, &job->output);
+            }
+            catch(std::exception& e)
+            {
+                job->failed = true;
+                job->error = e.what();
+            }
+            catch(...)
+            {
+                job->failed = true;
+                job->error = "Unknown exception while decoding or formatting a batch";
+            }
+
+            pthread_mutex_lock(&pipeline->mutex);
+            job->done = true;
+            pthread_cond_broadcast(&pipeline->cond);
+        }
+        pthread_mutex_unlock(&pipeline->mutex);
+        return 0;
+    }
+
+    void stop_workers(TranscodePipeline* pipeline, std::vector<pthread_t>& workers)
+    {
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->stop = true;
+        pipeline->pending.clear();
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        for(std::size_t i = 0, n = workers.size(); i < n; ++i)
+            pthread_join(workers[i], 0);
+    }
+
+    // FixAgeCodec sends the age in units of 4 seconds
+    const unsigned FIX_AGE_SCALE_FACTOR = 4;
+    const dccl::uint64 MICROSECONDS_IN_SECOND = 1000000;
+
+    // appends value rounded to the given number of decimal places (without trailing zeros), which is much faster than printf("%g")
+    void append_decimal(double value, int decimals, std::string* out)
+    {
+        static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+        const int max_decimals = sizeof(powers_of_ten) / sizeof(powers_of_ten[0]) - 1;
+        decimals = std::min(decimals, max_decimals);
+
+        const double scaled = std::floor(std::abs(value) * powers_of_ten[decimals] + 0.5);
+        if(!(scaled < 1e18))
+        {
+            // NaN, infinite or too large to round in a uint64
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%g", value);
+            out->append(buffer);
+            return;
+        }
+
+        dccl::uint64 digits = static_cast<dccl::uint64>(scaled);
+        // strip trailing zeros of the fractional part
+        while(decimals > 0 && digits % 10 == 0)
+        {
+            digits /= 10;
+            --decimals;
+        }
+
+        char buffer[32];
+        char* p = buffer + sizeof(buffer);
+        for(int i = 0; i < decimals; ++i)
+        {
+            *--p = '0' + digits % 10;
+            digits /= 10;
+        }
+        if(decimals > 0)
+            *--p = '.';
+        do
+        {
+            *--p = '0' + digits % 10;
+            digits /= 10;
+        } while(digits);
+        if(value < 0 && scaled != 0)
+            *--p = '-';
+        out->append(p, buffer + sizeof(buffer) - p);
+    }
+}
+
+//
+// Batch
+//
+
+const dccl::legacyccl::Batch::Table* dccl::legacyccl::Batch::table(const Descriptor* type) const
+{
+    for(std::vector<Table>::const_iterator it = tables_.begin(), end = tables_.end(); it != end; ++it)
+    {
+        if(it->type == type)
+            return &*it;
+    }
+    return 0;
+}
+
+//
+// Transcoder
+//
+
+dccl::legacyccl::Transcoder::Transcoder(const Codec& ccl)
+{
+    std::fill(index_, index_ + (1 << BITS_IN_BYTE), -1);
+    set_year(boost::gregorian::day_clock::universal_day().year());
+    
+    add_format(ccl, protobuf::CCLMDATEmpty::descriptor());
+    add_format(ccl, protobuf::CCLMDATRedirect::descriptor());
+    add_format(ccl, protobuf::CCLMDATBathy::descriptor());
+    add_format(ccl, protobuf::CCLMDATCTD::descriptor());
+    add_format(ccl, protobuf::CCLMDATState::descriptor());
+    add_format(ccl, protobuf::CCLMDATCommand::descriptor());
+    add_format(ccl, protobuf::CCLMDATError::descriptor());
+}
+
+void dccl::legacyccl::Transcoder::set_year(int year)
+{
+    using namespace boost::gregorian;
+    year_ = year;
+    for(int month = 0; month < 12; ++month)
+        month_start_[month] = (date(year, month + 1, 1) - date(1970, 1, 1)).days();
+    month_start_[12] = (date(year + 1, 1, 1) - date(1970, 1, 1)).days();
+}
+
+void dccl::legacyccl::Transcoder::add_format(const Codec& ccl, const Descriptor* type)
+{
+    struct CodecConversion
+    {
+        const char* codec;
+        Conversion conversion;
+        // enough to tell apart adjacent values of the WhoiUtil encoding
+        int decimals;
+    };
+    static const CodecConversion codec_conversions[] = {
+        { "_ccl_latloncompressed", LATLON, 7 },
+        { "_ccl_fix_age", FIX_AGE, 0 },
+        { "_ccl_time_date", TIME_DATE, 0 },
+        { "_ccl_heading", HEADING, 2 },
+        { "_ccl_depth", DEPTH, 1 },
+        { "_ccl_velocity", VELOCITY, 2 },
+        { "_ccl_watts", WATTS, 0 },
+        { "_ccl_gfi_pitch_oil", GFI_PITCH_OIL, 2 },
+        { "_ccl_speed", SPEED, 3 },
+        { "_ccl_hires_altitude", HIRES_ALTITUDE, 2 },
+        { "_ccl_temperature", TEMPERATURE, 5 },
+        { "_ccl_salinity", SALINITY, 1 },
+        { "_ccl_sound_speed", SOUND_SPEED, 1 }
+    };
+    const std::size_t num_codec_conversions = sizeof(codec_conversions) / sizeof(codec_conversions[0]);
+    
+    const MessageLayout& layout = ccl.layout(type);
+    if(layout.id_bit_width() != BITS_IN_BYTE)
+        throw(Exception("Message " + type->full_name() + " must be loaded with the dccl.ccl.id identifier codec to be transcoded"));
+
+    Format format;
+    for(std::vector<FieldLayout>::const_iterator it = layout.fields().begin(), end = layout.fields().end(); it != end; ++it)
+    {
+        const FieldDescriptor* field = it->field;
+        if(!it->fixed_offset || !it->fixed_size() || it->bit_offset + it->bit_width > FRAME_BYTES * BITS_IN_BYTE)
+            throw(Exception("Field `" + it->path + "` of Message " + type->full_name() + " is not at a fixed position in a 32-byte CCL frame"));
+
+        const dccl::DCCLFieldOptions& options = field->options().GetExtension(dccl::field);
+        
+        Conversion conversion = DEFAULT;
+        int decimals = std::max(0, static_cast<int>(it->precision));
+        if(options.has_codec())
+        {
+            std::size_t i = 0;
+            while(i < num_codec_conversions && options.codec() != codec_conversions[i].codec)
+                ++i;
+            if(i == num_codec_conversions)
+                throw(Exception("Field `" + it->path + "` of Message " + type->full_name() + " uses codec " + options.codec() + ", which cannot be transcoded"));
+            conversion = codec_conversions[i].conversion;
+            decimals = codec_conversions[i].decimals;
+        }
+        else if(field->cpp_type() == FieldDescriptor::CPPTYPE_STRING)
+        {
+            conversion = BYTES;
+        }
+        else if(it->kind == FieldLayout::OPAQUE)
+        {
+            throw(Exception("Field `" + it->path + "` of Message " + type->full_name() + " cannot be transcoded"));
+        }
+
+        // DCCL v2 always encodes max_repeat values of a repeated field
+        const unsigned repeat = it->repeated ? options.max_repeat() : 1;
+        for(unsigned i = 0; i < repeat; ++i)
+        {
+            Slot slot;
+            slot.conversion = conversion;
+            slot.bit_width = it->bit_width / repeat;
+            slot.bit_offset = it->bit_offset + i * slot.bit_width;
+            slot.layout = *it;
+            slot.column = format.columns.size();
+            slot.tag_column = 0;
+            slot.tag_field = 0;
+
+            std::string name = it->path;
+            if(it->repeated)
+                name += "_" + boost::lexical_cast<std::string>(i);
+
+            Batch::Column column;
+            column.field = field;
+            column.name = name;
+            column.decimals = decimals;
+            if(conversion == GFI_PITCH_OIL)
+            {
+                // gfi, pitch and oil
+                const Descriptor* gfi_pitch_oil = field->message_type();
+                for(int j = 0, n = gfi_pitch_oil->field_count(); j < n; ++j)
+                {
+                    column.field = gfi_pitch_oil->field(j);
+                    column.name = name + "." + column.field->name();
+                    format.columns.push_back(column);
+                }
+            }
+            else
+            {
+                format.columns.push_back(column);
+            }
+
+            if(conversion == BYTES && (slot.bit_offset % BITS_IN_BYTE || slot.bit_width % BITS_IN_BYTE))
+                throw(Exception("Bytes field `" + it->path + "` of Message " + type->full_name() + " is not byte aligned"));
+            
+            if(conversion == SPEED)
+            {
+                slot.tag_field = type->FindFieldByNumber(options.GetExtension(::ccl).thrust_mode_tag());
+                std::size_t j = 0;
+                while(j < slot.column && format.columns[j].field != slot.tag_field)
+                    ++j;
+                if(j == slot.column)
+                    throw(Exception("Field `" + it->path + "` of Message " + type->full_name() + " must follow its thrust mode field"));
+                slot.tag_column = j;
+            }
+            
+            format.slots.push_back(slot);
+        }
+    }
+
+    index_[layout.id_bits()] = formats_.size();
+    types_.push_back(type);
+    formats_.push_back(format);
+}
+
+void dccl::legacyccl::Transcoder::decode(const char* bytes, std::size_t n, Batch* batch) const
+{
+    batch->tables_.resize(formats_.size());
+    std::size_t max_columns = 0;
+    for(std::size_t i = 0, m = formats_.size(); i < m; ++i)
+    {
+        Batch::Table& table = batch->tables_[i];
+        table.type = types_[i];
+        table.columns = formats_[i].columns;
+        table.rows = 0;
+        max_columns = std::max(max_columns, table.columns.size());
+    }
+    batch->order_.resize(n);
+    batch->skipped_ = 0;
+
+    const int64 now = std::time(0);
+    std::vector<double> values(max_columns);
+    std::vector<std::string> byte_values(max_columns);
+    for(std::size_t i = 0; i < n; ++i)
+    {
+        const unsigned char* frame = reinterpret_cast<const unsigned char*>(bytes + i * FRAME_BYTES);
+        const int format_index = index_[frame[0]];
+        batch->order_[i] = -1;
+        if(format_index < 0)
+        {
+            ++batch->skipped_;
+            continue;
+        }
+
+        // decode the whole frame before adding it, so that a bad frame leaves no partial row
+        if(!decode_frame(formats_[format_index], frame, &values, &byte_values, now))
+        {
+            ++batch->skipped_;
+            continue;
+        }
+        
+        Batch::Table& table = batch->tables_[format_index];
+        for(std::size_t j = 0, m = table.columns.size(); j < m; ++j)
+        {
+            Batch::Column& column = table.columns[j];
+            if(column.field->cpp_type() == FieldDescriptor::CPPTYPE_STRING)
+                column.bytes.push_back(byte_values[j]);
+            else
+                column.values.push_back(values[j]);
+        }
+        ++table.rows;
+        batch->order_[i] = format_index;
+    }
+}
+
+bool dccl::legacyccl::Transcoder::decode_frame(const Format& format, const unsigned char* frame,
+                                               std::vector<double>* values, std::vector<std::string>* bytes,
+                                               int64 now) const
+{
+    for(std::vector<Slot>::const_iterator it = format.slots.begin(), end = format.slots.end(); it != end; ++it)
+    {
+        const Slot& slot = *it;
+        double& value = (*values)[slot.column];
+
+        if(slot.conversion == BYTES)
+        {
+            (*bytes)[slot.column].assign(reinterpret_cast<const char*>(frame) + slot.bit_offset / BITS_IN_BYTE,
+                                         slot.bit_width / BITS_IN_BYTE);
+            continue;
+        }
+        
+        const uint64 wire = internal::read_bits(frame, slot.bit_offset, slot.bit_width);
+        switch(slot.conversion)
+        {
+            case DEFAULT:
+                if(!slot.layout.decode(wire, &value, now))
+                    value = std::numeric_limits<double>::quiet_NaN();
+                break;
+                
+            case LATLON:
+            {
+                LONG_AND_COMP decoded;
+                decoded.as_long = static_cast<long>(wire);
+                value = Decode_latlon(decoded.as_compressed);
+                break;
+            }
+
+            case FIX_AGE:
+                value = FIX_AGE_SCALE_FACTOR * wire;
+                break;
+
+            case TIME_DATE:
+            {
+                TIME_DATE_LONG decoded;
+                decoded.as_long = static_cast<long>(wire);
+                short mon, day, hour, min, sec;
+                Decode_time_date(decoded.as_time_date, &mon, &day, &hour, &min, &sec);
+
+                // same as TimeDateCodec, without constructing a boost::gregorian::date (which throws for invalid dates)
+                if(mon < 1 || mon > 12 || day < 1 || day > month_start_[mon] - month_start_[mon - 1])
+                    return false;
+                const int64 seconds = (month_start_[mon - 1] + day - 1) * 24 * 3600 + hour * 3600 + min * 60 + sec;
+                value = static_cast<uint64>(seconds) * MICROSECONDS_IN_SECOND;
+                break;
+            }
+
+            case HEADING:
+                value = static_cast<float>(Decode_heading(wire));
+                break;
+
+            case DEPTH:
+                value = Decode_depth(wire);
+                break;
+
+            case VELOCITY:
+                value = Decode_est_velocity(wire);
+                break;
+
+            case WATTS:
+                value = Decode_watts(wire);
+                break;
+
+            case GFI_PITCH_OIL:
+            {
+                float gfi, pitch, oil;
+                Decode_gfi_pitch_oil(wire, &gfi, &pitch, &oil);
+                (*values)[slot.column] = gfi;
+                (*values)[slot.column + 1] = pitch;
+                (*values)[slot.column + 2] = oil;
+                break;
+            }
+
+            case SPEED:
+            {
+                // thrust mode enumeration index
+                const int thrust_mode = static_cast<int>((*values)[slot.tag_column]);
+                switch(slot.tag_field->enum_type()->value(thrust_mode)->number())
+                {
+                    default:
+                    case protobuf::CCLMDATRedirect::RPM:
+                        value = Decode_speed(SPEED_MODE_RPM, wire);
+                        break;
+                    case protobuf::CCLMDATRedirect::METERS_PER_SECOND:
+                        value = Decode_speed(SPEED_MODE_MSEC, wire);
+                        break;
+                }
+                break;
+            }
+
+            case HIRES_ALTITUDE:
+                value = Decode_hires_altitude(wire);
+                break;
+
+            case TEMPERATURE:
+                value = Decode_temperature(wire);
+                break;
+
+            case SALINITY:
+                value = Decode_salinity(wire);
+                break;
+
+            case SOUND_SPEED:
+                value = Decode_sound_speed(wire);
+                break;
+
+            case BYTES:
+                break;
+        }
+    }
+    return true;
+}
+
+std::size_t dccl::legacyccl::Transcoder::transcode(std::istream& in, Sink& sink,
+                                                   unsigned threads, std::size_t batch_frames) const
+{
+    if(batch_frames == 0)
+        throw(Exception("batch_frames must be > 0"));
+    
+    TranscodePipeline pipeline;
+    pipeline.transcoder = this;
+    pipeline.sink = &sink;
+    pipeline.stop = false;
+    pthread_mutex_init(&pipeline.mutex, 0);
+    pthread_cond_init(&pipeline.cond, 0);
+
+    std::vector<pthread_t> workers(threads);
+    for(unsigned i = 0; i < threads; ++i)
+        pthread_create(&workers[i], 0, transcode_worker, &pipeline);
+
+    // jobs in the order they were read
+    std::deque<TranscodeJob*> jobs;
+    const std::size_t max_jobs = threads ? 2 * threads : 1;
+    std::size_t decoded = 0;
+    bool eof = false;
+    try
+    {
+        while(true)
+        {
+            while(!eof && jobs.size() < max_jobs)
+            {
+                TranscodeJob* job = new TranscodeJob;
+                job->bytes.resize(batch_frames * FRAME_BYTES);
+                in.read(&job->bytes[0], job->bytes.size());
+                const std::size_t bytes_read = in.gcount();
+                job->frames = bytes_read / FRAME_BYTES;
+                if(bytes_read < job->bytes.size())
+                {
+                    eof = true;
+                    if(bytes_read % FRAME_BYTES)
+                        dlog.is(WARN) && dlog << "Ignoring " << bytes_read % FRAME_BYTES << " bytes after the last complete CCL frame" << std::endl;
+                }
+                
+                if(job->frames == 0)
+                {
+                    delete job;
+                    break;
+                }
+
+                jobs.push_back(job);
+                if(threads)
+                {
+                    pthread_mutex_lock(&pipeline.mutex);
+                    pipeline.pending.push_back(job);
+                    pthread_cond_signal(&pipeline.cond);
+                    pthread_mutex_unlock(&pipeline.mutex);
+                }
+                else
+                {
+                    decode(job->bytes.data(), job->frames, &job->batch);
+                    sink.format(job->batch, &job->output);
+                    job->done = true;
+                }
+            }
+
+            if(jobs.empty())
+                break;
+
+            TranscodeJob* job = jobs.front();
+            pthread_mutex_lock(&pipeline.mutex);
+            while(!job->done)
+                pthread_cond_wait(&pipeline.cond, &pipeline.mutex);
+            pthread_mutex_unlock(&pipeline.mutex);
+            if(job->failed)
+                throw(Exception(job->error));
+            jobs.pop_front();
+
+            sink.write(job->batch, job->output);
+            decoded += job->batch.size() - job->batch.skipped();
+            delete job;
+        }
+    }
+    catch(...)
+    {
+        stop_workers(&pipeline, workers);
+        for(std::deque<TranscodeJob*>::iterator it = jobs.begin(), end = jobs.end(); it != end; ++it)
+            delete *it;
+        pthread_cond_destroy(&pipeline.cond);
+        pthread_mutex_destroy(&pipeline.mutex);
+        throw;
+    }
+
+    stop_workers(&pipeline, workers);
+    pthread_cond_destroy(&pipeline.cond);
+    pthread_mutex_destroy(&pipeline.mutex);
+    return decoded;
+}
+
+//
+// DCCLSink
+//
+
+void dccl::legacyccl::DCCLSink::map(const Descriptor* ccl_type, const Descriptor* target)
+{
+    // throws if not loaded
+    dccl_.layout(target);
+    targets_[ccl_type] = target;
+}
+
+void dccl::legacyccl::DCCLSink::write(const Batch& batch, const std::string& output)
+{
+    const std::vector<Batch::Table>& tables = batch.tables();
+    std::vector<std::string> encoded(tables.size());
+    std::vector<std::size_t> frame_size(tables.size(), 0);
+    for(std::size_t i = 0, n = tables.size(); i < n; ++i)
+    {
+        const Batch::Table& table = tables[i];
+        std::map<const Descriptor*, const Descriptor*>::const_iterator target_it = targets_.find(table.type);
+        if(table.rows == 0 || target_it == targets_.end())
+            continue;
+
+        const MessageLayout& layout = dccl_.layout(target_it->second);
+        ColumnSet columns;
+        // NaN values (fields that could not be decoded) are encoded as not set
+        std::vector<std::vector<unsigned char> > presence(table.columns.size());
+        for(std::size_t c = 0, m = table.columns.size(); c < m; ++c)
+        {
+            const Batch::Column& column = table.columns[c];
+            const FieldLayout* field = layout.find(column.name);
+            if(column.values.empty() || !field || !field->direct() || field->kind == FieldLayout::STATIC)
+                continue;
+
+            const unsigned char* column_presence = 0;
+            for(std::size_t r = 0; r < table.rows; ++r)
+            {
+                if(column.values[r] != column.values[r])
+                {
+                    if(presence[c].empty())
+                        presence[c].resize((table.rows + BITS_IN_BYTE - 1) / BITS_IN_BYTE, 0xFF);
+                    internal::set_bitmap(&presence[c][0], r, false);
+                    column_presence = &presence[c][0];
+                }
+            }
+            columns.bind(column.name, &column.values[0], column_presence);
+        }
+        frame_size[i] = dccl_.encode_columns(target_it->second, columns, table.rows, &encoded[i]);
+    }
+
+    // put the messages back in the order of the frames
+    buffer_.clear();
+    std::vector<std::size_t> row(tables.size(), 0);
+    const std::vector<int>& order = batch.order();
+    for(std::size_t i = 0, n = order.size(); i < n; ++i)
+    {
+        const int table = order[i];
+        if(table < 0)
+            continue;
+        if(frame_size[table])
+        {
+            buffer_.append(encoded[table], row[table] * frame_size[table], frame_size[table]);
+            ++written_;
+        }
+        ++row[table];
+    }
+    out_.write(buffer_.data(), buffer_.size());
+}
+
+//
+// CSVSink
+//
+
+void dccl::legacyccl::CSVSink::format(const Batch& batch, std::string* output) const
+{
+    const std::vector<Batch::Table>& tables = batch.tables();
+    output->clear();
+
+    std::string hex;
+    std::vector<std::size_t> row(tables.size(), 0);
+    const std::vector<int>& order = batch.order();
+    for(std::size_t i = 0, n = order.size(); i < n; ++i)
+    {
+        const int table_index = order[i];
+        if(table_index < 0)
+            continue;
+
+        const Batch::Table& table = tables[table_index];
+        const std::size_t r = row[table_index]++;
+        output->append(table.type->full_name());
+        for(std::vector<Batch::Column>::const_iterator it = table.columns.begin(), end = table.columns.end(); it != end; ++it)
+        {
+            output->push_back(',');
+            switch(it->field->cpp_type())
+            {
+                case FieldDescriptor::CPPTYPE_STRING:
+                    hex_encode(it->bytes[r], &hex);
+                    output->append(hex);
+                    break;
+                case FieldDescriptor::CPPTYPE_ENUM:
+                {
+                    // empty if the field could not be decoded (NaN)
+                    const double index = it->values[r];
+                    if(index >= 0 && index < it->field->enum_type()->value_count())
+                        output->append(it->field->enum_type()->value(static_cast<int>(index))->name());
+                    break;
+                }
+                default:
+                    if(it->values[r] == it->values[r])
+                        append_decimal(it->values[r], it->decimals, output);
+                    break;
+            }
+        }
+        output->push_back('\n');
+    }
+}
+
+void dccl::legacyccl::CSVSink::write(const Batch& batch, const std::string& output)
+{
+    const std::vector<Batch::Table>& tables = batch.tables();
+    header_written_.resize(tables.size(), false);
+
+    // insert a header before the first line of each type
+    std::string::size_type line_begin = 0, written = 0;
+    const std::vector<int>& order = batch.order();
+    for(std::size_t i = 0, n = order.size(); i < n; ++i)
+    {
+        const int table_index = order[i];
+        if(table_index < 0)
+            continue;
+
+        if(!header_written_[table_index])
+        {
+            const Batch::Table& table = tables[table_index];
+            out_.write(output.data() + written, line_begin - written);
+            written = line_begin;
+            
+            out_ << "#" << table.type->full_name();
+            for(std::vector<Batch::Column>::const_iterator it = table.columns.begin(), end = table.columns.end(); it != end; ++it)
+                out_ << "," << it->name;
+            out_ << "\n";
+            header_written_[table_index] = true;
+
+            if(std::find(header_written_.begin(), header_written_.end(), false) == header_written_.end())
+                break;
+        }
+        line_begin = output.find('\n', line_begin) + 1;
+    }
+    out_.write(output.data() + written, output.size() - written);
+}
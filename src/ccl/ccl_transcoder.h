@@ -0,0 +1,246 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLCCLTRANSCODER20261019H
+#define DCCLCCLTRANSCODER20261019H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <istream>
+#include <ostream>
+
+#include <google/protobuf/descriptor.h>
+
+#include "dccl/common.h"
+#include "dccl/field_layout.h"
+
+namespace dccl
+{
+    class Codec;
+    
+    namespace legacyccl
+    {
+        class Transcoder;
+
+        /// \brief The fields of a batch of CCL frames, decoded into one array ("column") per field and CCL message type
+        class Batch
+        {
+          public:
+            /// \brief The values of one field in every frame of a given CCL type
+            struct Column
+            {
+                /// \brief Name of the field. Nested fields are joined by '.' (e.g. "gfi_pitch_oil.pitch") and each element of a repeated field has its own column, named with its index (e.g. "depth_0", "depth_1")
+                std::string name;
+                /// \brief The field (for nested fields, the innermost field)
+                const google::protobuf::FieldDescriptor* field;
+                /// \brief One value per frame, in engineering units (as the legacyccl field codecs would decode it). Enumerations are given as the enumeration <i>index</i>. NaN where the field could not be decoded (e.g. not set). Empty for bytes fields.
+                std::vector<double> values;
+                /// \brief One value per frame for bytes fields, otherwise empty.
+                std::vector<std::string> bytes;
+                /// \brief Number of decimal places needed to give the values to the resolution of their CCL encoding
+                int decimals;
+            };
+
+            /// \brief All the frames of one CCL type in the batch
+            struct Table
+            {
+                const google::protobuf::Descriptor* type;
+                std::vector<Column> columns;
+                /// \brief Number of frames (rows) of this type
+                std::size_t rows;
+            };
+            
+            /// \brief Number of frames in the batch (including skipped frames)
+            std::size_t size() const { return order_.size(); }
+
+            /// \brief Number of frames that are not CCL messages or could not be decoded
+            std::size_t skipped() const { return skipped_; }
+            
+            /// \brief One table for each CCL type known to the Transcoder (some may be empty)
+            const std::vector<Table>& tables() const { return tables_; }
+
+            /// \brief The table of a given CCL type, or 0 if the type is not known
+            const Table* table(const google::protobuf::Descriptor* type) const;
+
+            /// \brief For each frame (in the order given to Transcoder::decode()), the index of its table in tables(), or -1 if the frame was skipped
+            ///
+            /// Frames of each type are stored in the rows of their table in the same order, so this is all that is needed to put the frames back in their original order.
+            const std::vector<int>& order() const { return order_; }
+
+          private:
+            friend class Transcoder;
+            std::vector<Table> tables_;
+            std::vector<int> order_;
+            std::size_t skipped_;
+        };
+
+        /// \brief Receives the decoded batches from Transcoder::transcode()
+        class Sink
+        {
+          public:
+            virtual ~Sink() { }
+
+            /// \brief Convert a batch to output bytes
+            ///
+            /// Called from the worker threads as soon as the batch is decoded, so that expensive conversions (e.g. to text) run in parallel. Must not modify the Sink or use a Codec.
+            virtual void format(const Batch& batch, std::string* output) const { }
+
+            /// \brief Write a batch (and its output from format())
+            ///
+            /// Called for each batch in the original order, from the thread calling Transcoder::transcode().
+            virtual void write(const Batch& batch, const std::string& output) = 0;
+        };
+
+        /// \brief Re-encodes CCL frames as (DCCL3) messages of another type, keeping the original order
+        ///
+        /// Each field of the target message that can be written in place (see FieldLayout::direct()) is set from the CCL column of the same name (see Batch::Column::name), using Codec::encode_columns(). Frames of a CCL type that has not been mapped are dropped.
+        class DCCLSink : public Sink
+        {
+          public:
+            /// \param dccl Codec in which the target messages are loaded. Only used from the thread calling Transcoder::transcode().
+            /// \param out Stream to write the encoded messages to
+            DCCLSink(Codec& dccl, std::ostream& out)
+                : dccl_(dccl), out_(out), written_(0) { }
+
+            /// \brief Encode frames of CCL type `ccl_type` as `target` messages
+            ///
+            /// \throw Exception if `target` is not loaded
+            void map(const google::protobuf::Descriptor* ccl_type,
+                     const google::protobuf::Descriptor* target);
+
+            void write(const Batch& batch, const std::string& output);
+
+            /// \brief Number of messages written so far
+            std::size_t written() const { return written_; }
+            
+          private:
+            Codec& dccl_;
+            std::ostream& out_;
+            // CCL type to target type
+            std::map<const google::protobuf::Descriptor*, const google::protobuf::Descriptor*> targets_;
+            std::string buffer_;
+            std::size_t written_;
+        };
+
+        /// \brief Writes CCL frames as comma separated values, one line per frame
+        ///
+        /// The first value of each line is the CCL type name, followed by the columns of that type. The first time each type appears, a header line of the same form prefixed by '#' gives the column names. Enumerations are written by name, bytes fields in hexadecimal and numbers to the resolution of their CCL encoding (see Batch::Column::decimals). Fields that could not be decoded are left empty.
+        class CSVSink : public Sink
+        {
+          public:
+            explicit CSVSink(std::ostream& out) : out_(out) { }
+            void format(const Batch& batch, std::string* output) const;
+            void write(const Batch& batch, const std::string& output);
+          private:
+            std::ostream& out_;
+            std::vector<bool> header_written_;
+        };
+        
+        /// \brief Decodes logs of legacy CCL frames in bulk, without going through Codec (and creating a Message) for each frame.
+        ///
+        /// A table of the position and conversion (the WhoiUtil functions used by the legacyccl field codecs) of every field of the 32-byte CCL formats is built once from the layout of the CCL messages (see Codec::layout()). Each frame is then decoded by reading its fields directly, so decode() is safe to call from many threads at once.
+        class Transcoder
+        {
+          public:
+            enum { FRAME_BYTES = 32 };
+
+            /// \brief Build the table of CCL formats
+            ///
+            /// \param ccl Codec with the "dccl.ccl.id" identifier codec and the CCL messages loaded (see dccl3_load()). Only used in the constructor.
+            /// \throw Exception if a field of a CCL message uses a codec the transcoder does not know
+            explicit Transcoder(const Codec& ccl);
+
+            /// \brief CCL time_date fields do not include the year. Like TimeDateCodec, the current year is assumed unless another is given here (e.g. when transcoding old logs).
+            void set_year(int year);
+
+            /// \brief Decode frames into columns
+            ///
+            /// \param bytes n consecutive 32-byte CCL frames
+            /// \param n number of frames
+            /// \param batch decoded frames (replaces any previous contents)
+            void decode(const char* bytes, std::size_t n, Batch* batch) const;
+
+            /// \brief Decode a stream of 32-byte CCL frames and pass them to a Sink
+            ///
+            /// Frames are read in batches of `batch_frames`, decoded (and formatted, see Sink::format()) by `threads` worker threads, and written to `sink` in the original order from the calling thread. At most two batches per thread are held in memory. An exception thrown on a worker (by decode() or Sink::format()) is rethrown here once the batches before it have been written.
+            /// \param in Stream of CCL frames
+            /// \param sink Receives the decoded batches
+            /// \param threads Number of worker threads (0 decodes and formats in the calling thread)
+            /// \param batch_frames Number of frames per batch
+            /// \return Number of frames decoded (not including skipped frames)
+            std::size_t transcode(std::istream& in, Sink& sink,
+                                  unsigned threads = 1, std::size_t batch_frames = 8192) const;
+
+            /// \brief The CCL types known to the transcoder, in the same order as Batch::tables()
+            const std::vector<const google::protobuf::Descriptor*>& types() const
+            { return types_; }
+            
+          private:
+            enum Conversion
+            {
+                // fields using the default codecs (read with FieldLayout::decode())
+                DEFAULT, BYTES,
+                // legacyccl field codecs
+                LATLON, FIX_AGE, TIME_DATE, HEADING, DEPTH, VELOCITY, WATTS,
+                GFI_PITCH_OIL, SPEED, HIRES_ALTITUDE, TEMPERATURE, SALINITY, SOUND_SPEED
+            };
+
+            struct Slot
+            {
+                Conversion conversion;
+                unsigned bit_offset;
+                unsigned bit_width;
+                // layout of the field, for DEFAULT
+                FieldLayout layout;
+                // column to write the value(s) into
+                std::size_t column;
+                // for SPEED: column and field of the thrust mode
+                std::size_t tag_column;
+                const google::protobuf::FieldDescriptor* tag_field;
+            };
+            
+            struct Format
+            {
+                std::vector<Slot> slots;
+                // columns of Batch::Table
+                std::vector<Batch::Column> columns;
+            };
+
+            void add_format(const Codec& ccl, const google::protobuf::Descriptor* type);
+            // returns false if the frame is not valid (i.e. one of the legacyccl codecs would throw)
+            bool decode_frame(const Format& format, const unsigned char* frame,
+                              std::vector<double>* values, std::vector<std::string>* bytes,
+                              int64 now) const;
+            
+          private:
+            std::vector<const google::protobuf::Descriptor*> types_;
+            std::vector<Format> formats_;
+            // CCL id (first byte of the frame) to index in formats_, or -1
+            int index_[1 << BITS_IN_BYTE];
+            int year_;
+            // days from 1970-01-01 to the first of each month of year_, and to the first of the next year
+            int64 month_start_[13];
+        };
+    }
+}
+
+#endif
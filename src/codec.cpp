@@ -20,6 +20,8 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
+#include <cstring>
+
 
 #include <dlfcn.h> // for shared library loading
 
@@ -39,9 +41,22 @@
 #endif // CRYPTOPP_PATH_USES_PLUS_SIGN
 #endif // HAS_CRYPTOPP
 
+#if DCCL_HAS_CRYPTOPP
+// cipher state kept for the lifetime of the passphrase so that the AES key schedule is only computed once
+struct dccl::internal::CryptoContext
+{
+    CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption cipher;
+    CryptoPP::SHA256 hash;
+};
+#else
+struct dccl::internal::CryptoContext { };
+#endif
+
 #include "dccl/codecs2/field_codec_default.h"
 #include "dccl/codecs3/field_codec_default.h"
 #include "dccl/field_codec_id.h"
+#include "dccl/load_cache.h"
+#include "dccl/internal/bit_ops.h"
 
 #include "dccl/protobuf/option_extensions.pb.h"
 
@@ -57,6 +72,8 @@ using google::protobuf::Descriptor;
 using google::protobuf::Reflection;
 
 const unsigned full_width = 60;
+// IDs below this are kept in the skip_crypto_ids_ bitmap (8 kB at most); larger IDs in a sorted vector
+const unsigned MAX_SKIP_CRYPTO_BITMAP_ID = 1 << 16;
 
 
 //
@@ -64,7 +81,8 @@ const unsigned full_width = 60;
 //
 
 dccl::Codec::Codec(const std::string& dccl_id_codec, const std::string& library_path)
-    : id_codec_(dccl_id_codec)
+    : id_codec_(dccl_id_codec),
+      load_cache_(0)
 {
     set_default_codecs();
     FieldCodecManager::add<DefaultIdentifierCodec>(default_id_codec_name());
@@ -213,6 +231,10 @@ void dccl::Codec::encode_internal(const google::protobuf::Message& msg, bool hea
 
 size_t dccl::Codec::encode(char* bytes, size_t max_len, const google::protobuf::Message& msg, bool header_only /* = false */)
 {
+    size_t generated_size = 0;
+    if(!header_only && encode_generated(msg, bytes, max_len, &generated_size))
+        return generated_size;
+    
     const Descriptor* desc = msg.GetDescriptor();
     Bitset head_bits;
     Bitset body_bits;
@@ -243,12 +265,9 @@ size_t dccl::Codec::encode(char* bytes, size_t max_len, const google::protobuf::
         dlog.is(DEBUG3, ENCODE) && dlog << "Unencrypted Body (hex): " << hex_encode(bytes+head_byte_size, bytes+head_byte_size+body_byte_size) << std::endl;
         dlog.is(DEBUG2, ENCODE) && dlog << "Body bytes (bits): " <<  body_byte_size << "(" << body_bits.size() << ")" <<  std::endl;
 
-        if(!crypto_key_.empty() && !skip_crypto_ids_.count(id(desc))) {
-            std::string head_bytes(bytes, bytes+head_byte_size);
-            std::string body_bytes(bytes+head_byte_size, bytes+head_byte_size+body_byte_size);
-            encrypt(&body_bytes, head_bytes);
-            std::memcpy(bytes+head_byte_size, body_bytes.data(), body_bytes.size());
-        }
+        if(encrypted(id(desc)))
+            crypt(reinterpret_cast<unsigned char*>(bytes+head_byte_size), body_byte_size,
+                  reinterpret_cast<const unsigned char*>(bytes), head_byte_size);
 
         dlog.is(logger::DEBUG3, logger::ENCODE) && dlog << "Encrypted Body (hex): " << hex_encode(bytes+head_byte_size, bytes+head_byte_size+body_byte_size) << std::endl;
     }
@@ -262,6 +281,20 @@ size_t dccl::Codec::encode(char* bytes, size_t max_len, const google::protobuf::
 void dccl::Codec::encode(std::string* bytes, const google::protobuf::Message& msg, bool header_only /* = false */)
 {
     const Descriptor* desc = msg.GetDescriptor();
+
+    if(!header_only && !generated_.empty())
+    {
+        const internal::GeneratedCodec* generated = find_generated(desc);
+        if(generated)
+        {
+            size_t begin = bytes->size();
+            size_t generated_size = 0;
+            bytes->resize(begin + generated->size);
+            if(encode_generated(msg, &(*bytes)[begin], generated->size, &generated_size))
+                return;
+            bytes->resize(begin);
+        }
+    }
     Bitset head_bits;
     Bitset body_bits;
     encode_internal(msg, header_only, head_bits, body_bits);
@@ -281,8 +314,9 @@ void dccl::Codec::encode(std::string* bytes, const google::protobuf::Message& ms
         dlog.is(DEBUG3, ENCODE) && dlog << "Unencrypted Body (hex): " << hex_encode(body_bytes) << std::endl;
         dlog.is(DEBUG2, ENCODE) && dlog << "Body bytes (bits): " <<  body_bytes.size() << "(" << body_bits.size() << ")" <<  std::endl;
 
-        if(!crypto_key_.empty() && !skip_crypto_ids_.count(id(desc)))
-            encrypt(&body_bytes, head_bytes);
+        if(encrypted(id(desc)) && !body_bytes.empty())
+            crypt(reinterpret_cast<unsigned char*>(&body_bytes[0]), body_bytes.size(),
+                  reinterpret_cast<const unsigned char*>(head_bytes.data()), head_bytes.size());
 
         dlog.is(logger::DEBUG3, logger::ENCODE) && dlog << "Encrypted Body (hex): " << hex_encode(body_bytes) << std::endl;
     }
@@ -309,6 +343,17 @@ void dccl::Codec::decode(const std::string& bytes, google::protobuf::Message* ms
     decode(bytes.begin(), bytes.end(), msg, header_only);
 }
 
+// position of each field, for direct access to encoded messages
+boost::shared_ptr<dccl::MessageLayout> dccl::Codec::new_layout(boost::shared_ptr<FieldCodecBase> codec, const google::protobuf::Descriptor* desc)
+{
+    Bitset encoded_id;
+    id_codec()->field_encode(&encoded_id, id(desc), 0);
+    boost::shared_ptr<MessageLayout> message_layout(new MessageLayout(desc, encoded_id.to<uint64>(), encoded_id.size()));
+    codec->base_layout(message_layout.get(), desc, HEAD);
+    codec->base_layout(message_layout.get(), desc, BODY);
+    return message_layout;
+}
+
 // makes sure we can actual encode / decode a message of this descriptor given the loaded FieldCodecs
 // checks all bounds on the message
 void dccl::Codec::load(const google::protobuf::Descriptor* desc)
@@ -326,26 +371,55 @@ void dccl::Codec::load(const google::protobuf::Descriptor* desc)
         boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
 
         unsigned dccl_id = id(desc);
+
+        // the cached result also depends on the codec of each field, as given by the layout (which cannot always be computed for a message that would not validate)
+        boost::shared_ptr<MessageLayout> message_layout;
         unsigned head_size_bits, body_size_bits;
-        codec->base_max_size(&head_size_bits, desc, HEAD);
-        codec->base_max_size(&body_size_bits, desc, BODY);
+        bool cached = false;
+        if(load_cache_)
+        {
+            try
+            {
+                message_layout = new_layout(codec, desc);
+                cached = load_cache_->find_validated(*message_layout, &head_size_bits, &body_size_bits);
+            }
+            catch(std::exception&)
+            {
+                message_layout.reset();
+            }
+        }
+        
+        if(!cached)
+        {
+            codec->base_max_size(&head_size_bits, desc, HEAD);
+            codec->base_max_size(&body_size_bits, desc, BODY);
+        }
 
+        // the cached head size excludes the identifier, whose codec is not part of the layout
         unsigned id_bits = 0;
         id_codec()->field_size(&id_bits, dccl_id, 0);
-        head_size_bits += id_bits;
         
-        const unsigned byte_size = ceil_bits2bytes(head_size_bits) + ceil_bits2bytes(body_size_bits);
+        const unsigned byte_size = ceil_bits2bytes(head_size_bits + id_bits) + ceil_bits2bytes(body_size_bits);
 
         if(byte_size > desc->options().GetExtension(dccl::msg).max_bytes())
             throw(Exception("Actual maximum size of message exceeds allowed maximum (dccl.max_bytes). Tighten bounds, remove fields, improve codecs, or increase the allowed dccl.max_bytes"));
         
-        codec->base_validate(desc, HEAD);
-        codec->base_validate(desc, BODY);
+        if(!cached)
+        {
+            codec->base_validate(desc, HEAD);
+            codec->base_validate(desc, BODY);
+        }
 
         if(id2desc_.count(dccl_id) && desc != id2desc_.find(dccl_id)->second)
             throw(Exception("`dccl id` " + boost::lexical_cast<std::string>(dccl_id) + " is already in use by Message " + id2desc_.find(dccl_id)->second->full_name() + ": " + boost::lexical_cast<std::string>(id2desc_.find(dccl_id)->second)));
-        else
-            id2desc_.insert(std::make_pair(id(desc), desc));
+
+        if(!message_layout)
+            message_layout = new_layout(codec, desc);
+        if(!cached && load_cache_)
+            load_cache_->add_validated(*message_layout, head_size_bits, body_size_bits);
+
+        id2desc_.insert(std::make_pair(id(desc), desc));
+        id2layout_[dccl_id] = message_layout;
 
         dlog.is(DEBUG1) && dlog << "Successfully validated message of type: " << desc->full_name() << std::endl;
 
@@ -374,6 +448,8 @@ void dccl::Codec::unload(const google::protobuf::Descriptor* desc)
     if(id2desc_.count(dccl_id)) 
     {
         id2desc_.erase(dccl_id);
+        id2layout_.erase(dccl_id);
+        generated_.erase(desc);
     }
     else
     {
@@ -383,13 +459,108 @@ void dccl::Codec::unload(const google::protobuf::Descriptor* desc)
     
 }
 
+void dccl::Codec::load_generated(const google::protobuf::Descriptor* desc, const internal::GeneratedCodec& generated)
+{
+    const MessageLayout& message_layout = layout(desc);
+
+    // the generated code assumes the default identifier and field codecs, so check it agrees with the ones actually loaded
+    bool matches = generated.id == static_cast<int32>(id(desc)) &&
+        generated.id_bits == message_layout.id_bits() &&
+        generated.id_bit_width == message_layout.id_bit_width() &&
+        generated.head_bits == message_layout.head_bits() &&
+        generated.body_bits == message_layout.body_bits();
+    for(std::vector<FieldLayout>::const_iterator it = message_layout.fields().begin(), end = message_layout.fields().end(); matches && it != end; ++it)
+        matches = it->direct() && it->kind != FieldLayout::STATIC;
+
+    if(matches)
+    {
+        generated_[desc] = generated;
+        dlog.is(DEBUG1) && dlog << "Using the codec generated by protoc-gen-dccl for " << desc->full_name() << std::endl;
+    }
+    else
+    {
+        generated_.erase(desc);
+        dlog.is(DEBUG1) && dlog << "Not using the codec generated by protoc-gen-dccl for " << desc->full_name() << " as it does not match the loaded field codecs" << std::endl;
+    }
+}
+
+const dccl::internal::GeneratedCodec* dccl::Codec::find_generated(const google::protobuf::Descriptor* desc) const
+{
+    std::map<const Descriptor*, internal::GeneratedCodec>::const_iterator it = generated_.find(desc);
+    return (it == generated_.end()) ? 0 : &it->second;
+}
+
+bool dccl::Codec::encode_generated(const google::protobuf::Message& msg, char* bytes, size_t max_len, size_t* size)
+{
+    const internal::GeneratedCodec* generated = find_generated(msg.GetDescriptor());
+
+    // let encode_internal() report any errors
+    if(!generated || max_len < generated->size || !msg.IsInitialized())
+        return false;
+
+    if(!generated->encode(msg, reinterpret_cast<unsigned char*>(bytes)))
+        return false;
+
+    if(encrypted(generated->id))
+    {
+        const size_t head_byte_size = ceil_bits2bytes(generated->head_bits);
+        unsigned char* frame = reinterpret_cast<unsigned char*>(bytes);
+        crypt(frame + head_byte_size, generated->size - head_byte_size, frame, head_byte_size);
+    }
+
+    dlog.is(DEBUG1, ENCODE) && dlog << "Successfully encoded message of type: " << msg.GetDescriptor()->full_name() << " (generated codec)" << std::endl;
+    *size = generated->size;
+    return true;
+}
+
+bool dccl::Codec::decode_generated(const unsigned char* bytes, size_t max_len, google::protobuf::Message* msg, size_t* size)
+{
+    const internal::GeneratedCodec* generated = find_generated(msg->GetDescriptor());
+
+    // let the field codecs report any errors
+    if(!bytes || !generated || max_len < generated->size ||
+       internal::read_bits(bytes, 0, generated->id_bit_width) != generated->id_bits)
+        return false;
+
+    bool decoded = false;
+    if(encrypted(generated->id))
+    {
+        // the input is const, so decrypt a single copy of the frame
+        const size_t head_byte_size = ceil_bits2bytes(generated->head_bits);
+        std::vector<unsigned char> decrypted(bytes, bytes + generated->size);
+        crypt(&decrypted[0] + head_byte_size, generated->size - head_byte_size, &decrypted[0], head_byte_size);
+        decoded = generated->decode(&decrypted[0], msg);
+    }
+    else
+    {
+        decoded = generated->decode(bytes, msg);
+    }
+
+    if(decoded)
+    {
+        dlog.is(logger::DEBUG1, logger::DECODE) && dlog << "Successfully decoded message of type: " << msg->GetDescriptor()->full_name() << " (generated codec)" << std::endl;
+        *size = generated->size;
+    }
+    return decoded;
+}
+
 unsigned dccl::Codec::size(const google::protobuf::Message& msg)
 {
     const Descriptor* desc = msg.GetDescriptor();
 
+    // generated codecs are only used for fixed size messages
+    const internal::GeneratedCodec* generated = find_generated(desc);
+    if(generated)
+        return generated->size;
+
     boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
     
     unsigned dccl_id = id(desc);
+
+    // as for encode_internal(), so that field codecs can find their message (e.g. this_descriptor())
+    internal::MessageStack msg_stack;
+    msg_stack.push(desc);
+    
     unsigned head_size_bits;
     codec->base_size(&head_size_bits, msg, HEAD);
 
@@ -520,44 +691,253 @@ void dccl::Codec::info(const google::protobuf::Descriptor* desc, std::ostream* p
 }
 
 
-void dccl::Codec::encrypt(std::string* s, const std::string& nonce /* message head */)
+const dccl::MessageLayout& dccl::Codec::layout(const google::protobuf::Descriptor* desc) const
 {
-#if DCCL_HAS_CRYPTOPP
-    using namespace CryptoPP;
+    std::map<int32, boost::shared_ptr<MessageLayout> >::const_iterator it = id2layout_.find(id(desc));
+    if(it == id2layout_.end() || it->second->descriptor() != desc)
+        throw(Exception("Message " + desc->full_name() + " has not been loaded. Call load() before using this type."));
+    return *it->second;
+}
 
-    std::string iv;
-    SHA256 hash;
-    StringSource unused(nonce, true, new HashFilter(hash, new StringSink(iv)));
+const dccl::FieldLayout& dccl::Codec::patch_field(const char* bytes, std::size_t size, const std::string& path)
+{
+    unsigned this_id = id(bytes, bytes + size);
+    std::map<int32, boost::shared_ptr<MessageLayout> >::const_iterator it = id2layout_.find(this_id);
+    if(it == id2layout_.end())
+        throw(Exception("Message id " + boost::lexical_cast<std::string>(this_id) + " has not been loaded. Call load() before patching this type."));
+
+    const FieldLayout& field = it->second->direct_field(path);
+    if(field.kind == FieldLayout::STATIC)
+        throw(Exception("Field `" + path + "` is static (not encoded) and cannot be patched"));
+    if(size * BITS_IN_BYTE < field.bit_offset + field.bit_width)
+        throw(Exception("Bytes passed (hex: " + hex_encode(bytes, bytes + size) + ") are too small to contain field `" + path + "`"));
+    return field;
+}
+
+void dccl::Codec::patch_bits(char* bytes, std::size_t size, const FieldLayout& field, uint64 wire)
+{
+    const MessageLayout& message_layout = *id2layout_.find(id(bytes, bytes + size))->second;
+    unsigned char* frame = reinterpret_cast<unsigned char*>(bytes);
     
-    CTR_Mode<AES>::Encryption encryptor;
-    encryptor.SetKeyWithIV((byte*)crypto_key_.c_str(), crypto_key_.size(), (byte*)iv.c_str());
-
-    std::string cipher;
-    StreamTransformationFilter in(encryptor, new StringSink(cipher));
-    in.Put((byte*)s->c_str(), s->size());
-    in.MessageEnd();
-    *s = cipher;
-#endif
+    if(!encrypted(id(message_layout.descriptor())))
+    {
+        internal::write_bits(frame, field.bit_offset, field.bit_width, wire);
+    }
+    else
+    {
+        // the head is the nonce for the body, so the body always needs to be re-encrypted
+        const unsigned head_bytes = message_layout.body_byte_offset();
+        crypt(frame + head_bytes, size - head_bytes, frame, head_bytes);
+        internal::write_bits(frame, field.bit_offset, field.bit_width, wire);
+        crypt(frame + head_bytes, size - head_bytes, frame, head_bytes);
+    }
 }
 
-void dccl::Codec::decrypt(std::string* s, const std::string& nonce)
+const dccl::MessageLayout& dccl::Codec::find_layout(const char* bytes, std::size_t size) const
 {
-#if DCCL_HAS_CRYPTOPP
-    using namespace CryptoPP;
+    const unsigned char* frame = reinterpret_cast<const unsigned char*>(bytes);
+    for(std::map<int32, boost::shared_ptr<MessageLayout> >::const_iterator it = id2layout_.begin(), end = id2layout_.end(); it != end; ++it)
+    {
+        if(it->second->matches(frame, size))
+            return *it->second;
+    }
+    throw(Exception("Bytes passed (hex: " + hex_encode(bytes, bytes + size) + ") do not begin with the identifier of any loaded message"));
+}
+
+dccl::uint64 dccl::Codec::extract_bits(const char* bytes, std::size_t size, const FieldLayout& field, int64* now)
+{
+    const MessageLayout& message_layout = *field.message;
+    const unsigned char* frame = reinterpret_cast<const unsigned char*>(bytes);
+
+    if(!field.direct())
+        throw(Exception("Field `" + field.path + "` of Message " + message_layout.descriptor()->full_name() + " cannot be extracted directly"));
+    if(!message_layout.matches(frame, size))
+        throw(Exception("Bytes passed (hex: " + hex_encode(bytes, bytes + size) + ") are not a " + message_layout.descriptor()->full_name() + " message"));
+    if(field.kind == FieldLayout::STATIC)
+        return 0;
+    if(size * BITS_IN_BYTE < field.bit_offset + field.bit_width)
+        throw(Exception("Bytes passed (hex: " + hex_encode(bytes, bytes + size) + ") are too small to contain field `" + field.path + "`"));
+
+    if(field.kind == FieldLayout::TIME)
+    {
+        timeval t;
+        gettimeofday(&t, 0);
+        *now = t.tv_sec;
+    }
+    
+    if(field.part == HEAD || !encrypted(id(message_layout.descriptor())))
+        return internal::read_bits(frame, field.bit_offset, field.bit_width);
+
+    // the keystream is applied from the start of the body, so only the body bytes up to the end of the field need decrypting
+    const unsigned head_bytes = message_layout.body_byte_offset();
+    std::vector<unsigned char> body(frame + head_bytes, frame + ceil_bits2bytes(field.bit_offset + field.bit_width));
+    crypt(&body[0], body.size(), frame, head_bytes);
+    return internal::read_bits(&body[0], field.bit_offset - head_bytes * BITS_IN_BYTE, field.bit_width);
+}
+
+std::string dccl::Codec::encode_empty(const google::protobuf::Descriptor* desc)
+{
+    boost::shared_ptr<google::protobuf::Message> msg = DynamicProtobufManager::new_protobuf_message(desc);
+    boost::shared_ptr<FieldCodecBase> codec = FieldCodecManager::find(desc);
+
+    Bitset head_bits, body_bits;
+    id_codec()->field_encode(&head_bits, id(desc), 0);
 
-    std::string iv;
-    SHA256 hash;
-    StringSource unused(nonce, true, new HashFilter(hash, new StringSink(iv)));
+    internal::MessageStack msg_stack;
+    msg_stack.push(desc);
+    codec->base_encode(&head_bits, *msg, HEAD);
+    codec->base_encode(&body_bits, *msg, BODY);
     
-    CTR_Mode<AES>::Decryption decryptor;    
-    decryptor.SetKeyWithIV((byte*)crypto_key_.c_str(), crypto_key_.size(), (byte*)iv.c_str());
+    return head_bits.to_byte_string() + body_bits.to_byte_string();
+}
+
+std::size_t dccl::Codec::encode_columns(const google::protobuf::Descriptor* desc,
+                                        const ColumnSet& columns, std::size_t n, std::string* bytes)
+{
+    std::size_t begin = bytes->size();
+    bytes->resize(begin + n * max_size(desc));
+    try
+    {
+        std::size_t frame_size = encode_columns(desc, columns, n, &(*bytes)[0] + begin, bytes->size() - begin);
+        bytes->resize(begin + n * frame_size);
+        return frame_size;
+    }
+    catch(...)
+    {
+        // leave the caller's bytes as they were
+        bytes->resize(begin);
+        throw;
+    }
+}
+
+std::size_t dccl::Codec::encode_columns(const google::protobuf::Descriptor* desc,
+                                        const ColumnSet& columns, std::size_t n,
+                                        char* bytes, std::size_t max_len)
+{
+    const MessageLayout& message_layout = layout(desc);
+
+    std::vector<const FieldLayout*> fields;
+    columns.resolve(message_layout, &fields);
+
+    // every required field (not within an optional message) must have a column
+    std::set<const FieldLayout*> bound(fields.begin(), fields.end());
+    for(std::vector<FieldLayout>::const_iterator it = message_layout.fields().begin(), end = message_layout.fields().end(); it != end; ++it)
+    {
+        if(it->always_present && it->kind != FieldLayout::STATIC && !bound.count(&*it))
+            throw(Exception("Required field `" + it->path + "` of Message " + desc->full_name() + " must be bound to a column to encode it"));
+    }
+
+    // every message starts as an empty message and the columns are written over it
+    std::string empty = encode_empty(desc);
+    const std::size_t frame_size = empty.size();
+    if(max_len < n * frame_size)
+        throw std::length_error("max_len must be >= n * encoded message size");
+
+    std::vector<unsigned char*> frames(n);
+    for(std::size_t i = 0; i < n; ++i)
+    {
+        frames[i] = reinterpret_cast<unsigned char*>(bytes + i*frame_size);
+        std::memcpy(frames[i], empty.data(), frame_size);
+    }
+    if(n)
+        columns.encode(fields, &frames[0], n);
+
+    if(encrypted(id(desc)))
+    {
+        const unsigned head_bytes = message_layout.body_byte_offset();
+        for(std::size_t i = 0; i < n; ++i)
+            crypt(frames[i] + head_bytes, frame_size - head_bytes, frames[i], head_bytes);
+    }
     
-    std::string recovered;
+    return frame_size;
+}
 
-    StreamTransformationFilter out(decryptor, new StringSink(recovered));
-    out.Put((byte*)s->c_str(), s->size());
-    out.MessageEnd();
-    *s = recovered;
+std::size_t dccl::Codec::decode_columns(const google::protobuf::Descriptor* desc,
+                                        const std::vector<std::string>& frames, const ColumnSet& columns)
+{
+    std::vector<const unsigned char*> frame_ptrs(frames.size());
+    std::vector<std::size_t> frame_sizes(frames.size());
+    for(std::size_t i = 0, n = frames.size(); i < n; ++i)
+    {
+        frame_ptrs[i] = reinterpret_cast<const unsigned char*>(frames[i].data());
+        frame_sizes[i] = frames[i].size();
+    }
+    return decode_columns(layout(desc), frame_ptrs, frame_sizes, columns);
+}
+
+std::size_t dccl::Codec::decode_columns(const google::protobuf::Descriptor* desc,
+                                        const char* bytes, std::size_t frame_size, std::size_t n,
+                                        const ColumnSet& columns)
+{
+    std::vector<const unsigned char*> frame_ptrs(n);
+    for(std::size_t i = 0; i < n; ++i)
+        frame_ptrs[i] = reinterpret_cast<const unsigned char*>(bytes + i*frame_size);
+    return decode_columns(layout(desc), frame_ptrs, std::vector<std::size_t>(n, frame_size), columns);
+}
+
+std::size_t dccl::Codec::decode_columns(const MessageLayout& layout,
+                                        std::vector<const unsigned char*>& frames,
+                                        const std::vector<std::size_t>& frame_sizes,
+                                        const ColumnSet& columns)
+{
+    const std::size_t n = frames.size();
+    
+    std::vector<const FieldLayout*> fields;
+    const unsigned min_frame_size = columns.resolve(layout, &fields);
+
+    for(std::size_t i = 0; i < n; ++i)
+    {
+        if(frame_sizes[i] * BITS_IN_BYTE < layout.id_bit_width() ||
+           internal::read_bits(frames[i], 0, layout.id_bit_width()) != layout.id_bits())
+            throw(Exception("Message " + boost::lexical_cast<std::string>(i) + " (hex: " + hex_encode(frames[i], frames[i] + frame_sizes[i]) + ") is not of type " + layout.descriptor()->full_name()));
+        if(frame_sizes[i] < min_frame_size)
+            throw(Exception("Message " + boost::lexical_cast<std::string>(i) + " (hex: " + hex_encode(frames[i], frames[i] + frame_sizes[i]) + ") is too small to contain the requested fields of " + layout.descriptor()->full_name()));
+    }
+
+    // decrypt the bodies if any of the columns are in the body
+    std::vector<std::string> plain;
+    if(encrypted(id(layout.descriptor())))
+    {
+        bool need_body = false;
+        for(std::size_t i = 0, m = fields.size(); i < m; ++i)
+            need_body = need_body || (fields[i]->part == BODY && fields[i]->kind != FieldLayout::STATIC);
+
+        if(need_body)
+        {
+            const unsigned head_bytes = layout.body_byte_offset();
+            plain.resize(n);
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                plain[i].assign(frames[i], frames[i] + frame_sizes[i]);
+                unsigned char* frame = reinterpret_cast<unsigned char*>(&plain[i][0]);
+                crypt(frame + head_bytes, frame_sizes[i] - head_bytes, frame, head_bytes);
+                frames[i] = frame;
+            }
+        }
+    }
+
+    timeval t;
+    gettimeofday(&t, 0);
+    
+    if(n)
+        columns.decode(fields, &frames[0], n, t.tv_sec);
+
+    return n;
+}
+
+void dccl::Codec::crypt(unsigned char* body, std::size_t body_size, const unsigned char* head, std::size_t head_size)
+{
+#if DCCL_HAS_CRYPTOPP
+    using namespace CryptoPP;
+
+    if(!body_size)
+        return;
+    
+    // the IV is the SHA256 hash of the head (nonce); only the counter is reset, the key schedule is reused
+    unsigned char iv[SHA256::DIGESTSIZE];
+    crypto_->hash.CalculateDigest(iv, head, head_size);
+    crypto_->cipher.Resynchronize(iv, AES::BLOCKSIZE);
+    crypto_->cipher.ProcessData(body, body, body_size);
 #endif
 }
 
@@ -596,22 +976,39 @@ void dccl::Codec::unload_library(void* dl_handle)
 
 void dccl::Codec::set_crypto_passphrase(const std::string& passphrase, const std::set<unsigned>& do_not_encrypt_ids_ /*= std::set<unsigned>()*/)
 {
-    if(!crypto_key_.empty())
-        crypto_key_.clear();
+    crypto_.reset();
     skip_crypto_ids_.clear();
+    skip_crypto_large_ids_.clear();
 
 #if DCCL_HAS_CRYPTOPP
     using namespace CryptoPP;
     
-    SHA256 hash;
-    StringSource unused(passphrase, true, new HashFilter(hash, new StringSink(crypto_key_)));
+    unsigned char key[SHA256::DIGESTSIZE];
+    SHA256().CalculateDigest(key, reinterpret_cast<const unsigned char*>(passphrase.data()), passphrase.size());
+
+    // the IV is replaced for each message by crypt()
+    crypto_.reset(new internal::CryptoContext);
+    crypto_->cipher.SetKeyWithIV(key, sizeof(key), key);
     
     dlog.is(DEBUG1) && dlog << "Cryptography enabled with given passphrase" << std::endl;
 #else
     dlog.is(DEBUG1) && dlog << "Cryptography disabled because DCCL was compiled without support of Crypto++. Install Crypto++ and recompile to enable cryptography." << std::endl;
 #endif
 
-    skip_crypto_ids_ = do_not_encrypt_ids_;
+    for(std::set<unsigned>::const_iterator it = do_not_encrypt_ids_.begin(), end = do_not_encrypt_ids_.end(); it != end; ++it)
+    {
+        if(*it < MAX_SKIP_CRYPTO_BITMAP_ID)
+        {
+            if(*it >= skip_crypto_ids_.size() * BITS_IN_BYTE)
+                skip_crypto_ids_.resize(*it / BITS_IN_BYTE + 1, 0);
+            internal::set_bitmap(&skip_crypto_ids_[0], *it, true);
+        }
+        else
+        {
+            // std::set iterates in order, so this stays sorted for binary_search
+            skip_crypto_large_ids_.push_back(*it);
+        }
+    }
 }
 
 void dccl::Codec::info_all(std::ostream* param_os /*= 0 */) const
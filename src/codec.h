@@ -28,10 +28,16 @@
 #include <ostream>
 #include <stdexcept>
 #include <vector>
+#include <algorithm>
+
+#if __cplusplus >= 201103L
+#include <array>
+#endif
 
 #include <google/protobuf/descriptor.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 
 #include "binary.h"
 #include "dynamic_protobuf_manager.h"
@@ -39,6 +45,11 @@
 #include "exception.h"
 #include "field_codec.h"
 #include "field_codec_fixed.h"
+#include "field_codec_static.h"
+#include "field_layout.h"
+#include "column_set.h"
+#include "internal/generated_codec.h"
+#include "internal/bit_ops.h"
 
 #include "codecs2/field_codec_default_message.h"
 #include "codecs3/field_codec_default_message.h"
@@ -50,8 +61,16 @@
 namespace dccl
 {
     class FieldCodec;
+    class LoadCache;
+
+    namespace internal
+    {
+        struct CryptoContext;
+    }
   
     /// \brief The Dynamic CCL enCODer/DECoder. This is the main class you will use to load, encode and decode DCCL messages. Many users will not need any other DCCL classes than this one.
+    ///
+    /// A Codec may not be used from more than one thread at a time, but separate Codec instances may encode and decode concurrently on separate threads. Construct the Codecs, and add any field codecs with FieldCodecManager, before starting those threads.
     /// \ingroup dccl_api
     class Codec
     {
@@ -90,11 +109,15 @@ namespace dccl
         
         /// \brief All messages must be explicited loaded and validated (size checks, option extensions checks, etc.) before they can be encoded/decoded. Use this version of load() when the messages used are static (known at compile time).
         ///
+        /// If protoc-gen-dccl generated encode and decode functions for this type (it does for fixed size messages that only use the default codecs), and they agree with the layout computed from the loaded field codecs, encode() and decode() call them directly instead of traversing the message with the field codecs (see has_generated_codec()).
         /// \tparam ProtobufMessage Any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message)
         /// \throw dccl::Exception if message is invalid. Warnings and errors are written to dccl::dlog.
         template<typename ProtobufMessage>
             void load()
-        { load(ProtobufMessage::descriptor()); }
+        {
+            load(ProtobufMessage::descriptor());
+            load_generated<ProtobufMessage>(boost::integral_constant<bool, internal::HasGeneratedCodec<ProtobufMessage>::value>());
+        }
 
         /// \brief Unload a given message.
         ///
@@ -116,6 +139,12 @@ namespace dccl
         /// \throw dccl::Exception if message is invalid.
         void unload(const google::protobuf::Descriptor* desc);
 
+        /// \brief Use a cache of validation results in load(), so that messages that have not changed since they were last validated are loaded without being validated again
+        ///
+        /// \param cache Cache to read and record results in (which must outlive this Codec, or until set_load_cache(0) is called), or 0 to always validate
+        void set_load_cache(LoadCache* cache)
+        { load_cache_ = cache; }
+
         /// \brief Set a passphrase to be used when encoded messages to encrypt them and to decrypt messages after decoding them.
         ///
         /// Encryption is performed using AES via the opertional Crypto++ library. If this library is not compiled in, no encryption will be performed.
@@ -188,6 +217,29 @@ namespace dccl
 
         /// \brief Provides a map of all loaded DCCL IDs to the equivalent Protobuf descriptor
         const std::map<int32, const google::protobuf::Descriptor*>& loaded() const { return id2desc_; }
+
+        /// \brief Provides the position (head or body, bit offset) and size of every field of a loaded DCCL type, computed by load().
+        ///
+        /// For messages that only use fixed size codecs, every field is at the same bit offset in every encoded message, and fields using the default codecs can be read and written in place (see FieldLayout::direct(), patch()).
+        /// \tparam ProtobufMessage Any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message)
+        /// \throw Exception if the type has not been loaded
+        template<typename ProtobufMessage>
+            const MessageLayout& layout() const
+        { return layout(ProtobufMessage::descriptor()); }
+
+        /// \brief An alterative form of layout() for message types <i>not</i> known at compile-time ("dynamic").
+        const MessageLayout& layout(const google::protobuf::Descriptor* desc) const;
+
+        /// \brief True if encode() and decode() of this type use the functions generated by protoc-gen-dccl (see load()).
+        ///
+        /// \tparam ProtobufMessage Any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message)
+        template<typename ProtobufMessage>
+            bool has_generated_codec() const
+        { return has_generated_codec(ProtobufMessage::descriptor()); }
+
+        /// \brief An alterative form of has_generated_codec() for message types <i>not</i> known at compile-time ("dynamic").
+        bool has_generated_codec(const google::protobuf::Descriptor* desc) const
+        { return generated_.count(desc); }
         
         //@}
             
@@ -215,6 +267,114 @@ namespace dccl
         /// \return size of encoded message
         size_t encode(char* bytes, size_t max_len, const google::protobuf::Message& msg, bool header_only = false);
 
+#if __cplusplus >= 201103L
+        /// \brief Encodes a DCCL message into a buffer sized at compile time
+        ///
+        /// protoc-gen-dccl computes DCCL_ENCODED_MAX for messages that only use the default codecs (along with the other DCCLSizeParameters), so the buffer can live on the stack and no size needs to be queried at runtime.
+        /// \tparam ProtobufMessage Any Google Protobuf Message generated by protoc-gen-dccl with DCCL_ENCODED_MAX
+        /// \param bytes Output buffer to store encoded msg
+        /// \param msg Message to encode (must already have been validated)
+        /// \param header_only If true, only decode the header (do not try to decrypt (if applicable) and decode the message body)
+        /// \throw Exception if message cannot be encoded.
+        /// \return size of encoded message
+        template<typename ProtobufMessage>
+            size_t encode(std::array<char, ProtobufMessage::DCCL_ENCODED_MAX>* bytes, const ProtobufMessage& msg, bool header_only = false)
+        { return encode(bytes->data(), bytes->size(), msg, header_only); }
+#endif
+
+        /// \brief Encode many messages of the same type directly from columns (arrays), without creating a Google Protobuf Message for each.
+        ///
+        /// Every field bound in `columns` must be at a fixed position in the encoded message (see FieldLayout::direct()) and every `required` field must be bound. Fields that are not bound are encoded as not set. The same bounds checks and quantization as the field codecs are applied, so each message is identical to the one encode() would give for a Message with the same values.
+        /// All the messages are the same size and are appended back to back.
+        /// \tparam ProtobufMessage Any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message)
+        /// \param columns columns to read the field values from. Each must have at least n values.
+        /// \param n Number of messages to encode
+        /// \param bytes Pointer to byte string to append the encoded messages to
+        /// \throw Exception if a column cannot be encoded directly or a required field is not bound
+        /// \return size of each encoded message (in bytes)
+        template<typename ProtobufMessage>
+            std::size_t encode_columns(const ColumnSet& columns, std::size_t n, std::string* bytes)
+        { return encode_columns(ProtobufMessage::descriptor(), columns, n, bytes); }
+
+        /// \brief An alterative form of encode_columns() for message types <i>not</i> known at compile-time ("dynamic").
+        std::size_t encode_columns(const google::protobuf::Descriptor* desc,
+                                   const ColumnSet& columns, std::size_t n, std::string* bytes);
+
+        /// \brief Encode many messages of the same type from columns into an output buffer (see encode_columns(const ColumnSet&, std::size_t, std::string*)).
+        ///
+        /// \param desc Descriptor of the messages to encode
+        /// \param columns columns to read the field values from. Each must have at least n values.
+        /// \param n Number of messages to encode
+        /// \param bytes Output buffer. Message i is written to bytes + i*(returned size).
+        /// \param max_len Size of the output buffer
+        /// \return size of each encoded message (in bytes)
+        std::size_t encode_columns(const google::protobuf::Descriptor* desc,
+                                   const ColumnSet& columns, std::size_t n,
+                                   char* bytes, std::size_t max_len);
+
+        /// \brief Re-encode a single field of an already encoded message in place, leaving the rest of the message untouched.
+        ///
+        /// This is much cheaper than decoding, modifying and re-encoding the message (e.g. to update a timestamp or counter of a message that is resent). The field must be FieldLayout::direct() and is encoded with the same bounds checks and quantization as its field codec. If the message is encrypted, the body is decrypted and re-encrypted (with the new head, if the field is in the head).
+        /// \param bytes encoded message to modify
+        /// \param path Path of the field (e.g. "header.time"; see FieldLayout::path)
+        /// \param value New value of the field (for enumerations, the enumeration index)
+        /// \throw Exception if the field cannot be patched directly
+        template<typename T>
+            void patch(std::string* bytes, const std::string& path, const T& value)
+        { patch(&(*bytes)[0], bytes->size(), path, value); }
+
+        /// \brief Re-encode a single field of an already encoded message in place (see patch(std::string*, const std::string&, const T&)).
+        ///
+        /// \param bytes encoded message to modify
+        /// \param size size of the encoded message in bytes
+        /// \param path Path of the field (e.g. "header.time")
+        /// \param value New value of the field
+        template<typename T>
+            void patch(char* bytes, std::size_t size, const std::string& path, const T& value)
+        {
+            const FieldLayout& field = patch_field(bytes, size, path);
+            patch_bits(bytes, size, field, field.encode(value));
+        }
+
+        /// \brief Read a single field of an encoded message directly into a plain value, without decoding the message.
+        ///
+        /// Only the bits of the field are read: no Message, Bitset or boost::any is created and no field codec is called. This makes it cheap to inspect a few fields (e.g. header fields for routing) of many messages. The field must be FieldLayout::direct(); look it up once (e.g. `codec.layout<MyMsg>().direct_field("header.time")`) and reuse it for every message. If the field is in the body of an encrypted message, the body is decrypted first.
+        /// \param bytes encoded message
+        /// \param field Field to read, from the layout() of the message type
+        /// \param value Set to the value of the field, converted to T (for enumerations, the enumeration index)
+        /// \throw Exception if the bytes are not a message of the type containing `field` or are too small to contain it
+        /// \return false if the field is not set (`value` is unchanged)
+        template<typename T>
+            bool extract(const std::string& bytes, const FieldLayout& field, T* value)
+        { return extract(bytes.data(), bytes.size(), field, value); }
+
+        /// \brief Read a single field of an encoded message directly into a plain value (see extract(const std::string&, const FieldLayout&, T*)).
+        ///
+        /// \param bytes encoded message
+        /// \param size size of the encoded message in bytes
+        /// \param field Field to read, from the layout() of the message type
+        /// \param value Set to the value of the field
+        /// \return false if the field is not set
+        template<typename T>
+            bool extract(const char* bytes, std::size_t size, const FieldLayout& field, T* value)
+        {
+            int64 now = 0;
+            uint64 wire = extract_bits(bytes, size, field, &now);
+            return field.decode(wire, value, now);
+        }
+
+        /// \brief Read a single field of an encoded message of any loaded type directly into a plain value (see extract(const std::string&, const FieldLayout&, T*)).
+        ///
+        /// The type is identified by comparing the identifier bits against every loaded type, and the field is looked up by its path on each call, so prefer the FieldLayout form when reading the same field of many messages.
+        /// \param bytes encoded message
+        /// \param path Path of the field (e.g. "header.time"; see FieldLayout::path)
+        /// \param value Set to the value of the field
+        /// \throw Exception if the type has not been loaded or the field cannot be read directly
+        /// \return false if the field is not set
+        template<typename T>
+            bool extract(const std::string& bytes, const std::string& path, T* value)
+        { return extract(bytes, find_layout(bytes.data(), bytes.size()).direct_field(path), value); }
+        
         /// \brief Decode a DCCL message when the type is known at compile time.
         ///
         /// \param begin Iterator to the first byte of encoded message to decode (must already have been validated)
@@ -260,6 +420,34 @@ namespace dccl
         template<typename GoogleProtobufMessagePointer>
             GoogleProtobufMessagePointer decode(std::string* bytes);
 
+        /// \brief Decode many messages of the same type directly into columns (arrays), without creating a Google Protobuf Message for each.
+        ///
+        /// Every field bound in `columns` must be at a fixed position in the encoded message (see FieldLayout::direct()), which is the case for messages that only use the default numeric, bool, enum, time and static codecs (until the first variable size field). Row i of each column is set from frames[i].
+        /// \tparam ProtobufMessage Any Google Protobuf Message generated by protoc (i.e. subclass of google::protobuf::Message)
+        /// \param frames encoded messages to decode (must all be of type ProtobufMessage)
+        /// \param columns columns to write the decoded fields into. Each must have space for frames.size() values.
+        /// \throw Exception if a column cannot be decoded directly or a message is of the wrong type
+        /// \return number of messages decoded
+        template<typename ProtobufMessage>
+            std::size_t decode_columns(const std::vector<std::string>& frames, const ColumnSet& columns)
+        { return decode_columns(ProtobufMessage::descriptor(), frames, columns); }
+
+        /// \brief An alterative form of decode_columns() for message types <i>not</i> known at compile-time ("dynamic").
+        std::size_t decode_columns(const google::protobuf::Descriptor* desc,
+                                   const std::vector<std::string>& frames, const ColumnSet& columns);
+
+        /// \brief Decode many messages of the same type stored back to back in a single buffer directly into columns (see decode_columns(const std::vector<std::string>&, const ColumnSet&)).
+        ///
+        /// \param desc Descriptor of the encoded messages
+        /// \param bytes Start of the first message. Message i starts at bytes + i*frame_size.
+        /// \param frame_size Size of each message (in bytes)
+        /// \param n Number of messages
+        /// \param columns columns to write the decoded fields into. Each must have space for n values.
+        /// \return number of messages decoded
+        std::size_t decode_columns(const google::protobuf::Descriptor* desc,
+                                   const char* bytes, std::size_t frame_size, std::size_t n,
+                                   const ColumnSet& columns);
+
         /// \brief Provides the encoded size (in bytes) of msg. This is useful if you need to know the size of a message before encoding it (encoding it is generally much more expensive than calling this method)
         ///
         /// \param msg Google Protobuf message with DCCL extensions for which the encoded size is requested
@@ -316,8 +504,56 @@ namespace dccl
 
         void encode_internal(const google::protobuf::Message& msg, bool header_only, Bitset& header_bits, Bitset& body_bits);
 
-        void encrypt(std::string* s, const std::string& nonce);
-        void decrypt(std::string* s, const std::string& nonce);
+        std::string encode_empty(const google::protobuf::Descriptor* desc);
+
+        template<typename ProtobufMessage>
+            void load_generated(boost::true_type)
+        {
+            internal::GeneratedCodec generated;
+            generated.encode = &internal::generated_encode<ProtobufMessage>;
+            generated.decode = &internal::generated_decode<ProtobufMessage>;
+            generated.id = ProtobufMessage::DCCL_ID;
+            generated.id_bits = ProtobufMessage::DCCL_ID_BITS;
+            generated.id_bit_width = ProtobufMessage::DCCL_ID_BIT_WIDTH;
+            generated.head_bits = ProtobufMessage::DCCL_HEAD_BITS;
+            generated.body_bits = ProtobufMessage::DCCL_BODY_BITS;
+            generated.size = ProtobufMessage::DCCL_SIZE;
+            load_generated(ProtobufMessage::descriptor(), generated);
+        }
+
+        template<typename ProtobufMessage>
+            void load_generated(boost::false_type)
+        { }
+
+        void load_generated(const google::protobuf::Descriptor* desc, const internal::GeneratedCodec& generated);
+        const internal::GeneratedCodec* find_generated(const google::protobuf::Descriptor* desc) const;
+        bool encode_generated(const google::protobuf::Message& msg, char* bytes, size_t max_len, size_t* size);
+        bool decode_generated(const unsigned char* bytes, size_t max_len, google::protobuf::Message* msg, size_t* size);
+
+        const FieldLayout& patch_field(const char* bytes, std::size_t size, const std::string& path);
+        void patch_bits(char* bytes, std::size_t size, const FieldLayout& field, uint64 wire);
+        const MessageLayout& find_layout(const char* bytes, std::size_t size) const;
+        boost::shared_ptr<MessageLayout> new_layout(boost::shared_ptr<FieldCodecBase> codec, const google::protobuf::Descriptor* desc);
+        uint64 extract_bits(const char* bytes, std::size_t size, const FieldLayout& field, int64* now);
+
+        std::size_t decode_columns(const MessageLayout& layout,
+                                   std::vector<const unsigned char*>& frames,
+                                   const std::vector<std::size_t>& frame_sizes,
+                                   const ColumnSet& columns);
+        
+        // true if messages with this DCCL id have their body encrypted
+        bool encrypted(unsigned dccl_id) const
+        {
+            if(!crypto_)
+                return false;
+            else if(dccl_id < skip_crypto_ids_.size() * BITS_IN_BYTE)
+                return !internal::test_bitmap(&skip_crypto_ids_[0], dccl_id);
+            else
+                return !std::binary_search(skip_crypto_large_ids_.begin(), skip_crypto_large_ids_.end(), dccl_id);
+        }
+
+        // encrypts or decrypts (AES is used in CTR mode, so these are the same operation) the body in place, using the head as the nonce
+        void crypt(unsigned char* body, std::size_t body_size, const unsigned char* head, std::size_t head_size);
 
         void set_default_codecs();
 
@@ -328,16 +564,27 @@ namespace dccl
         }
         
       private:
-        // SHA256 hash of the crypto passphrase
-        std::string crypto_key_;
+        // AES cipher keyed with the SHA256 hash of the crypto passphrase (null if not encrypting)
+        boost::shared_ptr<internal::CryptoContext> crypto_;
 
-	// set of DCCL IDs *not* to encrypt        
-	std::set<unsigned> skip_crypto_ids_;
+        // bitmap of DCCL IDs *not* to encrypt (bit `id` set), covering IDs below 2^16
+        std::vector<unsigned char> skip_crypto_ids_;
+        // sorted DCCL IDs *not* to encrypt that are too large for the bitmap (e.g. CCL identifiers)
+        std::vector<unsigned> skip_crypto_large_ids_;
 
         // maps `dccl.id`s onto Message Descriptors
         std::map<int32, const google::protobuf::Descriptor*> id2desc_;
+
+        // maps `dccl.id`s onto the position of each field (computed by load())
+        std::map<int32, boost::shared_ptr<MessageLayout> > id2layout_;
+
+        // encode / decode functions generated by protoc-gen-dccl (see load())
+        std::map<const google::protobuf::Descriptor*, internal::GeneratedCodec> generated_;
         std::string id_codec_;
 
+        // validation results of previous loads (not owned, may be null)
+        LoadCache* load_cache_;
+
         std::vector<void *> dl_handles_;
         
     };
@@ -406,6 +653,13 @@ CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::p
 {
     try
     {
+        if(!header_only && !generated_.empty() && begin != end)
+        {
+            size_t size = 0;
+            if(decode_generated(internal::contiguous_bytes(begin), std::distance(begin, end), msg, &size))
+                return begin + size;
+        }
+        
         unsigned this_id = id(begin, end);
         
         dlog.is(logger::DEBUG1, logger::DECODE) && dlog  << "Began decoding message of id: " << this_id << std::endl;
@@ -463,21 +717,28 @@ CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::p
             }
             else
             {
-                dlog.is(logger::DEBUG3, logger::DECODE) && dlog  << "Encrypted Body (hex): " << hex_encode(head_bytes_end, end) << std::endl;
+                // only the bytes that can belong to this message (the rest of the buffer may hold other messages)
+                CharIterator body_bytes_end = end;
+                if(end - head_bytes_end > static_cast<std::ptrdiff_t>(body_size_bytes))
+                    body_bytes_end = head_bytes_end + body_size_bytes;
+                
+                dlog.is(logger::DEBUG3, logger::DECODE) && dlog  << "Encrypted Body (hex): " << hex_encode(head_bytes_end, body_bytes_end) << std::endl;
 
                 Bitset body_bits;
-                if(!crypto_key_.empty() && !skip_crypto_ids_.count(this_id))
+                if(encrypted(this_id))
                 {
                     std::string head_bytes(begin, head_bytes_end);
-                    std::string body_bytes(head_bytes_end, end);
-                    decrypt(&body_bytes, head_bytes);
+                    std::string body_bytes(head_bytes_end, body_bytes_end);
+                    if(!body_bytes.empty())
+                        crypt(reinterpret_cast<unsigned char*>(&body_bytes[0]), body_bytes.size(),
+                              reinterpret_cast<const unsigned char*>(head_bytes.data()), head_bytes.size());
                     dlog.is(logger::DEBUG3, logger::DECODE) && dlog  << "Unencrypted Body (hex): " << hex_encode(body_bytes) << std::endl;
                     body_bits.from_byte_stream(body_bytes.begin(), body_bytes.end());
                 }
                 else
                 {
-                    dlog.is(logger::DEBUG3, logger::DECODE) && dlog  << "Unencrypted Body (hex): " << hex_encode(head_bytes_end, end) << std::endl;
-                    body_bits.from_byte_stream(head_bytes_end, end);
+                    dlog.is(logger::DEBUG3, logger::DECODE) && dlog  << "Unencrypted Body (hex): " << hex_encode(head_bytes_end, body_bytes_end) << std::endl;
+                    body_bits.from_byte_stream(head_bytes_end, body_bytes_end);
                 }
 
                 dlog.is(logger::DEBUG3, logger::DECODE) && dlog  << "Unencrypted Body (bin): " << body_bits << std::endl;
@@ -485,7 +746,7 @@ CharIterator dccl::Codec::decode(CharIterator begin, CharIterator end, google::p
                 codec->base_decode(&body_bits, msg, BODY);
                 dlog.is(logger::DEBUG2, logger::DECODE) && dlog  << "after header & body decode, message is: " << *msg << std::endl;
 
-                actual_end = end - body_bits.size()/BITS_IN_BYTE;
+                actual_end = body_bytes_end - body_bits.size()/BITS_IN_BYTE;
             }
         }
         else
@@ -74,6 +74,11 @@ unsigned dccl::v2::DefaultBoolCodec::size()
 void dccl::v2::DefaultBoolCodec::validate()
 { }
 
+void dccl::v2::DefaultBoolCodec::describe_layout(FieldLayout* field_layout)
+{
+    field_layout->kind = FieldLayout::BOOL;
+}
+
 //
 // DefaultStringCodec
 //
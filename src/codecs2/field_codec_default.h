@@ -41,6 +41,8 @@
 #include "dccl/field_codec_fixed.h"
 #include "dccl/field_codec.h"
 #include "dccl/binary.h"
+#include "dccl/internal/quantize.h"
+#include "dccl/field_layout.h"
 
 namespace dccl
 {
@@ -99,27 +101,11 @@ namespace dccl
           
               virtual Bitset encode(const WireType& value)
               {
-                  // round first, before checking bounds
-                  WireType wire_value = dccl::round(value, precision());
-
-                  // check bounds, if out-of-bounds, send as zeros
-                  if(wire_value < min() || wire_value > max())
+                  dccl::uint64 uint_value = 0;
+                  // if out-of-bounds, send as zeros
+                  if(!internal::quantize(value, min(), max(), precision(),
+                                         FieldCodecBase::use_required(), &uint_value))
                       return Bitset(size());
-          
-                  wire_value -= dccl::round((WireType)min(), precision());
-
-                  if (precision() < 0) {
-                      wire_value /= (WireType)std::pow(10.0, -precision());
-                  } else if (precision() > 0) {
-                      wire_value *= (WireType)std::pow(10.0, precision());
-                  }
-
-                  dccl::uint64 uint_value = boost::numeric_cast<dccl::uint64>(dccl::round(wire_value, 0));
-
-                  // "presence" value (0)
-                  if(!FieldCodecBase::use_required())
-                      uint_value += 1;
-	  
 
                   Bitset encoded;
                   encoded.from(uint_value, size());
@@ -134,28 +120,33 @@ namespace dccl
                   // See, e.g., http://gcc.gnu.org/bugzilla/show_bug.cgi?id=10959
                   dccl::uint64 uint_value = (bits->template to<dccl::uint64>)();
 
-                  if(!FieldCodecBase::use_required())
-                  {
-                      if(!uint_value) throw NullValueException();
-                      --uint_value;
-                  }
-	  
-                  WireType wire_value = (WireType)uint_value;
-
-                  if (precision() < 0) {
-                      wire_value *= (WireType)std::pow(10.0, -precision());
-                  } else if (precision() > 0) {
-                      wire_value /= (WireType)std::pow(10.0, precision());
-                  }
-
-                  // round values again to properly handle cases where double precision
-                  // leads to slightly off values (e.g. 2.099999999 instead of 2.1)
-                  wire_value = dccl::round(wire_value + dccl::round((WireType)min(), precision()),
-                                           precision());
+                  WireType wire_value;
+                  if(!internal::unquantize(uint_value, min(), precision(),
+                                           FieldCodecBase::use_required(), &wire_value))
+                      throw NullValueException();
 
                   return wire_value;
               }
 
+              virtual void describe_layout(FieldLayout* field_layout)
+              {
+                  // type converting children (pre_encode / post_decode) must describe themselves
+                  if(boost::is_same<WireType, FieldType>::value)
+                      describe_numeric_layout(field_layout);
+              }
+
+              virtual const std::type_info& layout_type()
+              { return typeid(DefaultNumericFieldCodec); }
+
+              void describe_numeric_layout(FieldLayout* field_layout)
+              {
+                  field_layout->kind = FieldLayout::NUMERIC;
+                  field_layout->wire_type = internal::ToProtoCppType<WireType>::as_enum();
+                  field_layout->min = min();
+                  field_layout->max = max();
+                  field_layout->precision = precision();
+              }
+              
               unsigned size()
               {
                   // if not required field, leave one value for unspecified (always encoded as 0)
@@ -177,6 +168,8 @@ namespace dccl
             bool decode(Bitset* bits);
             unsigned size();
             void validate();
+            void describe_layout(FieldLayout* field_layout);
+            const std::type_info& layout_type() { return typeid(DefaultBoolCodec); }
         };
         
         /// \brief Provides an variable length ASCII string encoder. Can encode strings up to 255 bytes by using a length byte preceeding the string.
@@ -223,6 +216,13 @@ namespace dccl
 
           private:
             void validate() { }
+
+            void describe_layout(FieldLayout* field_layout)
+            {
+                describe_numeric_layout(field_layout);
+                field_layout->kind = FieldLayout::ENUM;
+            }
+            const std::type_info& layout_type() { return typeid(DefaultEnumCodec); }
             
             double max()
             {
@@ -244,28 +244,15 @@ namespace dccl
         {
           public:
             time_wire_type pre_encode(const TimeType& time_of_day) {
-                time_wire_type max_secs = max();
-                return std::fmod(time_of_day / static_cast<time_wire_type>(conversion_factor), max_secs);
+                return internal::time_of_day(time_of_day, conversion_factor, max());
             }
 
             TimeType post_decode(const time_wire_type& encoded_time) {
-
-                int64 max_secs = (int64)max();
                 timeval t;
                 gettimeofday(&t, 0);
-                int64 now = t.tv_sec;
-                int64 daystart = now - (now % max_secs);
-                int64 today_time = now - daystart;
-
-                // If time is more than 12 hours ahead of now, assume it's yesterday.
-                if ((encoded_time - today_time) > (max_secs/2)) {
-                    daystart -= max_secs;
-                } else if ((today_time - encoded_time) > (max_secs/2)) {
-                    daystart += max_secs;
-                }
-
-                return dccl::round((TimeType)(conversion_factor * (daystart + encoded_time)),
-                                   precision() - std::log10((double)conversion_factor));
+                return internal::expand_time_of_day<TimeType>(encoded_time, (int64)max(), conversion_factor,
+                                                              precision() - std::log10((double)conversion_factor),
+                                                              t.tv_sec);
             }
 
           private:
@@ -274,6 +261,13 @@ namespace dccl
                 DefaultNumericFieldCodec<time_wire_type, TimeType>::validate_numeric_bounds();
             }
 
+            void describe_layout(FieldLayout* field_layout)
+            {
+                DefaultNumericFieldCodec<time_wire_type, TimeType>::describe_numeric_layout(field_layout);
+                field_layout->kind = FieldLayout::TIME;
+                field_layout->time_conversion = conversion_factor;
+            }
+
             double max() { 
                 return FieldCodecBase::dccl_field_options().num_days() * SECONDS_IN_DAY;
             }
@@ -299,9 +293,12 @@ namespace dccl
             class TimeCodec : public TimeCodecBase<TimeType, 0>
         { BOOST_STATIC_ASSERT(sizeof(TimeCodec) == 0); };
     
-        template<> class TimeCodec<uint64> : public TimeCodecBase<uint64, 1000000> { };
-        template<> class TimeCodec<int64> : public TimeCodecBase<int64, 1000000> { };
-        template<> class TimeCodec<double> : public TimeCodecBase<double, 1> { };
+        template<> class TimeCodec<uint64> : public TimeCodecBase<uint64, 1000000>
+        { const std::type_info& layout_type() { return typeid(TimeCodec); } };
+        template<> class TimeCodec<int64> : public TimeCodecBase<int64, 1000000>
+        { const std::type_info& layout_type() { return typeid(TimeCodec); } };
+        template<> class TimeCodec<double> : public TimeCodecBase<double, 1>
+        { const std::type_info& layout_type() { return typeid(TimeCodec); } };
     
     
         /// \brief Placeholder codec that takes no space on the wire (0 bits).
@@ -322,6 +319,15 @@ namespace dccl
             
             unsigned size()
             { return 0; }
+
+            void describe_layout(FieldLayout* field_layout)
+            {
+                field_layout->kind = FieldLayout::STATIC;
+                field_layout->static_value = FieldCodecBase::dccl_field_options().static_value();
+            }
+
+            const std::type_info& layout_type()
+            { return typeid(StaticCodec); }
             
             void validate()
             {
@@ -21,6 +21,7 @@
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include "dccl/codec.h"
 #include "field_codec_default_message.h"
+#include "dccl/field_layout.h"
 
 using dccl::dlog;
 
@@ -153,6 +154,15 @@ std::string dccl::v2::DefaultMessageCodec::info()
     return ss.str();
 }
 
+void dccl::v2::DefaultMessageCodec::layout(MessageLayout* message_layout)
+{
+    // treat repeated messages as a single block
+    if(this_field() && this_field()->is_repeated())
+        FieldCodecBase::layout(message_layout);
+    else
+        traverse_descriptor<Layout>(message_layout);
+}
+
 bool dccl::v2::DefaultMessageCodec::check_field(const google::protobuf::FieldDescriptor* field)
 {
     if(!field)
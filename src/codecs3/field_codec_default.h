@@ -32,8 +32,10 @@ namespace dccl
     namespace v3
     {
 	// all these are the same as version 2
+        // (each declares its own layout_type(), as the v2 codecs only describe themselves)
         template<typename WireType, typename FieldType = WireType>
-            class DefaultNumericFieldCodec : public v2::DefaultNumericFieldCodec<WireType, FieldType> { };
+            class DefaultNumericFieldCodec : public v2::DefaultNumericFieldCodec<WireType, FieldType>
+        { const std::type_info& layout_type() { return typeid(DefaultNumericFieldCodec); } };
 
 	typedef v2::DefaultBoolCodec DefaultBoolCodec;
 	typedef v2::DefaultBytesCodec DefaultBytesCodec;
@@ -44,13 +46,16 @@ namespace dccl
             class TimeCodec : public v2::TimeCodecBase<TimeType, 0>
         { BOOST_STATIC_ASSERT(sizeof(TimeCodec) == 0); };
 
-        template<> class TimeCodec<uint64> : public v2::TimeCodecBase<uint64, 1000000> { };
-        template<> class TimeCodec<int64> : public v2::TimeCodecBase<int64, 1000000> { };
-        template<> class TimeCodec<double> : public v2::TimeCodecBase<double, 1> { };
+        template<> class TimeCodec<uint64> : public v2::TimeCodecBase<uint64, 1000000>
+        { const std::type_info& layout_type() { return typeid(TimeCodec); } };
+        template<> class TimeCodec<int64> : public v2::TimeCodecBase<int64, 1000000>
+        { const std::type_info& layout_type() { return typeid(TimeCodec); } };
+        template<> class TimeCodec<double> : public v2::TimeCodecBase<double, 1>
+        { const std::type_info& layout_type() { return typeid(TimeCodec); } };
     
         template<typename T>
             class StaticCodec : public v2::StaticCodec<T>
-        { };
+        { const std::type_info& layout_type() { return typeid(StaticCodec); } };
 
 
         /// \brief Provides an variable length ASCII string encoder.
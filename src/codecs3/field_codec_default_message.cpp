@@ -21,6 +21,7 @@
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include "dccl/codec.h"
 #include "dccl/codecs3/field_codec_default_message.h"
+#include "dccl/field_layout.h"
 
 using dccl::dlog;
 
@@ -202,6 +203,25 @@ std::string dccl::v3::DefaultMessageCodec::info()
     return ss.str();
 }
 
+void dccl::v3::DefaultMessageCodec::layout(MessageLayout* message_layout)
+{
+    // treat repeated messages as a single block
+    if(this_field() && this_field()->is_repeated())
+    {
+        FieldCodecBase::layout(message_layout);
+        return;
+    }
+    
+    if(is_optional())
+    {
+        // the fields only follow the presence bit if the message is set
+        const unsigned presence_bit = 1;
+        message_layout->add_bits(presence_bit, presence_bit);
+        message_layout->set_variable();
+    }
+    traverse_descriptor<Layout>(message_layout);
+}
+
 bool dccl::v3::DefaultMessageCodec::check_field(const google::protobuf::FieldDescriptor* field)
 {
     if(!field)
@@ -54,6 +54,7 @@ namespace dccl
             
             void validate();
             std::string info();
+            void layout(MessageLayout* message_layout);
             bool check_field(const google::protobuf::FieldDescriptor* field);
 
             struct Size
@@ -135,6 +136,16 @@ namespace dccl
                         codec->field_info(return_value, field_desc);
                     }
             };
+
+            struct Layout
+            {
+                static void field(boost::shared_ptr<FieldCodecBase> codec,
+                                  MessageLayout* return_value,
+                                  const google::protobuf::FieldDescriptor* field_desc)
+                    {
+                        codec->field_layout(return_value, field_desc);
+                    }
+            };
             
             
             template<typename Action, typename ReturnType>
@@ -0,0 +1,194 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "dccl/column_set.h"
+#include "dccl/field_layout.h"
+#include "dccl/exception.h"
+#include "dccl/internal/bit_ops.h"
+
+namespace
+{
+    template<typename T>
+        void decode_column(const dccl::FieldLayout& field, void* column_values, unsigned char* presence,
+                           const unsigned char* const* frames, std::size_t n, dccl::int64 now)
+    {
+        T* values = static_cast<T*>(column_values);
+
+        if(field.kind == dccl::FieldLayout::STATIC)
+        {
+            // no bits on the wire, so the same for every row
+            T value = T();
+            field.decode(0, &value, now);
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                values[i] = value;
+                if(presence) dccl::internal::set_bitmap(presence, i, true);
+            }
+            return;
+        }
+        
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            bool is_set = field.decode(dccl::internal::read_bits(frames[i], field.bit_offset, field.bit_width),
+                                       &values[i], now);
+            if(!is_set)
+                values[i] = T();
+            if(presence)
+                dccl::internal::set_bitmap(presence, i, is_set);
+        }
+    }
+
+    template<typename T>
+        void encode_column(const dccl::FieldLayout& field, const void* column_values, const unsigned char* presence,
+                           unsigned char* const* frames, std::size_t n)
+    {
+        const T* values = static_cast<const T*>(column_values);
+
+        if(field.kind == dccl::FieldLayout::STATIC)
+            return;
+        
+        // quantize the whole column first, then scatter the bits into each frame
+        std::vector<dccl::uint64> wire(n);
+        // (rows that are not set are left as they are, and their values may be invalid, e.g. NaN)
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            if(!presence || dccl::internal::test_bitmap(presence, i))
+                wire[i] = field.encode(values[i]);
+        }
+
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            if(presence && !dccl::internal::test_bitmap(presence, i))
+            {
+                if(field.required)
+                    throw(dccl::Exception("Field `" + field.path + "` is required but not set in row " + boost::lexical_cast<std::string>(i)));
+                // leave as encoded in the empty message (not set)
+                continue;
+            }
+            dccl::internal::write_bits(frames[i], field.bit_offset, field.bit_width, wire[i]);
+        }
+    }
+}
+
+void dccl::ColumnSet::add(const std::string& path,
+                          google::protobuf::FieldDescriptor::CppType type,
+                          void* values, unsigned char* presence)
+{
+    if(!values)
+        throw(Exception("Column for field `" + path + "` is NULL"));
+
+    Column column;
+    column.path = path;
+    column.type = type;
+    column.values = values;
+    column.presence = presence;
+    column.writable = true;
+    columns_.push_back(column);
+}
+
+void dccl::ColumnSet::add(const std::string& path,
+                          google::protobuf::FieldDescriptor::CppType type,
+                          const void* values, const unsigned char* presence)
+{
+    add(path, type, const_cast<void*>(values), const_cast<unsigned char*>(presence));
+    columns_.back().writable = false;
+}
+
+unsigned dccl::ColumnSet::resolve(const MessageLayout& layout, std::vector<const FieldLayout*>* fields) const
+{
+    unsigned end_bits = layout.id_bit_width();
+    fields->resize(columns_.size());
+    for(std::size_t i = 0, n = columns_.size(); i < n; ++i)
+    {
+        const FieldLayout& field = layout.direct_field(columns_[i].path);
+        (*fields)[i] = &field;
+        if(field.kind != FieldLayout::STATIC)
+            end_bits = std::max(end_bits, field.bit_offset + field.bit_width);
+    }
+    return ceil_bits2bytes(end_bits);
+}
+
+void dccl::ColumnSet::decode(const std::vector<const FieldLayout*>& fields,
+                             const unsigned char* const* frames, std::size_t n, int64 now) const
+{
+    using google::protobuf::FieldDescriptor;
+    
+    for(std::size_t i = 0, m = columns_.size(); i < m; ++i)
+    {
+        const Column& column = columns_[i];
+        const FieldLayout& field = *fields[i];
+        if(!column.writable)
+            throw(Exception("Column for field `" + column.path + "` is read-only (const) and cannot be decoded into"));
+
+        switch(column.type)
+        {
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                decode_column<double>(field, column.values, column.presence, frames, n, now); break;
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                decode_column<float>(field, column.values, column.presence, frames, n, now); break;
+            case FieldDescriptor::CPPTYPE_INT32:
+                decode_column<int32>(field, column.values, column.presence, frames, n, now); break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                decode_column<int64>(field, column.values, column.presence, frames, n, now); break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                decode_column<uint32>(field, column.values, column.presence, frames, n, now); break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                decode_column<uint64>(field, column.values, column.presence, frames, n, now); break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                decode_column<bool>(field, column.values, column.presence, frames, n, now); break;
+            default:
+                throw(Exception("Unsupported column type for field `" + column.path + "`"));
+        }
+    }
+}
+
+void dccl::ColumnSet::encode(const std::vector<const FieldLayout*>& fields,
+                             unsigned char* const* frames, std::size_t n) const
+{
+    using google::protobuf::FieldDescriptor;
+    
+    for(std::size_t i = 0, m = columns_.size(); i < m; ++i)
+    {
+        const Column& column = columns_[i];
+        const FieldLayout& field = *fields[i];
+        switch(column.type)
+        {
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                encode_column<double>(field, column.values, column.presence, frames, n); break;
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                encode_column<float>(field, column.values, column.presence, frames, n); break;
+            case FieldDescriptor::CPPTYPE_INT32:
+                encode_column<int32>(field, column.values, column.presence, frames, n); break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                encode_column<int64>(field, column.values, column.presence, frames, n); break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                encode_column<uint32>(field, column.values, column.presence, frames, n); break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                encode_column<uint64>(field, column.values, column.presence, frames, n); break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                encode_column<bool>(field, column.values, column.presence, frames, n); break;
+            default:
+                throw(Exception("Unsupported column type for field `" + column.path + "`"));
+        }
+    }
+}
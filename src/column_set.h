@@ -0,0 +1,127 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLCOLUMNSET20170601H
+#define DCCLCOLUMNSET20170601H
+
+#include <string>
+#include <vector>
+
+#include <google/protobuf/descriptor.h>
+
+#include "dccl/common.h"
+
+namespace dccl
+{
+    struct FieldLayout;
+    class MessageLayout;
+    
+    /// \brief Binds fields of a DCCL message type to caller provided arrays ("columns") so that many messages of that type can be encoded or decoded at once without creating a Google Protobuf Message for each (see Codec::encode_columns() and Codec::decode_columns()).
+    ///
+    /// Fields are named by their path from the root message (e.g. "x" or "header.time"; see FieldLayout::path). Each column holds one value per message (row), converted to the type of the column. Enumerations are given as the enumeration <i>index</i>.
+    ///
+    /// Any column may also be given a presence bitmap, where bit i (bit i % 8 of byte i / 8) is set if the field is set in row i. When decoding, rows where the field is not set are filled with zero. When encoding, rows where the bit is clear are encoded as not set (and their values are not read).
+    /// 
+    /// Only fields that FieldLayout::direct() can be bound.
+    class ColumnSet
+    {
+      public:
+        /// \brief Bind a field to a column
+        ///
+        /// \param path Path of the field (e.g. "header.time")
+        /// \param values Array of at least N values (for N messages)
+        /// \param presence Optional bitmap of at least ceil(N/8) bytes
+        void bind(const std::string& path, double* values, unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE, values, presence); }
+        void bind(const std::string& path, float* values, unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_FLOAT, values, presence); }
+        void bind(const std::string& path, int32* values, unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_INT32, values, presence); }
+        void bind(const std::string& path, int64* values, unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_INT64, values, presence); }
+        void bind(const std::string& path, uint32* values, unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_UINT32, values, presence); }
+        void bind(const std::string& path, uint64* values, unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_UINT64, values, presence); }
+        void bind(const std::string& path, bool* values, unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_BOOL, values, presence); }
+
+        /// \brief Bind a field to a read-only column (for encoding only)
+        ///
+        /// \param path Path of the field (e.g. "header.time")
+        /// \param values Array of at least N values (for N messages)
+        /// \param presence Optional bitmap of at least ceil(N/8) bytes. If omitted, the field is set in every row.
+        void bind(const std::string& path, const double* values, const unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE, values, presence); }
+        void bind(const std::string& path, const float* values, const unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_FLOAT, values, presence); }
+        void bind(const std::string& path, const int32* values, const unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_INT32, values, presence); }
+        void bind(const std::string& path, const int64* values, const unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_INT64, values, presence); }
+        void bind(const std::string& path, const uint32* values, const unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_UINT32, values, presence); }
+        void bind(const std::string& path, const uint64* values, const unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_UINT64, values, presence); }
+        void bind(const std::string& path, const bool* values, const unsigned char* presence = 0)
+        { add(path, google::protobuf::FieldDescriptor::CPPTYPE_BOOL, values, presence); }
+
+        /// \brief Remove all columns
+        void clear() { columns_.clear(); }
+
+        /// \brief Number of bound columns
+        std::size_t size() const { return columns_.size(); }
+        
+      private:
+        friend class Codec;
+
+        struct Column
+        {
+            std::string path;
+            google::protobuf::FieldDescriptor::CppType type;
+            void* values;
+            unsigned char* presence;
+            bool writable;
+        };
+        
+        void add(const std::string& path,
+                 google::protobuf::FieldDescriptor::CppType type,
+                 void* values, unsigned char* presence);
+        void add(const std::string& path,
+                 google::protobuf::FieldDescriptor::CppType type,
+                 const void* values, const unsigned char* presence);
+
+        // finds the layout for each column, returning the number of bytes a message must have to contain all the columns
+        unsigned resolve(const MessageLayout& layout, std::vector<const FieldLayout*>* fields) const;
+
+        void decode(const std::vector<const FieldLayout*>& fields,
+                    const unsigned char* const* frames, std::size_t n, int64 now) const;
+
+        // writes the columns into n frames (which must already contain the encoding of an empty message)
+        void encode(const std::vector<const FieldLayout*>& fields,
+                    unsigned char* const* frames, std::size_t n) const;
+
+      private:
+        std::vector<Column> columns_;
+    };
+}
+
+#endif
@@ -21,6 +21,8 @@
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
 #include <sstream>
 
+#include <boost/scoped_ptr.hpp>
+
 #include "dynamic_protobuf_manager.h"
 #include "logger.h"
 #include "exception.h"
@@ -65,6 +67,22 @@ dccl::DynamicProtobufManager::load_from_proto_file(const std::string& protofile_
     return user_descriptor_pool().FindFileByName(protofile_absolute_path);
 }
 
+bool dccl::DynamicProtobufManager::read_proto_file(const std::string& proto_name, std::string* contents)
+{
+    if(!get_instance()->disk_source_tree_)
+        return false;
+
+    boost::scoped_ptr<google::protobuf::io::ZeroCopyInputStream> in(get_instance()->disk_source_tree_->Open(proto_name));
+    if(!in)
+        return false;
+
+    contents->clear();
+    const void* data;
+    int size;
+    while(in->Next(&data, &size))
+        contents->append(static_cast<const char*>(data), size);
+    return true;
+}
 
 // DLogMultiFileErrorCollector
 void dccl::DynamicProtobufManager::DLogMultiFileErrorCollector::AddError(const std::string & filename, int line, int column,
@@ -146,6 +146,13 @@ namespace dccl
             get_instance()->disk_source_tree_->MapPath("", path);
         }
 
+        /// \brief Read a .proto file from the disk, finding it as load_from_proto_file() would (including imports on the include paths)
+        ///
+        /// \param proto_name Name of the file (as in FileDescriptor::name())
+        /// \param contents Set to the contents of the file
+        /// \return false if enable_compilation() has not been called or the file cannot be found
+        static bool read_proto_file(const std::string& proto_name, std::string* contents);
+
         /// \brief Load compiled .proto files from a UNIX shared library (i.e. *.so or *.dylib)
         ///
         /// \param shared_lib_path Path to shared library. May be relative if known by ld.so
@@ -24,12 +24,7 @@
 #include "field_codec.h"
 #include "exception.h"
 #include "dccl/codec.h"
-
-dccl::MessagePart dccl::FieldCodecBase::part_ =
-    dccl::UNKNOWN;
-
-const google::protobuf::Message* dccl::FieldCodecBase::root_message_ = 0;
-const google::protobuf::Descriptor* dccl::FieldCodecBase::root_descriptor_ = 0;
+#include "dccl/field_layout.h"
 
 using dccl::dlog;
 using namespace dccl::logger;
@@ -67,7 +62,7 @@ void dccl::FieldCodecBase::field_encode(Bitset* bits,
     
     Bitset new_bits;
     any_encode(&new_bits, wire_value);
-    disp_size(field, new_bits, msg_handler.field_.size());
+    disp_size(field, new_bits, msg_handler.state_.field.size());
     bits->append(new_bits);
 }
 
@@ -82,7 +77,7 @@ void dccl::FieldCodecBase::field_encode_repeated(Bitset* bits,
     
     Bitset new_bits;
     any_encode_repeated(&new_bits, wire_values);
-    disp_size(field, new_bits, msg_handler.field_.size(), wire_values.size());
+    disp_size(field, new_bits, msg_handler.state_.field.size(), wire_values.size());
     bits->append(new_bits);
 }
 
@@ -343,7 +338,7 @@ void dccl::FieldCodecBase::field_info(std::ostream* os,
     int width = this_field() ? full_width-name.size() : full_width-name.size()+spaces;
     ss << indent << name <<
         std::setfill('.') << std::setw(std::max(1, width)) << range.str()
-       << " {" << (this_field() ? FieldCodecManager::find(this_field(), has_codec_group(), codec_group())->name() : FieldCodecManager::find(root_descriptor_)->name()) << "}";
+       << " {" << (this_field() ? FieldCodecManager::find(this_field(), has_codec_group(), codec_group())->name() : FieldCodecManager::find(internal::MessageStack::state().root_descriptor)->name()) << "}";
 
     
     
@@ -361,6 +356,27 @@ void dccl::FieldCodecBase::field_info(std::ostream* os,
 
 }
 
+void dccl::FieldCodecBase::base_layout(MessageLayout* message_layout, const google::protobuf::Descriptor* desc, MessagePart part)
+{
+    BaseRAII scoped_globals(part, desc);
+
+    internal::MessageStack msg_handler;
+    if(desc)
+        msg_handler.push(desc);
+    else
+        throw(Exception("Layout called with NULL Descriptor"));
+
+    message_layout->begin(part);
+    field_layout(message_layout, static_cast<google::protobuf::FieldDescriptor*>(0));
+}
+
+void dccl::FieldCodecBase::field_layout(MessageLayout* message_layout,
+                                        const google::protobuf::FieldDescriptor* field)
+{
+    internal::MessageStack msg_handler(field);
+    layout(message_layout);
+}
+
 std::string dccl::FieldCodecBase::codec_group(const google::protobuf::Descriptor* desc)
 {
     if(desc->options().GetExtension(dccl::msg).has_codec_group())
@@ -379,6 +395,33 @@ std::string dccl::FieldCodecBase::info()
     return std::string();
 }
 
+void dccl::FieldCodecBase::layout(MessageLayout* message_layout)
+{
+    FieldLayout field_layout;
+    field_layout.always_present = true;
+    const std::vector<const google::protobuf::FieldDescriptor*>& fields = internal::MessageStack::state().field;
+    for(std::vector<const google::protobuf::FieldDescriptor*>::const_iterator it = fields.begin(), end = fields.end(); it != end; ++it)
+    {
+        if(!field_layout.path.empty())
+            field_layout.path += ".";
+        field_layout.path += (*it)->name();
+        field_layout.always_present = field_layout.always_present && (*it)->is_required();
+    }
+    
+    field_layout.field = this_field();
+    field_layout.repeated = this_field() && this_field()->is_repeated();
+    field_layout.bit_width = field_layout.repeated ? max_size_repeated() : max_size();
+    field_layout.min_bit_width = field_layout.repeated ? min_size_repeated() : min_size();
+    field_layout.required = use_required();
+    field_layout.adaptive = this_field() && adaptive();
+    field_layout.codec = name();
+    field_layout.validation_state = validation_state();
+    if(this_field() && typeid(*this) == layout_type())
+        describe_layout(&field_layout);
+
+    message_layout->add(field_layout);
+}
+
 void dccl::FieldCodecBase::any_encode_repeated(dccl::Bitset* bits, const std::vector<boost::any>& wire_values)
 {
     // out_bits = [field_values[2]][field_values[1]][field_values[0]]
@@ -500,12 +543,13 @@ void dccl::FieldCodecBase::any_post_decode_repeated(
 
 void dccl::FieldCodecBase::disp_size(const google::protobuf::FieldDescriptor* field, const Bitset& new_bits, int depth, int vector_size /* = -1 */)
 {
-    if(!root_descriptor_)
-        return;
-
     if(dlog.is(INFO, SIZE))
     {   
-        std::string name = ((field) ? field->name() : root_descriptor_->full_name());
+        const google::protobuf::Descriptor* root_descriptor = internal::MessageStack::state().root_descriptor;
+        if(!root_descriptor)
+            return;
+        
+        std::string name = ((field) ? field->name() : root_descriptor->full_name());
         if(vector_size >= 0)
             name +=  "[" + boost::lexical_cast<std::string>(vector_size) +  "]";
 
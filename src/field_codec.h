@@ -24,6 +24,7 @@
 
 #include <map>
 #include <string>
+#include <typeinfo>
 
 #include <boost/any.hpp>
 #include <boost/lexical_cast.hpp>
@@ -42,6 +43,8 @@
 namespace dccl
 {
     class Codec;
+    struct FieldLayout;
+    class MessageLayout;
 
     /// \brief Provides a base class for defining DCCL field encoders / decoders. Most users who wish to define custom encoders/decoders will use the RepeatedTypedFieldCodec, TypedFieldCodec or its children (e.g. TypedFixedFieldCodec) instead of directly inheriting from this class.
     class FieldCodecBase
@@ -73,7 +76,10 @@ namespace dccl
         ///
         /// \return FieldDescriptor for the current field or 0 if this codec is encoding the base message.
         const google::protobuf::FieldDescriptor* this_field() const 
-        { return !internal::MessageStack::field_.empty() ? internal::MessageStack::field_.back() : 0; }
+        {
+            const std::vector<const google::protobuf::FieldDescriptor*>& field = internal::MessageStack::state().field;
+            return !field.empty() ? field.back() : 0;
+        }
             
         /// \brief Returns the Descriptor (message schema meta-data) for the immediate parent Message
         ///
@@ -89,18 +95,22 @@ namespace dccl
         /// returns Descriptor for Foo if this_field() == FieldDescriptor for bar
         /// returns Descriptor for FooBar if this_field() == FieldDescriptor for baz
         static const google::protobuf::Descriptor* this_descriptor()
-        { return !internal::MessageStack::desc_.empty() ? internal::MessageStack::desc_.back() : 0; }
+        {
+            const std::vector<const google::protobuf::Descriptor*>& desc = internal::MessageStack::state().desc;
+            return !desc.empty() ? desc.back() : 0;
+        }
 
         // currently encoded or (partially) decoded root message
         static const google::protobuf::Message* root_message()
-        { return root_message_; }
+        { return internal::MessageStack::state().root_message; }
 
         static bool has_codec_group()
         {
-            if(root_descriptor_)
+            const google::protobuf::Descriptor* root_descriptor = internal::MessageStack::state().root_descriptor;
+            if(root_descriptor)
             {
-                return root_descriptor_->options().GetExtension(dccl::msg).has_codec_group() ||
-                    root_descriptor_->options().GetExtension(dccl::msg).has_codec_version();
+                return root_descriptor->options().GetExtension(dccl::msg).has_codec_group() ||
+                    root_descriptor->options().GetExtension(dccl::msg).has_codec_version();
             }
             else
                 return false;
@@ -109,13 +119,13 @@ namespace dccl
         static std::string codec_group(const google::protobuf::Descriptor* desc);
 
         static std::string codec_group()
-        { return codec_group(root_descriptor_); }
+        { return codec_group(internal::MessageStack::state().root_descriptor); }
 
         static int codec_version()
-        { return root_descriptor_->options().GetExtension(dccl::msg).codec_version(); }
+        { return internal::MessageStack::state().root_descriptor->options().GetExtension(dccl::msg).codec_version(); }
             
         /// \brief the part of the message currently being encoded (head or body).
-        static MessagePart part() { return part_; }
+        static MessagePart part() { return internal::MessageStack::state().root_part; }
             
         //@}
 
@@ -182,6 +192,13 @@ namespace dccl
         /// \param desc Descriptor to get information on. Use google::protobuf::Message::GetDescriptor() or MyProtobufType::descriptor() to get this object.
         /// \param part the part of the Message to act on.
         void base_info(std::ostream* os, const google::protobuf::Descriptor* desc, MessagePart part);
+
+        /// \brief Add the position and size of every field in this part of the message to a MessageLayout
+        ///
+        /// \param message_layout Layout to add the fields to. Fields are added at its current position.
+        /// \param desc Descriptor to compute the layout of. Use google::protobuf::Message::GetDescriptor() or MyProtobufType::descriptor() to get this object.
+        /// \param part the part of the Message to act on.
+        void base_layout(MessageLayout* message_layout, const google::protobuf::Descriptor* desc, MessagePart part);
         //@}
             
         /// \name Field functions (primitive types and embedded messages)
@@ -307,6 +324,12 @@ namespace dccl
         /// \param os Stream to write info to.
         /// \param field Protobuf descriptor to the field. Set to 0 for base message.
         void field_info(std::ostream* os, const google::protobuf::FieldDescriptor* field);
+
+        /// \brief Add the position and size of this field (or for embedded messages, its fields) to a MessageLayout
+        ///
+        /// \param message_layout Layout to add the field(s) to.
+        /// \param field Protobuf descriptor to the field. Set to 0 for base message.
+        void field_layout(MessageLayout* message_layout, const google::protobuf::FieldDescriptor* field);
         //@}
             
       protected:
@@ -411,6 +434,26 @@ namespace dccl
         /// \return Minimum size of this field (in bits).
         virtual unsigned min_size() = 0;
 
+        /// \brief Add this field to the layout of the message. The default adds a single entry sized by max_size() and min_size() (or max_size_repeated() and min_size_repeated()) and described by describe_layout(). Codecs for embedded messages override this to add each of their fields instead.
+        ///
+        /// \param message_layout Layout to add the field to.
+        virtual void layout(MessageLayout* message_layout);
+
+        /// \brief Describe how the bits written by this codec can be interpreted without the codec (see FieldLayout::Kind). The default leaves the field FieldLayout::OPAQUE.
+        ///
+        /// Only called if layout_type() is the type of this codec, so that a codec derived from one of the default codecs (which may change how a value is written, e.g. by overriding encode() or pre_encode()) is not mistaken for it.
+        /// \param field_layout Layout entry to fill in.
+        virtual void describe_layout(FieldLayout* field_layout) { }
+
+        /// \brief The codec class whose wire format describe_layout() describes. A codec opts in to describe_layout() by returning its own type here; classes derived from it are not described unless they do the same. The default (void) never matches.
+        virtual const std::type_info& layout_type() { return typeid(void); }
+
+        /// \brief True if coding a value changes the state that later values are coded with (e.g. an adaptive arithmetic model), so that messages using this codec must be encoded and decoded one at a time, in order. The default is false.
+        virtual bool adaptive() { return false; }
+
+        /// \brief State other than the definition of the field that its maximum size and validation depend on (e.g. the frequencies of an arithmetic model), so that a LoadCache can tell when a cached result is out of date. The default is empty (none).
+        virtual std::string validation_state() { return std::string(); }
+
         virtual void any_encode_repeated(Bitset* bits, const std::vector<boost::any>& wire_values);
         virtual void any_decode_repeated(Bitset* repeated_bits, std::vector<boost::any>* field_values);
 
@@ -449,38 +492,37 @@ namespace dccl
         
         
       private:
-        // sets global statics relating the current message begin processed
-        // and unsets them on destruction
+        // sets the calling thread's state relating the current message begin processed
+        // and unsets it on destruction
         struct BaseRAII
         {
             BaseRAII(MessagePart part,
                      const google::protobuf::Descriptor* root_descriptor)
+                : state_(internal::MessageStack::state())
                 {
-                    FieldCodecBase::part_ = part;
-                    FieldCodecBase::root_message_ = 0;
-                    FieldCodecBase::root_descriptor_ = root_descriptor;
+                    state_.root_part = part;
+                    state_.root_message = 0;
+                    state_.root_descriptor = root_descriptor;
                 }
 
             BaseRAII(MessagePart part,            
                      const google::protobuf::Message* root_message)
+                : state_(internal::MessageStack::state())
                 {
-                    FieldCodecBase::part_ = part;
-                    FieldCodecBase::root_message_ = root_message;
-                    FieldCodecBase::root_descriptor_ = root_message->GetDescriptor();                    
+                    state_.root_part = part;
+                    state_.root_message = root_message;
+                    state_.root_descriptor = root_message->GetDescriptor();                    
                 }
             ~BaseRAII()
                 {
-                    FieldCodecBase::part_ = dccl::UNKNOWN;
-                    FieldCodecBase::root_message_ = 0;
-                    FieldCodecBase::root_descriptor_ = 0;
+                    state_.root_part = dccl::UNKNOWN;
+                    state_.root_message = 0;
+                    state_.root_descriptor = 0;
                 }
+          private:
+            internal::MessageStack::State& state_;
         };
         
-        
-        static MessagePart part_;
-        static const google::protobuf::Message* root_message_;
-        static const google::protobuf::Descriptor* root_descriptor_;
-        
         std::string name_;
         google::protobuf::FieldDescriptor::Type field_type_;
         google::protobuf::FieldDescriptor::CppType wire_type_;
@@ -63,7 +63,7 @@ namespace dccl
                 
         /// \brief Add a new field codec (used for codecs operating on all types except statically generated Protobuf messages).
         ///
-        /// \tparam Codec A child of FieldCodecBase
+        /// \tparam Codec A child of FieldCodecBase: either a virtual (TypedFieldCodec, TypedFixedFieldCodec, RepeatedTypedFieldCodec) or a static (StaticFieldCodec, StaticFixedFieldCodec) codec
         /// \param name Name to use for this codec. Corresponds to (dccl.field).codec="name" in .proto file.
         /// \return nothing (void). Return templates are used for template metaprogramming selection of the proper add() overload.
         template<class Codec>
@@ -76,7 +76,7 @@ namespace dccl
                 
         /// \brief Add a new field codec only valid for a specific google::protobuf::FieldDescriptor::Type. This is useful if a given codec is designed to work with only a specific Protobuf type that shares an underlying C++ type (e.g. Protobuf types `bytes` and `string`)
         ///
-        /// \tparam Codec A child of FieldCodecBase
+        /// \tparam Codec A child of FieldCodecBase (virtual or static, as above)
         /// \tparam type The google::protobuf::FieldDescriptor::Type enumeration that this codec works on.
         /// \param name Name to use for this codec. Corresponds to (dccl.field).codec="name" in .proto file.
         template<class Codec, google::protobuf::FieldDescriptor::Type type>
@@ -0,0 +1,162 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLFIELDCODECSTATIC20170620H
+#define DCCLFIELDCODECSTATIC20170620H
+
+#include <boost/type_traits.hpp>
+
+#include "dccl/bit_stream.h"
+#include "dccl/field_codec_typed.h"
+
+namespace dccl
+{
+    namespace internal
+    {
+        /// \brief Marks the children of StaticFixedFieldCodec
+        struct StaticFixedFieldCodecTag { };
+    }
+    
+    /// \brief Base class for field encoders/decoders that use static (compile time) polymorphism and write to a bit stream directly, rather than returning a Bitset from virtual methods (as TypedFieldCodec). Use StaticFixedFieldCodec if your codec is fixed length.
+    ///
+    /// \ingroup dccl_field_api
+    /// Codec (the Derived class) provides these non-virtual methods, where Writer is BitWriter or BitsetWriter and Reader is BitReader or BitsetReader (both have the same interface, so these are usually member templates):
+    /// \code
+    /// template<typename Writer> void encode(Writer& writer);                          // empty field
+    /// template<typename Writer> void encode(Writer& writer, const WireType& value);
+    /// template<typename Reader> bool decode(Reader& reader, WireType* value);         // false if empty
+    /// unsigned size();                                                                // empty field, in bits
+    /// unsigned size(const WireType& value);
+    /// unsigned max_size();
+    /// unsigned min_size();
+    /// \endcode
+    /// This class implements the FieldCodecBase interface on top of these, so the codec is added with FieldCodecManager::add() just like a TypedFieldCodec. The same codec can be used by StructCodec (see structs::Custom), where all of the calls are resolved at compile time.
+    /// \tparam Derived The codec class itself
+    /// \tparam WireType The type used for encode() and decode() (messages are not supported)
+    /// \tparam FieldType The type used in the Google Protobuf message (see TypedFieldCodec)
+    template<typename Derived, typename WireType, typename FieldType = WireType>
+        class StaticFieldCodec : public FieldCodecSelector<WireType, FieldType>
+    {
+      public:
+      typedef WireType wire_type;
+      typedef FieldType field_type;
+
+      private:
+      Derived& derived() { return static_cast<Derived&>(*this); }
+
+      void any_encode(Bitset* bits, const boost::any& wire_value)
+      {
+          bits->clear();
+          BitsetWriter writer(bits);
+          try
+          {
+              if(wire_value.empty())
+                  derived().encode(writer);
+              else
+                  derived().encode(writer, boost::any_cast<WireType>(wire_value));
+          }
+          catch(boost::bad_any_cast&)
+          { throw(type_error("encode", typeid(WireType), wire_value.type())); }
+      }
+
+      void any_decode(Bitset* bits, boost::any* wire_value)
+      {
+          BitsetReader reader(bits);
+          WireType value;
+          if(derived().decode(reader, &value))
+              *wire_value = value;
+          else
+              *wire_value = boost::any();
+      }
+
+      unsigned any_size(const boost::any& wire_value)
+      {
+          try
+          {
+              if(wire_value.empty())
+                  return derived().size();
+              else
+                  return value_size(boost::any_cast<WireType>(wire_value), boost::is_base_of<internal::StaticFixedFieldCodecTag, Derived>());
+          }
+          catch(boost::bad_any_cast&)
+          { throw(type_error("size", typeid(WireType), wire_value.type())); }
+      }
+
+      // fixed length codecs only provide size()
+      unsigned value_size(const WireType&, boost::true_type)
+      { return derived().size(); }
+      unsigned value_size(const WireType& wire_value, boost::false_type)
+      { return derived().size(wire_value); }
+      
+      void any_pre_encode(boost::any* wire_value,
+                          const boost::any& field_value) 
+      {
+          try
+          {
+              if(!field_value.empty())
+                  *wire_value = this->pre_encode(boost::any_cast<FieldType>(field_value));
+          }
+          catch(boost::bad_any_cast&)
+          {
+              throw(type_error("pre_encode", typeid(FieldType), field_value.type()));
+          }
+          catch(NullValueException&)
+          {
+              *wire_value = boost::any();
+          }
+      }
+          
+      void any_post_decode(const boost::any& wire_value,
+                           boost::any* field_value)
+      {
+          try
+          {
+              if(!wire_value.empty())
+                  *field_value = this->post_decode(boost::any_cast<WireType>(wire_value));
+          }
+          catch(boost::bad_any_cast&)
+          {
+              throw(type_error("post_decode", typeid(WireType), wire_value.type()));
+          }
+          catch(NullValueException&)
+          {
+              *field_value = boost::any();
+          }
+      }
+    };
+
+    /// \brief Base class for StaticFieldCodec children that use a fixed number of bits on the wire regardless of the value of the field. The Derived class provides encode(), decode() and size() (the size of every encoded value), but not size(const WireType&), max_size() or min_size().
+    ///
+    /// \ingroup dccl_field_api
+    template<typename Derived, typename WireType, typename FieldType = WireType>
+        class StaticFixedFieldCodec : public StaticFieldCodec<Derived, WireType, FieldType>,
+        public internal::StaticFixedFieldCodecTag
+    {
+      public:
+      unsigned max_size()
+      { return static_cast<Derived&>(*this).size(); }
+          
+      unsigned min_size()
+      { return static_cast<Derived&>(*this).size(); }          
+    };
+}
+
+#endif
@@ -0,0 +1,97 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include "dccl/field_layout.h"
+#include "dccl/exception.h"
+#include "dccl/internal/bit_ops.h"
+
+dccl::MessageLayout::MessageLayout(const google::protobuf::Descriptor* desc,
+                                   uint64 id_bits, unsigned id_bit_width)
+    : desc_(desc),
+      id_bits_(id_bits),
+      id_bit_width_(id_bit_width),
+      head_bits_(id_bit_width),
+      body_bits_(0),
+      part_(HEAD),
+      cursor_(id_bit_width),
+      cursor_fixed_(true),
+      adaptive_(false)
+{ }
+
+bool dccl::MessageLayout::matches(const unsigned char* bytes, std::size_t size) const
+{
+    return size * BITS_IN_BYTE >= id_bit_width_ &&
+        internal::read_bits(bytes, 0, id_bit_width_) == id_bits_;
+}
+
+const dccl::FieldLayout* dccl::MessageLayout::find(const std::string& path) const
+{
+    std::map<std::string, std::size_t>::const_iterator it = index_.find(path);
+    return (it == index_.end()) ? 0 : &fields_[it->second];
+}
+
+const dccl::FieldLayout& dccl::MessageLayout::direct_field(const std::string& path) const
+{
+    const FieldLayout* field = find(path);
+    if(!field)
+        throw(Exception("Field `" + path + "` is not encoded in Message " + desc_->full_name()));
+
+    if(!field->direct())
+        throw(Exception("Field `" + path + "` of Message " + desc_->full_name() + " cannot be accessed directly: it must be a non-repeated field encoded by a default numeric, bool, enum, time or static codec, and no variable size field may precede it."));
+    return *field;
+}
+
+void dccl::MessageLayout::begin(MessagePart part)
+{
+    part_ = part;
+    if(part == BODY)
+    {
+        // head is always fixed size and padded to a whole byte
+        cursor_ = body_byte_offset() * BITS_IN_BYTE;
+        cursor_fixed_ = true;
+    }
+}
+
+void dccl::MessageLayout::add(FieldLayout field)
+{
+    field.message = this;
+    field.part = part_;
+    field.fixed_offset = cursor_fixed_;
+    field.bit_offset = cursor_;
+    adaptive_ = adaptive_ || field.adaptive;
+
+    index_.insert(std::make_pair(field.path, fields_.size()));
+    fields_.push_back(field);
+
+    add_bits(field.bit_width, field.min_bit_width);
+}
+
+void dccl::MessageLayout::add_bits(unsigned max_bits, unsigned min_bits)
+{
+    cursor_ += max_bits;
+    if(max_bits != min_bits)
+        cursor_fixed_ = false;
+
+    if(part_ == HEAD)
+        head_bits_ += max_bits;
+    else
+        body_bits_ += max_bits;
+}
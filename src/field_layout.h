@@ -0,0 +1,414 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLFIELDLAYOUT20170601H
+#define DCCLFIELDLAYOUT20170601H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/lexical_cast.hpp>
+
+#include <google/protobuf/descriptor.h>
+
+#include "dccl/common.h"
+#include "dccl/internal/field_codec_message_stack.h"
+#include "dccl/internal/quantize.h"
+
+namespace dccl
+{
+    class MessageLayout;
+    
+    /// \brief Describes the position, size and (when known) the wire representation of a single field in an encoded DCCL message
+    ///
+    /// Entries are created by the field codecs (see FieldCodecBase::layout() and FieldCodecBase::describe_layout()) when a message is loaded into Codec.
+    struct FieldLayout
+    {
+        /// \brief How the bits of this field can be interpreted without the field codec
+        enum Kind
+        {
+            /// only the field codec itself can interpret these bits
+            OPAQUE,
+            /// v2::DefaultNumericFieldCodec (bounded, quantized number)
+            NUMERIC,
+            /// v2::DefaultBoolCodec
+            BOOL,
+            /// v2::DefaultEnumCodec (the value is the enumeration <i>index</i>)
+            ENUM,
+            /// v2::TimeCodecBase (time of day)
+            TIME,
+            /// v2::StaticCodec (zero bits on the wire)
+            STATIC
+        };
+        
+        FieldLayout()
+        : field(0),
+            message(0),
+            part(UNKNOWN),
+            fixed_offset(false),
+            bit_offset(0),
+            bit_width(0),
+            min_bit_width(0),
+            repeated(false),
+            always_present(false),
+            adaptive(false),
+            kind(OPAQUE),
+            wire_type(google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE),
+            required(true),
+            min(0),
+            max(0),
+            precision(0),
+            time_conversion(1)
+            { }
+        
+        /// \brief Names of the fields from the root message to this field, joined by '.' (e.g. "header.time")
+        std::string path;
+        /// \brief The field this entry describes
+        const google::protobuf::FieldDescriptor* field;
+        /// \brief The layout this entry belongs to (set by MessageLayout::add())
+        const MessageLayout* message;
+        /// \brief Part of the message (HEAD or BODY) that contains this field
+        MessagePart part;
+
+        /// \brief True if bit_offset is the same for every message of this type (i.e. no variable size field precedes this one)
+        bool fixed_offset;
+        /// \brief Offset (in bits) from the start of the encoded message. Body offsets include the head, which is padded to a whole number of bytes.
+        unsigned bit_offset;
+        /// \brief Maximum size of this field in bits
+        unsigned bit_width;
+        /// \brief Minimum size of this field in bits
+        unsigned min_bit_width;
+        /// \brief True for a repeated field, in which case bit_width and min_bit_width cover all the values (and the size prefix, if any)
+        bool repeated;
+        /// \brief True if this field and every message containing it are `required`, so every valid message has a value for it
+        bool always_present;
+        /// \brief True if coding this field changes the state that later messages are coded with (see FieldCodecBase::adaptive())
+        bool adaptive;
+        /// \brief Name of the field codec (FieldCodecBase::name())
+        std::string codec;
+        /// \brief FieldCodecBase::validation_state() of the field codec
+        std::string validation_state;
+
+        /// \name Wire representation
+        ///
+        /// Set by FieldCodecBase::describe_layout(). Only meaningful if kind != OPAQUE.
+        //@{
+        Kind kind;
+        /// \brief C++ type used by the codec on the wire (e.g. DefaultNumericFieldCodec's WireType)
+        google::protobuf::FieldDescriptor::CppType wire_type;
+        /// \brief If false, a wire value of zero means "not set"
+        bool required;
+        double min;
+        double max;
+        double precision;
+        /// \brief For TIME: the number of field units in one second (e.g. 1000000 for microseconds)
+        int time_conversion;
+        /// \brief For STATIC: (dccl.field).static_value
+        std::string static_value;
+        //@}
+
+        /// \brief True if this field is always the same size
+        bool fixed_size() const
+        { return bit_width == min_bit_width; }
+        
+        /// \brief True if this field can be read and written directly from its position in the encoded message (without the field codec)
+        bool direct() const
+        {
+            return !repeated &&
+                (kind == STATIC || (kind != OPAQUE && fixed_offset && fixed_size() && bit_width <= 64));
+        }
+
+        /// \brief Converts the bits of a direct() field into a value
+        ///
+        /// \param wire The bits of this field (see internal::read_bits())
+        /// \param value Set to the decoded value, converted to T. ENUM fields give the enumeration index.
+        /// \param now Current time (seconds since the UNIX epoch), used to expand TIME fields
+        /// \return false if the field is not set
+        template<typename T>
+            bool decode(uint64 wire, T* value, int64 now) const;
+
+        /// \brief Converts a value into the bits of a direct() field, applying the same bounds checks and quantization as the field codec
+        ///
+        /// \param value Value to encode (converted to the type of the field). ENUM fields take the enumeration index.
+        /// \return The bits of this field (see internal::write_bits())
+        template<typename T>
+            uint64 encode(const T& value) const;
+    };
+
+    /// \brief The layout of all the fields of a loaded DCCL message type
+    class MessageLayout
+    {
+      public:
+        /// \brief Create an empty layout for the given type
+        ///
+        /// \param desc Descriptor of the DCCL message
+        /// \param id_bits Encoded identifier (as written by the identifier codec)
+        /// \param id_bit_width Size of the encoded identifier in bits
+        MessageLayout(const google::protobuf::Descriptor* desc,
+                      uint64 id_bits, unsigned id_bit_width);
+
+        /// \brief Descriptor of the DCCL message
+        const google::protobuf::Descriptor* descriptor() const { return desc_; }
+
+        /// \brief Encoded identifier as it appears in the first id_bit_width() bits of the message
+        uint64 id_bits() const { return id_bits_; }
+        /// \brief Size of the identifier in bits
+        unsigned id_bit_width() const { return id_bit_width_; }
+
+        /// \brief Maximum size (in bits) of the head, including the identifier (but not the padding to a whole byte)
+        unsigned head_bits() const { return head_bits_; }
+        /// \brief Offset (in bytes) of the body from the start of the encoded message
+        unsigned body_byte_offset() const { return ceil_bits2bytes(head_bits_); }
+        /// \brief Maximum size (in bits) of the body
+        unsigned body_bits() const { return body_bits_; }
+
+        /// \brief True if any field is FieldLayout::adaptive, in which case messages of this type must be encoded and decoded one at a time, in order
+        bool adaptive() const { return adaptive_; }
+
+        /// \brief True if the encoded message starts with the identifier of this type
+        ///
+        /// Compares the raw identifier bits, so no Bitset is created and the identifier codec is not called.
+        bool matches(const unsigned char* bytes, std::size_t size) const;
+
+        /// \brief All the fields in the order they are encoded (head, then body)
+        const std::vector<FieldLayout>& fields() const { return fields_; }
+
+        /// \brief Find a field by its path (e.g. "header.time")
+        ///
+        /// \return the field, or 0 if no such field is encoded
+        const FieldLayout* find(const std::string& path) const;
+
+        /// \brief Find a field by its path, which must be direct()
+        ///
+        /// \throw Exception if no such field is encoded, or if it cannot be accessed directly
+        const FieldLayout& direct_field(const std::string& path) const;
+        
+        /// \name Building methods
+        ///
+        /// Called by the field codecs as the layout is computed
+        //@{
+        /// \brief Start a new part of the message. The body begins on the byte following the (padded) head.
+        void begin(MessagePart part);
+        /// \brief Place a field at the current position
+        void add(FieldLayout field);
+        /// \brief Skip bits that do not belong to any field (e.g. a presence bit)
+        void add_bits(unsigned max_bits, unsigned min_bits);
+        /// \brief Make the offsets of all subsequent fields unknown
+        void set_variable() { cursor_fixed_ = false; }
+        //@}
+        
+      private:
+        // fields point back to this layout
+        MessageLayout(const MessageLayout&);
+        MessageLayout& operator= (const MessageLayout&);
+        
+        const google::protobuf::Descriptor* desc_;
+        uint64 id_bits_;
+        unsigned id_bit_width_;
+        
+        unsigned head_bits_;
+        unsigned body_bits_;
+
+        MessagePart part_;
+        unsigned cursor_;
+        bool cursor_fixed_;
+        bool adaptive_;
+        
+        std::vector<FieldLayout> fields_;
+        std::map<std::string, std::size_t> index_;
+    };
+}
+
+template<typename T>
+bool dccl::FieldLayout::decode(uint64 wire, T* value, int64 now) const
+{
+    using google::protobuf::FieldDescriptor;
+    switch(kind)
+    {
+        case NUMERIC:
+            switch(wire_type)
+            {
+                case FieldDescriptor::CPPTYPE_DOUBLE:
+                {
+                    double v;
+                    if(!internal::unquantize(wire, min, precision, required, &v)) return false;
+                    *value = static_cast<T>(v);
+                    return true;
+                }
+                case FieldDescriptor::CPPTYPE_FLOAT:
+                {
+                    float v;
+                    if(!internal::unquantize(wire, min, precision, required, &v)) return false;
+                    *value = static_cast<T>(v);
+                    return true;
+                }
+                case FieldDescriptor::CPPTYPE_INT32:
+                {
+                    int32 v;
+                    if(!internal::unquantize(wire, min, precision, required, &v)) return false;
+                    *value = static_cast<T>(v);
+                    return true;
+                }
+                case FieldDescriptor::CPPTYPE_INT64:
+                {
+                    int64 v;
+                    if(!internal::unquantize(wire, min, precision, required, &v)) return false;
+                    *value = static_cast<T>(v);
+                    return true;
+                }
+                case FieldDescriptor::CPPTYPE_UINT32:
+                {
+                    uint32 v;
+                    if(!internal::unquantize(wire, min, precision, required, &v)) return false;
+                    *value = static_cast<T>(v);
+                    return true;
+                }
+                case FieldDescriptor::CPPTYPE_UINT64:
+                {
+                    uint64 v;
+                    if(!internal::unquantize(wire, min, precision, required, &v)) return false;
+                    *value = static_cast<T>(v);
+                    return true;
+                }
+                default:
+                    return false;
+            }
+            
+        case BOOL:
+            if(!required)
+            {
+                if(!wire) return false;
+                --wire;
+            }
+            *value = static_cast<T>(wire != 0);
+            return true;
+
+        case ENUM:
+        {
+            int32 index;
+            if(!internal::unquantize(wire, min, precision, required, &index) || index > max)
+                return false;
+            *value = static_cast<T>(index);
+            return true;
+        }
+        
+        case TIME:
+        {
+            double encoded_time;
+            if(!internal::unquantize(wire, min, precision, required, &encoded_time))
+                return false;
+
+            double time_precision = precision - std::log10((double)time_conversion);
+            switch(field->cpp_type())
+            {
+                case FieldDescriptor::CPPTYPE_UINT64:
+                    *value = static_cast<T>(internal::expand_time_of_day<uint64>(encoded_time, (int64)max, time_conversion, time_precision, now));
+                    return true;
+                case FieldDescriptor::CPPTYPE_INT64:
+                    *value = static_cast<T>(internal::expand_time_of_day<int64>(encoded_time, (int64)max, time_conversion, time_precision, now));
+                    return true;
+                default:
+                    *value = static_cast<T>(internal::expand_time_of_day<double>(encoded_time, (int64)max, time_conversion, time_precision, now));
+                    return true;
+            }
+        }
+        
+        case STATIC:
+            *value = boost::lexical_cast<T>(static_value);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+template<typename T>
+dccl::uint64 dccl::FieldLayout::encode(const T& value) const
+{
+    using google::protobuf::FieldDescriptor;
+    uint64 wire = 0;
+    switch(kind)
+    {
+        case NUMERIC:
+            switch(wire_type)
+            {
+                // NaN (which fails neither bounds check in quantize()) is encoded as all zeros, as is a value out of bounds
+                case FieldDescriptor::CPPTYPE_DOUBLE:
+                    if(static_cast<double>(value) == static_cast<double>(value))
+                        internal::quantize(static_cast<double>(value), min, max, precision, required, &wire);
+                    break;
+                case FieldDescriptor::CPPTYPE_FLOAT:
+                    if(static_cast<double>(value) == static_cast<double>(value))
+                        internal::quantize(static_cast<float>(value), min, max, precision, required, &wire);
+                    break;
+                // checked in double before the value is narrowed
+                case FieldDescriptor::CPPTYPE_INT32:
+                    if(internal::narrows_in_bounds<int32>(static_cast<double>(value), min, max, precision))
+                        internal::quantize(static_cast<int32>(value), min, max, precision, required, &wire);
+                    break;
+                case FieldDescriptor::CPPTYPE_INT64:
+                    if(internal::narrows_in_bounds<int64>(static_cast<double>(value), min, max, precision))
+                        internal::quantize(static_cast<int64>(value), min, max, precision, required, &wire);
+                    break;
+                case FieldDescriptor::CPPTYPE_UINT32:
+                    if(internal::narrows_in_bounds<uint32>(static_cast<double>(value), min, max, precision))
+                        internal::quantize(static_cast<uint32>(value), min, max, precision, required, &wire);
+                    break;
+                case FieldDescriptor::CPPTYPE_UINT64:
+                    if(internal::narrows_in_bounds<uint64>(static_cast<double>(value), min, max, precision))
+                        internal::quantize(static_cast<uint64>(value), min, max, precision, required, &wire);
+                    break;
+                default:
+                    break;
+            }
+            return wire;
+            
+        case BOOL:
+            return required ? static_cast<bool>(value) : static_cast<bool>(value) + 1;
+            
+        case ENUM:
+            if(internal::narrows_in_bounds<int32>(static_cast<double>(value), min, max, precision))
+                internal::quantize(static_cast<int32>(value), min, max, precision, required, &wire);
+            return wire;
+
+        case TIME:
+        {
+            double encoded_time = 0;
+            switch(field->cpp_type())
+            {
+                case FieldDescriptor::CPPTYPE_UINT64:
+                    encoded_time = internal::time_of_day(static_cast<uint64>(value), time_conversion, max); break;
+                case FieldDescriptor::CPPTYPE_INT64:
+                    encoded_time = internal::time_of_day(static_cast<int64>(value), time_conversion, max); break;
+                default:
+                    encoded_time = internal::time_of_day(static_cast<double>(value), time_conversion, max); break;
+            }
+            internal::quantize(encoded_time, min, max, precision, required, &wire);
+            return wire;
+        }
+        
+        default:
+            return 0;
+    }
+}
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLBITOPS20170601H
+#define DCCLBITOPS20170601H
+
+#include <algorithm>
+
+#include "dccl/common.h"
+
+namespace dccl
+{
+    namespace internal
+    {
+        /// \brief Reads `width` (<= 64) bits starting at bit `offset` of an encoded byte buffer.
+        ///
+        /// Bits are numbered as in Bitset::to_byte_string(): bit `i` is bit (i % 8) of byte (i / 8), so the value is read least significant bit first. Only the bytes that contain the requested bits are read.
+        inline uint64 read_bits(const unsigned char* bytes, unsigned offset, unsigned width)
+        {
+            if(!width)
+                return 0;
+            
+            const unsigned char* byte = bytes + offset / BITS_IN_BYTE;
+            unsigned shift = offset % BITS_IN_BYTE;
+
+            uint64 value = static_cast<uint64>(*byte++ >> shift);
+            unsigned got = BITS_IN_BYTE - shift;
+            while(got < width)
+            {
+                value |= static_cast<uint64>(*byte++) << got;
+                got += BITS_IN_BYTE;
+            }
+
+            if(width < 64)
+                value &= (static_cast<uint64>(1) << width) - 1;
+            return value;
+        }
+
+        /// \brief Writes the `width` (<= 64) least significant bits of `value` starting at bit `offset` of an encoded byte buffer, leaving all other bits untouched.
+        ///
+        /// Uses the same bit numbering as read_bits().
+        inline void write_bits(unsigned char* bytes, unsigned offset, unsigned width, uint64 value)
+        {
+            unsigned char* byte = bytes + offset / BITS_IN_BYTE;
+            unsigned shift = offset % BITS_IN_BYTE;
+            unsigned done = 0;
+            while(done < width)
+            {
+                unsigned n = std::min(BITS_IN_BYTE - shift, width - done);
+                unsigned char mask = static_cast<unsigned char>(((1u << n) - 1) << shift);
+                *byte = static_cast<unsigned char>((*byte & ~mask) | ((static_cast<unsigned>(value >> done) << shift) & mask));
+                done += n;
+                shift = 0;
+                ++byte;
+            }
+        }
+
+        /// \brief Reverses the order of the bits of a byte (to convert a stream written most significant bit first to the numbering of read_bits(), and back).
+        inline unsigned char reverse_bits(unsigned char byte)
+        {
+            byte = static_cast<unsigned char>((byte & 0xF0) >> 4 | (byte & 0x0F) << 4);
+            byte = static_cast<unsigned char>((byte & 0xCC) >> 2 | (byte & 0x33) << 2);
+            return static_cast<unsigned char>((byte & 0xAA) >> 1 | (byte & 0x55) << 1);
+        }
+
+        /// \brief Sets or clears bit `i` of a bitmap (bit i is bit (i % 8) of byte (i / 8)).
+        inline void set_bitmap(unsigned char* bitmap, std::size_t i, bool value)
+        {
+            unsigned char mask = static_cast<unsigned char>(1u << (i % BITS_IN_BYTE));
+            if(value)
+                bitmap[i / BITS_IN_BYTE] |= mask;
+            else
+                bitmap[i / BITS_IN_BYTE] &= static_cast<unsigned char>(~mask);
+        }
+
+        /// \brief Reads bit `i` of a bitmap (see set_bitmap()).
+        inline bool test_bitmap(const unsigned char* bitmap, std::size_t i)
+        { return (bitmap[i / BITS_IN_BYTE] >> (i % BITS_IN_BYTE)) & 1; }
+    }
+}
+
+#endif
@@ -19,58 +19,95 @@
 //
 // You should have received a copy of the GNU Lesser General Public License
 // along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <pthread.h>
+
 #include "field_codec_message_stack.h"
 #include "dccl/field_codec.h"
 
-std::vector<const google::protobuf::FieldDescriptor*> dccl::internal::MessageStack::field_;
-std::vector<const google::protobuf::Descriptor*> dccl::internal::MessageStack::desc_;
-std::vector<dccl::MessagePart> dccl::internal::MessageStack::parts_;
+namespace
+{
+    pthread_key_t state_key;
+    pthread_once_t state_key_once = PTHREAD_ONCE_INIT;
+
+    void delete_state(void* state)
+    { delete static_cast<dccl::internal::MessageStack::State*>(state); }
+    
+    void create_state_key()
+    { pthread_key_create(&state_key, delete_state); }
+
+#ifdef __GNUC__
+    // caches this thread's state for state(), which is called for every field coded
+    __thread dccl::internal::MessageStack::State* thread_state = 0;
+#endif
+}
 
 //
 // MessageStack
 //
 
+dccl::internal::MessageStack::State& dccl::internal::MessageStack::state()
+{
+#ifdef __GNUC__
+    if(thread_state)
+        return *thread_state;
+#endif
+    
+    pthread_once(&state_key_once, create_state_key);
+    State* state = static_cast<State*>(pthread_getspecific(state_key));
+    if(!state)
+    {
+        // deleted by delete_state() when the thread exits
+        state = new State;
+        pthread_setspecific(state_key, state);
+    }
+#ifdef __GNUC__
+    thread_state = state;
+#endif
+    return *state;
+}
+
 void dccl::internal::MessageStack::push(const google::protobuf::Descriptor* desc)
  
 {
-    desc_.push_back(desc);
+    state_.desc.push_back(desc);
     ++descriptors_pushed_;
 }
 
 void dccl::internal::MessageStack::push(const google::protobuf::FieldDescriptor* field)
 {
-    field_.push_back(field);
+    state_.field.push_back(field);
     ++fields_pushed_;
 }
 
 void dccl::internal::MessageStack::push(MessagePart part)
 {
-    parts_.push_back(part);
+    state_.parts.push_back(part);
     ++parts_pushed_;
 }
 
 
 void dccl::internal::MessageStack::__pop_desc()
 {
-    if(!desc_.empty())
-        desc_.pop_back();
+    if(!state_.desc.empty())
+        state_.desc.pop_back();
 }
 
 void dccl::internal::MessageStack::__pop_field()
 {
-    if(!field_.empty())
-        field_.pop_back();
+    if(!state_.field.empty())
+        state_.field.pop_back();
 }
 
 void dccl::internal::MessageStack::__pop_parts()
 {
-    if(!parts_.empty())
-        parts_.pop_back();
+    if(!state_.parts.empty())
+        state_.parts.pop_back();
 }
 
 
 dccl::internal::MessageStack::MessageStack(const google::protobuf::FieldDescriptor* field)
-    : descriptors_pushed_(0),
+    : state_(state()),
+      descriptors_pushed_(0),
       fields_pushed_(0),
       parts_pushed_(0)
 {
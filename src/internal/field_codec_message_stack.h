@@ -41,25 +41,44 @@ namespace dccl
             ~MessageStack();
             
             bool first() 
-            { return desc_.empty(); }
+            { return state_.desc.empty(); }
             int count() 
-            { return desc_.size(); }
+            { return state_.desc.size(); }
 
             void push(const google::protobuf::Descriptor* desc);
             void push(const google::protobuf::FieldDescriptor* field);
             void push(MessagePart part);
 
-            static MessagePart current_part() { return parts_.empty() ? UNKNOWN : parts_.back(); }
+            static MessagePart current_part()
+            {
+                const std::vector<MessagePart>& parts = state().parts;
+                return parts.empty() ? UNKNOWN : parts.back();
+            }
+
+            // The message being processed by the calling thread. This is kept per thread so that separate Codec instances can be used concurrently from different threads.
+            struct State
+            {
+                State() : root_part(UNKNOWN), root_message(0), root_descriptor(0) { }
+                
+                std::vector<const google::protobuf::Descriptor*> desc;
+                std::vector<const google::protobuf::FieldDescriptor*> field;
+                std::vector<MessagePart> parts;
+
+                // set by FieldCodecBase::BaseRAII
+                MessagePart root_part;
+                const google::protobuf::Message* root_message;
+                const google::protobuf::Descriptor* root_descriptor;
+            };
+            
+            static State& state();
         
             friend class ::dccl::FieldCodecBase;
           private:
             void __pop_desc();
             void __pop_field();
             void __pop_parts();
-                
-            static std::vector<const google::protobuf::Descriptor*> desc_;
-            static std::vector<const google::protobuf::FieldDescriptor*> field_;
-            static std::vector<MessagePart> parts_;
+
+            State& state_;
             int descriptors_pushed_;
             int fields_pushed_;
             int parts_pushed_;
@@ -0,0 +1,114 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLGENERATEDCODEC20170601H
+#define DCCLGENERATEDCODEC20170601H
+
+#include <string>
+
+#include <google/protobuf/message.h>
+
+#include "dccl/common.h"
+
+namespace dccl
+{
+    namespace internal
+    {
+        /// \brief The encode and decode functions generated by protoc-gen-dccl for one message type (see Codec::load())
+        struct GeneratedCodec
+        {
+            /// \brief Encode `msg` into `bytes` (which must hold `size` bytes). Returns false if `msg` is not the generated class (e.g. a DynamicMessage).
+            typedef bool (*EncodeFunction)(const google::protobuf::Message& msg, unsigned char* bytes);
+            /// \brief Decode `bytes` into `msg`. Returns false if `msg` is not the generated class.
+            typedef bool (*DecodeFunction)(const unsigned char* bytes, google::protobuf::Message* msg);
+
+            EncodeFunction encode;
+            DecodeFunction decode;
+
+            int32 id;
+            uint64 id_bits;
+            unsigned id_bit_width;
+            unsigned head_bits;
+            unsigned body_bits;
+            /// \brief Size of every encoded message in bytes
+            unsigned size;
+        };
+
+        /// \brief True if ProtobufMessage has the static dccl_encode(), dccl_decode() and dccl_size() functions written by protoc-gen-dccl
+        template<typename ProtobufMessage>
+            struct HasGeneratedCodec
+        {
+          private:
+            typedef char yes[1];
+            typedef char no[2];
+            
+            template<typename T, T> struct Check;
+            
+            template<typename T>
+                static yes& test(Check<void (*)(const T&, unsigned char*), &T::dccl_encode>*,
+                                 Check<void (*)(const unsigned char*, T*), &T::dccl_decode>*);
+            template<typename T>
+                static no& test(...);
+            
+          public:
+            enum { value = sizeof(test<ProtobufMessage>(0, 0)) == sizeof(yes) };
+        };
+
+        template<typename ProtobufMessage>
+            bool generated_encode(const google::protobuf::Message& msg, unsigned char* bytes)
+        {
+            const ProtobufMessage* typed_msg = dynamic_cast<const ProtobufMessage*>(&msg);
+            if(!typed_msg)
+                return false;
+            ProtobufMessage::dccl_encode(*typed_msg, bytes);
+            return true;
+        }
+
+        template<typename ProtobufMessage>
+            bool generated_decode(const unsigned char* bytes, google::protobuf::Message* msg)
+        {
+            ProtobufMessage* typed_msg = dynamic_cast<ProtobufMessage*>(msg);
+            if(!typed_msg)
+                return false;
+            ProtobufMessage::dccl_decode(bytes, typed_msg);
+            return true;
+        }
+
+        /// \brief Pointer to the bytes of an iterator range, or 0 if the iterator type does not guarantee contiguous storage.
+        template<typename CharIterator>
+            inline const unsigned char* contiguous_bytes(CharIterator)
+        { return 0; }
+
+        inline const unsigned char* contiguous_bytes(const char* it)
+        { return reinterpret_cast<const unsigned char*>(it); }
+
+        inline const unsigned char* contiguous_bytes(char* it)
+        { return reinterpret_cast<const unsigned char*>(it); }
+
+        inline const unsigned char* contiguous_bytes(std::string::const_iterator it)
+        { return reinterpret_cast<const unsigned char*>(&*it); }
+
+        inline const unsigned char* contiguous_bytes(std::string::iterator it)
+        { return reinterpret_cast<const unsigned char*>(&*it); }
+    }
+}
+
+#endif
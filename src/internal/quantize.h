@@ -0,0 +1,156 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLQUANTIZE20170601H
+#define DCCLQUANTIZE20170601H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <boost/numeric/conversion/cast.hpp>
+
+#include "dccl/common.h"
+
+namespace dccl
+{
+    namespace internal
+    {
+        /// \brief Maps a numeric value onto the unsigned integer written on the wire by v2::DefaultNumericFieldCodec (and the codecs built on it).
+        ///
+        /// \param value Value to quantize
+        /// \param min (dccl.field).min (or equivalent) of the field
+        /// \param max (dccl.field).max (or equivalent) of the field
+        /// \param precision (dccl.field).precision (or equivalent) of the field
+        /// \param required If false, 0 is reserved for "not set" and all values are shifted up by one.
+        /// \param uint_value Set to the wire value if `value` is within bounds.
+        /// \return false if `value` is out of bounds (which is encoded as all zeros)
+        template<typename WireType>
+            bool quantize(WireType value, double min, double max, double precision,
+                          bool required, uint64* uint_value)
+        {
+            // round first, before checking bounds
+            WireType wire_value = dccl::round(value, precision);
+
+            // check bounds, if out-of-bounds, send as zeros
+            if(wire_value < min || wire_value > max)
+                return false;
+          
+            wire_value -= dccl::round((WireType)min, precision);
+
+            if (precision < 0) {
+                wire_value /= (WireType)std::pow(10.0, -precision);
+            } else if (precision > 0) {
+                wire_value *= (WireType)std::pow(10.0, precision);
+            }
+
+            *uint_value = boost::numeric_cast<dccl::uint64>(dccl::round(wire_value, 0));
+
+            // "presence" value (0)
+            if(!required)
+                *uint_value += 1;
+
+            return true;
+        }
+
+        /// \brief Checks, before a value is converted to the integer type WireType and given to quantize(), that the conversion is defined and that the result may be within bounds
+        ///
+        /// The conversion of NaN, or of a value outside the range of WireType, is undefined (and may wrap into the bounds), so the check is done in double.
+        /// \return false if `value` is NaN or cannot be within bounds once converted (in which case it is encoded as all zeros, as by quantize())
+        template<typename WireType>
+            bool narrows_in_bounds(double value, double min, double max, double precision)
+        {
+            if(value != value)
+                return false;
+
+            // the conversion truncates
+            value = (value < 0) ? std::ceil(value) : std::floor(value);
+
+            // values within one rounding step of the bounds are left to the exact check in quantize()
+            const double slack = (precision < 0) ? std::pow(10.0, -precision) : 0;
+            return value >= std::max(min - slack, static_cast<double>(std::numeric_limits<WireType>::min())) &&
+                value <= max + slack &&
+                value < static_cast<double>(std::numeric_limits<WireType>::max()) + 1;
+        }
+
+        /// \brief Inverse of quantize().
+        ///
+        /// \return false if `uint_value` is the "not set" value of an optional field.
+        template<typename WireType>
+            bool unquantize(uint64 uint_value, double min, double precision,
+                            bool required, WireType* value)
+        {
+            if(!required)
+            {
+                if(!uint_value) return false;
+                --uint_value;
+            }
+	  
+            WireType wire_value = (WireType)uint_value;
+
+            if (precision < 0) {
+                wire_value *= (WireType)std::pow(10.0, -precision);
+            } else if (precision > 0) {
+                wire_value /= (WireType)std::pow(10.0, precision);
+            }
+
+            // round values again to properly handle cases where double precision
+            // leads to slightly off values (e.g. 2.099999999 instead of 2.1)
+            *value = dccl::round(wire_value + dccl::round((WireType)min, precision),
+                                 precision);
+            return true;
+        }
+
+        /// \brief Reduces a time (in TimeType units since the UNIX epoch) to seconds since the start of the current period of `max_secs`, as encoded by v2::TimeCodecBase.
+        template<typename TimeType>
+            double time_of_day(const TimeType& time, int conversion_factor, double max_secs)
+        {
+            return std::fmod(time / static_cast<double>(conversion_factor), max_secs);
+        }
+        
+        /// \brief Expands a time of day (seconds since the start of the current period of `max_secs`, as encoded by v2::TimeCodecBase) into a full time, choosing the period closest to `now`.
+        ///
+        /// \param encoded_time Seconds since the start of the period
+        /// \param max_secs Length of the period in seconds (num_days * 86400)
+        /// \param conversion_factor Number of TimeType units in one second
+        /// \param precision Precision of the decoded value (in TimeType units)
+        /// \param now Current time (seconds since the UNIX epoch)
+        template<typename TimeType>
+            TimeType expand_time_of_day(double encoded_time, int64 max_secs,
+                                        int conversion_factor, double precision, int64 now)
+        {
+            int64 daystart = now - (now % max_secs);
+            int64 today_time = now - daystart;
+
+            // If time is more than 12 hours ahead of now, assume it's yesterday.
+            if ((encoded_time - today_time) > (max_secs/2)) {
+                daystart -= max_secs;
+            } else if ((today_time - encoded_time) > (max_secs/2)) {
+                daystart += max_secs;
+            }
+
+            return dccl::round((TimeType)(conversion_factor * (daystart + encoded_time)),
+                               precision);
+        }
+    }
+}
+
+#endif
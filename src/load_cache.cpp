@@ -0,0 +1,332 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <google/protobuf/descriptor.pb.h>
+
+#include "dccl/load_cache.h"
+#include "dccl/dynamic_protobuf_manager.h"
+#include "dccl/exception.h"
+#include "dccl/logger.h"
+#include "dccl/version.h"
+
+using namespace dccl::logger;
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::FileDescriptor;
+
+namespace
+{
+    // 64-bit FNV-1a: only needs to detect changes, not resist deliberate collisions
+    const dccl::uint64 FNV_OFFSET = 14695981039346656037ULL;
+    const dccl::uint64 FNV_PRIME = 1099511628211ULL;
+
+    dccl::uint64 fnv1a(const std::string& data, dccl::uint64 hash = FNV_OFFSET)
+    {
+        for(std::string::const_iterator it = data.begin(), end = data.end(); it != end; ++it)
+        {
+            hash ^= static_cast<unsigned char>(*it);
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    dccl::uint64 fnv1a(dccl::uint64 value, dccl::uint64 hash)
+    {
+        for(int i = 0; i < 8; ++i, value >>= 8)
+        {
+            hash ^= value & 0xff;
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    bool compiled_in(const std::string& file_name)
+    { return google::protobuf::DescriptorPool::generated_pool()->FindFileByName(file_name) != 0; }
+}
+
+dccl::LoadCache::LoadCache(const std::string& path)
+    : path_(path),
+      modified_(false),
+      file_hits_(0),
+      validation_hits_(0)
+{
+    int fd = open(path_.c_str(), O_RDONLY);
+    if(fd >= 0)
+    {
+        struct stat st;
+        if(fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data != MAP_FAILED)
+            {
+                if(!cache_.ParseFromArray(data, st.st_size))
+                {
+                    dlog.is(WARN) && dlog << "Ignoring corrupt DCCL load cache: " << path_ << std::endl;
+                    cache_.Clear();
+                }
+                munmap(data, st.st_size);
+            }
+        }
+        close(fd);
+    }
+
+    if(cache_.dccl_version() != VERSION_STRING ||
+       cache_.source_size() != cache_.descriptors().file_size())
+    {
+        if(cache_.has_dccl_version())
+            dlog.is(WARN) && dlog << "Ignoring DCCL load cache from DCCL version " << cache_.dccl_version() << ": " << path_ << std::endl;
+        cache_.Clear();
+        cache_.set_dccl_version(VERSION_STRING);
+    }
+
+    for(int i = 0, n = cache_.source_size(); i < n; ++i)
+        sources_[cache_.source(i).name()] = i;
+    for(int i = 0, n = cache_.validated_size(); i < n; ++i)
+        validated_[cache_.validated(i).name()] = i;
+}
+
+const google::protobuf::FileDescriptor* dccl::LoadCache::load_from_proto_file(const std::string& protofile_absolute_path)
+{
+    std::set<std::string> checked;
+    if(source_unchanged(protofile_absolute_path, &checked))
+    {
+        std::set<std::string> added;
+        add_to_database(protofile_absolute_path, &added);
+        const FileDescriptor* file = DynamicProtobufManager::user_descriptor_pool().FindFileByName(protofile_absolute_path);
+        if(file)
+        {
+            ++file_hits_;
+            return file;
+        }
+    }
+
+    const FileDescriptor* file = DynamicProtobufManager::load_from_proto_file(protofile_absolute_path);
+    if(file)
+    {
+        std::set<std::string> added;
+        add_source(file, &added);
+    }
+    return file;
+}
+
+// true if the cached file and all its imports are the same as on the disk
+bool dccl::LoadCache::source_unchanged(const std::string& name, std::set<std::string>* checked)
+{
+    if(!checked->insert(name).second)
+        return true;
+
+    std::map<std::string, int>::const_iterator it = sources_.find(name);
+    if(it == sources_.end())
+        return compiled_in(name);
+
+    std::string contents;
+    if(!DynamicProtobufManager::read_proto_file(name, &contents) ||
+       fnv1a(contents) != cache_.source(it->second).content_hash())
+        return false;
+
+    const google::protobuf::FileDescriptorProto& proto = cache_.descriptors().file(it->second);
+    for(int i = 0, n = proto.dependency_size(); i < n; ++i)
+    {
+        if(!source_unchanged(proto.dependency(i), checked))
+            return false;
+    }
+    return true;
+}
+
+// adds the cached file to the DynamicProtobufManager, after its imports
+void dccl::LoadCache::add_to_database(const std::string& name, std::set<std::string>* added)
+{
+    std::map<std::string, int>::const_iterator it = sources_.find(name);
+    if(it == sources_.end() || !added->insert(name).second)
+        return;
+
+    const google::protobuf::FileDescriptorProto& proto = cache_.descriptors().file(it->second);
+    for(int i = 0, n = proto.dependency_size(); i < n; ++i)
+        add_to_database(proto.dependency(i), added);
+
+    google::protobuf::FileDescriptorProto existing;
+    if(!DynamicProtobufManager::simple_database().FindFileByName(name, &existing))
+        DynamicProtobufManager::simple_database().Add(proto);
+}
+
+// caches a parsed file and its imports
+void dccl::LoadCache::add_source(const google::protobuf::FileDescriptor* file, std::set<std::string>* added)
+{
+    if(compiled_in(file->name()) || !added->insert(file->name()).second)
+        return;
+
+    for(int i = 0, n = file->dependency_count(); i < n; ++i)
+        add_source(file->dependency(i), added);
+
+    std::string contents;
+    if(!DynamicProtobufManager::read_proto_file(file->name(), &contents))
+        return;
+
+    int index;
+    std::map<std::string, int>::const_iterator it = sources_.find(file->name());
+    if(it == sources_.end())
+    {
+        index = cache_.source_size();
+        cache_.add_source();
+        cache_.mutable_descriptors()->add_file();
+        sources_[file->name()] = index;
+    }
+    else
+    {
+        index = it->second;
+    }
+
+    protobuf::LoadCache::SourceFile* source = cache_.mutable_source(index);
+    source->set_name(file->name());
+    source->set_content_hash(fnv1a(contents));
+    google::protobuf::FileDescriptorProto* proto = cache_.mutable_descriptors()->mutable_file(index);
+    proto->Clear();
+    file->CopyTo(proto);
+    modified_ = true;
+}
+
+bool dccl::LoadCache::find_validated(const MessageLayout& layout, unsigned* head_bits, unsigned* body_bits)
+{
+    std::map<std::string, int>::const_iterator it = validated_.find(layout.descriptor()->full_name());
+    if(it == validated_.end())
+        return false;
+
+    const protobuf::LoadCache::Validated& validated = cache_.validated(it->second);
+    if(validated.descriptor_hash() != validation_hash(layout))
+        return false;
+
+    *head_bits = validated.head_bits();
+    *body_bits = validated.body_bits();
+    ++validation_hits_;
+    return true;
+}
+
+void dccl::LoadCache::add_validated(const MessageLayout& layout, unsigned head_bits, unsigned body_bits)
+{
+    const Descriptor* desc = layout.descriptor();
+    protobuf::LoadCache::Validated* validated;
+    std::map<std::string, int>::const_iterator it = validated_.find(desc->full_name());
+    if(it == validated_.end())
+    {
+        validated_[desc->full_name()] = cache_.validated_size();
+        validated = cache_.add_validated();
+    }
+    else
+    {
+        validated = cache_.mutable_validated(it->second);
+    }
+
+    validated->set_name(desc->full_name());
+    validated->set_descriptor_hash(validation_hash(layout));
+    validated->set_head_bits(head_bits);
+    validated->set_body_bits(body_bits);
+    modified_ = true;
+}
+
+// hash of everything that validation depends on: the options and fields of the message, and
+// (recursively) of the embedded messages and enumerations
+dccl::uint64 dccl::LoadCache::descriptor_hash(const google::protobuf::Descriptor* desc)
+{
+    std::set<const void*> visited;
+    std::vector<const Descriptor*> pending(1, desc);
+    uint64 hash = FNV_OFFSET;
+    while(!pending.empty())
+    {
+        const Descriptor* d = pending.back();
+        pending.pop_back();
+        if(!visited.insert(d).second)
+            continue;
+
+        hash = fnv1a(d->full_name(), hash);
+        hash = fnv1a(d->options().SerializeAsString(), hash);
+        for(int i = 0, n = d->field_count(); i < n; ++i)
+        {
+            const FieldDescriptor* field = d->field(i);
+            hash = fnv1a(field->name(), hash);
+            const int oneof = field->containing_oneof() ? field->containing_oneof()->index() + 1 : 0;
+            hash = fnv1a((static_cast<uint64>(field->number()) << 32) | (oneof << 16) | (field->type() << 8) | field->label(), hash);
+            hash = fnv1a(field->options().SerializeAsString(), hash);
+
+            if(field->message_type())
+            {
+                hash = fnv1a(field->message_type()->full_name(), hash);
+                pending.push_back(field->message_type());
+            }
+            else if(field->enum_type())
+            {
+                hash = fnv1a(field->enum_type()->full_name(), hash);
+                if(visited.insert(field->enum_type()).second)
+                {
+                    google::protobuf::EnumDescriptorProto enum_proto;
+                    field->enum_type()->CopyTo(&enum_proto);
+                    hash = fnv1a(enum_proto.SerializeAsString(), hash);
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+// hash of the definition of the message, and of the codec of each field and the state it depends on
+// (e.g. the frequencies of an arithmetic model)
+dccl::uint64 dccl::LoadCache::validation_hash(const MessageLayout& layout)
+{
+    uint64 hash = descriptor_hash(layout.descriptor());
+    for(std::vector<FieldLayout>::const_iterator it = layout.fields().begin(), end = layout.fields().end(); it != end; ++it)
+    {
+        hash = fnv1a(it->path, hash);
+        hash = fnv1a(it->codec, hash);
+        hash = fnv1a(it->field ? static_cast<uint64>(it->field->type()) : 0, hash);
+        hash = fnv1a(it->validation_state, hash);
+    }
+    return hash;
+}
+
+void dccl::LoadCache::save()
+{
+    if(!modified_)
+        return;
+
+    std::string tmp_path = path_ + ".tmp";
+    {
+        std::ofstream out(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+        if(!out || !cache_.SerializeToOstream(&out) || !out.flush())
+        {
+            std::remove(tmp_path.c_str());
+            throw(Exception("Failed to write DCCL load cache: " + tmp_path));
+        }
+    }
+    if(std::rename(tmp_path.c_str(), path_.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+        throw(Exception("Failed to replace DCCL load cache: " + path_));
+    }
+    modified_ = false;
+}
@@ -0,0 +1,104 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLLOADCACHE20261019H
+#define DCCLLOADCACHE20261019H
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <google/protobuf/descriptor.h>
+
+#include "dccl/common.h"
+#include "dccl/field_layout.h"
+#include "dccl/protobuf/load_cache.pb.h"
+
+namespace dccl
+{
+    /// \brief On-disk cache of parsed .proto files and of the validation of DCCL messages, to shorten the startup of applications that load many message types at runtime
+    ///
+    /// Parsing .proto files (DynamicProtobufManager::load_from_proto_file()) and validating messages (Codec::load()) make up most of the startup time of such applications. A LoadCache keeps the results of both in a single file (a serialized protobuf::LoadCache, which is read through a memory map):
+    /// - load_from_proto_file() uses the cached FileDescriptorProtos of a file and its imports if none of these files has changed (by a hash of the contents of the files that would be parsed now), and otherwise parses the files and caches them.
+    /// - A Codec given the cache with Codec::set_load_cache() skips the validation and maximum size computation of each message whose definition (including every message and enumeration it uses) is unchanged since it was validated, and whose fields use the same field codecs with the same FieldCodecBase::validation_state() (e.g. the same arithmetic models). The field layout (which gives the codec of each field) is still computed.
+    ///
+    /// New results are written back to the file by save(). A cache written by another version of DCCL is ignored.
+    ///
+    /// A LoadCache may not be used from more than one thread at a time.
+    class LoadCache
+    {
+      public:
+        /// \brief Read the cache from a file, if it exists
+        ///
+        /// A missing, unreadable or corrupt file, or one written by another version of DCCL, results in an empty cache.
+        /// \param path Path of the cache file
+        explicit LoadCache(const std::string& path);
+
+        /// \brief Load a .proto file, from the cache if it is unchanged (see DynamicProtobufManager::load_from_proto_file())
+        ///
+        /// DynamicProtobufManager::enable_compilation() must have been called, and the include paths added, as for DynamicProtobufManager::load_from_proto_file().
+        /// \param protofile_absolute_path Absolute, canonical path to the file
+        /// \throw Exception If the file has to be parsed and cannot be
+        const google::protobuf::FileDescriptor* load_from_proto_file(const std::string& protofile_absolute_path);
+
+        /// \brief Find the result of validating a message (used by Codec::load())
+        ///
+        /// \param layout Layout of the message, as computed with the field codecs loaded now
+        /// \return true if the message and its field codecs are unchanged since it was validated, in which case head_bits and body_bits are set to its maximum sizes (the head excluding the identifier)
+        bool find_validated(const MessageLayout& layout, unsigned* head_bits, unsigned* body_bits);
+
+        /// \brief Record a message that passed validation (used by Codec::load()); head_bits excludes the identifier
+        void add_validated(const MessageLayout& layout, unsigned head_bits, unsigned body_bits);
+
+        /// \brief Write the cache to its file, if anything was added since it was read
+        ///
+        /// The file is replaced with a rename, so other processes read either the old or the new cache.
+        /// \throw Exception If the file cannot be written
+        void save();
+
+        /// \brief Number of calls to load_from_proto_file() that were served from the cache
+        unsigned file_hits() const { return file_hits_; }
+        /// \brief Number of calls to find_validated() that were served from the cache
+        unsigned validation_hits() const { return validation_hits_; }
+
+      private:
+        bool source_unchanged(const std::string& name, std::set<std::string>* checked);
+        void add_to_database(const std::string& name, std::set<std::string>* added);
+        void add_source(const google::protobuf::FileDescriptor* file, std::set<std::string>* added);
+        uint64 descriptor_hash(const google::protobuf::Descriptor* desc);
+        uint64 validation_hash(const MessageLayout& layout);
+
+      private:
+        std::string path_;
+        protobuf::LoadCache cache_;
+
+        // name of each source file to its index in cache_.source() (and cache_.descriptors().file())
+        std::map<std::string, int> sources_;
+        // full name of each validated message to its index in cache_.validated()
+        std::map<std::string, int> validated_;
+
+        bool modified_;
+        unsigned file_hits_;
+        unsigned validation_hits_;
+    };
+}
+
+#endif
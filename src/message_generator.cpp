@@ -0,0 +1,317 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <cmath>
+
+#include <sys/time.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#include "dccl/message_generator.h"
+#include "dccl/dynamic_protobuf_manager.h"
+#include "dccl/exception.h"
+#include "dccl/protobuf/option_extensions.pb.h"
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+namespace
+{
+    // times are generated within this many seconds before the time base
+    const unsigned TIME_WINDOW = 3600;
+
+    void set_number(Message* msg, const FieldDescriptor* field, double value)
+    {
+        const Reflection* refl = msg->GetReflection();
+        const bool repeated = field->is_repeated();
+        switch(field->cpp_type())
+        {
+            case FieldDescriptor::CPPTYPE_INT32:
+                repeated ? refl->AddInt32(msg, field, value) : refl->SetInt32(msg, field, value);
+                break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                repeated ? refl->AddInt64(msg, field, value) : refl->SetInt64(msg, field, value);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                repeated ? refl->AddUInt32(msg, field, value) : refl->SetUInt32(msg, field, value);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                repeated ? refl->AddUInt64(msg, field, value) : refl->SetUInt64(msg, field, value);
+                break;
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                repeated ? refl->AddDouble(msg, field, value) : refl->SetDouble(msg, field, value);
+                break;
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                repeated ? refl->AddFloat(msg, field, value) : refl->SetFloat(msg, field, value);
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool is_number(const FieldDescriptor* field)
+    {
+        switch(field->cpp_type())
+        {
+            case FieldDescriptor::CPPTYPE_INT32:
+            case FieldDescriptor::CPPTYPE_INT64:
+            case FieldDescriptor::CPPTYPE_UINT32:
+            case FieldDescriptor::CPPTYPE_UINT64:
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+dccl::MessageGenerator::MessageGenerator(unsigned seed)
+    : rng_(seed)
+{
+    presence_[HEAD] = 0.5;
+    presence_[BODY] = 0.5;
+
+    timeval t;
+    gettimeofday(&t, 0);
+    time_base_ = t.tv_sec + t.tv_usec / 1e6;
+}
+
+void dccl::MessageGenerator::set_presence_probability(double probability, MessagePart part)
+{
+    if(!(probability >= 0 && probability <= 1))
+        throw(Exception("Presence probability must be within [0, 1], not " + boost::lexical_cast<std::string>(probability)));
+
+    if(part != BODY)
+        presence_[HEAD] = probability;
+    if(part != HEAD)
+        presence_[BODY] = probability;
+}
+
+void dccl::MessageGenerator::generate(Message* msg, Mode mode)
+{
+    msg->Clear();
+    fill(msg, plan(msg->GetDescriptor(), BODY), mode);
+}
+
+boost::shared_ptr<Message> dccl::MessageGenerator::generate(const Descriptor* desc, Mode mode)
+{
+    boost::shared_ptr<Message> msg = DynamicProtobufManager::new_protobuf_message(desc);
+    fill(msg.get(), plan(desc, BODY), mode);
+    return msg;
+}
+
+const dccl::MessageGenerator::MessagePlan& dccl::MessageGenerator::plan(const Descriptor* desc, MessagePart part)
+{
+    std::pair<const Descriptor*, MessagePart> key(desc, part);
+    std::map<std::pair<const Descriptor*, MessagePart>, MessagePlan>::const_iterator it = plans_.find(key);
+    if(it != plans_.end())
+        return it->second;
+
+    MessagePlan& fields = plans_[key];
+    for(int i = 0, n = desc->field_count(); i < n; ++i)
+    {
+        const FieldDescriptor* field = desc->field(i);
+        const DCCLFieldOptions& options = field->options().GetExtension(dccl::field);
+        if(options.omit())
+            continue;
+
+        FieldPlan field_plan;
+        field_plan.field = field;
+        field_plan.part = (part == HEAD || options.in_head()) ? HEAD : BODY;
+        field_plan.kind = FieldPlan::VALUE;
+        field_plan.min = options.min();
+        field_plan.max = options.max();
+        field_plan.factor = std::pow(10.0, options.precision());
+        field_plan.max_length = options.max_length();
+        field_plan.max_repeat = field->is_repeated() ? options.max_repeat() : 1;
+        field_plan.static_number = 0;
+        field_plan.static_enum = 0;
+        field_plan.time_units = 1;
+        field_plan.embedded = 0;
+
+        // bounds that cannot be met are left to the codec to report
+        if(!options.has_min() || !options.has_max() || options.max() < options.min())
+            field_plan.min = field_plan.max = 0;
+
+        const std::string& codec = options.codec();
+        if((codec == "_static" || codec == "dccl.static2") &&
+           (is_number(field) || field->cpp_type() == FieldDescriptor::CPPTYPE_STRING))
+        {
+            field_plan.kind = FieldPlan::STATIC;
+            field_plan.static_string = options.static_value();
+            if(is_number(field))
+            {
+                try { field_plan.static_number = boost::lexical_cast<double>(options.static_value()); }
+                catch(boost::bad_lexical_cast&) { }
+            }
+        }
+        else if((codec == "_time" || codec == "dccl.time2") &&
+                (field->cpp_type() == FieldDescriptor::CPPTYPE_DOUBLE ||
+                 field->cpp_type() == FieldDescriptor::CPPTYPE_INT64 ||
+                 field->cpp_type() == FieldDescriptor::CPPTYPE_UINT64))
+        {
+            // as for v2::TimeCodec: integer times are in microseconds, with whole seconds unless (dccl.field).precision is given
+            field_plan.kind = FieldPlan::TIME;
+            field_plan.time_units = (field->cpp_type() == FieldDescriptor::CPPTYPE_DOUBLE) ? 1 : 1e6;
+            field_plan.factor = options.has_precision() ? std::pow(10.0, options.precision()) * field_plan.time_units : 1;
+        }
+
+        fields.push_back(field_plan);
+    }
+
+    // after the fields are all added, as this may add to plans_ (but does not invalidate `fields`)
+    for(MessagePlan::iterator it = fields.begin(), end = fields.end(); it != end; ++it)
+    {
+        if(it->field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE)
+            it->embedded = &plan(it->field->message_type(), it->part);
+    }
+    return fields;
+}
+
+void dccl::MessageGenerator::fill(Message* msg, const MessagePlan& fields, Mode mode)
+{
+    for(MessagePlan::const_iterator it = fields.begin(), end = fields.end(); it != end; ++it)
+    {
+        const FieldDescriptor* field = it->field;
+        if(field->is_repeated())
+        {
+            for(unsigned i = 0, n = (mode == MAX_SIZE) ? it->max_repeat : uniform(it->max_repeat); i < n; ++i)
+                fill_field(msg, *it, mode);
+        }
+        // static fields always decode to static_value, so are always set
+        else if(field->is_required() || mode == MAX_SIZE || it->kind == FieldPlan::STATIC || present(it->part))
+        {
+            fill_field(msg, *it, mode);
+        }
+    }
+}
+
+void dccl::MessageGenerator::fill_field(Message* msg, const FieldPlan& plan, Mode mode)
+{
+    const FieldDescriptor* field = plan.field;
+    const Reflection* refl = msg->GetReflection();
+    const bool repeated = field->is_repeated();
+
+    switch(field->cpp_type())
+    {
+        case FieldDescriptor::CPPTYPE_BOOL:
+        {
+            bool value = (mode == MAX_SIZE) || (rng_() & 1);
+            repeated ? refl->AddBool(msg, field, value) : refl->SetBool(msg, field, value);
+            break;
+        }
+        case FieldDescriptor::CPPTYPE_ENUM:
+        {
+            const google::protobuf::EnumDescriptor* enum_desc = field->enum_type();
+            int index = (mode == MAX_SIZE) ? enum_desc->value_count() - 1 : uniform(enum_desc->value_count() - 1);
+            repeated ? refl->AddEnum(msg, field, enum_desc->value(index)) : refl->SetEnum(msg, field, enum_desc->value(index));
+            break;
+        }
+        case FieldDescriptor::CPPTYPE_STRING:
+        {
+            std::string value;
+            if(plan.kind == FieldPlan::STATIC)
+            {
+                value = plan.static_string;
+            }
+            else
+            {
+                // the default bytes codecs are of fixed size, padding shorter values with zeros,
+                // and the default string codecs decode an empty string as not set
+                const bool bytes = (field->type() == FieldDescriptor::TYPE_BYTES);
+                if(mode == MAX_SIZE || bytes || plan.max_length == 0)
+                    value.resize(plan.max_length);
+                else
+                    value.resize(1 + uniform(plan.max_length - 1));
+                for(std::string::iterator it = value.begin(), end = value.end(); it != end; ++it)
+                    *it = bytes ? static_cast<char>(rng_() & 0xFF) : static_cast<char>('a' + uniform('z' - 'a'));
+            }
+            repeated ? refl->AddString(msg, field, value) : refl->SetString(msg, field, value);
+            break;
+        }
+        case FieldDescriptor::CPPTYPE_MESSAGE:
+        {
+            Message* embedded = repeated ? refl->AddMessage(msg, field) : refl->MutableMessage(msg, field);
+            fill(embedded, *plan.embedded, mode);
+            // an empty optional message decodes as not set
+            if(field->is_optional())
+            {
+                std::vector<const FieldDescriptor*> set_fields;
+                embedded->GetReflection()->ListFields(*embedded, &set_fields);
+                if(set_fields.empty())
+                    refl->ClearField(msg, field);
+            }
+            break;
+        }
+        default:
+            set_number(msg, field, number(plan, mode));
+            break;
+    }
+}
+
+double dccl::MessageGenerator::number(const FieldPlan& plan, Mode mode)
+{
+    switch(plan.kind)
+    {
+        case FieldPlan::STATIC:
+            return plan.static_number;
+
+        case FieldPlan::TIME:
+        {
+            double seconds = time_base_ -
+                boost::random::uniform_real_distribution<double>(0, TIME_WINDOW)(rng_);
+            return std::floor(seconds * plan.factor) / plan.factor * plan.time_units;
+        }
+
+        case FieldPlan::VALUE:
+        default:
+        {
+            // the default codecs use the same number of bits for any value within the bounds
+            if(mode == MAX_SIZE || plan.max == plan.min)
+                return plan.max;
+
+            double value = boost::random::uniform_real_distribution<double>(plan.min, plan.max)(rng_);
+            // quantize to the precision, keeping within the bounds
+            value = std::floor(value * plan.factor + 0.5) / plan.factor;
+            if(value > plan.max)
+                value -= 1 / plan.factor;
+            if(value < plan.min)
+                value += 1 / plan.factor;
+            return value;
+        }
+    }
+}
+
+bool dccl::MessageGenerator::present(MessagePart part)
+{
+    // rng_() is uniform over [0, 2^32)
+    return rng_() < presence_[part] * 4294967296.0;
+}
+
+unsigned dccl::MessageGenerator::uniform(unsigned max)
+{
+    return boost::random::uniform_int_distribution<unsigned>(0, max)(rng_);
+}
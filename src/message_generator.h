@@ -0,0 +1,142 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLMESSAGEGENERATOR20261019H
+#define DCCLMESSAGEGENERATOR20261019H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include "dccl/common.h"
+#include "dccl/internal/field_codec_message_stack.h"
+
+namespace dccl
+{
+    /// \brief Generates random instances of DCCL messages, e.g. as input for benchmarks and load tests
+    ///
+    /// Values respect the (dccl.field) options of the message: numbers are within min and max and quantized to precision, strings have from one to max_length characters and bytes are of max_length (as the default bytes codecs are of fixed size), repeated fields have no more than max_repeat values, enumerations take one of their defined values, fields with the static codec ("_static" or "dccl.static2") are always set to static_value (which is what they decode to), and fields with the time codec ("_time" or "dccl.time2") are set to a time within the hour before the time base (by default, when the generator was created; see set_time_base()). Omitted fields are left unset. Optional fields (and optional embedded messages) are set with a configurable probability, which can differ between the header (in_head) and body.
+    ///
+    /// Field codecs other than the defaults may place constraints on their values that are not known here, so the messages are not guaranteed to encode unless the message uses only the default codecs.
+    ///
+    /// The sequence of messages depends only on the seed, the time base and the options, so is repeatable. A generator may not be used from more than one thread at a time.
+    class MessageGenerator
+    {
+      public:
+        /// \brief Kind of instance to generate
+        enum Mode
+        {
+            /// values, lengths, repeat counts and presence are chosen at random
+            RANDOM,
+            /// every field is set, with strings and bytes of max_length and repeated fields of max_repeat values, so that the message encodes to Codec::max_size() (for messages using the default codecs)
+            MAX_SIZE
+        };
+
+        enum { DEFAULT_SEED = 5489 };
+
+        /// \brief Create a generator
+        ///
+        /// \param seed Seed for the random number generator
+        explicit MessageGenerator(unsigned seed = DEFAULT_SEED);
+
+        /// \brief Restart the sequence of messages from the given seed
+        void seed(unsigned seed) { rng_.seed(seed); }
+
+        /// \brief Set the probability that optional fields are set (default 0.5)
+        ///
+        /// \param probability From 0 (never set) to 1 (always set)
+        /// \param part Part of the message this applies to (HEAD for in_head fields, BODY for the rest), or UNKNOWN for both
+        /// \throw Exception If the probability is not within [0, 1]
+        void set_presence_probability(double probability, MessagePart part = UNKNOWN);
+
+        /// \brief Set the time that time fields are generated before (by default, the time the generator was created)
+        ///
+        /// The time codecs only encode the time of day, which is decoded to the time nearest to now, so messages generated with a time base far from now decode to a different time.
+        /// \param seconds Seconds since the UNIX epoch
+        void set_time_base(double seconds) { time_base_ = seconds; }
+
+        /// \brief Clear `msg` and fill it with generated values
+        ///
+        /// Reusing the same message for each call avoids allocating a new one each time.
+        /// \param msg Message to fill
+        /// \param mode Kind of instance to generate
+        void generate(google::protobuf::Message* msg, Mode mode = RANDOM);
+
+        /// \brief Generate a new message of the given type
+        ///
+        /// \param desc Message type (as found by DynamicProtobufManager::find_descriptor() or MessageType::descriptor())
+        /// \param mode Kind of instance to generate
+        boost::shared_ptr<google::protobuf::Message> generate(const google::protobuf::Descriptor* desc, Mode mode = RANDOM);
+
+      private:
+        struct FieldPlan;
+        typedef std::vector<FieldPlan> MessagePlan;
+
+        // what to generate for a field, computed once from its (dccl.field) options
+        struct FieldPlan
+        {
+            enum Kind { VALUE, STATIC, TIME };
+
+            const google::protobuf::FieldDescriptor* field;
+            MessagePart part;
+            Kind kind;
+            double min;
+            double max;
+            // 10^precision
+            double factor;
+            unsigned max_length;
+            unsigned max_repeat;
+            // for STATIC: the value of static_value, parsed for the type of the field
+            double static_number;
+            const google::protobuf::EnumValueDescriptor* static_enum;
+            std::string static_string;
+            // for TIME: the number of field units per second
+            double time_units;
+            // for embedded messages
+            const MessagePlan* embedded;
+        };
+
+        const MessagePlan& plan(const google::protobuf::Descriptor* desc, MessagePart part);
+        void fill(google::protobuf::Message* msg, const MessagePlan& fields, Mode mode);
+        void fill_field(google::protobuf::Message* msg, const FieldPlan& plan, Mode mode);
+        double number(const FieldPlan& plan, Mode mode);
+        bool present(MessagePart part);
+        unsigned uniform(unsigned max);
+
+      private:
+        boost::random::mt19937 rng_;
+        // indexed by HEAD and BODY
+        double presence_[2];
+        // seconds since the UNIX epoch
+        double time_base_;
+        // by type and the part it is in, as embedded messages in the header are entirely in the header
+        std::map<std::pair<const google::protobuf::Descriptor*, MessagePart>, MessagePlan> plans_;
+    };
+}
+
+#endif
@@ -0,0 +1,282 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#include <cmath>
+
+#include "field_codec_range.h"
+#include "dccl/field_codec_manager.h"
+
+using dccl::dlog;
+using namespace dccl::logger;
+using dccl::arith::Model;
+
+const int dccl::range::RangeCoder::RANGE_BITS;
+const dccl::uint64 dccl::range::RangeCoder::TOP;
+const dccl::uint64 dccl::range::RangeCoder::BOTTOM;
+
+// shared library load
+extern "C"
+{
+    void dccl3_load(dccl::Codec* dccl)
+    {
+        dccl_range_load(dccl);
+    }
+
+    void dccl_range_load(dccl::Codec* dccl)
+    {
+        using namespace dccl;
+        using namespace dccl::range;
+                    
+        FieldCodecManager::add<RangeFieldCodec<int32> >("_range");
+        FieldCodecManager::add<RangeFieldCodec<int64> >("_range");
+        FieldCodecManager::add<RangeFieldCodec<uint32> >("_range");
+        FieldCodecManager::add<RangeFieldCodec<uint64> >("_range");
+        FieldCodecManager::add<RangeFieldCodec<double> >("_range");
+        FieldCodecManager::add<RangeFieldCodec<float> >("_range");
+        FieldCodecManager::add<RangeFieldCodec<bool> >("_range");
+        FieldCodecManager::add<RangeFieldCodec<const google::protobuf::EnumValueDescriptor*> >("_range");
+
+        FieldCodecManager::add<RangeFieldCodec<int32> >("dccl.range");
+        FieldCodecManager::add<RangeFieldCodec<int64> >("dccl.range");
+        FieldCodecManager::add<RangeFieldCodec<uint32> >("dccl.range");
+        FieldCodecManager::add<RangeFieldCodec<uint64> >("dccl.range");
+        FieldCodecManager::add<RangeFieldCodec<double> >("dccl.range");
+        FieldCodecManager::add<RangeFieldCodec<float> >("dccl.range");
+        FieldCodecManager::add<RangeFieldCodec<bool> >("dccl.range");
+        FieldCodecManager::add<RangeFieldCodec<const google::protobuf::EnumValueDescriptor*> >("dccl.range");
+    }
+    
+    void dccl3_unload(dccl::Codec* dccl)
+    {
+        dccl_range_unload(dccl);
+    }
+    
+    void dccl_range_unload(dccl::Codec* dccl)
+    {
+        using namespace dccl;
+        using namespace dccl::range;
+                    
+        FieldCodecManager::remove<RangeFieldCodec<int32> >("_range");
+        FieldCodecManager::remove<RangeFieldCodec<int64> >("_range");
+        FieldCodecManager::remove<RangeFieldCodec<uint32> >("_range");
+        FieldCodecManager::remove<RangeFieldCodec<uint64> >("_range");
+        FieldCodecManager::remove<RangeFieldCodec<double> >("_range");
+        FieldCodecManager::remove<RangeFieldCodec<float> >("_range");
+        FieldCodecManager::remove<RangeFieldCodec<bool> >("_range");
+        FieldCodecManager::remove<RangeFieldCodec<const google::protobuf::EnumValueDescriptor*> >("_range");
+
+        FieldCodecManager::remove<RangeFieldCodec<int32> >("dccl.range");
+        FieldCodecManager::remove<RangeFieldCodec<int64> >("dccl.range");
+        FieldCodecManager::remove<RangeFieldCodec<uint32> >("dccl.range");
+        FieldCodecManager::remove<RangeFieldCodec<uint64> >("dccl.range");
+        FieldCodecManager::remove<RangeFieldCodec<double> >("dccl.range");
+        FieldCodecManager::remove<RangeFieldCodec<float> >("dccl.range");
+        FieldCodecManager::remove<RangeFieldCodec<bool> >("dccl.range");
+        FieldCodecManager::remove<RangeFieldCodec<const google::protobuf::EnumValueDescriptor*> >("dccl.range");
+    }
+}
+
+namespace
+{
+    // add one to the bytes already output (low has overflowed TOP)
+    void propagate_carry(std::vector<unsigned char>* bytes)
+    {
+        std::vector<unsigned char>::iterator it = bytes->end();
+        while(*(--it) == 0xFF)
+            *it = 0;
+        ++(*it);
+    }
+}
+
+unsigned dccl::range::RangeCoder::encode(Model& model,
+                                         const std::vector<Model::value_type>& values,
+                                         unsigned max_repeat,
+                                         bool update_model,
+                                         std::vector<unsigned char>* bytes)
+{
+    bytes->clear();
+    
+    uint64 low = 0;
+    uint64 range = TOP;
+    
+    for(unsigned value_index = 0; value_index < max_repeat; ++value_index)
+    {
+        Model::symbol_type symbol = Model::EOF_SYMBOL;
+        if(value_index < values.size())
+            symbol = model.value_to_symbol(values[value_index]);
+
+        // if out-of-range is given no frequency, end encoding
+        if(symbol == Model::OUT_OF_RANGE_SYMBOL &&
+           model.user_model().out_of_range_frequency() == 0)
+        {
+            dlog.is(DEBUG2) && dlog << "(RangeFieldCodec) out of range symbol, but no frequency given; ending encoding" << std::endl;
+            symbol = Model::EOF_SYMBOL;
+        }
+        
+        const bool end = (symbol == Model::EOF_SYMBOL);
+
+        // if EOF_SYMBOL is given no frequency, fill with the most probable symbol
+        if(symbol == Model::EOF_SYMBOL &&
+           model.user_model().eof_frequency() == 0)
+        {
+            symbol = std::max_element(model.user_model().frequency().begin(), model.user_model().frequency().end()) - model.user_model().frequency().begin();
+        }
+
+        const std::pair<Model::freq_type, Model::freq_type> c_freq_range =
+            model.symbol_to_cumulative_freq(symbol, Model::ENCODER);
+
+        dlog.is(DEBUG3) && dlog << "(RangeFieldCodec) symbol: " << symbol << ", cumulative freq: ["<< c_freq_range.first << "," << c_freq_range.second << ")" << std::endl;
+        
+        const uint64 r = range / model.total_freq(Model::ENCODER);
+        if(r == 0)
+            throw(Exception("(RangeFieldCodec) model total frequency is too large"));
+        
+        low += r*c_freq_range.first;
+        range = r*(c_freq_range.second - c_freq_range.first);
+
+        if(low >= TOP)
+        {
+            propagate_carry(bytes);
+            low -= TOP;
+        }
+        
+        while(range < BOTTOM)
+        {
+            bytes->push_back(static_cast<unsigned char>(low >> (RANGE_BITS - 8)));
+            low = (low << 8) & (TOP - 1);
+            range <<= 8;
+        }
+        
+        if(update_model)
+            model.update_model(symbol, Model::ENCODER);
+
+        if(end && model.user_model().eof_frequency() != 0)
+            break;
+    }
+
+    // shortest value (with zeros following) in [low, low + range)
+    int n = 0;
+    uint64 v = low;
+    for(; n < RANGE_BITS; ++n)
+    {
+        const uint64 unit = static_cast<uint64>(1) << (RANGE_BITS - n);
+        v = (low + unit - 1) & ~(unit - 1);
+        if(v - low < range)
+            break;
+    }
+    if(n == RANGE_BITS)
+        v = low;
+
+    if(v >= TOP)
+    {
+        propagate_carry(bytes);
+        v -= TOP;
+    }
+
+    unsigned size = bytes->size()*8 + n;
+    for(int i = RANGE_BITS - 8; i > RANGE_BITS - 8 - n; i -= 8)
+        bytes->push_back(static_cast<unsigned char>(v >> i));
+
+    // the decoder reads missing bits as zero
+    while(size > 0 && !((*bytes)[(size-1) >> 3] & (0x80 >> ((size-1) & 7))))
+        --size;
+    bytes->resize((size + 7) >> 3);
+
+    dlog.is(DEBUG3) && dlog << "(RangeFieldCodec) stream size: " << size << " bits" << std::endl;
+    
+    return size;
+}
+
+std::vector<Model::value_type> dccl::range::RangeCoder::decode(Model& model,
+                                                               const std::vector<unsigned char>& bytes,
+                                                               unsigned max_repeat)
+{
+    std::vector<Model::value_type> values;
+    
+    std::vector<unsigned char>::const_iterator byte_it = bytes.begin(), byte_end = bytes.end();
+    
+    uint64 range = TOP;
+    uint64 code = 0; // offset of the stream value from the low end of the interval
+    for(int i = 0; i < RANGE_BITS; i += 8)
+        code = (code << 8) | ((byte_it != byte_end) ? *(byte_it++) : 0);
+    
+    for(unsigned value_index = 0; value_index < max_repeat; ++value_index)
+    {
+        const Model::freq_type total = model.total_freq(Model::DECODER);
+        const uint64 r = range / total;
+        if(r == 0)
+            throw(Exception("(RangeFieldCodec) model total frequency is too large"));
+        
+        const uint64 c_freq = code / r;
+        if(c_freq >= total)
+            throw(Exception("(RangeFieldCodec) invalid stream"));
+        
+        const Model::symbol_type symbol =
+            model.cumulative_freq_to_symbol(std::make_pair(static_cast<Model::freq_type>(c_freq), static_cast<Model::freq_type>(c_freq)), Model::DECODER).first;
+        
+        const std::pair<Model::freq_type, Model::freq_type> c_freq_range =
+            model.symbol_to_cumulative_freq(symbol, Model::DECODER);
+
+        dlog.is(DEBUG3) && dlog << "(RangeFieldCodec) symbol: " << symbol << ", cumulative freq: ["<< c_freq_range.first << "," << c_freq_range.second << ")" << std::endl;
+
+        code -= r*c_freq_range.first;
+        range = r*(c_freq_range.second - c_freq_range.first);
+
+        while(range < BOTTOM)
+        {
+            code = (code << 8) | ((byte_it != byte_end) ? *(byte_it++) : 0);
+            range <<= 8;
+        }
+        
+        model.update_model(symbol, Model::DECODER);
+        
+        if(symbol == Model::EOF_SYMBOL)
+            break;
+        
+        values.push_back(model.symbol_to_value(symbol));
+    }
+    
+    return values;
+}
+
+unsigned dccl::range::RangeCoder::max_bits(const Model& model, unsigned max_repeat)
+{
+    using dccl::log2;
+
+    const dccl::arith::protobuf::ArithmeticModel& user = model.user_model();
+    
+    Model::freq_type total = user.eof_frequency() + user.out_of_range_frequency();
+    for(int i = 0, n = user.frequency_size(); i < n; ++i)
+        total += user.frequency(i);
+
+    // as for ArithmeticFieldCodec::max_size_repeated(): all least probable symbols, or all but one plus EOF
+    Model::freq_type lowest_frequency = *std::min_element(user.frequency().begin(), user.frequency().end());
+    if(user.out_of_range_frequency() != 0)
+        lowest_frequency = std::min(lowest_frequency, user.out_of_range_frequency());
+
+    double worst = max_repeat*(log2(total)-log2(lowest_frequency));
+    if(user.eof_frequency() != 0)
+        worst = std::max(worst, (max_repeat-1)*(log2(total)-log2(lowest_frequency)) + log2(total)-log2(user.eof_frequency()));
+
+    // each symbol loses at most log2(1/(1-total/BOTTOM)) (< 1/512) bits to the truncated division,
+    // and terminating the stream takes at most one bit more than the final interval
+    return static_cast<unsigned>(std::ceil(worst + max_repeat/512.0)) + 2;
+}
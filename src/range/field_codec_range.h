@@ -0,0 +1,232 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef DCCLFIELDCODECRANGE20261019H
+#define DCCLFIELDCODECRANGE20261019H
+
+#include <vector>
+
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+#include "dccl/internal/bit_ops.h"
+
+extern "C"
+{
+    void dccl3_load(dccl::Codec* dccl);
+    void dccl3_unload(dccl::Codec* dccl);
+    void dccl_range_load(dccl::Codec* dccl);
+    void dccl_range_unload(dccl::Codec* dccl);
+}
+
+namespace dccl
+{
+    /// DCCL Range Coder Library namespace: a byte-oriented alternative to the bit-serial coder in dccl::arith, using the same models (dccl::arith::ModelManager) and field options ((dccl.field).arithmetic)
+    namespace range
+    {
+        /// \brief Byte-oriented range coder (with carry propagation) over the symbols of a dccl::arith::Model.
+        ///
+        /// The interval is kept in RANGE_BITS bits and renormalized a byte at a time, so the per-symbol work is one division and a few multiplications regardless of the number of bits produced. The stream is terminated with the shortest bit string that falls in the final interval, followed (implicitly) by zeros, so trailing zero bits are never stored.
+        class RangeCoder
+        {
+          public:
+            static const int RANGE_BITS = 48;
+            static const uint64 TOP = static_cast<uint64>(1) << RANGE_BITS;
+            // renormalize when the range falls below this (so range / total_freq keeps at least RANGE_BITS - 8 - arith::Model::FREQUENCY_BITS bits of precision)
+            static const uint64 BOTTOM = static_cast<uint64>(1) << (RANGE_BITS - 8);
+
+            /// \brief Encode `values` (followed by an EOF symbol if fewer than `max_repeat`)
+            ///
+            /// \param model Model to code with (updated if adaptive and `update_model` is true)
+            /// \param values Values to encode
+            /// \param max_repeat Maximum number of values
+            /// \param update_model Update adaptive models after each symbol
+            /// \param bytes Filled with the stream, most significant bit of each byte first
+            /// \return Number of bits of `bytes` used (the remaining bits are zero)
+            static unsigned encode(arith::Model& model,
+                                   const std::vector<arith::Model::value_type>& values,
+                                   unsigned max_repeat,
+                                   bool update_model,
+                                   std::vector<unsigned char>* bytes);
+
+            /// \brief Decode a stream created by encode() (`bytes` may be shorter than the stream, as missing bytes are zero)
+            static std::vector<arith::Model::value_type> decode(arith::Model& model,
+                                                                const std::vector<unsigned char>& bytes,
+                                                                unsigned max_repeat);
+
+            /// \brief Upper bound on the bits returned by encode() for `max_repeat` values, using the frequencies given to ModelManager::set_model()
+            static unsigned max_bits(const arith::Model& model, unsigned max_repeat);
+        };
+
+        /// \brief Field codec using RangeCoder. The encoded field is the length of the stream (in bits) followed by the stream, so that decoding takes exactly the bits that were encoded.
+        ///
+        /// Compared to dccl::arith::ArithmeticFieldCodec, this costs the length prefix (ceil(log2(max stream bits + 1)) bits) per field, but codes a byte at a time rather than a bit at a time. As with the arithmetic codec, adaptive models that drift far from their initial frequencies can exceed the maximum size (an Exception is thrown on encode).
+        template<typename FieldType = arith::Model::value_type>   
+            class RangeFieldCodecBase : public RepeatedTypedFieldCodec<arith::Model::value_type, FieldType>
+        {   
+          public:
+            Bitset encode_repeated(const std::vector<arith::Model::value_type>& wire_value)
+            {
+                arith::ModelLock lock;
+                std::vector<unsigned char> bytes;
+                const unsigned stream_size = RangeCoder::encode(current_model(), wire_value, max_repeat(), true, &bytes);
+
+                const unsigned length_bits = length_size();
+                if(stream_size >= (static_cast<uint64>(1) << length_bits))
+                    throw(Exception("(RangeFieldCodec) encoded field exceeds maximum size of " + boost::lexical_cast<std::string>(max_stream_size()) + " bits (adaptive model has diverged too far from its initial frequencies?)"));
+
+                // the length followed by the stream (written most significant bit first by RangeCoder) in Bitset byte order, so that the Bitset is filled from whole bytes
+                std::vector<unsigned char> field_bytes(ceil_bits2bytes(length_bits + bytes.size() * BITS_IN_BYTE), 0);
+                internal::write_bits(&field_bytes[0], 0, length_bits, stream_size);
+                for(std::size_t i = 0, n = bytes.size(); i < n; ++i)
+                    internal::write_bits(&field_bytes[0], length_bits + i * BITS_IN_BYTE, BITS_IN_BYTE, internal::reverse_bits(bytes[i]));
+
+                Bitset bits;
+                bits.from_byte_stream(field_bytes.begin(), field_bytes.end());
+                bits.resize(length_bits + stream_size);
+                return bits;
+            }
+
+            std::vector<arith::Model::value_type> decode_repeated(Bitset* bits)
+            {
+                arith::ModelLock lock;
+
+                // min_size_repeated() bits (the length prefix) have already been read
+                const unsigned length_bits = length_size();
+                const unsigned stream_size = bits->to<unsigned>();
+                
+                bits->get_more_bits(stream_size);
+
+                // take whole bytes out of the Bitset, then put the stream back in RangeCoder's bit order
+                const std::string field_string = bits->to_byte_string();
+                const unsigned char* field_bytes = reinterpret_cast<const unsigned char*>(field_string.data());
+                std::vector<unsigned char> bytes(ceil_bits2bytes(stream_size));
+                for(std::size_t i = 0, n = bytes.size(); i < n; ++i)
+                {
+                    const unsigned offset = i * BITS_IN_BYTE;
+                    bytes[i] = internal::reverse_bits(internal::read_bits(field_bytes, length_bits + offset, std::min(BITS_IN_BYTE, stream_size - offset)));
+                }
+                
+                return RangeCoder::decode(current_model(), bytes, max_repeat());
+            }
+
+            unsigned size_repeated(const std::vector<arith::Model::value_type>& wire_values)
+            {
+                arith::ModelLock lock;
+                arith::Model& model = current_model();
+                std::vector<unsigned char> bytes;
+                if(model.user_model().is_adaptive())
+                {
+                    // the stream depends on the updates made after each symbol, so make them and undo them afterwards
+                    arith::Model::ScratchScope scratch(&model);
+                    return length_size() + RangeCoder::encode(model, wire_values, max_repeat(), true, &bytes);
+                }
+                return length_size() + RangeCoder::encode(model, wire_values, max_repeat(), false, &bytes);
+            }
+
+            unsigned max_size_repeated()
+            { return length_size() + max_stream_size(); }
+
+            unsigned min_size_repeated()
+            { return length_size(); }
+
+            bool adaptive()
+            {
+                arith::ModelLock lock;
+                return current_model().user_model().is_adaptive();
+            }
+
+            std::string validation_state()
+            {
+                arith::ModelLock lock;
+                return current_model().user_model().SerializeAsString();
+            }
+
+            void validate()
+            {
+                FieldCodecBase::require(FieldCodecBase::dccl_field_options().HasExtension(::arithmetic),
+                                        "missing (dccl.field).arithmetic");
+
+                std::string model_name = FieldCodecBase::dccl_field_options().GetExtension(::arithmetic).model();
+                try
+                {
+                    arith::ModelManager::find(model_name);
+                }
+                catch(Exception& e)
+                {
+                    FieldCodecBase::require(false, "no such (dccl.field).arithmetic.model called \"" + model_name + "\" loaded.");
+                }
+
+                FieldCodecBase::require(!FieldCodecBase::dccl_field_options().GetExtension(::arithmetic).context_model_size(),
+                                        "(dccl.field).arithmetic.context_model is not supported by the range coder");
+            }
+
+          private:
+            unsigned max_stream_size()
+            {
+                arith::ModelLock lock;
+                return RangeCoder::max_bits(current_model(), max_repeat());
+            }
+            
+            unsigned length_size()
+            { return dccl::ceil_log2(max_stream_size() + 1); }
+            
+            unsigned max_repeat()
+            {
+                return FieldCodecBase::this_field()->is_repeated() ? FieldCodecBase::dccl_field_options().max_repeat() : 1;
+            }
+
+            arith::Model& current_model()
+            { return arith::LinkModels::find_current(FieldCodecBase::this_field()); }
+        };
+
+        template<typename FieldType>   
+            class RangeFieldCodec : public RangeFieldCodecBase<FieldType>
+        {
+            arith::Model::value_type pre_encode(const FieldType& field_value)
+            { return static_cast<arith::Model::value_type>(field_value); }
+            
+            FieldType post_decode(const arith::Model::value_type& wire_value)
+            { return static_cast<FieldType>(wire_value); }
+        };
+        
+        template <>
+            class RangeFieldCodec<const google::protobuf::EnumValueDescriptor*> : public RangeFieldCodecBase<const google::protobuf::EnumValueDescriptor*>
+        {
+          public:
+            arith::Model::value_type pre_encode(const google::protobuf::EnumValueDescriptor* const& field_value)
+            { return field_value->number(); }
+            
+            const google::protobuf::EnumValueDescriptor* post_decode(const arith::Model::value_type& wire_value)
+            {
+                const google::protobuf::EnumDescriptor* e = FieldCodecBase::this_field()->enum_type();
+                const google::protobuf::EnumValueDescriptor* return_value = e->FindValueByNumber((int)wire_value);
+                
+                if(return_value)
+                    return return_value;
+                else
+                    throw NullValueException();
+            }
+        };   
+    }
+}
+
+#endif
@@ -0,0 +1,669 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef DCCLSTRUCTCODEC20170615H
+#define DCCLSTRUCTCODEC20170615H
+
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "dccl/binary.h"
+#include "dccl/bit_stream.h"
+#include "dccl/internal/field_codec_message_stack.h"
+#include "dccl/internal/quantize.h"
+
+namespace dccl
+{
+    /// \brief Describes a plain C++ struct to StructCodec. Specialize this for each struct to be encoded.
+    ///
+    /// The specialization gives the DCCL id and visits each field (in the order of the equivalent .proto message) with a description of its (dccl.field) options:
+    /// \code
+    /// namespace dccl
+    /// {
+    ///     template<> struct StructTraits<NavReport>
+    ///     {
+    ///         enum { DCCL_ID = 124 };
+    ///         template<typename Visitor, typename Struct>
+    ///             static void visit(Visitor& v, Struct& s)
+    ///         {
+    ///             v(s.x, structs::Numeric(-10000, 10000, 1));
+    ///             v(s.depth, structs::Numeric(0, 6000));   // s.depth is a boost::optional<double>
+    ///             v(s.waypoints, structs::Message().max_repeat(4));   // s.waypoints is a std::vector<Waypoint>
+    ///         }
+    ///     };
+    /// }
+    /// \endcode
+    /// Plain members correspond to `required` fields, boost::optional<T> members to `optional` fields and std::vector<T> members to `repeated` fields. Member types must be the C++ types protobuf uses for the field (e.g. `float` for `float`, dccl::int64 for `int64`) for the rounding to match.
+    template<typename Struct> struct StructTraits;
+
+    /// Field descriptions used by StructTraits specializations
+    namespace structs
+    {
+        /// \brief Options common to all fields: (dccl.field).in_head and (dccl.field).max_repeat
+        template<typename Derived>
+            class FieldSpec
+        {
+          public:
+          FieldSpec() : in_head_(false), max_repeat_(0) { }
+            
+            /// \brief Copy of this field description with (dccl.field).in_head = `in_head`
+            Derived in_head(bool in_head = true) const
+            {
+                Derived d(static_cast<const Derived&>(*this));
+                d.in_head_ = in_head;
+                return d;
+            }
+
+            /// \brief Copy of this field description with (dccl.field).max_repeat = `max_repeat`
+            Derived max_repeat(unsigned max_repeat) const
+            {
+                Derived d(static_cast<const Derived&>(*this));
+                d.max_repeat_ = max_repeat;
+                return d;
+            }
+            
+            bool is_in_head() const { return in_head_; }
+            unsigned repeat_limit() const { return max_repeat_; }
+            
+          private:
+            bool in_head_;
+            unsigned max_repeat_;
+        };
+
+        /// \brief Bounded numeric field (as v2::DefaultNumericFieldCodec): (dccl.field).min, max and precision
+        class Numeric : public FieldSpec<Numeric>
+        {
+          public:
+          Numeric(double min, double max, int precision = 0)
+              : min_(min),
+                max_(max),
+                precision_(precision)
+                { }
+
+            unsigned max_bits(bool required) const
+            { return dccl::ceil_log2((max_-min_)*std::pow(10.0, precision_)+1 + (required ? 0 : 1)); }
+            unsigned min_bits(bool required) const
+            { return max_bits(required); }
+            
+            template<typename T>
+                void encode(BitWriter& writer, const T& value, bool required) const
+            {
+                uint64 uint_value = 0;
+                // if out-of-bounds, send as zeros
+                internal::quantize(value, min_, max_, precision_, required, &uint_value);
+                writer.write(uint_value, max_bits(required));
+            }
+            
+            void encode_null(BitWriter& writer) const
+            { writer.write(0, max_bits(false)); }
+            
+            template<typename T>
+                bool decode(BitReader& reader, T* value, bool required) const
+            { return internal::unquantize(reader.read(max_bits(required)), min_, precision_, required, value); }
+            
+          private:
+            double min_;
+            double max_;
+            int precision_;
+        };
+
+        /// \brief Boolean field (as v2::DefaultBoolCodec)
+        class Bool : public FieldSpec<Bool>
+        {
+          public:
+            unsigned max_bits(bool required) const
+            { return required ? 1 : 2; }
+            unsigned min_bits(bool required) const
+            { return max_bits(required); }
+            
+            void encode(BitWriter& writer, bool value, bool required) const
+            { writer.write(required ? value : value + 1, max_bits(required)); }
+            
+            void encode_null(BitWriter& writer) const
+            { writer.write(0, max_bits(false)); }
+            
+            bool decode(BitReader& reader, bool* value, bool required) const
+            {
+                uint64 t = reader.read(max_bits(required));
+                if(!required)
+                {
+                    if(!t) return false;
+                    --t;
+                }
+                *value = t;
+                return true;
+            }
+        };
+
+        /// \brief Enumeration field (as v2::DefaultEnumCodec), encoded as the index of its value in `values`, which must list the values in the order they are declared in the .proto file.
+        template<typename Enum>
+            class Enumeration : public FieldSpec<Enumeration<Enum> >
+        {
+          public:
+            template<std::size_t N>
+                Enumeration(const Enum (&values)[N])
+                : values_(values),
+                count_(N)
+                { }
+            
+          Enumeration(const Enum* values, unsigned count)
+              : values_(values),
+                count_(count)
+                { }
+
+            unsigned max_bits(bool required) const
+            { return dccl::ceil_log2(count_ + (required ? 0 : 1)); }
+            unsigned min_bits(bool required) const
+            { return max_bits(required); }
+            
+            void encode(BitWriter& writer, Enum value, bool required) const
+            {
+                // the first value with this number, as google::protobuf::EnumDescriptor::FindValueByNumber()
+                uint64 index = 0;
+                for(unsigned i = 0; i < count_; ++i)
+                {
+                    if(values_[i] == value)
+                    {
+                        index = required ? i : i + 1;
+                        break;
+                    }
+                }
+                writer.write(index, max_bits(required));
+            }
+            
+            void encode_null(BitWriter& writer) const
+            { writer.write(0, max_bits(false)); }
+            
+            bool decode(BitReader& reader, Enum* value, bool required) const
+            {
+                uint64 index = reader.read(max_bits(required));
+                if(!required)
+                {
+                    if(!index) return false;
+                    --index;
+                }
+                if(index >= count_)
+                    return false;
+                *value = values_[index];
+                return true;
+            }
+
+          private:
+            const Enum* values_;
+            unsigned count_;
+        };
+
+        /// \brief Makes an Enumeration, deducing the enumeration type
+        template<typename Enum, std::size_t N>
+            Enumeration<Enum> enumeration(const Enum (&values)[N])
+        { return Enumeration<Enum>(values); }
+        
+        /// \brief Variable length string field (as v3::DefaultStringCodec): (dccl.field).max_length
+        class String : public FieldSpec<String>
+        {
+          public:
+          String(unsigned max_length)
+              : max_length_(max_length)
+            { }
+            
+            unsigned max_bits(bool required) const
+            { return min_bits(required) + max_length_ * BITS_IN_BYTE; }
+            unsigned min_bits(bool required) const
+            { return dccl::ceil_log2(max_length_ + 1); }
+            
+            void encode(BitWriter& writer, const std::string& value, bool required) const
+            {
+                // longer strings are truncated
+                std::size_t length = std::min<std::size_t>(value.size(), max_length_);
+                writer.write(length, min_bits(required));
+                writer.write_bytes(value.data(), length);
+            }
+            
+            void encode_null(BitWriter& writer) const
+            { writer.write(0, min_bits(false)); }
+            
+            bool decode(BitReader& reader, std::string* value, bool required) const
+            {
+                std::size_t length = reader.read(min_bits(required));
+                if(!length)
+                    return false;
+                value->resize(length);
+                reader.read_bytes(&(*value)[0], length);
+                return true;
+            }
+
+          private:
+            unsigned max_length_;
+        };
+
+        /// \brief Embedded message field (as v3::DefaultMessageCodec): a struct with its own StructTraits
+        class Message : public FieldSpec<Message>
+        { };
+
+        /// \brief Field encoded by a StaticFieldCodec child, whose (public) encode(), decode() and size methods are called directly. The member type is the codec's wire_type.
+        ///
+        /// The codec must not use the FieldCodecBase state that is only set inside Codec (e.g. this_field(), dccl_field_options() or use_required()): presence (for optional members) is left to the codec's own empty encode() and decode().
+        template<typename Codec>
+            class Custom : public FieldSpec<Custom<Codec> >
+        {
+          public:
+            typedef typename Codec::wire_type wire_type;
+            
+            unsigned max_bits(bool required) const
+            { return codec_.max_size(); }
+            unsigned min_bits(bool required) const
+            { return codec_.min_size(); }
+
+            void encode(BitWriter& writer, const wire_type& value, bool required) const
+            { codec_.encode(writer, value); }
+            
+            void encode_null(BitWriter& writer) const
+            { codec_.encode(writer); }
+            
+            bool decode(BitReader& reader, wire_type* value, bool required) const
+            { return codec_.decode(reader, value); }
+
+          private:
+            mutable Codec codec_;
+        };
+    }
+
+    namespace internal
+    {
+        /// \brief Tracks which part (head or body) of the message the fields visited belong to, as MessageStack and v3::DefaultMessageCodec::check_field()
+        class StructPass
+        {
+          protected:
+          StructPass(MessagePart pass)
+              : pass_(pass),
+                current_(UNKNOWN)
+                { }
+            
+            template<typename Spec>
+                bool in_part(const Spec& spec) const
+            {
+                if(current_ == UNKNOWN)
+                    return spec.is_in_head() == (pass_ == HEAD);
+                else
+                    return current_ == pass_;
+            }
+
+            // the part of the fields of an embedded message
+            MessagePart child_part(const structs::Message& spec) const
+            { return spec.is_in_head() ? HEAD : current_; }
+
+            template<typename Spec>
+                static unsigned repeat_limit(const Spec& spec)
+            {
+                if(!spec.repeat_limit())
+                    throw(Exception("StructCodec: missing max_repeat on a std::vector field"));
+                return spec.repeat_limit();
+            }
+            
+            MessagePart pass_;
+            MessagePart current_;
+        };
+        
+        class StructEncoder : public StructPass
+        {
+          public:
+          StructEncoder(BitWriter& writer, MessagePart pass)
+              : StructPass(pass),
+                writer_(writer)
+                { }
+            
+            template<typename T, typename Spec>
+                void operator()(const T& value, const Spec& spec)
+            {
+                if(in_part(spec))
+                    field(value, spec, true);
+            }
+
+            template<typename T, typename Spec>
+                void operator()(const boost::optional<T>& value, const Spec& spec)
+            {
+                if(!in_part(spec))
+                    return;
+                if(value)
+                    field(*value, spec, false);
+                else
+                    null(spec);
+            }
+
+            template<typename T, typename Spec>
+                void operator()(const std::vector<T>& values, const Spec& spec)
+            {
+                if(!in_part(spec))
+                    return;
+                // FieldCodecBase::any_encode_repeated(): the number of values precedes them
+                const unsigned max_repeat = repeat_limit(spec);
+                const std::size_t n = std::min<std::size_t>(values.size(), max_repeat);
+                writer_.write(n, dccl::ceil_log2(max_repeat + 1));
+                for(std::size_t i = 0; i < n; ++i)
+                    field(static_cast<const T&>(values[i]), spec, true);
+            }
+            
+          private:
+            template<typename T, typename Spec>
+                void field(const T& value, const Spec& spec, bool required)
+            { spec.encode(writer_, value, required); }
+
+            template<typename T>
+                void field(const T& value, const structs::Message& spec, bool required)
+            {
+                // presence bit
+                if(!required)
+                    writer_.write(1, 1);
+                MessagePart parent = current_;
+                current_ = child_part(spec);
+                StructTraits<T>::visit(*this, value);
+                current_ = parent;
+            }
+            
+            template<typename Spec>
+                void null(const Spec& spec)
+            { spec.encode_null(writer_); }
+            
+            void null(const structs::Message&)
+            { writer_.write(0, 1); }
+            
+          private:
+            BitWriter& writer_;
+        };
+
+        class StructDecoder : public StructPass
+        {
+          public:
+          StructDecoder(BitReader& reader, MessagePart pass)
+              : StructPass(pass),
+                reader_(reader),
+                set_fields_(0)
+                { }
+            
+            template<typename T, typename Spec>
+                void operator()(T& value, const Spec& spec)
+            {
+                if(!in_part(spec))
+                    return;
+                if(field(&value, spec, true))
+                    ++set_fields_;
+                else
+                    value = T();
+            }
+
+            template<typename T, typename Spec>
+                void operator()(boost::optional<T>& value, const Spec& spec)
+            {
+                if(!in_part(spec))
+                    return;
+                T decoded = T();
+                if(field(&decoded, spec, false))
+                {
+                    value = decoded;
+                    ++set_fields_;
+                }
+                else
+                {
+                    value = boost::none;
+                }
+            }
+            
+            template<typename T, typename Spec>
+                void operator()(std::vector<T>& values, const Spec& spec)
+            {
+                if(!in_part(spec))
+                    return;
+                const unsigned n = reader_.read(dccl::ceil_log2(repeat_limit(spec) + 1));
+                values.clear();
+                values.reserve(n);
+                for(unsigned i = 0; i < n; ++i)
+                {
+                    T decoded = T();
+                    // empty values are dropped (as TypeHelper's add_value()), but embedded messages are kept
+                    if(field(&decoded, spec, true) || is_message(spec))
+                        values.push_back(decoded);
+                }
+                if(!values.empty())
+                    ++set_fields_;
+            }
+            
+          private:
+            template<typename T, typename Spec>
+                bool field(T* value, const Spec& spec, bool required)
+            { return spec.decode(reader_, value, required); }
+
+            // returns false if the message is not present or has no fields set
+            template<typename T>
+                bool field(T* value, const structs::Message& spec, bool required)
+            {
+                if(!required && !reader_.read(1))
+                    return false;
+                MessagePart parent = current_;
+                unsigned parent_set_fields = set_fields_;
+                current_ = child_part(spec);
+                set_fields_ = 0;
+                StructTraits<T>::visit(*this, *value);
+                bool set = set_fields_ > 0;
+                current_ = parent;
+                set_fields_ = parent_set_fields;
+                return set;
+            }
+
+            template<typename Spec>
+                static bool is_message(const Spec&) { return false; }
+            static bool is_message(const structs::Message&) { return true; }
+            
+          private:
+            BitReader& reader_;
+            unsigned set_fields_;
+        };
+
+        /// \brief Computes the maximum and minimum sizes (in bits) of the fields of a struct
+        class StructMaxSize : public StructPass
+        {
+          public:
+          StructMaxSize(MessagePart pass)
+              : StructPass(pass),
+                max_bits_(0),
+                min_bits_(0)
+                { }
+            
+            template<typename T, typename Spec>
+                void operator()(const T& value, const Spec& spec)
+            {
+                if(in_part(spec))
+                    field(value, spec, true, &max_bits_, &min_bits_);
+            }
+
+            template<typename T, typename Spec>
+                void operator()(const boost::optional<T>&, const Spec& spec)
+            {
+                if(in_part(spec))
+                    field(T(), spec, false, &max_bits_, &min_bits_);
+            }
+
+            template<typename T, typename Spec>
+                void operator()(const std::vector<T>&, const Spec& spec)
+            {
+                if(!in_part(spec))
+                    return;
+                const unsigned max_repeat = repeat_limit(spec);
+                unsigned max_bits = 0, min_bits = 0;
+                field(T(), spec, true, &max_bits, &min_bits);
+                // FieldCodecBase::max_size_repeated() and min_size_repeated()
+                const unsigned size_bits = dccl::ceil_log2(max_repeat + 1);
+                max_bits_ += size_bits + max_repeat * max_bits;
+                min_bits_ += size_bits;
+            }
+
+            unsigned max_bits() const { return max_bits_; }
+            unsigned min_bits() const { return min_bits_; }
+            
+          private:
+            template<typename T, typename Spec>
+                void field(const T&, const Spec& spec, bool required, unsigned* max_bits, unsigned* min_bits)
+            {
+                *max_bits += spec.max_bits(required);
+                *min_bits += spec.min_bits(required);
+            }
+
+            template<typename T>
+                void field(const T& value, const structs::Message& spec, bool required, unsigned* max_bits, unsigned* min_bits)
+            {
+                MessagePart parent = current_;
+                unsigned parent_max_bits = max_bits_, parent_min_bits = min_bits_;
+                current_ = child_part(spec);
+                max_bits_ = min_bits_ = 0;
+                StructTraits<T>::visit(*this, value);
+                unsigned children_max_bits = max_bits_, children_min_bits = min_bits_;
+                current_ = parent;
+                max_bits_ = parent_max_bits;
+                min_bits_ = parent_min_bits;
+
+                // v3::DefaultMessageCodec::max_size() and min_size()
+                if(required)
+                {
+                    *max_bits += children_max_bits;
+                    *min_bits += children_min_bits;
+                }
+                else
+                {
+                    const unsigned presence_bit = 1;
+                    *max_bits += children_max_bits + presence_bit;
+                    *min_bits += presence_bit;
+                }
+            }
+            
+          private:
+            unsigned max_bits_;
+            unsigned min_bits_;
+        };
+    }
+    
+    /// \brief Encodes and decodes plain C++ structs described by StructTraits, producing the same bytes as Codec does for the equivalent DCCL (codec_version = 3) message using the default codecs and default identifier codec.
+    ///
+    /// Everything is resolved at compile time: no reflection, boost::any or virtual functions are used, and nothing is allocated during encoding into a caller supplied buffer.
+    /// \tparam Struct A (default constructible) struct with a StructTraits specialization
+    template<typename Struct>
+        class StructCodec
+    {
+      public:
+        /// \brief DCCL id of the struct
+        static int32 id() { return StructTraits<Struct>::DCCL_ID; }
+
+        /// \brief Maximum encoded size in bytes. As Codec::max_size(), this allows for the longest (two byte) identifier.
+        static unsigned max_size()
+        {
+            static const unsigned size = ceil_bits2bytes(2*BITS_IN_BYTE + head_bits(true)) + ceil_bits2bytes(body_bits(true));
+            return size;
+        }
+
+        /// \brief Minimum encoded size in bytes. As Codec::min_size(), this allows for the shortest (one byte) identifier.
+        static unsigned min_size()
+        {
+            static const unsigned size = ceil_bits2bytes(BITS_IN_BYTE + head_bits(false)) + ceil_bits2bytes(body_bits(false));
+            return size;
+        }
+        
+        /// \brief Encodes `s` into `bytes` (which holds `size` bytes). Throws Exception if the encoded message does not fit.
+        /// \return Number of bytes written
+        static std::size_t encode(const Struct& s, unsigned char* bytes, std::size_t size)
+        {
+            BitWriter writer(bytes, size);
+
+            // DefaultIdentifierCodec
+            const uint32 dccl_id = id();
+            if(dccl_id <= ONE_BYTE_MAX_ID)
+                writer.write(dccl_id << 1, BITS_IN_BYTE);
+            else
+                writer.write((dccl_id << 1) | 1, 2*BITS_IN_BYTE);
+            
+            internal::StructEncoder head(writer, HEAD);
+            StructTraits<Struct>::visit(head, s);
+            writer.align();
+            
+            internal::StructEncoder body(writer, BODY);
+            StructTraits<Struct>::visit(body, s);
+            writer.align();
+
+            return writer.bytes();
+        }
+
+        /// \brief Encodes `s`, replacing the contents of `bytes`
+        static void encode(std::string* bytes, const Struct& s)
+        {
+            bytes->resize(max_size());
+            bytes->resize(encode(s, reinterpret_cast<unsigned char*>(&(*bytes)[0]), bytes->size()));
+        }
+
+        /// \brief Decodes `size` bytes into `s`. Throws Exception if the bytes are not a message with this struct's id or are truncated.
+        /// \return Number of bytes consumed
+        static std::size_t decode(const unsigned char* bytes, std::size_t size, Struct* s)
+        {
+            BitReader reader(bytes, size);
+
+            uint32 dccl_id = reader.read(BITS_IN_BYTE);
+            if(dccl_id & 1)
+                dccl_id |= reader.read(BITS_IN_BYTE) << BITS_IN_BYTE;
+            dccl_id >>= 1;
+            if(static_cast<int32>(dccl_id) != id())
+                throw(Exception("StructCodec: message has id " + boost::lexical_cast<std::string>(dccl_id) + ", expected " + boost::lexical_cast<std::string>(id())));
+
+            *s = Struct();
+            internal::StructDecoder head(reader, HEAD);
+            StructTraits<Struct>::visit(head, *s);
+            reader.align();
+
+            internal::StructDecoder body(reader, BODY);
+            StructTraits<Struct>::visit(body, *s);
+            reader.align();
+            
+            return reader.bytes();
+        }
+
+        /// \brief Decodes `bytes` into `s`
+        static void decode(const std::string& bytes, Struct* s)
+        { decode(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size(), s); }
+        
+      private:
+        enum { ONE_BYTE_MAX_ID = (1 << 7) - 1 };
+
+        static unsigned head_bits(bool max)
+        {
+            const Struct s = Struct();
+            internal::StructMaxSize head(HEAD);
+            StructTraits<Struct>::visit(head, s);
+            return max ? head.max_bits() : head.min_bits();
+        }
+
+        static unsigned body_bits(bool max)
+        {
+            const Struct s = Struct();
+            internal::StructMaxSize body(BODY);
+            StructTraits<Struct>::visit(body, s);
+            return max ? body.max_bits() : body.min_bits();
+        }
+    };
+}
+
+#endif
@@ -67,8 +67,11 @@ void run_test(dccl::arith::protobuf::ArithmeticModel& model,
 
     
     std::cout << "Try encode..." << std::endl;
+    // before encoding, as encoding updates adaptive models
+    unsigned size = codec.size(msg_in);
     std::string bytes;
     codec.encode(&bytes, msg_in);
+    assert(size == bytes.size());
     std::cout << "... got bytes (hex): " << dccl::hex_encode(bytes) << std::endl;
 
     std::cout << "Try decode..." << std::endl;
@@ -83,6 +86,35 @@ void run_test(dccl::arith::protobuf::ArithmeticModel& model,
 }
 
 
+// model for values 0 ... symbols-1, with most of the probability on `peak` (or uniform if peak < 0)
+void set_peaked_model(const std::string& name, int peak, int symbols)
+{
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name(name);
+    model.set_eof_frequency(1);
+    for(int i = 0; i < symbols; ++i)
+    {
+        model.add_value_bound(i);
+        model.add_frequency((peak < 0) ? 10 : (i == peak ? 60 : (std::abs(i - peak) == 1 ? 15 : 1)));
+    }
+    model.add_value_bound(symbols);
+    dccl::arith::ModelManager::set_model(model);
+}
+
+template<typename Msg>
+std::string context_round_trip(dccl::Codec& codec, const Msg& msg_in)
+{
+    unsigned size = codec.size(msg_in);
+    std::string bytes;
+    codec.encode(&bytes, msg_in);
+    assert(size == bytes.size());
+    
+    Msg msg_out;
+    codec.decode(bytes, &msg_out);
+    assert(msg_in.SerializeAsString() == msg_out.SerializeAsString());
+    return bytes;
+}
+
 // usage: dccl_test10 [boolean: verbose]
 int main(int argc, char* argv[])
 {
@@ -365,7 +397,123 @@ int main(int argc, char* argv[])
         std::cout << "end random test #" << i << std::endl;
         
     }
-    
+
+    // adaptive models kept per link
+    {
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("model");
+        model.set_eof_frequency(1);
+        model.add_value_bound(0);
+        model.add_frequency(1); 
+        model.add_value_bound(1);
+        model.add_frequency(1); 
+        model.add_value_bound(2);
+        model.set_out_of_range_frequency(1);
+        model.set_is_adaptive(true);
+        dccl::arith::ModelManager::set_model(model);
+
+        ArithmeticDouble3TestMsg msg_in;
+        msg_in.add_value(0); 
+        msg_in.add_value(0); 
+        msg_in.add_value(0);
+        msg_in.add_value(1); 
+
+        codec.load(msg_in.GetDescriptor());
+
+        // (debug_assert compares each decode with the last encode, so decode straight after encoding)
+        dccl::arith::LinkModels link_a, link_b, rx;
+        ArithmeticDouble3TestMsg msg_out;
+        std::string a1, a2, a3, b1, restored;
+        {
+            dccl::arith::LinkScope scope(&link_a);
+            codec.encode(&a1, msg_in);
+        }
+        {
+            dccl::arith::LinkScope scope(&rx);
+            codec.decode(a1, &msg_out);
+            assert(msg_in.SerializeAsString() == msg_out.SerializeAsString());
+        }
+        
+        dccl::arith::LinkModels snapshot(link_a);
+        {
+            dccl::arith::LinkScope scope(&link_a);
+            codec.encode(&a2, msg_in);
+        }
+        {
+            // rx has followed link_a's sequence
+            dccl::arith::LinkScope scope(&rx);
+            msg_out.Clear();
+            codec.decode(a2, &msg_out);
+            assert(msg_in.SerializeAsString() == msg_out.SerializeAsString());
+        }
+        
+        {
+            // link_b starts from the set_model() frequencies, unaffected by link_a
+            dccl::arith::LinkScope scope(&link_b);
+            codec.encode(&b1, msg_in);
+        }
+        std::cout << "link a: " << dccl::hex_encode(a1) << " " << dccl::hex_encode(a2) << ", link b: " << dccl::hex_encode(b1) << std::endl;
+        assert(a1 == b1);
+        assert(a1 != a2);
+
+        link_a = snapshot;
+        {
+            dccl::arith::LinkScope scope(&link_a);
+            codec.encode(&restored, msg_in);
+        }
+        assert(restored == a2);
+
+        // reset() restarts the link's models
+        link_a.reset();
+        {
+            dccl::arith::LinkScope scope(&link_a);
+            codec.encode(&a3, msg_in);
+        }
+        assert(a3 == a1);
+    }
+
+    // context models
+    {
+        set_peaked_model("depth", -1, 2);
+        set_peaked_model("altitude", -1, 4);
+        set_peaked_model("altitude_shallow", 3, 4);
+        set_peaked_model("altitude_deep", 0, 4);
+        set_peaked_model("profile", -1, 4);
+        for(int i = 0; i < 4; ++i)
+            set_peaked_model("profile_" + boost::lexical_cast<std::string>(i), i, 4);
+
+        codec.load<ArithmeticContextTestMsg>();
+        codec.load<ArithmeticNoContextTestMsg>();
+
+        const int profile[] = { 0, 0, 1, 1, 2, 2, 3, 3, 3, 2, 2, 1, 1, 1, 0, 0 };
+        for(int depth = 0; depth < 2; ++depth)
+        {
+            ArithmeticContextTestMsg msg;
+            ArithmeticNoContextTestMsg no_context_msg;
+            msg.set_depth(depth);
+            no_context_msg.set_depth(depth);
+            msg.set_altitude(depth ? 0 : 3);
+            no_context_msg.set_altitude(depth ? 0 : 3);
+            for(int i = 0, n = sizeof(profile)/sizeof(int); i < n; ++i)
+            {
+                msg.add_profile(profile[i]);
+                no_context_msg.add_profile(profile[i]);
+            }
+            
+            std::string bytes = context_round_trip(codec, msg);
+            std::string no_context_bytes = context_round_trip(codec, no_context_msg);
+            std::cout << "with context: " << dccl::hex_encode(bytes) << ", without: " << dccl::hex_encode(no_context_bytes) << std::endl;
+            assert(bytes.size() < no_context_bytes.size());
+
+            // altitude not set: no context, so `altitude` model is used; unlikely values still round trip
+            msg.clear_altitude();
+            msg.set_profile(3, 0);
+            context_round_trip(codec, msg);
+        }
+
+        // sizes are bounded by the least (and most) favorable model in the family
+        assert(codec.max_size(ArithmeticContextTestMsg::descriptor()) >= codec.max_size(ArithmeticNoContextTestMsg::descriptor()));
+    }
 
     std::cout << "all tests passed" << std::endl;
 }
@@ -0,0 +1,212 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests dccl_arithmetic_train: trains models on a corpus and round trips the corpus with them
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <google/protobuf/text_format.h>
+
+#include "dccl/codec.h"
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+// splits the output of dccl_arithmetic_train into one model per "# field(s): ..." section
+std::vector<dccl::arith::protobuf::ArithmeticModel> parse_models(const std::string& output)
+{
+    std::vector<std::string> model_texts;
+    std::istringstream lines(output);
+    std::string line;
+    while(std::getline(lines, line))
+    {
+        if(line.compare(0, 11, "# field(s):") == 0)
+            model_texts.push_back(std::string());
+        else if(!model_texts.empty())
+            model_texts.back() += line + "\n";
+    }
+
+    std::vector<dccl::arith::protobuf::ArithmeticModel> models(model_texts.size());
+    for(int i = 0, n = model_texts.size(); i < n; ++i)
+        assert(google::protobuf::TextFormat::ParseFromString(model_texts[i], &models[i]));
+    return models;
+}
+
+// runs `command`, returning its output and setting `status` to its exit status
+std::string run(const std::string& command, int* status)
+{
+    FILE* pipe = popen(command.c_str(), "r");
+    assert(pipe);
+    std::string output;
+    char buffer[256];
+    while(fgets(buffer, sizeof(buffer), pipe))
+        output += buffer;
+    int result = pclose(pipe);
+    *status = WIFEXITED(result) ? WEXITSTATUS(result) : -1;
+    return output;
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+
+    char dir_template[] = "/tmp/dccl_test_arithmetic_train.XXXXXX";
+    assert(mkdtemp(dir_template));
+    const std::string dir = dir_template;
+    const std::string corpus_path = dir + "/corpus.txt";
+    const std::string empty_path = dir + "/empty.txt";
+    const std::string binned_path = dir + "/binned.txt";
+    const std::string train = std::string(DCCL_ARITHMETIC_TRAIN) + " -f " + DCCL_TEST_PROTO + " -j 2";
+
+    // skewed so that the trained models compress the corpus
+    std::vector<TrainTestMsg> corpus(40);
+    {
+        std::ofstream out(corpus_path.c_str());
+        out << "# comment lines are skipped\n";
+        for(int i = 0, n = corpus.size(); i < n; ++i)
+        {
+            TrainTestMsg& msg = corpus[i];
+            if(i % 5)
+                msg.set_state(i % 7 ? STATE_SURVEY : static_cast<State>(i % 2 + 1));
+            for(int j = 0, m = i % 6 + 1; j < m; ++j)
+                msg.add_depth((i * j) % 3 ? 5 : j + 10);
+            out << msg.ShortDebugString() << "\n";
+        }
+        std::ofstream empty(empty_path.c_str());
+        empty << "# nothing but a comment\n";
+    }
+
+    // no samples: fails with a message saying so
+    {
+        int status = 0;
+        std::string output = run(train + " < " + empty_path + " 2>&1", &status);
+        std::cout << output;
+        assert(status != 0);
+        assert(output.find("read no samples") != std::string::npos);
+    }
+
+    int status = 0;
+    std::string output = run(train + " < " + corpus_path, &status);
+    std::cout << output;
+    assert(status == 0);
+    assert(output.find("# trained on 40 messages") != std::string::npos);
+
+    std::vector<dccl::arith::protobuf::ArithmeticModel> models = parse_models(output);
+    assert(models.size() == 2);
+
+    std::set<std::string> names;
+    for(int i = 0, n = models.size(); i < n; ++i)
+    {
+        dccl::arith::ModelManager::set_model(models[i]);
+        names.insert(models[i].name());
+    }
+    assert(names.count("state_model") && names.count("depth_model"));
+
+    dccl::Codec codec;
+    void* dl_handle = dlopen(DCCL_ARITHMETIC_NAME, RTLD_LAZY);
+    if(!dl_handle)
+    {
+        std::cerr << "Failed to open " << DCCL_ARITHMETIC_NAME << std::endl;
+        exit(1);
+    }
+    codec.load_library(dl_handle);
+    codec.load<TrainTestMsg>();
+    codec.info<TrainTestMsg>(&std::cout);
+
+    unsigned corpus_bytes = 0;
+    for(int i = 0, n = corpus.size(); i < n; ++i)
+    {
+        unsigned size = codec.size(corpus[i]);
+        std::string bytes;
+        codec.encode(&bytes, corpus[i]);
+        assert(size == bytes.size());
+        corpus_bytes += bytes.size();
+
+        TrainTestMsg msg_out;
+        codec.decode(bytes, &msg_out);
+        assert(msg_out.SerializeAsString() == corpus[i].SerializeAsString());
+    }
+    std::cout << "corpus encoded in " << corpus_bytes << " bytes" << std::endl;
+
+    // more distinct values than symbols: binned, with every value (including the largest) mapping
+    // to a symbol of the model, and decoding to the nearest bound
+    {
+        std::vector<TrainTestMsg> binned;
+        {
+            std::ofstream out(binned_path.c_str());
+            for(int depth = 0; depth <= 500;)
+            {
+                TrainTestMsg msg;
+                for(int j = 0; j < 6 && depth <= 500; ++j)
+                    msg.add_depth(depth++);
+                out << msg.ShortDebugString() << "\n";
+                binned.push_back(msg);
+            }
+        }
+
+        std::string binned_output = run(train + " < " + binned_path, &status);
+        assert(status == 0);
+        std::vector<dccl::arith::protobuf::ArithmeticModel> binned_models = parse_models(binned_output);
+        dccl::arith::protobuf::ArithmeticModel depth_model;
+        for(int i = 0, n = binned_models.size(); i < n; ++i)
+        {
+            if(binned_models[i].name() == "depth_model")
+                depth_model = binned_models[i];
+        }
+        assert(depth_model.frequency_size() == 64);
+        
+        dccl::arith::Model model(depth_model);
+        dccl::arith::ModelManager::create_and_validate_model(&model);
+        for(int depth = 0; depth <= 500; ++depth)
+        {
+            dccl::arith::Model::symbol_type symbol = model.value_to_symbol(depth);
+            assert(symbol >= 0 && symbol < depth_model.frequency_size());
+        }
+
+        dccl::arith::ModelManager::set_model(depth_model);
+        for(int i = 0, n = binned.size(); i < n; ++i)
+        {
+            std::string bytes;
+            codec.encode(&bytes, binned[i]);
+            TrainTestMsg msg_out;
+            codec.decode(bytes, &msg_out);
+            assert(msg_out.depth_size() == binned[i].depth_size());
+            for(int j = 0, m = msg_out.depth_size(); j < m; ++j)
+                assert(msg_out.depth(j) == model.symbol_to_value(model.value_to_symbol(binned[i].depth(j))));
+        }
+    }
+
+    unlink(corpus_path.c_str());
+    unlink(empty_path.c_str());
+    unlink(binned_path.c_str());
+    rmdir(dir.c_str());
+
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,282 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests the C code generated by protoc-gen-dccl_c against the Codec
+
+#include <cstdlib>
+#include <cstring>
+
+#include "dccl/codec.h"
+#include "test.pb.h"
+#include "dccl/test/dccl_c/test.dccl.h"
+
+using namespace dccl::test;
+
+void to_c(const Position& msg, dccl_test_Position* c)
+{
+    c->lat = msg.lat();
+    c->lon = msg.lon();
+    c->has_depth = msg.has_depth();
+    c->depth = msg.depth();
+}
+
+void from_c(const dccl_test_Position& c, Position* msg)
+{
+    msg->set_lat(c.lat);
+    msg->set_lon(c.lon);
+    if(c.has_depth)
+        msg->set_depth(c.depth);
+}
+
+void to_c(const std::string& s, char* c, std::size_t max_length)
+{
+    std::size_t length = std::min(s.size(), max_length);
+    std::memcpy(c, s.data(), length);
+    c[length] = 0;
+}
+
+void to_c(const Status& msg, dccl_test_Status* c)
+{
+    std::memset(c, 0, sizeof(*c));
+    c->header.source = msg.header().source();
+    c->header.has_sequence = msg.header().has_sequence();
+    c->header.sequence = msg.header().sequence();
+    c->has_position = msg.has_position();
+    to_c(msg.position(), &c->position);
+    to_c(msg.origin(), &c->origin);
+    c->has_int32_val = msg.has_int32_val();
+    c->int32_val = msg.int32_val();
+    c->has_int64_val = msg.has_int64_val();
+    c->int64_val = msg.int64_val();
+    c->has_uint32_val = msg.has_uint32_val();
+    c->uint32_val = msg.uint32_val();
+    c->uint64_val = msg.uint64_val();
+    c->has_double_val = msg.has_double_val();
+    c->double_val = msg.double_val();
+    c->has_float_val = msg.has_float_val();
+    c->float_val = msg.float_val();
+    c->bool_req = msg.bool_req();
+    c->has_bool_opt = msg.has_bool_opt();
+    c->bool_opt = msg.bool_opt();
+    c->has_mode = msg.has_mode();
+    c->mode = static_cast<dccl_test_Mode>(msg.mode());
+    c->mode_req = static_cast<dccl_test_Mode>(msg.mode_req());
+    c->has_name = msg.has_name();
+    to_c(msg.name(), c->name, sizeof(c->name) - 1);
+    c->has_key = msg.has_key();
+    std::memcpy(c->key, msg.key().data(), std::min(msg.key().size(), sizeof(c->key)));
+    std::memcpy(c->token, msg.token().data(), std::min(msg.token().size(), sizeof(c->token)));
+
+    c->values_count = msg.values_size();
+    for(int i = 0, n = msg.values_size(); i < n; ++i)
+        c->values[i] = msg.values(i);
+    c->waypoints_count = msg.waypoints_size();
+    for(int i = 0, n = msg.waypoints_size(); i < n; ++i)
+        to_c(msg.waypoints(i), &c->waypoints[i]);
+    c->modes_count = msg.modes_size();
+    for(int i = 0, n = msg.modes_size(); i < n; ++i)
+        c->modes[i] = static_cast<dccl_test_Mode>(msg.modes(i));
+    c->tags_count = msg.tags_size();
+    for(int i = 0, n = msg.tags_size(); i < n; ++i)
+        to_c(msg.tags(i), c->tags[i], sizeof(c->tags[i]) - 1);
+    c->flags_count = msg.flags_size();
+    for(int i = 0, n = msg.flags_size(); i < n; ++i)
+        c->flags[i] = msg.flags(i);
+}
+
+void from_c(const dccl_test_Status& c, Status* msg)
+{
+    msg->Clear();
+    msg->mutable_header()->set_source(c.header.source);
+    if(c.header.has_sequence)
+        msg->mutable_header()->set_sequence(c.header.sequence);
+    if(c.has_position)
+        from_c(c.position, msg->mutable_position());
+    from_c(c.origin, msg->mutable_origin());
+    if(c.has_int32_val)
+        msg->set_int32_val(c.int32_val);
+    if(c.has_int64_val)
+        msg->set_int64_val(c.int64_val);
+    if(c.has_uint32_val)
+        msg->set_uint32_val(c.uint32_val);
+    msg->set_uint64_val(c.uint64_val);
+    if(c.has_double_val)
+        msg->set_double_val(c.double_val);
+    if(c.has_float_val)
+        msg->set_float_val(c.float_val);
+    msg->set_bool_req(c.bool_req);
+    if(c.has_bool_opt)
+        msg->set_bool_opt(c.bool_opt);
+    if(c.has_mode)
+        msg->set_mode(static_cast<Mode>(c.mode));
+    msg->set_mode_req(static_cast<Mode>(c.mode_req));
+    if(c.has_name)
+        msg->set_name(c.name);
+    if(c.has_key)
+        msg->set_key(std::string(c.key, c.key + sizeof(c.key)));
+    msg->set_token(std::string(c.token, c.token + sizeof(c.token)));
+
+    for(unsigned i = 0; i < c.values_count; ++i)
+        msg->add_values(c.values[i]);
+    for(unsigned i = 0; i < c.waypoints_count; ++i)
+        from_c(c.waypoints[i], msg->add_waypoints());
+    for(unsigned i = 0; i < c.modes_count; ++i)
+        msg->add_modes(static_cast<Mode>(c.modes[i]));
+    for(unsigned i = 0; i < c.tags_count; ++i)
+        msg->add_tags(c.tags[i]);
+    for(unsigned i = 0; i < c.flags_count; ++i)
+        msg->add_flags(c.flags[i]);
+}
+
+double random_between(double min, double max)
+{ return min + (max - min) * (std::rand() / double(RAND_MAX)); }
+
+std::string random_string(std::size_t max_length)
+{
+    std::string s(std::rand() % (max_length + 1), 'a');
+    for(std::size_t i = 0; i < s.size(); ++i)
+        s[i] = static_cast<char>('a' + std::rand() % 26);
+    return s;
+}
+
+std::string random_bytes(std::size_t max_length)
+{
+    std::string s(std::rand() % (max_length + 1), 0);
+    for(std::size_t i = 0; i < s.size(); ++i)
+        s[i] = static_cast<char>(std::rand() % 256);
+    return s;
+}
+
+void random_position(Position* position, int i)
+{
+    position->set_lat(random_between(-95, 95));
+    position->set_lon(random_between(-180, 180));
+    if(i % 3)
+        position->set_depth(random_between(-10, 6100));
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+    
+    dccl::Codec codec;
+    codec.load<Status>();
+    codec.load<Small>();
+
+    assert(dccl_test_Status_DCCL_ID == Status::DCCL_ID);
+    assert(dccl_test_Status_DCCL_MAX_BYTES == codec.max_size<Status>());
+
+    const Mode modes[] = { IDLE, SURVEY, RETURN, ABORT };
+    std::srand(1);
+    for(int i = 0; i < 500; ++i)
+    {
+        Status msg;
+        msg.mutable_header()->set_source(i % 40);
+        if(i % 2)
+            msg.mutable_header()->set_sequence(i * 300);
+        if(i % 3)
+            random_position(msg.mutable_position(), i);
+        random_position(msg.mutable_origin(), i + 1);
+        if(i % 4)
+            msg.set_int32_val(static_cast<int>(random_between(-110, 110)));
+        if(i % 5)
+            msg.set_int64_val(static_cast<dccl::int64>(random_between(-1100000, 1100000)));
+        if(i % 6)
+            msg.set_uint32_val(static_cast<unsigned>(random_between(0, 1100)));
+        msg.set_uint64_val(static_cast<dccl::uint64>(random_between(0, 4000000000.0)));
+        if(i % 7)
+            msg.set_double_val(random_between(-1.6, 1.6));
+        if(i % 8)
+            msg.set_float_val(random_between(-10.5, 10.5));
+        msg.set_bool_req(i % 2);
+        if(i % 3)
+            msg.set_bool_opt(i % 5);
+        if(i % 4)
+            msg.set_mode(modes[i % 4]);
+        msg.set_mode_req(modes[(i + 1) % 4]);
+        if(i % 5)
+            msg.set_name(random_string(14));
+        if(i % 2)
+            msg.set_key(random_bytes(4));
+        msg.set_token(random_bytes(2));
+        for(int j = 0, n = std::rand() % 6; j < n; ++j)
+            msg.add_values(std::rand() % 25 - 12);
+        for(int j = 0, n = std::rand() % 4; j < n; ++j)
+            random_position(msg.add_waypoints(), j);
+        for(int j = 0, n = std::rand() % 5; j < n; ++j)
+            msg.add_modes(modes[std::rand() % 4]);
+        for(int j = 0, n = std::rand() % 4; j < n; ++j)
+            msg.add_tags(random_string(6));
+        for(int j = 0, n = std::rand() % 4; j < n; ++j)
+            msg.add_flags(std::rand() % 2);
+        msg.set_omitted(i);
+
+        std::string bytes;
+        codec.encode(&bytes, msg);
+
+        // encoding
+        dccl_test_Status c_msg;
+        to_c(msg, &c_msg);
+        uint8_t c_bytes[dccl_test_Status_DCCL_MAX_BYTES];
+        std::size_t c_size = dccl_test_Status_pack(&c_msg, c_bytes, sizeof(c_bytes));
+        assert(std::string(c_bytes, c_bytes + c_size) == bytes);
+        assert(dccl_c_id(c_bytes, c_size) == Status::DCCL_ID);
+
+        // decoding
+        Status decoded;
+        codec.decode(bytes, &decoded);
+        dccl_test_Status c_decoded;
+        assert(dccl_test_Status_unpack(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), &c_decoded) == bytes.size());
+        Status c_decoded_msg;
+        from_c(c_decoded, &c_decoded_msg);
+        assert(c_decoded_msg.SerializeAsString() == decoded.SerializeAsString());
+
+        // too small buffers and truncated messages are rejected
+        assert(dccl_test_Status_pack(&c_msg, c_bytes, bytes.size() - 1) == 0);
+        assert(dccl_test_Status_unpack(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size() - 1, &c_decoded) == 0);
+    }
+
+    // smaller identifier, and messages of the wrong type
+    {
+        dccl_test_Small c_msg;
+        std::memset(&c_msg, 0, sizeof(c_msg));
+        c_msg.has_value = true;
+        c_msg.value = 42;
+        c_msg.has_flag = true;
+        c_msg.flag = true;
+
+        uint8_t c_bytes[dccl_test_Small_DCCL_MAX_BYTES];
+        std::size_t c_size = dccl_test_Small_pack(&c_msg, c_bytes, sizeof(c_bytes));
+        assert(dccl_c_id(c_bytes, c_size) == Small::DCCL_ID);
+
+        Small msg;
+        msg.set_value(42);
+        msg.set_flag(true);
+        std::string bytes;
+        codec.encode(&bytes, msg);
+        assert(std::string(c_bytes, c_bytes + c_size) == bytes);
+
+        dccl_test_Status c_status;
+        assert(dccl_test_Status_unpack(c_bytes, c_size, &c_status) == 0);
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
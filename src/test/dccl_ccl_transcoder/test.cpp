@@ -0,0 +1,297 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests bulk transcoding of legacy CCL frames
+
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "dccl/codec.h"
+#include "dccl/ccl/ccl_compatibility.h"
+#include "dccl/ccl/ccl_transcoder.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+using dccl::legacyccl::Batch;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+const unsigned char CCL_IDS[] = { 0x06, 0x07, 0x09, 0x0A, 0x0B, 0x0E, 0x0F };
+const unsigned NUM_FRAMES = 5000;
+
+// value of a column as decoded by the legacyccl field codecs
+double codec_value(const Message& msg, const Batch::Column& column, std::string* bytes)
+{
+    const Message* parent = &msg;
+    const FieldDescriptor* field = column.field;
+    if(field->containing_type() != msg.GetDescriptor())
+    {
+        // gfi_pitch_oil.pitch
+        const FieldDescriptor* parent_field = msg.GetDescriptor()->FindFieldByName(column.name.substr(0, column.name.find('.')));
+        parent = &msg.GetReflection()->GetMessage(msg, parent_field);
+    }
+
+    const Reflection* refl = parent->GetReflection();
+    if(field->is_repeated())
+    {
+        int index = boost::lexical_cast<int>(column.name.substr(column.name.rfind('_') + 1));
+        switch(field->cpp_type())
+        {
+            case FieldDescriptor::CPPTYPE_FLOAT: return refl->GetRepeatedFloat(*parent, field, index);
+            case FieldDescriptor::CPPTYPE_DOUBLE: return refl->GetRepeatedDouble(*parent, field, index);
+            default: assert(false);
+        }
+    }
+    
+    switch(field->cpp_type())
+    {
+        case FieldDescriptor::CPPTYPE_FLOAT: return refl->GetFloat(*parent, field);
+        case FieldDescriptor::CPPTYPE_DOUBLE: return refl->GetDouble(*parent, field);
+        case FieldDescriptor::CPPTYPE_UINT32: return refl->GetUInt32(*parent, field);
+        case FieldDescriptor::CPPTYPE_UINT64: return refl->GetUInt64(*parent, field);
+        case FieldDescriptor::CPPTYPE_ENUM: return refl->GetEnum(*parent, field)->index();
+        case FieldDescriptor::CPPTYPE_STRING: *bytes = refl->GetString(*parent, field); return 0;
+        default: assert(false);
+    }
+    return 0;
+}
+
+// fails to format the last (partial) batch
+struct FailingSink : public dccl::legacyccl::Sink
+{
+    FailingSink() : batches(0) { }
+    void format(const Batch& batch, std::string* output) const
+    {
+        if(batch.size() != 300)
+            throw(std::runtime_error("partial batch"));
+    }
+    void write(const Batch& batch, const std::string& output)
+    { ++batches; }
+    unsigned batches;
+};
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+
+    dccl::Codec ccl("dccl.ccl.id", DCCL_CCL_COMPAT_NAME);
+    dccl::legacyccl::Transcoder transcoder(ccl);
+    assert(transcoder.types().size() == sizeof(CCL_IDS));
+
+    // random frames of every CCL type, some of which are not valid (e.g. the 30th of February), and some frames that are not CCL at all
+    srand(1);
+    std::string frames;
+    for(unsigned i = 0; i < NUM_FRAMES; ++i)
+    {
+        std::string frame(dccl::legacyccl::Transcoder::FRAME_BYTES, 0);
+        for(std::string::iterator it = frame.begin(), end = frame.end(); it != end; ++it)
+            *it = rand();
+        frame[0] = (i % 50 == 0) ? dccl::legacyccl::DCCL_CCL_HEADER : CCL_IDS[rand() % sizeof(CCL_IDS)];
+        frames += frame;
+    }
+
+    // decode each frame with the legacyccl codecs
+    std::vector<boost::shared_ptr<Message> > reference(NUM_FRAMES);
+    unsigned num_valid = 0;
+    for(unsigned i = 0; i < NUM_FRAMES; ++i)
+    {
+        if(frames[i * dccl::legacyccl::Transcoder::FRAME_BYTES] == dccl::legacyccl::DCCL_CCL_HEADER)
+            continue;
+        try
+        {
+            reference[i] = ccl.decode<boost::shared_ptr<Message> >(frames.substr(i * dccl::legacyccl::Transcoder::FRAME_BYTES, dccl::legacyccl::Transcoder::FRAME_BYTES));
+            ++num_valid;
+        }
+        catch(std::exception& e)
+        { }
+    }
+    std::cout << num_valid << "/" << NUM_FRAMES << " valid CCL frames" << std::endl;
+    assert(num_valid > NUM_FRAMES / 2 && num_valid < NUM_FRAMES);
+    
+    // the transcoder gives the same values
+    {
+        Batch batch;
+        transcoder.decode(frames.data(), NUM_FRAMES, &batch);
+        assert(batch.size() == NUM_FRAMES);
+        assert(batch.skipped() == NUM_FRAMES - num_valid);
+
+        std::vector<std::size_t> row(batch.tables().size(), 0);
+        for(unsigned i = 0; i < NUM_FRAMES; ++i)
+        {
+            int table_index = batch.order()[i];
+            assert((table_index < 0) == !reference[i]);
+            if(table_index < 0)
+                continue;
+
+            const Batch::Table& table = batch.tables()[table_index];
+            assert(table.type == reference[i]->GetDescriptor());
+            std::size_t r = row[table_index]++;
+            for(std::vector<Batch::Column>::const_iterator it = table.columns.begin(), end = table.columns.end(); it != end; ++it)
+            {
+                std::string bytes;
+                double value = codec_value(*reference[i], *it, &bytes);
+                if(it->field->cpp_type() == FieldDescriptor::CPPTYPE_STRING)
+                    assert(it->bytes[r] == bytes);
+                else
+                    assert(it->values[r] == value);
+            }
+        }
+        for(std::size_t i = 0, n = batch.tables().size(); i < n; ++i)
+            assert(row[i] == batch.tables()[i].rows);
+
+        const Batch::Table* state = batch.table(dccl::legacyccl::protobuf::CCLMDATState::descriptor());
+        assert(state && state->rows > 0);
+        assert(state->columns.back().name == "gfi_pitch_oil.oil");
+        const Batch::Table* bathy = batch.table(dccl::legacyccl::protobuf::CCLMDATBathy::descriptor());
+        assert(bathy && bathy->columns[1].name == "depth_0" && bathy->columns[3].name == "depth_2");
+    }
+
+    // re-encode State and CTD frames as DCCL3 messages, with different numbers of threads and batch sizes
+    dccl::Codec dccl3;
+    dccl3.load<State3>();
+    dccl3.load<CTD3>();
+
+    std::string dccl3_encoded;
+    const unsigned threads[] = { 0, 1, 4 };
+    const std::size_t batch_frames[] = { NUM_FRAMES, 1, 7 };
+    for(int i = 0; i < 3; ++i)
+    {
+        std::stringstream in(frames + "\x0e\x01\x02");
+        std::stringstream out;
+        dccl::legacyccl::DCCLSink sink(dccl3, out);
+        sink.map(dccl::legacyccl::protobuf::CCLMDATState::descriptor(), State3::descriptor());
+        sink.map(dccl::legacyccl::protobuf::CCLMDATCTD::descriptor(), CTD3::descriptor());
+        
+        std::size_t decoded = transcoder.transcode(in, sink, threads[i], batch_frames[i]);
+        assert(decoded == num_valid);
+
+        if(i == 0)
+            dccl3_encoded = out.str();
+        else
+            assert(out.str() == dccl3_encoded);
+    }
+
+    unsigned num_dccl3 = 0;
+    for(unsigned i = 0; i < NUM_FRAMES; ++i)
+    {
+        if(!reference[i])
+            continue;
+
+        if(const dccl::legacyccl::protobuf::CCLMDATState* state = dynamic_cast<const dccl::legacyccl::protobuf::CCLMDATState*>(reference[i].get()))
+        {
+            State3 state3;
+            dccl3.decode(&dccl3_encoded, &state3);
+            assert(std::abs(state3.latitude() - state->latitude()) < 1e-5);
+            assert(std::abs(state3.longitude() - state->longitude()) < 1e-5);
+            assert(state3.time_date() == state->time_date());
+            assert(std::abs(state3.heading() - state->heading()) < 0.1);
+            assert(std::abs(state3.depth() - state->depth()) < 0.1);
+            assert(static_cast<int>(state3.mission_mode()) == static_cast<int>(state->mission_mode()));
+            assert(state3.battery_percent() == state->battery_percent());
+            assert(std::abs(state3.gfi_pitch_oil().pitch() - state->gfi_pitch_oil().pitch()) < 0.1);
+            ++num_dccl3;
+        }
+        else if(const dccl::legacyccl::protobuf::CCLMDATCTD* ctd = dynamic_cast<const dccl::legacyccl::protobuf::CCLMDATCTD*>(reference[i].get()))
+        {
+            CTD3 ctd3;
+            dccl3.decode(&dccl3_encoded, &ctd3);
+            assert(std::abs(ctd3.temperature_0() - ctd->temperature(0)) < 0.01);
+            assert(std::abs(ctd3.temperature_1() - ctd->temperature(1)) < 0.01);
+            assert(std::abs(ctd3.depth_0() - ctd->depth(0)) < 0.1);
+            ++num_dccl3;
+        }
+    }
+    assert(dccl3_encoded.empty());
+    std::cout << "transcoded " << num_dccl3 << " frames to DCCL3" << std::endl;
+    
+    // comma separated values: a header for each type and a line per frame
+    {
+        std::stringstream in(frames);
+        std::stringstream out;
+        dccl::legacyccl::CSVSink sink(out);
+        transcoder.transcode(in, sink, 2, 100);
+
+        unsigned headers = 0, lines = 0;
+        std::map<std::string, std::size_t> num_values;
+        std::string line;
+        while(std::getline(out, line))
+        {
+            std::vector<std::string> values;
+            boost::split(values, line, boost::is_any_of(","));
+            if(line[0] == '#')
+            {
+                ++headers;
+                num_values[values[0].substr(1)] = values.size();
+            }
+            else
+            {
+                ++lines;
+                assert(num_values[values[0]] == values.size());
+            }
+        }
+        assert(headers == sizeof(CCL_IDS));
+        assert(lines == num_valid);
+    }
+
+    // an exception thrown by Sink::format() on a worker is rethrown by transcode(), after the batches before it are written
+    {
+        std::stringstream in(frames);
+        FailingSink sink;
+        bool caught = false;
+        try
+        {
+            transcoder.transcode(in, sink, 4, 300);
+        }
+        catch(dccl::Exception& e)
+        {
+            caught = true;
+            std::cout << "caught expected: " << e.what() << std::endl;
+            assert(std::string(e.what()) == "partial batch");
+        }
+        assert(caught);
+        assert(sink.batches == NUM_FRAMES / 300);
+    }
+
+    // not a CCL codec
+    {
+        dccl::Codec dccl;
+        bool caught = false;
+        try
+        {
+            dccl::legacyccl::Transcoder bad(dccl);
+        }
+        catch(dccl::Exception& e)
+        {
+            caught = true;
+            std::cout << "caught expected: " << e.what() << std::endl;
+        }
+        assert(caught);
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -68,6 +68,10 @@ int main(int argc, char* argv[])
     check<TestMsgGroup>(50, true);
     check<TestMsgGroup>(-50, true);
     check<TestMsgVersion>(50, true);
+
+    // only the default codecs themselves describe their wire format, not classes derived from them
+    assert(codec.layout<TestMsgGroup>().find("d")->kind == dccl::FieldLayout::NUMERIC);
+    assert(codec.layout<TestMsgGroup>().find("msg.msg.val")->kind == dccl::FieldLayout::OPAQUE);
     
     std::cout << "all tests passed" << std::endl;
 }
@@ -0,0 +1,319 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests encoding and decoding many messages directly from/into columns (Codec::encode_columns, Codec::decode_columns)
+
+#include <cstdlib>
+#include <limits>
+#include <sys/time.h>
+
+#include "dccl/codec.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+const int N = 200;
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);    
+    
+    dccl::Codec codec;
+    codec.load<NavigationReport>();
+    codec.load<OtherReport>();
+
+    timeval t;
+    gettimeofday(&t, 0);
+    dccl::uint64 now = 1000000 * static_cast<dccl::uint64>(t.tv_sec);
+    
+    std::srand(1);
+    std::vector<std::string> frames(N);
+    for(int i = 0; i < N; ++i)
+    {
+        NavigationReport r;
+        r.mutable_header()->set_time(now + i * 1000000);
+        if(i % 2) r.mutable_header()->set_source(i % 32);
+        r.set_x((std::rand() % 200000 - 100000) / 10.0);
+        r.set_y((std::rand() % 200000 - 100000) / 10.0);
+        r.set_z(-(std::rand() % 5000));
+        if(i % 3) r.set_veh_class(static_cast<NavigationReport::VehicleClass>(i % 3 + 1));
+        if(i % 5) r.set_battery_ok(i % 7);
+        if(i % 4) r.set_heading((std::rand() % 36000) / 100.0);
+        if(i % 6) r.set_name("auv");
+        codec.encode(&frames[i], r);
+    }
+
+    std::vector<dccl::uint64> time(N);
+    std::vector<dccl::int32> source(N), veh_class(N), const_int(N);
+    std::vector<double> x(N), y(N), z(N);
+    std::vector<float> heading(N);
+    bool battery_ok[N];
+    std::vector<unsigned char> source_set(N/8+1), veh_class_set(N/8+1), battery_ok_set(N/8+1), heading_set(N/8+1);
+
+    dccl::ColumnSet columns;
+    columns.bind("header.time", &time[0]);
+    columns.bind("header.source", &source[0], &source_set[0]);
+    columns.bind("x", &x[0]);
+    columns.bind("y", &y[0]);
+    columns.bind("z", &z[0]);
+    columns.bind("veh_class", &veh_class[0], &veh_class_set[0]);
+    columns.bind("battery_ok", battery_ok, &battery_ok_set[0]);
+    columns.bind("heading", &heading[0], &heading_set[0]);
+    columns.bind("const_int", &const_int[0]);
+
+    assert(codec.decode_columns<NavigationReport>(frames, columns) == N);
+    
+    for(int i = 0; i < N; ++i)
+    {
+        NavigationReport r;
+        codec.decode(frames[i], &r);
+
+        assert(time[i] == r.header().time());
+        assert(bool(source_set[i/8] & (1 << (i%8))) == r.header().has_source());
+        assert(source[i] == r.header().source());
+        assert(x[i] == r.x());
+        assert(y[i] == r.y());
+        assert(z[i] == r.z());
+        assert(bool(veh_class_set[i/8] & (1 << (i%8))) == r.has_veh_class());
+        if(r.has_veh_class())
+            assert(veh_class[i] == NavigationReport::VehicleClass_descriptor()->FindValueByNumber(r.veh_class())->index());
+        assert(bool(battery_ok_set[i/8] & (1 << (i%8))) == r.has_battery_ok());
+        assert(battery_ok[i] == r.battery_ok());
+        assert(bool(heading_set[i/8] & (1 << (i%8))) == r.has_heading());
+        assert(heading[i] == r.heading());
+        assert(const_int[i] == r.const_int());
+    }
+    
+    // same messages stored back to back in one buffer
+    const unsigned frame_size = codec.max_size<NavigationReport>();
+    std::string buffer(frame_size * N, '\0');
+    for(int i = 0; i < N; ++i)
+        buffer.replace(i*frame_size, frames[i].size(), frames[i]);
+
+    std::vector<double> x2(N);
+    std::vector<dccl::int32> veh_class2(N);
+    dccl::ColumnSet columns2;
+    columns2.bind("x", &x2[0]);
+    columns2.bind("veh_class", &veh_class2[0]);
+    codec.decode_columns(NavigationReport::descriptor(), buffer.data(), frame_size, N, columns2);
+    assert(x2 == x);
+    for(int i = 0; i < N; ++i)
+        assert(veh_class2[i] == ((veh_class_set[i/8] & (1 << (i%8))) ? veh_class[i] : 0));
+    
+    // variable size field and fields that follow it cannot be decoded directly
+    {
+        std::vector<dccl::uint32> depth_rating(N);
+        dccl::ColumnSet bad_columns;
+        bad_columns.bind("depth_rating", &depth_rating[0]);
+        try
+        {
+            codec.decode_columns<NavigationReport>(frames, bad_columns);
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+    }
+
+    // wrong message type
+    {
+        OtherReport other;
+        other.set_x(10);
+        frames.push_back(std::string());
+        codec.encode(&frames.back(), other);
+        std::vector<double> x3(N+1);
+        dccl::ColumnSet x_column;
+        x_column.bind("x", &x3[0]);
+        try
+        {
+            codec.decode_columns<NavigationReport>(frames, x_column);
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+    }
+    
+    // encode from columns gives the same bytes as encoding each message
+    {
+        std::vector<double> ex(N), ey(N), ez(N);
+        std::vector<dccl::int32> eveh(N), esource(N);
+        std::vector<float> eheading(N);
+        std::vector<dccl::uint64> etime(N);
+        std::vector<unsigned char> eveh_set(N/8+1), esource_set(N/8+1);
+
+        std::vector<std::string> expected(N);
+        std::vector<NavigationReport> reports(N);
+        for(int i = 0; i < N; ++i)
+        {
+            NavigationReport& r = reports[i];
+            etime[i] = now + i * 1000000;
+            r.mutable_header()->set_time(etime[i]);
+            esource[i] = i % 40; // some out of bounds
+            if(i % 2)
+            {
+                r.mutable_header()->set_source(esource[i]);
+                esource_set[i/8] |= (1 << (i%8));
+            }
+            ex[i] = (std::rand() % 200000 - 100000) / 7.0; // needs rounding
+            ey[i] = (std::rand() % 300000 - 150000) / 10.0; // some out of bounds
+            ez[i] = -(std::rand() % 5000);
+            r.set_x(ex[i]);
+            r.set_y(ey[i]);
+            r.set_z(ez[i]);
+            eveh[i] = i % 3;
+            if(i % 3)
+            {
+                r.set_veh_class(static_cast<NavigationReport::VehicleClass>(NavigationReport::VehicleClass_descriptor()->value(eveh[i])->number()));
+                eveh_set[i/8] |= (1 << (i%8));
+            }
+            eheading[i] = (std::rand() % 36000) / 100.0;
+            r.set_heading(eheading[i]);
+            codec.encode(&expected[i], r);
+        }
+
+        const std::vector<double>& cx = ex;
+        dccl::ColumnSet in_columns;
+        in_columns.bind("header.time", &etime[0]);
+        in_columns.bind("header.source", &esource[0], &esource_set[0]);
+        in_columns.bind("x", &cx[0]);
+        in_columns.bind("y", &ey[0]);
+        in_columns.bind("z", &ez[0]);
+        in_columns.bind("veh_class", &eveh[0], &eveh_set[0]);
+        in_columns.bind("heading", &eheading[0]);
+
+        std::string encoded;
+        std::size_t frame_size = codec.encode_columns<NavigationReport>(in_columns, N, &encoded);
+        assert(encoded.size() == N * frame_size);
+        for(int i = 0; i < N; ++i)
+        {
+            assert(expected[i].size() == frame_size);
+            assert(encoded.substr(i * frame_size, frame_size) == expected[i]);
+        }
+
+        // const columns cannot be decoded into
+        try
+        {
+            codec.decode_columns(NavigationReport::descriptor(), encoded.data(), frame_size, N, in_columns);
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+        
+        // required fields must be bound, and a failed encode leaves the output as it was
+        dccl::ColumnSet missing_columns;
+        missing_columns.bind("x", &cx[0]);
+        const std::string before = encoded;
+        try
+        {
+            codec.encode_columns<NavigationReport>(missing_columns, N, &encoded);
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+        assert(encoded == before);
+
+        // the values of rows that are not set are not used (e.g. NaN, as left by a failed decode)
+        std::vector<float> nan_heading(eheading);
+        std::vector<unsigned char> heading_set(N/8+1, 0);
+        for(int i = 0; i < N; ++i)
+        {
+            if(i % 4)
+            {
+                heading_set[i/8] |= (1 << (i%8));
+            }
+            else
+            {
+                nan_heading[i] = std::numeric_limits<float>::quiet_NaN();
+                reports[i].clear_heading();
+            }
+        }
+        dccl::ColumnSet nan_columns;
+        nan_columns.bind("header.time", &etime[0]);
+        nan_columns.bind("header.source", &esource[0], &esource_set[0]);
+        nan_columns.bind("x", &cx[0]);
+        nan_columns.bind("y", &ey[0]);
+        nan_columns.bind("z", &ez[0]);
+        nan_columns.bind("veh_class", &eveh[0], &eveh_set[0]);
+        nan_columns.bind("heading", &nan_heading[0], &heading_set[0]);
+        encoded.clear();
+        codec.encode_columns<NavigationReport>(nan_columns, N, &encoded);
+        for(int i = 0; i < N; ++i)
+        {
+            std::string bytes;
+            codec.encode(&bytes, reports[i]);
+            assert(encoded.substr(i * frame_size, frame_size) == bytes);
+        }
+
+        // double columns bound to integer and enumeration fields are checked before they are
+        // narrowed: NaN, and values that would wrap into the bounds, are not set
+        std::vector<double> dsource(N), dveh(N);
+        for(int i = 0; i < N; ++i)
+        {
+            NavigationReport& r = reports[i];
+            r.clear_heading();
+            r.mutable_header()->clear_source();
+            r.clear_veh_class();
+            switch(i % 4)
+            {
+                case 0:
+                    dsource[i] = dveh[i] = std::numeric_limits<double>::quiet_NaN();
+                    break;
+                case 1:
+                    dsource[i] = 4294967296.0 + 5;
+                    dveh[i] = 4294967296.0 + 1;
+                    break;
+                case 2:
+                    dsource[i] = i % 32;
+                    dveh[i] = i % 3;
+                    r.mutable_header()->set_source(i % 32);
+                    r.set_veh_class(static_cast<NavigationReport::VehicleClass>(NavigationReport::VehicleClass_descriptor()->value(i % 3)->number()));
+                    break;
+                case 3:
+                    dsource[i] = dveh[i] = -1e20;
+                    break;
+            }
+        }
+        dccl::ColumnSet narrowed_columns;
+        narrowed_columns.bind("header.time", &etime[0]);
+        narrowed_columns.bind("header.source", &dsource[0]);
+        narrowed_columns.bind("x", &cx[0]);
+        narrowed_columns.bind("y", &ey[0]);
+        narrowed_columns.bind("z", &ez[0]);
+        narrowed_columns.bind("veh_class", &dveh[0]);
+        encoded.clear();
+        codec.encode_columns<NavigationReport>(narrowed_columns, N, &encoded);
+        for(int i = 0; i < N; ++i)
+        {
+            std::string bytes;
+            codec.encode(&bytes, reports[i]);
+            assert(encoded.substr(i * frame_size, frame_size) == bytes);
+        }
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
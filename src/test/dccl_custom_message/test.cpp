@@ -219,7 +219,28 @@ int main(int argc, char* argv[])
     codec.decode(bytes2, &msg_out2);
     std::cout << "... got Message out:\n" << msg_out2.DebugString() << std::endl;
     assert(msg_in2.SerializeAsString() == msg_out2.SerializeAsString());
-    
+
+#if DCCL_HAS_CRYPTOPP
+    // wire format: body is AES-256 in CTR mode, key = SHA256(passphrase), IV = SHA256(head)
+    assert(dccl::hex_encode(bytes1) == "0615f82c67bf");
+    assert(dccl::hex_encode(bytes2) == "0847a06a1dfe707e");
+#endif
+
+    // skip IDs both inside and beyond the skip bitmap range
+    std::set<unsigned> skip_ids;
+    skip_ids.insert(4);
+    skip_ids.insert(0x0CC1000B);
+    codec.set_crypto_passphrase("my_passphrase!", skip_ids);
+
+    std::string bytes3;
+    codec.encode(&bytes3, msg_in2);
+    std::cout << "unencrypted bytes (hex): " << dccl::hex_encode(bytes3) << std::endl;
+    assert(dccl::hex_encode(bytes3) == "080a000000c52300");
+
+    bytes3.clear();
+    codec.encode(&bytes3, msg_in1);
+    assert(bytes3 == bytes1);
+
     std::cout << "all tests passed" << std::endl;
 }
 
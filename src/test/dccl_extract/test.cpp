@@ -0,0 +1,162 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests reading fields directly from encoded messages without decoding them
+
+#include <sys/time.h>
+
+#include "dccl/codec.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);    
+    
+    dccl::Codec codec;
+    codec.load<RoutedMessage>();
+    codec.load<OtherMessage>();
+
+    const dccl::MessageLayout& layout = codec.layout<RoutedMessage>();
+    const dccl::FieldLayout& time = layout.direct_field("header.time");
+    const dccl::FieldLayout& source = layout.direct_field("header.source_platform");
+    const dccl::FieldLayout& dest = layout.direct_field("header.dest_platform");
+    const dccl::FieldLayout& dest_type = layout.direct_field("header.dest_type");
+    const dccl::FieldLayout& priority = layout.direct_field("priority");
+    const dccl::FieldLayout& depth = layout.direct_field("depth");
+    const dccl::FieldLayout& ack = layout.direct_field("ack");
+    assert(time.message == &layout && depth.message == &layout);
+    assert(time.part == dccl::HEAD && depth.part == dccl::BODY);
+    
+    timeval t;
+    gettimeofday(&t, 0);
+
+    for(int i = 0; i < 20; ++i)
+    {
+        RoutedMessage msg;
+        msg.mutable_header()->set_time(static_cast<dccl::uint64>(t.tv_sec - i * 60) * 1000000);
+        msg.mutable_header()->set_source_platform(i);
+        if(i % 2)
+            msg.mutable_header()->set_dest_platform(31 - i);
+        msg.mutable_header()->set_dest_type(static_cast<Header::PublishDestination>(i % 3 + 1));
+        if(i % 3)
+            msg.set_priority(static_cast<RoutedMessage::Priority>(i % 3));
+        msg.set_depth(i * 101.3);
+        msg.set_ack(i % 2);
+        
+        std::string bytes;
+        codec.encode(&bytes, msg);
+
+        RoutedMessage decoded;
+        codec.decode(bytes, &decoded);
+
+        dccl::uint64 time_value = 0;
+        assert(codec.extract(bytes, time, &time_value));
+        assert(time_value == decoded.header().time());
+
+        dccl::int64 source_value = -1;
+        assert(codec.extract(bytes, source, &source_value));
+        assert(source_value == decoded.header().source_platform());
+
+        dccl::int64 dest_value = -1;
+        assert(codec.extract(bytes, dest, &dest_value) == decoded.header().has_dest_platform());
+        if(decoded.header().has_dest_platform())
+            assert(dest_value == decoded.header().dest_platform());
+        else
+            assert(dest_value == -1);
+        
+        int dest_type_index = -1;
+        assert(codec.extract(bytes, dest_type, &dest_type_index));
+        assert(dest_type_index == Header::PublishDestination_descriptor()->FindValueByNumber(decoded.header().dest_type())->index());
+
+        int priority_index = -1;
+        assert(codec.extract(bytes, priority, &priority_index) == decoded.has_priority());
+        if(decoded.has_priority())
+            assert(priority_index == RoutedMessage::Priority_descriptor()->FindValueByNumber(decoded.priority())->index());
+
+        double depth_value = 0;
+        assert(codec.extract(bytes.data(), bytes.size(), depth, &depth_value));
+        assert(depth_value == decoded.depth());
+
+        bool ack_value = false;
+        assert(codec.extract(bytes, ack, &ack_value));
+        assert(ack_value == decoded.ack());
+
+        // lookup by path, with the type identified from the encoded message
+        double path_depth = 0;
+        assert(codec.extract(bytes, "depth", &path_depth));
+        assert(path_depth == depth_value);
+    }
+
+    RoutedMessage msg;
+    msg.mutable_header()->set_time(static_cast<dccl::uint64>(t.tv_sec) * 1000000);
+    msg.mutable_header()->set_source_platform(1);
+    msg.set_depth(10);
+    msg.set_note("hello");
+    std::string bytes;
+    codec.encode(&bytes, msg);
+
+    // follows a variable size field
+    try
+    {
+        dccl::int64 value;
+        codec.extract(bytes, "after_note", &value);
+        assert(false);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught expected exception: " << e.what() << std::endl;
+    }
+
+    // field of a different type
+    OtherMessage other;
+    other.set_value(5);
+    std::string other_bytes;
+    codec.encode(&other_bytes, other);
+    try
+    {
+        double value;
+        codec.extract(other_bytes, depth, &value);
+        assert(false);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught expected exception: " << e.what() << std::endl;
+    }
+
+    dccl::int64 other_value = 0;
+    assert(codec.extract(other_bytes, "value", &other_value) && other_value == 5);
+
+    // truncated
+    try
+    {
+        double value;
+        codec.extract(bytes.substr(0, layout.body_byte_offset()), depth, &value);
+        assert(false);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught expected exception: " << e.what() << std::endl;
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,193 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests the encode / decode functions generated by protoc-gen-dccl against the field codecs
+
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "dccl/codec.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+// decodes bytes with both codecs and checks the results agree
+template<typename ProtobufMessage>
+void check_decode(dccl::Codec& generated, dccl::Codec& reflection, const std::string& bytes)
+{
+    ProtobufMessage generated_msg, reflection_msg;
+    generated.decode(bytes, &generated_msg);
+    reflection.decode(bytes, &reflection_msg);
+    std::cout << generated_msg.ShortDebugString() << std::endl;
+    assert(generated_msg.SerializeAsString() == reflection_msg.SerializeAsString());
+}
+
+template<typename ProtobufMessage>
+void check(dccl::Codec& generated, dccl::Codec& reflection, const ProtobufMessage& msg)
+{
+    std::string generated_bytes, reflection_bytes;
+    generated.encode(&generated_bytes, msg);
+    reflection.encode(&reflection_bytes, msg);
+    assert(generated_bytes == reflection_bytes);
+    assert(generated.size(msg) == generated_bytes.size());
+
+    char buffer[ProtobufMessage::DCCL_SIZE];
+    assert(generated.encode(buffer, sizeof(buffer), msg) == generated_bytes.size());
+    assert(std::string(buffer, buffer + sizeof(buffer)) == generated_bytes);
+    
+    check_decode<ProtobufMessage>(generated, reflection, generated_bytes);
+}
+
+double random_between(double min, double max)
+{ return min + (max - min) * (std::rand() / double(RAND_MAX)); }
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);    
+    
+    // load<T>() uses the generated functions
+    dccl::Codec generated;
+    generated.load<FixedMessage>();
+    generated.load<FixedMessageV2>();
+    generated.load<VariableMessage>();
+    assert(generated.has_generated_codec<FixedMessage>());
+    assert(generated.has_generated_codec<FixedMessageV2>());
+    assert(!generated.has_generated_codec<VariableMessage>());
+    assert(!dccl::internal::HasGeneratedCodec<VariableMessage>::value);
+    assert(FixedMessage::DCCL_SIZE == generated.max_size<FixedMessage>());
+    assert(FixedMessage::DCCL_HEAD_BITS == generated.layout<FixedMessage>().head_bits());
+    
+    // load(desc) uses the field codecs
+    dccl::Codec reflection;
+    reflection.load(FixedMessage::descriptor());
+    reflection.load(FixedMessageV2::descriptor());
+    assert(!reflection.has_generated_codec<FixedMessage>());
+
+    timeval t;
+    gettimeofday(&t, 0);
+
+    std::srand(t.tv_sec);
+    const FixedMessage::Mode modes[] = { FixedMessage::IDLE, FixedMessage::SURVEY, FixedMessage::RETURN, FixedMessage::ABORT };
+    for(int i = 0; i < 200; ++i)
+    {
+        FixedMessage msg;
+        msg.mutable_header()->set_time(static_cast<dccl::uint64>(t.tv_sec - i) * 1000000 + i);
+        msg.mutable_header()->set_source_platform(i % 32);
+        if(i % 2)
+        {
+            msg.mutable_header()->set_time_signed(static_cast<dccl::int64>(t.tv_sec + i) * 1000000);
+            msg.mutable_header()->set_time_double(t.tv_sec - 3600.5 * (i % 5));
+            msg.mutable_header()->set_time_precision(static_cast<dccl::int64>(t.tv_sec) * 1000000 + 12345 * i);
+            msg.mutable_header()->set_time_double_precision(t.tv_sec + 0.123456 * i);
+            msg.mutable_header()->set_dest_type(Header::PUBLISH_OTHER);
+            msg.mutable_header()->set_dest_platform(31 - i % 32);
+        }
+
+        msg.mutable_position()->set_lat(random_between(-90, 90));
+        msg.mutable_position()->set_lon(random_between(-180, 180));
+        if(i % 3)
+            msg.mutable_position()->set_depth(random_between(0, 6000));
+
+        // include some out of range values
+        if(i % 4)
+            msg.set_int32_val(static_cast<int>(random_between(-120, 120)));
+        if(i % 5)
+            msg.set_int64_val(static_cast<dccl::int64>(random_between(-1000000, 1000000)));
+        if(i % 6)
+            msg.set_uint32_val(static_cast<unsigned>(random_between(0, 1100)));
+        msg.set_uint64_val(static_cast<dccl::uint64>(random_between(0, 4000000000.0)));
+        if(i % 7)
+            msg.set_double_val(random_between(-1.6, 1.6));
+        msg.set_bool_req(i % 2);
+        if(i % 3)
+            msg.set_bool_opt(i % 5);
+        if(i % 4)
+            msg.set_mode(modes[i % 4]);
+        msg.set_mode_req(modes[(i + 1) % 4]);
+        msg.set_omitted("not sent");
+
+        check(generated, reflection, msg);
+
+        FixedMessageV2 msg_v2;
+        if(i % 2)
+        {
+            msg_v2.mutable_position()->set_lat(random_between(-90, 90));
+            msg_v2.mutable_position()->set_lon(random_between(-180, 180));
+        }
+        if(i % 3)
+            msg_v2.set_value(i % 60);
+        if(i % 5)
+            msg_v2.set_timestamp(t.tv_sec + i);
+        check(generated, reflection, msg_v2);
+    }
+
+    // messages that are not the generated class use the field codecs
+    {
+        FixedMessage msg;
+        msg.mutable_header()->set_time(static_cast<dccl::uint64>(t.tv_sec) * 1000000);
+        msg.mutable_header()->set_source_platform(3);
+        msg.mutable_position()->set_lat(10);
+        msg.mutable_position()->set_lon(20);
+        msg.set_uint64_val(42);
+        msg.set_bool_req(true);
+        msg.set_mode_req(FixedMessage::ABORT);
+
+        std::string bytes;
+        generated.encode(&bytes, msg);
+
+        boost::shared_ptr<google::protobuf::Message> dynamic_msg = dccl::DynamicProtobufManager::new_protobuf_message(FixedMessage::descriptor());
+        generated.decode(bytes, dynamic_msg.get());
+        assert(dynamic_msg->SerializeAsString() == msg.SerializeAsString());
+
+        std::string dynamic_bytes;
+        generated.encode(&dynamic_bytes, *dynamic_msg);
+        assert(dynamic_bytes == bytes);
+
+        // uninitialized messages are still rejected
+        msg.clear_bool_req();
+        try
+        {
+            generated.encode(&bytes, msg);
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+    }
+
+    // messages with variable size fields are not generated
+    {
+        VariableMessage msg;
+        msg.set_value(5);
+        msg.set_name("dccl");
+        std::string bytes;
+        generated.encode(&bytes, msg);
+        VariableMessage decoded;
+        generated.decode(bytes, &decoded);
+        assert(decoded.SerializeAsString() == msg.SerializeAsString());
+    }
+
+    generated.unload<FixedMessage>();
+    assert(!generated.has_generated_codec<FixedMessage>());
+    
+    std::cout << "all tests passed" << std::endl;
+}
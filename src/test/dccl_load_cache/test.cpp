@@ -0,0 +1,321 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests dccl::LoadCache
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <unistd.h>
+
+#include "dccl/codec.h"
+#include "dccl/dynamic_protobuf_manager.h"
+#include "dccl/field_codec_fixed.h"
+#include "dccl/load_cache.h"
+#include "dccl/message_generator.h"
+#include "dccl/protobuf/option_extensions.pb.h"
+
+using google::protobuf::Descriptor;
+using google::protobuf::FileDescriptor;
+using google::protobuf::FileDescriptorProto;
+
+const char* TYPES_PROTO =
+    "import \"dccl/protobuf/option_extensions.proto\";\n"
+    "package dccl.test.cache;\n"
+    "enum Kind { KIND_A = 1; KIND_B = 2; KIND_C = 3; }\n"
+    "message Embedded\n"
+    "{\n"
+    "  optional int32 val = 1 [(dccl.field).min = -10, (dccl.field).max = 10];\n"
+    "  optional Kind kind = 2;\n"
+    "}\n";
+
+const char* MSGS_PROTO =
+    "import \"dccl/protobuf/option_extensions.proto\";\n"
+    "import \"types.proto\";\n"
+    "package dccl.test.cache;\n"
+    "message Msg1\n"
+    "{\n"
+    "  option (dccl.msg).id = 1;\n"
+    "  option (dccl.msg).max_bytes = 32;\n"
+    "  option (dccl.msg).codec_version = 3;\n"
+    "  optional double d = 1 [(dccl.field).min = -100, (dccl.field).max = 100, (dccl.field).precision = 2];\n"
+    "  optional Embedded embedded = 2;\n"
+    "}\n"
+    "message Msg2\n"
+    "{\n"
+    "  option (dccl.msg).id = 2;\n"
+    "  option (dccl.msg).max_bytes = 32;\n"
+    "  option (dccl.msg).codec_version = 3;\n"
+    "  repeated Embedded embedded = 1 [(dccl.field).max_repeat = 3];\n"
+    "  optional string s = 2 [(dccl.field).max_length = 8];\n"
+    "}\n";
+
+const char* CODEC_PROTO =
+    "import \"dccl/protobuf/option_extensions.proto\";\n"
+    "package dccl.test.cache;\n"
+    "message Msg3\n"
+    "{\n"
+    "  option (dccl.msg).id = 3;\n"
+    "  option (dccl.msg).max_bytes = 4;\n"
+    "  option (dccl.msg).codec_version = 3;\n"
+    "  required int32 w = 1 [(dccl.field).codec = \"test_width\"];\n"
+    "}\n";
+
+// size of TestWidthCodec in bits, which is not part of the message definition
+unsigned test_width = 8;
+
+class TestWidthCodec : public dccl::TypedFixedFieldCodec<dccl::int32>
+{
+  private:
+    dccl::Bitset encode() { return dccl::Bitset(size()); }
+    dccl::Bitset encode(const dccl::int32& wire_value) { return dccl::Bitset(size(), static_cast<unsigned long>(wire_value)); }
+    dccl::int32 decode(dccl::Bitset* bits) { return bits->to_ulong(); }
+    unsigned size() { return test_width; }
+    void validate() { }
+    std::string validation_state() { return boost::lexical_cast<std::string>(test_width); }
+};
+
+void write_file(const std::string& path, const std::string& contents)
+{
+    std::ofstream out(path.c_str());
+    out << contents;
+    assert(out);
+}
+
+// loads both messages, and checks they encode and decode
+void load_messages(dccl::Codec* codec, const FileDescriptor* file)
+{
+    for(int i = 0, n = file->message_type_count(); i < n; ++i)
+    {
+        const Descriptor* desc = file->message_type(i);
+        codec->load(desc);
+
+        dccl::MessageGenerator generator;
+        boost::shared_ptr<google::protobuf::Message> msg = generator.generate(desc);
+        std::string bytes;
+        codec->encode(&bytes, *msg);
+        boost::shared_ptr<google::protobuf::Message> decoded = codec->decode<boost::shared_ptr<google::protobuf::Message> >(bytes);
+        assert(decoded->SerializeAsString() == msg->SerializeAsString());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    char dir_template[] = "/tmp/dccl_test_load_cache.XXXXXX";
+    assert(mkdtemp(dir_template));
+    const std::string dir = dir_template;
+    const std::string types_path = dir + "/types.proto";
+    const std::string msgs_path = dir + "/msgs.proto";
+    const std::string codec_path = dir + "/codec.proto";
+    const std::string cache_path = dir + "/load.cache";
+    write_file(types_path, TYPES_PROTO);
+    write_file(msgs_path, MSGS_PROTO);
+    write_file(codec_path, CODEC_PROTO);
+
+    dccl::DynamicProtobufManager::enable_compilation();
+    dccl::DynamicProtobufManager::add_include_path(dir);
+
+    // nothing cached: the files are parsed and the messages validated
+    const FileDescriptor* file = 0;
+    unsigned max_size[2];
+    {
+        dccl::LoadCache cache(cache_path);
+        file = cache.load_from_proto_file(msgs_path);
+        assert(file);
+        assert(file->message_type_count() == 2);
+        assert(cache.file_hits() == 0);
+
+        dccl::Codec codec;
+        codec.set_load_cache(&cache);
+        load_messages(&codec, file);
+        assert(cache.validation_hits() == 0);
+        for(int i = 0; i < 2; ++i)
+            max_size[i] = codec.max_size(file->message_type(i));
+
+        cache.save();
+        assert(access(cache_path.c_str(), R_OK) == 0);
+    }
+
+    // unchanged: everything comes from the cache
+    {
+        dccl::LoadCache cache(cache_path);
+        assert(cache.load_from_proto_file(msgs_path) == file);
+        assert(cache.file_hits() == 1);
+
+        // the cached descriptors (including the import) were handed to the DynamicProtobufManager
+        FileDescriptorProto proto;
+        assert(dccl::DynamicProtobufManager::simple_database().FindFileByName(msgs_path, &proto));
+        assert(dccl::DynamicProtobufManager::simple_database().FindFileByName("types.proto", &proto));
+
+        dccl::Codec codec;
+        codec.set_load_cache(&cache);
+        load_messages(&codec, file);
+        assert(cache.validation_hits() == 2);
+        for(int i = 0; i < 2; ++i)
+            assert(codec.max_size(file->message_type(i)) == max_size[i]);
+    }
+
+    // a message with the same name but a different definition (here, a wider bound in an embedded
+    // message) is validated again
+    {
+        FileDescriptorProto types_proto, msgs_proto;
+        file->dependency(1)->CopyTo(&types_proto);
+        file->CopyTo(&msgs_proto);
+        types_proto.mutable_message_type(0)->mutable_field(0)->mutable_options()->MutableExtension(dccl::field)->set_max(1000);
+
+        google::protobuf::SimpleDescriptorDatabase changed_database;
+        changed_database.Add(types_proto);
+        changed_database.Add(msgs_proto);
+        google::protobuf::DescriptorPoolDatabase generated(*google::protobuf::DescriptorPool::generated_pool());
+        google::protobuf::MergedDescriptorDatabase database(&changed_database, &generated);
+        google::protobuf::DescriptorPool pool(&database);
+        const FileDescriptor* changed = pool.FindFileByName(msgs_path);
+        assert(changed);
+
+        dccl::LoadCache cache(cache_path);
+        dccl::Codec codec;
+        codec.set_load_cache(&cache);
+        codec.load(changed->message_type(0));
+        assert(cache.validation_hits() == 0);
+        assert(codec.max_size(changed->message_type(0)) > max_size[0]);
+
+        // and the cache now holds the new result
+        dccl::Codec uncached;
+        uncached.load(file->message_type(0));
+        unsigned head_bits, body_bits;
+        assert(cache.find_validated(codec.layout(changed->message_type(0)), &head_bits, &body_bits));
+        assert(!cache.find_validated(uncached.layout(file->message_type(0)), &head_bits, &body_bits));
+    }
+
+    // a change to the state a field codec depends on, or to which codec a field uses, means the
+    // message is validated again
+    {
+        dccl::FieldCodecManager::add<TestWidthCodec>("test_width");
+        const Descriptor* desc = dccl::DynamicProtobufManager::load_from_proto_file(codec_path)->message_type(0);
+        unsigned narrow_size;
+        {
+            dccl::LoadCache cache(cache_path);
+            dccl::Codec codec;
+            codec.set_load_cache(&cache);
+            codec.load(desc);
+            assert(cache.validation_hits() == 0);
+            narrow_size = codec.max_size(desc);
+            cache.save();
+        }
+        {
+            dccl::LoadCache cache(cache_path);
+            dccl::Codec codec;
+            codec.set_load_cache(&cache);
+            codec.load(desc);
+            assert(cache.validation_hits() == 1);
+        }
+
+        test_width = 16;
+        {
+            dccl::LoadCache cache(cache_path);
+            dccl::Codec codec;
+            codec.set_load_cache(&cache);
+            codec.load(desc);
+            assert(cache.validation_hits() == 0);
+            assert(codec.max_size(desc) == narrow_size + 1);
+        }
+
+        // exactly fills (dccl.msg).max_bytes: one byte of identifier and three of body, both
+        // when validated and when read back from the cache
+        test_width = 24;
+        for(int pass = 0; pass < 2; ++pass)
+        {
+            dccl::LoadCache cache(cache_path);
+            dccl::Codec codec;
+            codec.set_load_cache(&cache);
+            codec.load(desc);
+            assert(cache.validation_hits() == static_cast<unsigned>(pass));
+            dccl::MessageGenerator generator;
+            std::string bytes;
+            codec.encode(&bytes, *generator.generate(desc));
+            assert(bytes.size() == 4);
+            cache.save();
+        }
+
+        // no longer fits in (dccl.msg).max_bytes
+        test_width = 40;
+        {
+            dccl::LoadCache cache(cache_path);
+            dccl::Codec codec;
+            codec.set_load_cache(&cache);
+            bool caught = false;
+            try { codec.load(desc); }
+            catch(dccl::Exception&) { caught = true; }
+            assert(caught);
+        }
+
+        // the codec is no longer loaded (e.g. its library was not opened): the 8 bit result is
+        // still cached, but the message fails to load
+        test_width = 8;
+        dccl::FieldCodecManager::remove<TestWidthCodec>("test_width");
+        {
+            dccl::LoadCache cache(cache_path);
+            dccl::Codec codec;
+            codec.set_load_cache(&cache);
+            bool caught = false;
+            try { codec.load(desc); }
+            catch(dccl::Exception&) { caught = true; }
+            assert(caught);
+            assert(cache.validation_hits() == 0);
+        }
+    }
+
+    // a change to an imported file means the file must be parsed again
+    {
+        write_file(types_path, std::string(TYPES_PROTO) + "// changed\n");
+        dccl::LoadCache cache(cache_path);
+        assert(cache.load_from_proto_file(msgs_path) == file);
+        assert(cache.file_hits() == 0);
+        cache.save();
+
+        dccl::LoadCache updated(cache_path);
+        assert(updated.load_from_proto_file(msgs_path) == file);
+        assert(updated.file_hits() == 1);
+    }
+
+    // a corrupt cache is ignored
+    {
+        write_file(cache_path, "not a cache");
+        dccl::LoadCache cache(cache_path);
+        assert(cache.load_from_proto_file(msgs_path) == file);
+        assert(cache.file_hits() == 0);
+        dccl::Codec uncached;
+        uncached.load(file->message_type(0));
+        unsigned head_bits, body_bits;
+        assert(!cache.find_validated(uncached.layout(file->message_type(0)), &head_bits, &body_bits));
+    }
+
+    std::remove(cache_path.c_str());
+    std::remove(msgs_path.c_str());
+    std::remove(codec_path.c_str());
+    std::remove(types_path.c_str());
+    rmdir(dir_template);
+
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,144 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests dccl::MessageGenerator
+
+#include "dccl/codec.h"
+#include "dccl/message_generator.h"
+#include "test.pb.h"
+using namespace dccl::test;
+
+const int MESSAGES = 1000;
+
+void check_bounds(const TestMsg& msg)
+{
+    assert(!msg.has_omitted());
+    if(msg.has_d()) assert(msg.d() >= -100 && msg.d() <= 100);
+    if(msg.has_f()) assert(msg.f() >= 0 && msg.f() <= 10);
+    if(msg.has_i64()) assert(msg.i64() >= -1000 && msg.i64() <= 1000);
+    if(msg.has_u32()) assert(msg.u32() <= 500);
+    if(msg.has_s()) assert(msg.s().size() <= 10);
+    if(msg.has_by()) assert(msg.by().size() == 6);
+    if(msg.has_st()) assert(msg.st() == 7);
+    assert(msg.r_size() <= 5);
+    for(int i = 0, n = msg.r_size(); i < n; ++i)
+        assert(msg.r(i) >= 0 && msg.r(i) <= 20);
+    assert(msg.re_size() <= 3);
+}
+
+// the encoded message decodes to exactly the message generated
+template<typename Msg>
+void check_round_trip(dccl::Codec& codec, const Msg& msg_in)
+{
+    std::string bytes;
+    codec.encode(&bytes, msg_in);
+    Msg msg_out;
+    codec.decode(bytes, &msg_out);
+    assert(msg_in.SerializeAsString() == msg_out.SerializeAsString());
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    dccl::Codec codec;
+    codec.load<TestMsg>();
+    codec.load<HeadMsg>();
+
+    // random instances are within bounds and encode
+    {
+        dccl::MessageGenerator generator;
+        TestMsg msg;
+        HeadMsg head_msg;
+        int optional_set = 0;
+        for(int i = 0; i < MESSAGES; ++i)
+        {
+            generator.generate(&msg);
+            check_bounds(msg);
+            check_round_trip(codec, msg);
+            optional_set += msg.has_d();
+
+            generator.generate(&head_msg);
+            if(head_msg.header().has_source()) assert(head_msg.header().source() <= 31);
+            check_round_trip(codec, head_msg);
+        }
+        std::cout << "d set in " << optional_set << " of " << MESSAGES << " messages" << std::endl;
+        assert(optional_set > MESSAGES / 3 && optional_set < 2 * MESSAGES / 3);
+    }
+
+    // the same seed and time base give the same messages, including the time
+    {
+        dccl::MessageGenerator a(42), b(42);
+        a.set_time_base(1500000000);
+        b.set_time_base(1500000000);
+        TestMsg msg_b;
+        for(int i = 0; i < 10; ++i)
+        {
+            boost::shared_ptr<google::protobuf::Message> msg_a = a.generate(TestMsg::descriptor());
+            b.generate(&msg_b);
+            assert(msg_a->SerializeAsString() == msg_b.SerializeAsString());
+            assert(!msg_b.has_time() || (msg_b.time() <= 1500000000 && msg_b.time() >= 1500000000 - 3600));
+        }
+    }
+
+    // presence by part: always in the header (in_head), never in the body
+    {
+        dccl::MessageGenerator generator;
+        generator.set_presence_probability(1, dccl::HEAD);
+        generator.set_presence_probability(0, dccl::BODY);
+        HeadMsg msg;
+        for(int i = 0; i < 100; ++i)
+        {
+            generator.generate(&msg);
+            assert(msg.header().has_time() && msg.header().has_source() && msg.header().has_embedded());
+            assert(msg.header().embedded().has_val() && msg.header().embedded().has_flag());
+            assert(!msg.has_a() && !msg.has_s() && !msg.has_t());
+            check_round_trip(codec, msg);
+        }
+
+        try
+        {
+            generator.set_presence_probability(1.5);
+            assert(false);
+        }
+        catch(dccl::Exception& e)
+        {
+            std::cout << "Caught expected: " << e.what() << std::endl;
+        }
+    }
+
+    // worst case instances encode to the maximum size
+    {
+        dccl::MessageGenerator generator;
+        TestMsg msg;
+        generator.generate(&msg, dccl::MessageGenerator::MAX_SIZE);
+        std::cout << msg.ShortDebugString() << std::endl;
+        assert(msg.s().size() == 10 && msg.r_size() == 5 && msg.re_size() == 3 && msg.st() == 7);
+        assert(codec.size(msg) == codec.max_size<TestMsg>());
+        check_round_trip(codec, msg);
+
+        HeadMsg head_msg;
+        generator.generate(&head_msg, dccl::MessageGenerator::MAX_SIZE);
+        assert(codec.size(head_msg) == codec.max_size<HeadMsg>());
+    }
+
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,119 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests the field layout table and in place patching of encoded messages
+
+#include <sys/time.h>
+
+#include "dccl/codec.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);    
+    
+    dccl::Codec codec;
+    codec.load<Status>();
+
+    const dccl::MessageLayout& layout = codec.layout<Status>();
+    for(std::vector<dccl::FieldLayout>::const_iterator it = layout.fields().begin(), end = layout.fields().end(); it != end; ++it)
+        std::cout << it->path << ": " << (it->part == dccl::HEAD ? "head" : "body") << " offset: " << it->bit_offset << " width: " << it->bit_width << " direct: " << it->direct() << std::endl;
+
+    assert(layout.id_bit_width() == 16);
+    assert(layout.fields().size() == 7);
+    
+    const dccl::FieldLayout* time = layout.find("header.time");
+    assert(time && time->part == dccl::HEAD && time->bit_offset == 16 && time->direct());
+    const dccl::FieldLayout* counter = layout.find("header.counter");
+    assert(counter && counter->part == dccl::HEAD && counter->bit_offset == time->bit_offset + time->bit_width && counter->bit_width == 10);
+    const dccl::FieldLayout* depth = layout.find("depth");
+    assert(depth && depth->part == dccl::BODY && depth->bit_offset == layout.body_byte_offset() * 8 && depth->direct());
+    assert(layout.find("mode")->kind == dccl::FieldLayout::ENUM);
+    assert(layout.find("fault")->kind == dccl::FieldLayout::BOOL);
+    // variable size (repeated) field, and the field after it
+    assert(!layout.find("sensor")->direct());
+    assert(!layout.find("battery")->fixed_offset);
+    assert(!layout.find("no_such_field"));
+    assert(layout.head_bits() + layout.body_bits() <= codec.max_size<Status>() * 8);
+
+    timeval t;
+    gettimeofday(&t, 0);
+    
+    Status status;
+    status.mutable_header()->set_time(t.tv_sec);
+    status.mutable_header()->set_counter(1);
+    status.set_depth(1200);
+    status.set_mode(Status::SURVEY);
+    status.add_sensor(3);
+    status.add_sensor(7);
+    status.set_battery(87.5);
+    
+    std::string bytes;
+    codec.encode(&bytes, status);
+
+    for(int i = 2; i < 20; ++i)
+    {
+        status.mutable_header()->set_time(status.header().time() + 10.1);
+        status.mutable_header()->set_counter(i);
+        status.set_depth(1200 + i * 3);
+        status.set_mode(static_cast<Status::Mode>(i % 3));
+        status.set_fault(i % 2);
+        
+        codec.patch(&bytes, "header.time", status.header().time());
+        codec.patch(&bytes, "header.counter", i);
+        codec.patch(&bytes, "depth", status.depth());
+        codec.patch(&bytes, "mode", Status::Mode_descriptor()->FindValueByNumber(status.mode())->index());
+        codec.patch(&bytes, "fault", status.fault());
+
+        std::string expected;
+        codec.encode(&expected, status);
+        assert(bytes == expected);
+
+        Status decoded;
+        codec.decode(bytes, &decoded);
+        assert(decoded.header().counter() == static_cast<unsigned>(i));
+        assert(decoded.sensor_size() == 2);
+        assert(decoded.battery() == 87.5);
+    }
+
+    // out of bounds values are encoded as zero, as by the field codec
+    status.mutable_header()->set_counter(5000);
+    codec.patch(&bytes, "header.counter", 5000);
+    {
+        std::string expected;
+        codec.encode(&expected, status);
+        assert(bytes == expected);
+    }
+    
+    try
+    {
+        codec.patch(&bytes, "battery", 50.0);
+        assert(false);
+    }
+    catch(dccl::Exception& e)
+    {
+        std::cout << "Caught expected exception: " << e.what() << std::endl;
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,192 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests range coder (against the arithmetic coder using the same models)
+
+#include <dlfcn.h>
+
+#include "dccl/codec.h"
+#include "dccl/range/field_codec_range.h"
+
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+dccl::Codec codec;
+
+void load(const char* name)
+{
+    void* dl_handle = dlopen(name, RTLD_LAZY);
+    if(!dl_handle)
+    {
+        std::cerr << "Failed to open " << name << std::endl;
+        exit(1);
+    }
+    codec.load_library(dl_handle);
+}
+
+// model with `symbols` values 0 ... symbols-1 and random frequencies
+dccl::arith::protobuf::ArithmeticModel random_model(int symbols)
+{
+    dccl::arith::protobuf::ArithmeticModel model;
+    model.set_name("model");
+    model.set_eof_frequency(rand() % 100 + 1);
+    model.set_out_of_range_frequency(1);
+    for(int i = 0; i < symbols; ++i)
+    {
+        model.add_value_bound(i);
+        // skewed, so there is something to compress
+        model.add_frequency((rand() % 1000 + 1) * (rand() % 10 ? 1 : 100));
+    }
+    model.add_value_bound(symbols);
+    return model;
+}
+
+// value drawn from the distribution given by the model
+int random_value(const dccl::arith::protobuf::ArithmeticModel& model)
+{
+    int total = 0;
+    for(int i = 0, n = model.frequency_size(); i < n; ++i)
+        total += model.frequency(i);
+    
+    int r = rand() % total;
+    int i = 0;
+    while(r >= static_cast<int>(model.frequency(i)))
+        r -= model.frequency(i++);
+    return model.value_bound(i);
+}
+
+template<typename Msg>
+std::string round_trip(const Msg& msg_in)
+{
+    unsigned size = codec.size(msg_in);
+    std::string bytes;
+    codec.encode(&bytes, msg_in);
+    assert(size == bytes.size());
+    
+    Msg msg_out;
+    codec.decode(bytes, &msg_out);
+    assert(msg_in.SerializeAsString() == msg_out.SerializeAsString());
+    return bytes;
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+
+    load(DCCL_ARITHMETIC_NAME);
+    load(DCCL_RANGE_NAME);
+    
+    srand(1);
+    
+    // compression compared to the arithmetic coder, over random models and messages of all lengths
+    {
+        unsigned range_total = 0, arithmetic_total = 0;
+        for(int i = 0; i <= 100; ++i)
+        {
+            dccl::arith::ModelManager::set_model(random_model(rand() % 1000 + 2));
+            if(i == 0)
+            {
+                // models must be set first
+                codec.load<RangeTestMsg>();
+                codec.load<ArithmeticTestMsg>();
+            }
+
+            RangeTestMsg range_msg;
+            ArithmeticTestMsg arithmetic_msg;
+            for(int j = 0; j < i; ++j)
+            {
+                int value = random_value(dccl::arith::ModelManager::find("model").user_model());
+                range_msg.add_value(value);
+                arithmetic_msg.add_value(value);
+            }
+            
+            range_total += round_trip(range_msg).size();
+            arithmetic_total += round_trip(arithmetic_msg).size();
+        }
+        std::cout << "total bytes: range: " << range_total << ", arithmetic: " << arithmetic_total << std::endl;
+        // the range coder pays for a length prefix (~2 bytes per message here)
+        assert(range_total <= arithmetic_total * 1.01 + 2*101);
+    }
+
+    // exact number of bits used (fields following are decoded correctly), short and empty fields
+    {
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("enum_model");
+        model.set_eof_frequency(1);
+        model.set_out_of_range_frequency(0);
+        model.add_value_bound(ENUM_A);
+        model.add_frequency(100);
+        model.add_value_bound(ENUM_B);
+        model.add_frequency(10);
+        model.add_value_bound(ENUM_C);
+        model.add_frequency(1);
+        model.add_value_bound(ENUM_C + 1);
+        dccl::arith::ModelManager::set_model(model);
+        model.set_name("single_model");
+        dccl::arith::ModelManager::set_model(model);
+        model.set_name("enum_model");
+        codec.load<RangeMixedTestMsg>();
+
+        for(int i = 0; i <= 8; ++i)
+        {
+            RangeMixedTestMsg msg;
+            msg.set_single(static_cast<Enum1>(i % 3 + 1));
+            msg.set_before(i * 11);
+            for(int j = 0; j < i; ++j)
+                msg.add_value(static_cast<Enum1>((i+j) % 3 + 1));
+            msg.set_after(100 - i);
+            round_trip(msg);
+        }
+
+        // adaptive: decoder follows the encoder's updates
+        // (only one field uses the adaptive model, as size() does not carry one field's updates to the next)
+        model.set_is_adaptive(true);
+        dccl::arith::ModelManager::set_model(model);
+        std::vector<std::string> encoded;
+        std::vector<RangeMixedTestMsg> msgs;
+        for(int i = 0; i < 20; ++i)
+        {
+            RangeMixedTestMsg msg;
+            msg.set_single(ENUM_C);
+            msg.set_before(i);
+            for(int j = 0; j < 8; ++j)
+                msg.add_value(j % 2 ? ENUM_A : ENUM_C);
+            msg.set_after(i);
+            msgs.push_back(msg);
+            
+            unsigned size = codec.size(msg);
+            encoded.push_back(std::string());
+            codec.encode(&encoded.back(), msg);
+            assert(size == encoded.back().size());
+        }
+        // ENUM_C becomes more probable
+        assert(encoded.back().size() < encoded.front().size());
+        for(int i = 0; i < 20; ++i)
+        {
+            RangeMixedTestMsg msg_out;
+            codec.decode(encoded[i], &msg_out);
+            assert(msgs[i].SerializeAsString() == msg_out.SerializeAsString());
+        }
+    }
+
+    std::cout << "all tests passed" << std::endl;
+}
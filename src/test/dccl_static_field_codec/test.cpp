@@ -0,0 +1,265 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests that static (CRTP) field codecs encode the same as the equivalent virtual codecs, both in the Codec and in StructCodec
+
+#include <cstdlib>
+
+#include "dccl/codec.h"
+#include "dccl/struct_codec.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+using dccl::Bitset;
+
+namespace dccl
+{
+    namespace test
+    {
+        // 0 to 360 degrees in half degree steps, with zero meaning "not set"
+        inline dccl::uint64 heading_steps(double heading)
+        {
+            double h = std::fmod(heading, 360.0);
+            if(h < 0)
+                h += 360;
+            return static_cast<dccl::uint64>(dccl::round(h * 2)) % 720 + 1;
+        }
+        
+        class HeadingStaticCodec : public dccl::StaticFixedFieldCodec<HeadingStaticCodec, double>
+        {
+          public:
+            template<typename Writer>
+                void encode(Writer& writer)
+            { writer.write(0, size()); }
+
+            template<typename Writer>
+                void encode(Writer& writer, const double& heading)
+            { writer.write(heading_steps(heading), size()); }
+
+            template<typename Reader>
+                bool decode(Reader& reader, double* heading)
+            {
+                dccl::uint64 steps = reader.read(size());
+                if(!steps)
+                    return false;
+                *heading = (steps - 1) / 2.0;
+                return true;
+            }
+            
+            unsigned size() { return 10; }
+        };
+
+        class HeadingTypedCodec : public dccl::TypedFixedFieldCodec<double>
+        {
+          private:
+            Bitset encode() { return Bitset(size()); }
+            Bitset encode(const double& heading) { return Bitset(size(), heading_steps(heading)); }
+            double decode(Bitset* bits)
+            {
+                unsigned long steps = bits->to_ulong();
+                if(!steps)
+                    throw(dccl::NullValueException());
+                return (steps - 1) / 2.0;
+            }
+            unsigned size() { return 10; }
+            void validate() { }
+        };
+
+        // up to 15 characters, preceded by the length
+        class PascalStaticCodec : public dccl::StaticFieldCodec<PascalStaticCodec, std::string>
+        {
+          public:
+            template<typename Writer>
+                void encode(Writer& writer)
+            { writer.write(0, LENGTH_BITS); }
+
+            template<typename Writer>
+                void encode(Writer& writer, const std::string& s)
+            {
+                std::size_t length = std::min<std::size_t>(s.size(), MAX_LENGTH);
+                writer.write(length, LENGTH_BITS);
+                writer.write_bytes(s.data(), length);
+            }
+
+            template<typename Reader>
+                bool decode(Reader& reader, std::string* s)
+            {
+                std::size_t length = reader.read(LENGTH_BITS);
+                if(!length)
+                    return false;
+                s->resize(length);
+                reader.read_bytes(&(*s)[0], length);
+                return true;
+            }
+
+            unsigned size() { return LENGTH_BITS; }
+            unsigned size(const std::string& s) { return LENGTH_BITS + std::min<std::size_t>(s.size(), MAX_LENGTH) * dccl::BITS_IN_BYTE; }
+            unsigned max_size() { return LENGTH_BITS + MAX_LENGTH * dccl::BITS_IN_BYTE; }
+            unsigned min_size() { return LENGTH_BITS; }
+
+          private:
+            enum { LENGTH_BITS = 4, MAX_LENGTH = 15 };
+        };
+
+        class PascalTypedCodec : public dccl::TypedFieldCodec<std::string>
+        {
+          private:
+            Bitset encode() { return Bitset(size()); }
+            Bitset encode(const std::string& s)
+            {
+                std::string value = s.substr(0, MAX_LENGTH);
+                Bitset bits(LENGTH_BITS, value.size());
+                Bitset value_bits;
+                value_bits.from_byte_string(value);
+                bits.append(value_bits);
+                return bits;
+            }
+            std::string decode(Bitset* bits)
+            {
+                unsigned long length = bits->to_ulong();
+                if(!length)
+                    throw(dccl::NullValueException());
+                bits->get_more_bits(length * dccl::BITS_IN_BYTE);
+                Bitset value_bits = *bits;
+                value_bits >>= LENGTH_BITS;
+                value_bits.resize(length * dccl::BITS_IN_BYTE);
+                return value_bits.to_byte_string();
+            }
+            unsigned size() { return LENGTH_BITS; }
+            unsigned size(const std::string& s) { return LENGTH_BITS + std::min<std::size_t>(s.size(), MAX_LENGTH) * dccl::BITS_IN_BYTE; }
+            unsigned max_size() { return LENGTH_BITS + MAX_LENGTH * dccl::BITS_IN_BYTE; }
+            unsigned min_size() { return LENGTH_BITS; }
+            void validate() { }
+
+            enum { LENGTH_BITS = 4, MAX_LENGTH = 15 };
+        };
+    }
+}
+
+struct Plain
+{
+    boost::optional<double> heading;
+    boost::optional<std::string> note;
+    std::vector<double> headings;
+    double course;
+};
+
+namespace dccl
+{
+    template<> struct StructTraits<Plain>
+    {
+        enum { DCCL_ID = 5 };
+        template<typename Visitor, typename Struct>
+            static void visit(Visitor& v, Struct& s)
+        {
+            v(s.heading, structs::Custom<HeadingStaticCodec>());
+            v(s.note, structs::Custom<PascalStaticCodec>());
+            v(s.headings, structs::Custom<HeadingStaticCodec>().max_repeat(3));
+            v(s.course, structs::Custom<HeadingStaticCodec>());
+        }
+    };
+}
+
+std::string random_string(std::size_t max_length)
+{
+    std::string s(std::rand() % (max_length + 1), 'a');
+    for(std::size_t i = 0; i < s.size(); ++i)
+        s[i] = static_cast<char>('a' + std::rand() % 26);
+    return s;
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+
+    // both styles are added the same way
+    dccl::FieldCodecManager::add<HeadingStaticCodec>("heading_static");
+    dccl::FieldCodecManager::add<PascalStaticCodec>("pascal_static");
+    dccl::FieldCodecManager::add<HeadingTypedCodec>("heading_typed");
+    dccl::FieldCodecManager::add<PascalTypedCodec>("pascal_typed");
+    
+    dccl::Codec codec;
+    codec.load<StaticCodecMsg>();
+    codec.load<TypedCodecMsg>();
+
+    assert(codec.max_size<StaticCodecMsg>() == codec.max_size<TypedCodecMsg>());
+    assert(codec.min_size<StaticCodecMsg>() == codec.min_size<TypedCodecMsg>());
+    assert(dccl::StructCodec<Plain>::max_size() == codec.max_size<StaticCodecMsg>());
+    assert(dccl::StructCodec<Plain>::min_size() == codec.min_size<StaticCodecMsg>());
+    
+    std::srand(1);
+    for(int i = 0; i < 200; ++i)
+    {
+        Plain s;
+        StaticCodecMsg static_msg;
+        if(i % 3)
+        {
+            s.heading = (std::rand() % 1000) / 2.0 - 100;
+            static_msg.set_heading(*s.heading);
+        }
+        if(i % 4)
+        {
+            s.note = random_string(18);
+            static_msg.set_note(*s.note);
+        }
+        for(int j = 0, n = std::rand() % 4; j < n; ++j)
+        {
+            s.headings.push_back((std::rand() % 720) / 2.0);
+            static_msg.add_headings(s.headings.back());
+        }
+        s.course = (std::rand() % 720) / 2.0;
+        static_msg.set_course(s.course);
+            
+        TypedCodecMsg typed_msg;
+        typed_msg.ParseFromString(static_msg.SerializeAsString());
+
+        std::string static_bytes, typed_bytes, struct_bytes;
+        codec.encode(&static_bytes, static_msg);
+        codec.encode(&typed_bytes, typed_msg);
+        dccl::StructCodec<Plain>::encode(&struct_bytes, s);
+
+        // only the identifiers differ
+        assert(static_bytes.substr(1) == typed_bytes.substr(1));
+        assert(struct_bytes == static_bytes);
+        
+        StaticCodecMsg static_decoded;
+        TypedCodecMsg typed_decoded;
+        codec.decode(static_bytes, &static_decoded);
+        codec.decode(typed_bytes, &typed_decoded);
+        assert(static_decoded.SerializeAsString() == typed_decoded.SerializeAsString());
+        assert(codec.size(static_decoded) == static_bytes.size());
+
+        Plain struct_decoded;
+        dccl::StructCodec<Plain>::decode(static_bytes, &struct_decoded);
+        assert(static_decoded.has_heading() == bool(struct_decoded.heading));
+        if(struct_decoded.heading)
+            assert(static_decoded.heading() == *struct_decoded.heading);
+        assert(static_decoded.has_note() == bool(struct_decoded.note));
+        if(struct_decoded.note)
+            assert(static_decoded.note() == *struct_decoded.note);
+        assert(static_decoded.headings_size() == static_cast<int>(struct_decoded.headings.size()));
+        for(int j = 0, n = static_decoded.headings_size(); j < n; ++j)
+            assert(static_decoded.headings(j) == struct_decoded.headings[j]);
+        assert(static_decoded.course() == struct_decoded.course);
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
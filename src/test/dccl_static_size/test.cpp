@@ -0,0 +1,145 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests the compile-time sizes and field positions generated by protoc-gen-dccl against the values computed by the Codec
+
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "dccl/codec.h"
+#include "dccl/internal/bit_ops.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+// the generated sizes assume the identifier of the type itself (Codec::max_size() allows for the widest identifier)
+template<typename ProtobufMessage>
+void check_sizes(dccl::Codec& codec)
+{
+    const dccl::MessageLayout& layout = codec.layout<ProtobufMessage>();
+
+    std::cout << ProtobufMessage::descriptor()->full_name() << ": "
+              << ProtobufMessage::DCCL_ENCODED_MIN << "-" << ProtobufMessage::DCCL_ENCODED_MAX << " bytes (head: "
+              << ProtobufMessage::DCCL_HEAD_MIN_BITS << "-" << ProtobufMessage::DCCL_HEAD_BITS << " bits, body: "
+              << ProtobufMessage::DCCL_BODY_MIN_BITS << "-" << ProtobufMessage::DCCL_BODY_BITS << " bits)" << std::endl;
+    
+    assert(ProtobufMessage::DCCL_ID_BITS == layout.id_bits());
+    assert(ProtobufMessage::DCCL_ID_BIT_WIDTH == layout.id_bit_width());
+    assert(ProtobufMessage::DCCL_HEAD_BITS == layout.head_bits());
+    assert(ProtobufMessage::DCCL_BODY_BITS == layout.body_bits());
+    assert(ProtobufMessage::DCCL_ENCODED_MAX == layout.body_byte_offset() + dccl::ceil_bits2bytes(layout.body_bits()));
+
+    const unsigned widest_id_bits = 16, narrowest_id_bits = 8;
+    assert(ProtobufMessage::DCCL_ENCODED_MAX ==
+           codec.max_size<ProtobufMessage>() - (dccl::ceil_bits2bytes(layout.head_bits() - layout.id_bit_width() + widest_id_bits) - layout.body_byte_offset()));
+    assert(ProtobufMessage::DCCL_ENCODED_MIN ==
+           codec.min_size<ProtobufMessage>() + (dccl::ceil_bits2bytes(ProtobufMessage::DCCL_HEAD_MIN_BITS) - dccl::ceil_bits2bytes(ProtobufMessage::DCCL_HEAD_MIN_BITS - layout.id_bit_width() + narrowest_id_bits)));
+
+    // every message fits, and the empty message is the smallest
+    ProtobufMessage msg;
+    if(ProtobufMessage::descriptor()->FindFieldByName("token"))
+        msg.GetReflection()->SetString(&msg, ProtobufMessage::descriptor()->FindFieldByName("token"), "ab");
+    if(ProtobufMessage::descriptor()->FindFieldByName("source"))
+        msg.GetReflection()->SetInt32(&msg, ProtobufMessage::descriptor()->FindFieldByName("source"), 1);
+    assert(codec.size(msg) == ProtobufMessage::DCCL_ENCODED_MIN);
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::ALL, &std::cerr);
+
+    dccl::Codec codec;
+    codec.load<VariableMessageV3>();
+    codec.load<VariableMessageV2>();
+    codec.load<FixedMessage>();
+    
+    check_sizes<VariableMessageV3>(codec);
+    check_sizes<VariableMessageV2>(codec);
+
+    // the largest messages fill the buffer
+    {
+        VariableMessageV3 msg;
+        msg.set_source(31);
+        msg.set_time(1000);
+        msg.set_name("0123456789");
+        for(int i = 0; i < 4; ++i)
+            msg.add_values(i);
+        msg.set_key("abc");
+        msg.set_token("de");
+        msg.mutable_position()->set_lat(1);
+        msg.mutable_position()->set_lon(2);
+        msg.mutable_position()->set_depth(3);
+        for(int i = 0; i < 2; ++i)
+            *msg.add_waypoints() = msg.position();
+        msg.set_mode(SURVEY);
+        for(int i = 0; i < 3; ++i)
+            msg.add_flags(true);
+        assert(codec.size(msg) == VariableMessageV3::DCCL_ENCODED_MAX);
+
+        char buffer[VariableMessageV3::DCCL_ENCODED_MAX];
+        assert(codec.encode(buffer, sizeof(buffer), msg) == sizeof(buffer));
+    }
+
+    // fixed layouts also give the position of each field
+    {
+        const dccl::MessageLayout& layout = codec.layout<FixedMessage>();
+        assert(FixedMessage::DCCL_ENCODED_MIN == FixedMessage::DCCL_ENCODED_MAX);
+        assert(static_cast<unsigned>(FixedMessage::DCCL_ENCODED_MAX) == static_cast<unsigned>(FixedMessage::DCCL_SIZE));
+        assert(FixedMessage::DCCL_ENCODED_MAX == codec.max_size<FixedMessage>());
+
+        assert(FixedMessage::DCCLFieldBitOffsets::time == layout.find("time")->bit_offset);
+        assert(FixedMessage::DCCLFieldBitWidths::time == layout.find("time")->bit_width);
+        assert(FixedMessage::DCCLFieldBitOffsets::position_lat == layout.find("position.lat")->bit_offset);
+        assert(FixedMessage::DCCLFieldBitWidths::position_lat == layout.find("position.lat")->bit_width);
+        assert(FixedMessage::DCCLFieldBitOffsets::position_depth == layout.find("position.depth")->bit_offset);
+        assert(FixedMessage::DCCLFieldBitWidths::position_depth == layout.find("position.depth")->bit_width);
+        assert(FixedMessage::DCCLFieldBitOffsets::mode == layout.find("mode")->bit_offset);
+        assert(FixedMessage::DCCLFieldBitWidths::mode == layout.find("mode")->bit_width);
+        
+        timeval t;
+        gettimeofday(&t, 0);
+        FixedMessage msg;
+        msg.set_time(static_cast<dccl::uint64>(t.tv_sec) * 1000000);
+        msg.mutable_position()->set_lat(42.5);
+        msg.mutable_position()->set_lon(-70.25);
+        msg.set_value(500);
+        msg.set_ok(true);
+
+        std::string bytes;
+        codec.encode(&bytes, msg);
+        assert(dccl::internal::read_bits(reinterpret_cast<const unsigned char*>(bytes.data()),
+                                         FixedMessage::DCCLFieldBitOffsets::value,
+                                         FixedMessage::DCCLFieldBitWidths::value) == 500 + 1);
+
+#if __cplusplus >= 201103L
+        static_assert(FixedMessage::DCCL_ENCODED_MAX <= 64, "FixedMessage must fit in 64 bytes");
+        std::array<char, FixedMessage::DCCL_ENCODED_MAX> buffer;
+        assert(codec.encode(&buffer, msg) == buffer.size());
+        assert(std::string(buffer.begin(), buffer.end()) == bytes);
+
+        FixedMessage decoded;
+        codec.decode(std::string(buffer.begin(), buffer.end()), &decoded);
+        assert(decoded.SerializeAsString() == msg.SerializeAsString());
+#endif
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
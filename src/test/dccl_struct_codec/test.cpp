@@ -0,0 +1,295 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests that StructCodec produces the same bytes as the Codec for the equivalent messages
+
+#include <cstdlib>
+
+#include "dccl/codec.h"
+#include "dccl/struct_codec.h"
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+namespace plain
+{
+    struct Position
+    {
+        double lat;
+        double lon;
+        boost::optional<float> depth;
+    };
+
+    struct Report
+    {
+        dccl::int32 source;
+        boost::optional<dccl::uint32> sequence;
+        double heading;
+        boost::optional<dccl::int64> timestamp;
+        boost::optional<float> speed;
+        dccl::uint64 count;
+        bool ok;
+        boost::optional<bool> flag;
+        Mode mode;
+        boost::optional<Mode> last_mode;
+        boost::optional<std::string> name;
+        std::string label;
+        Position position;
+        boost::optional<Position> origin;
+        std::vector<dccl::int32> values;
+        std::vector<Position> waypoints;
+        std::vector<Mode> modes;
+        std::vector<std::string> tags;
+        std::vector<bool> flags;
+        Position fix;
+    };
+
+    struct Small
+    {
+        boost::optional<dccl::int32> value;
+        boost::optional<bool> flag;
+    };
+}
+
+// in the order of test.proto
+const Mode mode_values[] = { IDLE, SURVEY, RETURN, ABORT };
+
+namespace dccl
+{
+    template<> struct StructTraits<plain::Position>
+    {
+        template<typename Visitor, typename Struct>
+            static void visit(Visitor& v, Struct& s)
+        {
+            v(s.lat, structs::Numeric(-90, 90, 6));
+            v(s.lon, structs::Numeric(-180, 180, 6));
+            v(s.depth, structs::Numeric(0, 6000, 1));
+        }
+    };
+
+    template<> struct StructTraits<plain::Report>
+    {
+        enum { DCCL_ID = 200 };
+        template<typename Visitor, typename Struct>
+            static void visit(Visitor& v, Struct& s)
+        {
+            v(s.source, structs::Numeric(0, 31).in_head());
+            v(s.sequence, structs::Numeric(0, 100000).in_head());
+            v(s.heading, structs::Numeric(0, 360, 1));
+            v(s.timestamp, structs::Numeric(0, 1000000000, -3));
+            v(s.speed, structs::Numeric(-5, 5, 2));
+            v(s.count, structs::Numeric(5, 4000000000.0));
+            v(s.ok, structs::Bool());
+            v(s.flag, structs::Bool());
+            v(s.mode, structs::enumeration(mode_values));
+            v(s.last_mode, structs::enumeration(mode_values));
+            v(s.name, structs::String(12));
+            v(s.label, structs::String(4));
+            v(s.position, structs::Message());
+            v(s.origin, structs::Message());
+            v(s.values, structs::Numeric(-10, 10).max_repeat(5));
+            v(s.waypoints, structs::Message().max_repeat(3));
+            v(s.modes, structs::enumeration(mode_values).max_repeat(4));
+            v(s.tags, structs::String(6).max_repeat(3));
+            v(s.flags, structs::Bool().max_repeat(3));
+            v(s.fix, structs::Message().in_head());
+        }
+    };
+
+    template<> struct StructTraits<plain::Small>
+    {
+        enum { DCCL_ID = 20 };
+        template<typename Visitor, typename Struct>
+            static void visit(Visitor& v, Struct& s)
+        {
+            v(s.value, structs::Numeric(0, 50));
+            v(s.flag, structs::Bool());
+        }
+    };
+}
+
+void to_proto(const plain::Position& s, Position* msg)
+{
+    msg->set_lat(s.lat);
+    msg->set_lon(s.lon);
+    if(s.depth) msg->set_depth(*s.depth);
+}
+
+void to_proto(const plain::Report& s, Report* msg)
+{
+    msg->Clear();
+    msg->set_source(s.source);
+    if(s.sequence) msg->set_sequence(*s.sequence);
+    msg->set_heading(s.heading);
+    if(s.timestamp) msg->set_timestamp(*s.timestamp);
+    if(s.speed) msg->set_speed(*s.speed);
+    msg->set_count(s.count);
+    msg->set_ok(s.ok);
+    if(s.flag) msg->set_flag(*s.flag);
+    msg->set_mode(s.mode);
+    if(s.last_mode) msg->set_last_mode(*s.last_mode);
+    if(s.name) msg->set_name(*s.name);
+    msg->set_label(s.label);
+    to_proto(s.position, msg->mutable_position());
+    if(s.origin) to_proto(*s.origin, msg->mutable_origin());
+    for(std::size_t i = 0; i < s.values.size(); ++i)
+        msg->add_values(s.values[i]);
+    for(std::size_t i = 0; i < s.waypoints.size(); ++i)
+        to_proto(s.waypoints[i], msg->add_waypoints());
+    for(std::size_t i = 0; i < s.modes.size(); ++i)
+        msg->add_modes(s.modes[i]);
+    for(std::size_t i = 0; i < s.tags.size(); ++i)
+        msg->add_tags(s.tags[i]);
+    for(std::size_t i = 0; i < s.flags.size(); ++i)
+        msg->add_flags(s.flags[i]);
+    to_proto(s.fix, msg->mutable_fix());
+}
+
+double random_between(double min, double max)
+{ return min + (max - min) * (std::rand() / double(RAND_MAX)); }
+
+std::string random_string(std::size_t max_length)
+{
+    std::string s(std::rand() % (max_length + 1), 'a');
+    for(std::size_t i = 0; i < s.size(); ++i)
+        s[i] = static_cast<char>('a' + std::rand() % 26);
+    return s;
+}
+
+// includes some out of bounds values
+plain::Position random_position(int i)
+{
+    plain::Position position;
+    position.lat = random_between(-95, 95);
+    position.lon = random_between(-180, 180);
+    if(i % 3)
+        position.depth = random_between(-10, 6100);
+    return position;
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::dlog.connect(dccl::logger::WARN_PLUS, &std::cerr);
+    
+    dccl::Codec codec;
+    codec.load<Report>();
+    codec.load<Small>();
+
+    assert(dccl::StructCodec<plain::Report>::id() == Report::descriptor()->options().GetExtension(dccl::msg).id());
+    assert(dccl::StructCodec<plain::Report>::max_size() == codec.max_size<Report>());
+    assert(dccl::StructCodec<plain::Report>::min_size() == codec.min_size<Report>());
+    assert(dccl::StructCodec<plain::Small>::max_size() == codec.max_size<Small>());
+    assert(dccl::StructCodec<plain::Small>::min_size() == codec.min_size<Small>());
+
+    std::srand(1);
+    for(int i = 0; i < 500; ++i)
+    {
+        plain::Report s;
+        s.source = i % 40;
+        if(i % 2) s.sequence = i * 300;
+        s.heading = random_between(0, 360);
+        if(i % 3) s.timestamp = static_cast<dccl::int64>(random_between(0, 1100000000));
+        if(i % 4) s.speed = random_between(-5.5, 5.5);
+        s.count = static_cast<dccl::uint64>(random_between(0, 4000000000.0));
+        s.ok = i % 2;
+        if(i % 5) s.flag = i % 3;
+        s.mode = mode_values[i % 4];
+        if(i % 6) s.last_mode = mode_values[(i + 1) % 4];
+        if(i % 7) s.name = random_string(14);
+        s.label = "l" + random_string(4);
+        s.position = random_position(i);
+        if(i % 3) s.origin = random_position(i + 1);
+        for(int j = 0, n = std::rand() % 6; j < n; ++j)
+            s.values.push_back(std::rand() % 25 - 12);
+        for(int j = 0, n = std::rand() % 4; j < n; ++j)
+            s.waypoints.push_back(random_position(j));
+        for(int j = 0, n = std::rand() % 5; j < n; ++j)
+            s.modes.push_back(mode_values[std::rand() % 4]);
+        for(int j = 0, n = std::rand() % 4; j < n; ++j)
+            s.tags.push_back(random_string(6));
+        for(int j = 0, n = std::rand() % 4; j < n; ++j)
+            s.flags.push_back(std::rand() % 2);
+        s.fix = random_position(i + 2);
+
+        Report msg;
+        to_proto(s, &msg);
+        std::string bytes;
+        codec.encode(&bytes, msg);
+
+        std::string struct_bytes;
+        dccl::StructCodec<plain::Report>::encode(&struct_bytes, s);
+        assert(struct_bytes == bytes);
+
+        Report decoded;
+        codec.decode(bytes, &decoded);
+        plain::Report struct_decoded;
+        dccl::StructCodec<plain::Report>::decode(bytes, &struct_decoded);
+        Report struct_decoded_msg;
+        to_proto(struct_decoded, &struct_decoded_msg);
+        assert(struct_decoded_msg.SerializeAsString() == decoded.SerializeAsString());
+
+        // encoding into a buffer that is too small
+        unsigned char buffer[256];
+        try
+        {
+            dccl::StructCodec<plain::Report>::encode(s, buffer, bytes.size() - 1);
+            assert(false);
+        }
+        catch(dccl::Exception& e) { }
+        assert(dccl::StructCodec<plain::Report>::encode(s, buffer, sizeof(buffer)) == bytes.size());
+
+        // truncated message
+        try
+        {
+            dccl::StructCodec<plain::Report>::decode(bytes.substr(0, bytes.size() - 1), &struct_decoded);
+            assert(false);
+        }
+        catch(dccl::Exception& e) { }
+    }
+
+    // one byte identifier, and a message of the wrong type
+    {
+        plain::Small s;
+        s.value = 42;
+        std::string struct_bytes;
+        dccl::StructCodec<plain::Small>::encode(&struct_bytes, s);
+
+        Small msg;
+        msg.set_value(42);
+        std::string bytes;
+        codec.encode(&bytes, msg);
+        assert(struct_bytes == bytes);
+
+        plain::Small decoded;
+        dccl::StructCodec<plain::Small>::decode(bytes, &decoded);
+        assert(decoded.value && *decoded.value == 42 && !decoded.flag);
+        
+        plain::Report report;
+        try
+        {
+            dccl::StructCodec<plain::Report>::decode(bytes, &report);
+            assert(false);
+        }
+        catch(dccl::Exception& e) { }
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,156 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests encoding and decoding with separate Codecs on concurrent threads
+
+#include <pthread.h>
+
+#include "dccl/codec.h"
+#include "test.pb.h"
+using namespace dccl::test;
+
+const int THREADS = 4;
+const int ROUNDS = 5;
+
+struct Corpus
+{
+    std::vector<boost::shared_ptr<google::protobuf::Message> > msgs;
+    // as encoded by a Codec on the main thread
+    std::vector<std::string> encoded;
+};
+
+struct Worker
+{
+    Worker() : corpus(0), failures(0) { }
+    dccl::Codec codec;
+    const Corpus* corpus;
+    int failures;
+};
+
+void fill_position(Position* position)
+{
+    position->set_lat((rand() % 18000000 - 9000000) / 1e5);
+    position->set_lon((rand() % 36000000 - 18000000) / 1e5);
+    if(rand() % 2)
+        position->set_depth(rand() % 6001);
+}
+
+void* run(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    const Corpus& corpus = *worker->corpus;
+    for(int round = 0; round < ROUNDS; ++round)
+    {
+        for(std::size_t i = 0, n = corpus.msgs.size(); i < n; ++i)
+        {
+            std::string encoded;
+            worker->codec.encode(&encoded, *corpus.msgs[i]);
+            if(encoded != corpus.encoded[i])
+                ++worker->failures;
+
+            boost::shared_ptr<google::protobuf::Message> decoded(corpus.msgs[i]->New());
+            worker->codec.decode(encoded, decoded.get());
+            if(decoded->SerializeAsString() != corpus.msgs[i]->SerializeAsString())
+                ++worker->failures;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    dccl::Codec codec;
+    codec.load<Status>();
+    codec.load<Command>();
+
+    Corpus corpus;
+    srand(1);
+    for(int i = 0; i < 100; ++i)
+    {
+        if(i % 3)
+        {
+            boost::shared_ptr<Status> status(new Status);
+            status->set_time(1500000000 + i);
+            fill_position(status->mutable_position());
+            for(int j = 0, n = rand() % 5; j < n; ++j)
+                fill_position(status->add_track());
+            if(rand() % 2)
+                status->set_name(std::string(rand() % 9, 'a' + i % 26));
+            for(int j = 0, n = rand() % 7; j < n; ++j)
+                status->add_readings(rand() % 201 - 100);
+            corpus.msgs.push_back(status);
+        }
+        else
+        {
+            boost::shared_ptr<Command> command(new Command);
+            command->set_destination(i % 32);
+            if(rand() % 2)
+                fill_position(command->mutable_goal());
+            if(rand() % 2)
+                command->set_abort(rand() % 2);
+            corpus.msgs.push_back(command);
+        }
+
+        std::string encoded;
+        codec.encode(&encoded, *corpus.msgs.back());
+
+        // keep the decoded message (with its values quantized to the field precision), which round trips exactly
+        boost::shared_ptr<google::protobuf::Message> decoded(corpus.msgs.back()->New());
+        codec.decode(encoded, decoded.get());
+        corpus.msgs.back() = decoded;
+
+        std::string reencoded;
+        codec.encode(&reencoded, *decoded);
+        assert(reencoded == encoded);
+        corpus.encoded.push_back(encoded);
+    }
+
+    // Codecs (and their loaded messages) are set up on this thread before the workers start
+    Worker workers[THREADS];
+    pthread_t threads[THREADS];
+    for(int i = 0; i < THREADS; ++i)
+    {
+        workers[i].codec.load<Status>();
+        workers[i].codec.load<Command>();
+        workers[i].corpus = &corpus;
+    }
+
+    for(int i = 0; i < THREADS; ++i)
+        pthread_create(&threads[i], 0, run, &workers[i]);
+    for(int i = 0; i < THREADS; ++i)
+        pthread_join(threads[i], 0);
+
+    for(int i = 0; i < THREADS; ++i)
+    {
+        std::cout << "thread " << i << ": " << workers[i].failures << " failures" << std::endl;
+        assert(workers[i].failures == 0);
+    }
+
+    // the main thread's Codec is unaffected by the workers
+    for(std::size_t i = 0, n = corpus.msgs.size(); i < n; ++i)
+    {
+        std::string encoded;
+        codec.encode(&encoded, *corpus.msgs[i]);
+        assert(encoded == corpus.encoded[i]);
+    }
+    
+    std::cout << "all tests passed" << std::endl;
+}
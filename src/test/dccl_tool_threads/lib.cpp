@@ -0,0 +1,53 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// shared library for the dccl_tool_threads test: loads the arithmetic codecs and an adaptive model
+
+#include "dccl/codec.h"
+#include "dccl/arithmetic/field_codec_arithmetic.h"
+
+#include "test.pb.h"
+
+extern "C"
+{
+    void dccl3_load(dccl::Codec* dccl)
+    {
+        dccl_arithmetic_load(dccl);
+
+        dccl::arith::protobuf::ArithmeticModel model;
+        model.set_name("tool_depth_model");
+        model.set_is_adaptive(true);
+        model.set_eof_frequency(10);
+        // 9 is never used, which leaves room in the maximum size for the used values to become less probable as the model adapts
+        for(int i = 0; i < 10; ++i)
+        {
+            model.add_value_bound(i);
+            model.add_frequency(i < 9 ? 10 : 1);
+        }
+        model.add_value_bound(10);
+        dccl::arith::ModelManager::set_model(model);
+    }
+
+    void dccl3_unload(dccl::Codec* dccl)
+    {
+        dccl_arithmetic_unload(dccl);
+    }
+}
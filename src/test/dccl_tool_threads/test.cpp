@@ -0,0 +1,110 @@
+// Copyright 2009-2017 Toby Schneider (http://gobysoft.org/index.wt/people/toby)
+//                     GobySoft, LLC (for 2013-)
+//                     Massachusetts Institute of Technology (for 2007-2014)
+//                     Community contributors (see AUTHORS file)
+//
+//
+// This file is part of the Dynamic Compact Control Language Library
+// ("DCCL").
+//
+// DCCL is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// DCCL is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with DCCL.  If not, see <http://www.gnu.org/licenses/>.
+// tests that the dccl tool gives the same output with several threads (-j) as with one for messages coded with adaptive models
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "dccl/codec.h"
+
+#include "test.pb.h"
+
+using namespace dccl::test;
+
+// enough input for several chunks of work (see dccl_tool.cpp)
+const int NUM_MESSAGES = 60000;
+
+// runs `command`, returning its output and setting `status` to its exit status
+std::string run(const std::string& command, int* status)
+{
+    FILE* pipe = popen(command.c_str(), "r");
+    assert(pipe);
+    std::string output;
+    char buffer[256];
+    while(fgets(buffer, sizeof(buffer), pipe))
+        output += buffer;
+    int result = pclose(pipe);
+    *status = WIFEXITED(result) ? WEXITSTATUS(result) : -1;
+    return output;
+}
+
+int main(int argc, char* argv[])
+{
+    char dir_template[] = "/tmp/dccl_test_tool_threads.XXXXXX";
+    assert(mkdtemp(dir_template));
+    const std::string dir = dir_template;
+    const std::string input_path = dir + "/input.txt";
+    const std::string encoded_path = dir + "/encoded.hex";
+    const std::string dccl = std::string(DCCL_TOOL) + " -l " + DCCL_TEST_LIB + " -m dccl.test.ToolThreadsMsg --format hex";
+
+    // skewed, so that the adaptive model moves away from its initial frequencies
+    std::string input;
+    {
+        srand(1);
+        for(int i = 0; i < NUM_MESSAGES; ++i)
+        {
+            ToolThreadsMsg msg;
+            msg.set_count(i % 1000);
+            for(int j = 0, n = rand() % 9; j < n; ++j)
+                msg.add_depth(rand() % 4 ? 2 : rand() % 9);
+            input += msg.ShortDebugString() + "\n";
+        }
+        std::ofstream out(input_path.c_str());
+        out << input;
+    }
+
+    int status = 0;
+    const std::string encoded = run(dccl + " -e -j 1 < " + input_path, &status);
+    assert(status == 0);
+    assert(std::count(encoded.begin(), encoded.end(), '\n') == NUM_MESSAGES);
+    {
+        std::ofstream out(encoded_path.c_str());
+        out << encoded;
+    }
+
+    // encoded in order on one thread, rather than concurrently on the four
+    std::string notice = run(dccl + " -e -j 4 < " + input_path + " 2>&1 >/dev/null", &status);
+    std::cout << notice;
+    assert(status == 0);
+    assert(notice.find("Using one thread") != std::string::npos);
+    
+    assert(run(dccl + " -e -j 4 < " + input_path + " 2>/dev/null", &status) == encoded);
+    assert(status == 0);
+
+    // decoded once each (rather than also on the reading thread to find the end of the message)
+    assert(run(dccl + " -d -o -j 1 < " + encoded_path, &status) == input);
+    assert(status == 0);
+    assert(run(dccl + " -d -o -j 4 < " + encoded_path + " 2>/dev/null", &status) == input);
+    assert(status == 0);
+
+    unlink(input_path.c_str());
+    unlink(encoded_path.c_str());
+    rmdir(dir.c_str());
+
+    std::cout << "all tests passed" << std::endl;
+}